@@ -1,6 +1,8 @@
 // This code is in the public domain -- castano@gmail.com
 
 #include "FileSystem.h"
+#include "StrLib.h" // Path
+#include "Array.inl"
 
 #if NV_OS_WIN32
 #define _CRT_NONSTDC_NO_WARNINGS // _chdir is defined deprecated, but that's a bug, chdir is deprecated, _chdir is *not*.
@@ -15,8 +17,11 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <dirent.h> // opendir
 #endif
 #include <stdio.h> // remove, unlink
+#include <stdlib.h> // qsort
+#include <string.h> // strcmp
 
 using namespace nv;
 
@@ -46,6 +51,20 @@ bool FileSystem::exists(const char * path)
 #endif
 }
 
+bool FileSystem::isDirectory(const char * path)
+{
+#if NV_OS_WIN32 || NV_OS_XBOX
+    DWORD attributes = GetFileAttributesA(path);
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#elif NV_OS_ORBIS
+    // not implemented
+    return false;
+#else
+    struct stat buf;
+    return stat(path, &buf) == 0 && S_ISDIR(buf.st_mode);
+#endif
+}
+
 bool FileSystem::createDirectory(const char * path)
 {
 #if NV_OS_WIN32 || NV_OS_XBOX
@@ -78,3 +97,114 @@ bool FileSystem::removeFile(const char * path)
     // @@ Use unlink or remove?
     return remove(path) == 0;
 }
+
+uint64 FileSystem::lastModified(const char * path)
+{
+#if NV_OS_WIN32 || NV_OS_XBOX
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data)) {
+        return 0;
+    }
+    // FILETIME is in 100ns units.
+    uint64 time = (uint64(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+    return time / 10000000;
+#elif NV_OS_ORBIS
+    // not implemented
+    return 0;
+#else
+    struct stat buf;
+    if (stat(path, &buf) != 0) {
+        return 0;
+    }
+    return uint64(buf.st_mtime);
+#endif
+}
+
+bool FileSystem::fileStamp(const char * path, uint64 * modifiedTime, uint64 * size)
+{
+    nvDebugCheck(modifiedTime != NULL && size != NULL);
+#if NV_OS_WIN32 || NV_OS_XBOX
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data)) {
+        return false;
+    }
+    // FILETIME is in 100ns units.
+    *modifiedTime = ((uint64(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime) * 100;
+    *size = (uint64(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    return true;
+#elif NV_OS_ORBIS
+    // not implemented
+    return false;
+#else
+    struct stat buf;
+    if (stat(path, &buf) != 0) {
+        return false;
+    }
+#if NV_OS_DARWIN
+    *modifiedTime = uint64(buf.st_mtimespec.tv_sec) * 1000000000 + uint64(buf.st_mtimespec.tv_nsec);
+#else
+    *modifiedTime = uint64(buf.st_mtim.tv_sec) * 1000000000 + uint64(buf.st_mtim.tv_nsec);
+#endif
+    *size = uint64(buf.st_size);
+    return true;
+#endif
+}
+
+static int comparePaths(const void * a, const void * b)
+{
+    return strcmp(((const Path *)a)->str(), ((const Path *)b)->str());
+}
+
+bool FileSystem::listDirectory(const char * path, Array<Path> & fileNames)
+{
+    fileNames.clear();
+
+#if NV_OS_WIN32 || NV_OS_XBOX
+    Path pattern(path);
+    pattern.appendSeparator();
+    pattern.append("*");
+
+    WIN32_FIND_DATAA data;
+    HANDLE handle = FindFirstFileA(pattern.str(), &data);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    do {
+        if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+            fileNames.append(Path(data.cFileName));
+        }
+    } while (FindNextFileA(handle, &data));
+
+    FindClose(handle);
+#elif NV_OS_ORBIS
+    // not implemented
+    return false;
+#else
+    DIR * dir = opendir(path);
+    if (dir == NULL) {
+        return false;
+    }
+
+    Path fullPath;
+    while (dirent * entry = readdir(dir)) {
+        fullPath.copy(path);
+        fullPath.appendSeparator();
+        fullPath.append(entry->d_name);
+
+        struct stat buf;
+        if (stat(fullPath.str(), &buf) == 0 && !S_ISDIR(buf.st_mode)) {
+            fileNames.append(Path(entry->d_name));
+        }
+    }
+
+    closedir(dir);
+#endif
+
+    // Paths can be moved bitwise, so qsort is fine.
+    if (fileNames.count() > 1) {
+        qsort(fileNames.buffer(), fileNames.count(), sizeof(Path), comparePaths);
+    }
+
+    return true;
+}
@@ -8,14 +8,27 @@
 
 namespace nv
 {
+    template <typename T> class Array;
+    class Path;
 
     namespace FileSystem
     {
         NVCORE_API bool exists(const char * path);
+        NVCORE_API bool isDirectory(const char * path);
         NVCORE_API bool createDirectory(const char * path);
         NVCORE_API bool changeDirectory(const char * path);
         NVCORE_API bool removeFile(const char * path);
 
+        // Last modification time in seconds, 0 if the file does not exist or the platform does not support it.
+        NVCORE_API uint64 lastModified(const char * path);
+
+        // Modification time with the full resolution of the file system, in nanoseconds, and file size. Use both to
+        // detect changes, files rewritten within a second have the same lastModified time.
+        NVCORE_API bool fileStamp(const char * path, uint64 * modifiedTime, uint64 * size);
+
+        // Names of the files in a directory sorted by name, subdirectories are not included.
+        NVCORE_API bool listDirectory(const char * path, Array<Path> & fileNames);
+
     } // FileSystem namespace
 
 } // nv namespace
@@ -2,6 +2,7 @@
 
 #include "Memory.h"
 #include "Debug.h"
+#include "SpinLock.h"
 
 #include <stdlib.h>
 
@@ -117,3 +118,370 @@ void operator delete(void* p, const std::nothrow_t&) throw()
 #endif // NV_OVERRIDE_ALLOC
 
 
+
+
+// Buffer pool.
+
+#if NV_OS_WIN32
+#include <malloc.h> // _aligned_malloc, _aligned_free
+#elif NV_OS_USE_PTHREAD
+#include <pthread.h>
+#endif
+
+#if NV_OS_LINUX
+#include <sys/mman.h> // madvise
+#endif
+
+#include <string.h> // memset
+
+#if NV_OS_USE_PTHREAD
+#define NV_BUFFER_THREAD_CACHE 1
+#else
+#define NV_BUFFER_THREAD_CACHE 0
+#endif
+
+namespace
+{
+    // Sizes below 64 KB go straight to malloc. Each octave above that is split in 4 size classes, so that at most 25% of a buffer is wasted.
+    const uint s_minPooledSizeLog2 = 16;
+    const uint s_maxPooledSizeLog2 = 48;
+    const uint s_classesPerOctave = 4;
+    const uint s_classCount = (s_maxPooledSizeLog2 - s_minPooledSizeLog2) * s_classesPerOctave;
+
+    const size_t s_hugePageSize = 2 * 1024 * 1024;
+    const size_t s_cacheLineSize = 64;
+
+    struct FreeBlock
+    {
+        FreeBlock * next;
+    };
+
+    // The counters are only statistics, they don't order other memory operations.
+    struct PoolStats
+    {
+        std::atomic<uint64> allocatedBytes{0};
+        std::atomic<uint64> peakAllocatedBytes{0};
+        std::atomic<uint64> cachedBytes{0};
+        std::atomic<uint64> allocationCount{0};
+        std::atomic<uint64> reusedCount{0};
+    };
+
+    struct ThreadCache;
+
+    // All members are constant initialized, so the pool can be used during static initialization.
+    struct BufferPool
+    {
+        SpinLock lock;
+        FreeBlock * freeList[s_classCount] = {};
+        ThreadCache * threadCaches = NULL;  // Caches of the live threads, linked under the lock.
+        PoolStats stats;
+    };
+
+    BufferPool s_pool;
+    std::atomic<uint64> s_budget{256 * 1024 * 1024};
+    BufferAllocator * s_allocator = NULL;
+
+
+    // Return the size class of the given size, false if the size is not pooled.
+    bool sizeClass(size_t size, uint * index, size_t * classSize)
+    {
+        if (size < (size_t(1) << s_minPooledSizeLog2)) return false;
+
+        uint k = s_minPooledSizeLog2;
+        while ((size >> (k + 1)) != 0) k++;
+
+        const size_t base = size_t(1) << k;
+        const size_t step = base / s_classesPerOctave;
+        size_t j = (size - base + step - 1) / step;
+        if (j == s_classesPerOctave) {
+            k++;
+            j = 0;
+        }
+
+        const uint i = (k - s_minPooledSizeLog2) * s_classesPerOctave + uint(j);
+        if (i >= s_classCount) return false;
+
+        *index = i;
+        *classSize = (size_t(1) << k) + j * ((size_t(1) << k) / s_classesPerOctave);
+        return true;
+    }
+
+    void * systemAllocate(size_t size)
+    {
+        const size_t alignment = (size >= s_hugePageSize) ? s_hugePageSize : s_cacheLineSize;
+
+#if NV_OS_WIN32
+        return _aligned_malloc(size, alignment);
+#else
+        void * ptr = NULL;
+        if (posix_memalign(&ptr, alignment, size) != 0) {
+            return NULL;
+        }
+#if NV_OS_LINUX && defined(MADV_HUGEPAGE)
+        if (size >= s_hugePageSize) {
+            madvise(ptr, size, MADV_HUGEPAGE);
+        }
+#endif
+        return ptr;
+#endif
+    }
+
+    void systemFree(void * ptr)
+    {
+#if NV_OS_WIN32
+        _aligned_free(ptr);
+#else
+        ::free(ptr);
+#endif
+    }
+
+    void poolPush(uint index, void * ptr)
+    {
+        FreeBlock * block = (FreeBlock *)ptr;
+
+        s_pool.lock.lock();
+        block->next = s_pool.freeList[index];
+        s_pool.freeList[index] = block;
+        s_pool.lock.unlock();
+    }
+
+    void * poolPop(uint index)
+    {
+        s_pool.lock.lock();
+        FreeBlock * block = s_pool.freeList[index];
+        if (block != NULL) {
+            s_pool.freeList[index] = block->next;
+        }
+        s_pool.lock.unlock();
+
+        return block;
+    }
+
+    void addAllocatedBytes(uint64 size)
+    {
+        const uint64 allocated = s_pool.stats.allocatedBytes.fetch_add(size, std::memory_order_relaxed) + size;
+
+        uint64 peak = s_pool.stats.peakAllocatedBytes.load(std::memory_order_relaxed);
+        while (allocated > peak && !s_pool.stats.peakAllocatedBytes.compare_exchange_weak(peak, allocated, std::memory_order_relaxed)) {
+        }
+    }
+
+
+#if NV_BUFFER_THREAD_CACHE
+
+    // Each thread keeps the last released buffer of every size class. A slot is taken with an atomic exchange, so that
+    // purgeBufferPool can also empty the caches of threads that never exit, like the workers of a thread pool. Thread
+    // caches are flushed to the shared pool when the thread exits.
+    struct ThreadCache
+    {
+        ThreadCache() : prev(NULL), next(NULL) {
+            for (uint i = 0; i < s_classCount; i++) block[i].store(NULL, std::memory_order_relaxed);
+        }
+
+        std::atomic<void *> block[s_classCount];
+        ThreadCache * prev;
+        ThreadCache * next;
+    };
+
+    pthread_key_t s_threadCacheKey;
+    pthread_once_t s_threadCacheOnce = PTHREAD_ONCE_INIT;
+
+    extern "C" void releaseThreadCache(void * arg)
+    {
+        ThreadCache * cache = (ThreadCache *)arg;
+
+        s_pool.lock.lock();
+        if (cache->prev != NULL) cache->prev->next = cache->next;
+        else s_pool.threadCaches = cache->next;
+        if (cache->next != NULL) cache->next->prev = cache->prev;
+        s_pool.lock.unlock();
+
+        for (uint i = 0; i < s_classCount; i++) {
+            void * block = cache->block[i].exchange(NULL, std::memory_order_acquire);
+            if (block != NULL) {
+                poolPush(i, block);
+            }
+        }
+
+        delete cache;
+    }
+
+    extern "C" void initThreadCacheKey()
+    {
+        pthread_key_create(&s_threadCacheKey, releaseThreadCache);
+    }
+
+    ThreadCache * threadCache()
+    {
+        pthread_once(&s_threadCacheOnce, initThreadCacheKey);
+
+        ThreadCache * cache = (ThreadCache *)pthread_getspecific(s_threadCacheKey);
+        if (cache == NULL) {
+            cache = new ThreadCache;
+            if (pthread_setspecific(s_threadCacheKey, cache) != 0) {
+                delete cache;
+                return NULL;
+            }
+
+            s_pool.lock.lock();
+            cache->next = s_pool.threadCaches;
+            if (cache->next != NULL) cache->next->prev = cache;
+            s_pool.threadCaches = cache;
+            s_pool.lock.unlock();
+        }
+        return cache;
+    }
+
+#endif // NV_BUFFER_THREAD_CACHE
+
+} // namespace
+
+
+void * nv::allocateBuffer(size_t size)
+{
+    if (s_allocator != NULL) {
+        return s_allocator->allocate(size);
+    }
+
+    s_pool.stats.allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+    uint index;
+    size_t classSize;
+    if (!sizeClass(size, &index, &classSize)) {
+        addAllocatedBytes(size);
+        return ::malloc(size);
+    }
+
+    void * ptr = NULL;
+
+#if NV_BUFFER_THREAD_CACHE
+    ThreadCache * cache = threadCache();
+    if (cache != NULL && cache->block[index].load(std::memory_order_relaxed) != NULL) {
+        ptr = cache->block[index].exchange(NULL, std::memory_order_acquire);
+    }
+#endif
+
+    if (ptr == NULL) {
+        ptr = poolPop(index);
+    }
+
+    if (ptr != NULL) {
+        s_pool.stats.cachedBytes.fetch_sub(classSize, std::memory_order_relaxed);
+        s_pool.stats.reusedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+        ptr = systemAllocate(classSize);
+        if (ptr == NULL) return NULL;
+    }
+
+    addAllocatedBytes(classSize);
+
+    return ptr;
+}
+
+void nv::freeBuffer(void * ptr, size_t size)
+{
+    if (ptr == NULL) return;
+
+    if (s_allocator != NULL) {
+        s_allocator->free(ptr, size);
+        return;
+    }
+
+    uint index;
+    size_t classSize;
+    if (!sizeClass(size, &index, &classSize)) {
+        s_pool.stats.allocatedBytes.fetch_sub(size, std::memory_order_relaxed);
+        ::free(ptr);
+        return;
+    }
+
+    s_pool.stats.allocatedBytes.fetch_sub(classSize, std::memory_order_relaxed);
+
+    // Release to the system when over budget.
+    if (s_pool.stats.cachedBytes.fetch_add(classSize, std::memory_order_relaxed) + classSize > s_budget.load(std::memory_order_relaxed)) {
+        s_pool.stats.cachedBytes.fetch_sub(classSize, std::memory_order_relaxed);
+        systemFree(ptr);
+        return;
+    }
+
+#if NV_BUFFER_THREAD_CACHE
+    ThreadCache * cache = threadCache();
+    void * empty = NULL;
+    if (cache != NULL && cache->block[index].compare_exchange_strong(empty, ptr, std::memory_order_release, std::memory_order_relaxed)) {
+        return;
+    }
+#endif
+
+    poolPush(index, ptr);
+}
+
+void nv::setBufferAllocator(BufferAllocator * allocator)
+{
+    s_allocator = allocator;
+}
+
+void nv::setBufferPoolBudget(size_t maxCachedBytes)
+{
+    s_budget.store(maxCachedBytes, std::memory_order_relaxed);
+
+    if (s_pool.stats.cachedBytes.load(std::memory_order_relaxed) > maxCachedBytes) {
+        purgeBufferPool();
+    }
+}
+
+size_t nv::bufferPoolBudget()
+{
+    return size_t(s_budget.load(std::memory_order_relaxed));
+}
+
+void nv::purgeBufferPool()
+{
+    FreeBlock * freeList[s_classCount];
+
+    s_pool.lock.lock();
+    memcpy(freeList, s_pool.freeList, sizeof(freeList));
+    memset(s_pool.freeList, 0, sizeof(s_pool.freeList));
+
+#if NV_BUFFER_THREAD_CACHE
+    // Threads that are still alive might never touch their caches again.
+    for (ThreadCache * cache = s_pool.threadCaches; cache != NULL; cache = cache->next) {
+        for (uint i = 0; i < s_classCount; i++) {
+            FreeBlock * block = (FreeBlock *)cache->block[i].exchange(NULL, std::memory_order_acquire);
+            if (block != NULL) {
+                block->next = freeList[i];
+                freeList[i] = block;
+            }
+        }
+    }
+#endif
+
+    s_pool.lock.unlock();
+
+    for (uint i = 0; i < s_classCount; i++) {
+        const size_t classSize = (size_t(1) << (s_minPooledSizeLog2 + i / s_classesPerOctave)) / s_classesPerOctave * (s_classesPerOctave + i % s_classesPerOctave);
+
+        FreeBlock * block = freeList[i];
+        while (block != NULL) {
+            FreeBlock * next = block->next;
+            systemFree(block);
+            s_pool.stats.cachedBytes.fetch_sub(classSize, std::memory_order_relaxed);
+            block = next;
+        }
+    }
+}
+
+void nv::getBufferStats(BufferStats * stats)
+{
+    // Each counter is read atomically, the snapshot as a whole is not.
+    stats->allocatedBytes = s_pool.stats.allocatedBytes.load(std::memory_order_relaxed);
+    stats->peakAllocatedBytes = s_pool.stats.peakAllocatedBytes.load(std::memory_order_relaxed);
+    stats->cachedBytes = s_pool.stats.cachedBytes.load(std::memory_order_relaxed);
+    stats->allocationCount = s_pool.stats.allocationCount.load(std::memory_order_relaxed);
+    stats->reusedCount = s_pool.stats.reusedCount.load(std::memory_order_relaxed);
+}
+
+void nv::resetBufferPeak()
+{
+    s_pool.stats.peakAllocatedBytes.store(s_pool.stats.allocatedBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
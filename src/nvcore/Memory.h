@@ -59,6 +59,54 @@ namespace nv {
         memset(&data, 0, sizeof(T));
     }
 
+
+    // Large buffer allocation. Image planes and per-level scratch buffers are allocated and released at a high 
+    // rate with the same handful of sizes. By default these go through a size-class pool that keeps released 
+    // buffers around (up to a budget) with a small per-thread cache in front of it. Large buffers are aligned to 
+    // 2 MB so that they can be backed by huge pages. Small requests are forwarded to malloc.
+
+    // Allocator interface. The size is passed to free() as well, so that implementations do not need headers.
+    class NVCORE_CLASS BufferAllocator
+    {
+    public:
+        virtual ~BufferAllocator() {}
+        virtual void * allocate(size_t size) = 0;
+        virtual void free(void * ptr, size_t size) = 0;
+    };
+
+    struct BufferStats
+    {
+        uint64 allocatedBytes;      // Bytes currently handed out.
+        uint64 peakAllocatedBytes;  // High water mark of allocatedBytes.
+        uint64 cachedBytes;         // Bytes held by the pool, ready to be reused.
+        uint64 allocationCount;     // Total number of allocations.
+        uint64 reusedCount;         // Allocations served by the pool without calling the system allocator.
+    };
+
+    NVCORE_API void * allocateBuffer(size_t size);
+    NVCORE_API void freeBuffer(void * ptr, size_t size);
+
+    // Replace the default pool. Pass NULL to restore it. Buffers must be released by the allocator that created them, so only change this while no buffers are alive.
+    NVCORE_API void setBufferAllocator(BufferAllocator * allocator);
+
+    // Maximum number of bytes the default pool keeps cached. Defaults to 256 MB. Zero disables pooling.
+    NVCORE_API void setBufferPoolBudget(size_t maxCachedBytes);
+    NVCORE_API size_t bufferPoolBudget();
+
+    // Release the cached buffers of the default pool, including the ones in the per-thread caches.
+    NVCORE_API void purgeBufferPool();
+
+    NVCORE_API void getBufferStats(BufferStats * stats);
+    NVCORE_API void resetBufferPeak();
+
+    template <typename T> NV_FORCEINLINE T * allocateBuffer(size_t count) {
+        return (T *)allocateBuffer(sizeof(T) * count);
+    }
+
+    template <typename T> NV_FORCEINLINE void freeBuffer(T * ptr, size_t count) {
+        freeBuffer((void *)ptr, sizeof(T) * count);
+    }
+
 } // nv namespace
 
 #endif // NV_CORE_MEMORY_H
@@ -0,0 +1,292 @@
+// This code is in the public domain -- castano@gmail.com
+
+#include "Profiler.h"
+#include "Debug.h"
+#include "SpinLock.h"
+
+#if !NV_OS_HAS_TLS_QUALIFIER
+#include <pthread.h>
+#endif
+
+#include <string.h> // strcmp, memset
+
+using namespace nv;
+
+volatile bool nv::g_profilerEnabled = false;
+
+namespace
+{
+    struct ThreadBuffer
+    {
+        uint64 callCount[ProfilerMaxZones];
+        uint64 itemCount[ProfilerMaxZones];
+        uint64 totalTicks[ProfilerMaxZones];
+        uint64 selfTicks[ProfilerMaxZones];
+
+        uint64 busyTicks;
+        uint64 outerCallCount;
+
+        // Ticks spent in the children of each open zone.
+        int depth;
+        uint64 childTicks[ProfilerMaxDepth];
+    };
+
+    // Zone names are only written under the lock, zone count is only incremented after the name is written.
+    const char * s_zoneNames[ProfilerMaxZones];
+    std::atomic<int> s_zoneCount{0};
+    SpinLock s_zoneLock;
+
+    // Thread buffers are never released, so the stats of threads that have exited are still reported.
+    ThreadBuffer * s_threadBuffers[ProfilerMaxThreads];
+    std::atomic<int> s_threadCount{0};
+
+    // Threads that exceed the limit are not profiled. They are marked with this buffer, which is never written.
+    ThreadBuffer s_overflowBuffer;
+
+    uint64 s_startTicks = 0;
+    uint64 s_stopTicks = 0;
+    uint64 s_startClock = 0;
+
+    // Use the time stamp counter when available, it's much cheaper than the system clock.
+    inline uint64 profilerClock()
+    {
+#if NV_CPU_X86 || NV_CPU_X86_64
+        return fastCpuClock();
+#else
+        return systemClock();
+#endif
+    }
+
+    ThreadBuffer * createThreadBuffer()
+    {
+        const int index = s_threadCount.fetch_add(1);
+        if (index >= ProfilerMaxThreads) {
+            return &s_overflowBuffer;
+        }
+
+        ThreadBuffer * buffer = new ThreadBuffer;
+        memset(buffer, 0, sizeof(ThreadBuffer));
+        s_threadBuffers[index] = buffer;
+        return buffer;
+    }
+
+#if NV_OS_HAS_TLS_QUALIFIER
+    NV_THREAD_LOCAL ThreadBuffer * s_threadBuffer = NULL;
+
+    inline ThreadBuffer * threadBuffer()
+    {
+        if (s_threadBuffer == NULL) s_threadBuffer = createThreadBuffer();
+        return s_threadBuffer != &s_overflowBuffer ? s_threadBuffer : NULL;
+    }
+#else
+    pthread_key_t s_threadBufferKey;
+    pthread_once_t s_threadBufferKeyOnce = PTHREAD_ONCE_INIT;
+
+    void createThreadBufferKey()
+    {
+        pthread_key_create(&s_threadBufferKey, NULL);
+    }
+
+    inline ThreadBuffer * threadBuffer()
+    {
+        pthread_once(&s_threadBufferKeyOnce, createThreadBufferKey);
+        ThreadBuffer * buffer = (ThreadBuffer *)pthread_getspecific(s_threadBufferKey);
+        if (buffer == NULL) {
+            buffer = createThreadBuffer();
+            pthread_setspecific(s_threadBufferKey, buffer);
+        }
+        return buffer != &s_overflowBuffer ? buffer : NULL;
+    }
+#endif
+
+    inline int threadBufferCount()
+    {
+        int count = s_threadCount.load();
+        return count < ProfilerMaxThreads ? count : ProfilerMaxThreads;
+    }
+
+    // Estimate the frequency of the profiler clock against the system clock.
+    double ticksPerSecond()
+    {
+#if NV_CPU_X86 || NV_CPU_X86_64
+        const uint64 clockFrequency = systemClockFrequency();
+
+        // Make sure the calibration interval is long enough to be accurate.
+        uint64 clock = systemClock();
+        if (s_startClock == 0 || clock - s_startClock < clockFrequency / 100) {
+            uint64 startClock = clock;
+            uint64 startTicks = profilerClock();
+            do { clock = systemClock(); } while (clock - startClock < clockFrequency / 100);
+            return double(profilerClock() - startTicks) * clockFrequency / double(clock - startClock);
+        }
+
+        uint64 ticks = profilerClock();
+        return double(ticks - s_startTicks) * clockFrequency / double(clock - s_startClock);
+#else
+        return double(systemClockFrequency());
+#endif
+    }
+
+} // namespace
+
+
+int nv::profilerZone(const char * name)
+{
+    nvDebugCheck(name != NULL);
+
+    s_zoneLock.lock();
+
+    const int zoneCount = s_zoneCount.load(std::memory_order_relaxed);
+
+    int zone = -1;
+    for (int i = 0; i < zoneCount; i++) {
+        if (strcmp(s_zoneNames[i], name) == 0) {
+            zone = i;
+            break;
+        }
+    }
+
+    if (zone < 0 && zoneCount < ProfilerMaxZones) {
+        zone = zoneCount;
+        s_zoneNames[zone] = name;
+        s_zoneCount.store(zone + 1, std::memory_order_release);
+    }
+
+    s_zoneLock.unlock();
+
+    return zone;
+}
+
+void nv::profilerEnable(bool enable)
+{
+    if (enable == g_profilerEnabled) return;
+
+    if (enable) {
+        s_startClock = systemClock();
+        s_startTicks = profilerClock();
+    }
+    else {
+        s_stopTicks = profilerClock();
+    }
+
+    g_profilerEnabled = enable;
+}
+
+void nv::profilerReset()
+{
+    const int threadCount = threadBufferCount();
+    for (int i = 0; i < threadCount; i++) {
+        ThreadBuffer * buffer = s_threadBuffers[i];
+        if (buffer == NULL) continue;
+
+        // Keep the nesting state of the thread, the caller might be inside a zone.
+        int depth = buffer->depth;
+        memset(buffer, 0, sizeof(ThreadBuffer));
+        buffer->depth = depth;
+    }
+
+    s_startClock = systemClock();
+    s_startTicks = profilerClock();
+    s_stopTicks = s_startTicks;
+}
+
+double nv::profilerElapsedTime()
+{
+    if (s_startClock == 0) return 0.0;
+
+    uint64 ticks = g_profilerEnabled ? profilerClock() : s_stopTicks;
+    return double(ticks - s_startTicks) / ticksPerSecond();
+}
+
+int nv::profilerZoneCount()
+{
+    return s_zoneCount;
+}
+
+void nv::profilerZoneStats(int zone, ProfileZoneStats * stats)
+{
+    nvDebugCheck(zone >= 0 && zone < s_zoneCount);
+    nvDebugCheck(stats != NULL);
+
+    uint64 callCount = 0, itemCount = 0, totalTicks = 0, selfTicks = 0;
+
+    const int threadCount = threadBufferCount();
+    for (int i = 0; i < threadCount; i++) {
+        const ThreadBuffer * buffer = s_threadBuffers[i];
+        if (buffer == NULL) continue;
+
+        callCount += buffer->callCount[zone];
+        itemCount += buffer->itemCount[zone];
+        totalTicks += buffer->totalTicks[zone];
+        selfTicks += buffer->selfTicks[zone];
+    }
+
+    const double frequency = ticksPerSecond();
+
+    stats->name = s_zoneNames[zone];
+    stats->callCount = callCount;
+    stats->itemCount = itemCount;
+    stats->totalTime = double(totalTicks) / frequency;
+    stats->selfTime = double(selfTicks) / frequency;
+}
+
+int nv::profilerThreadCount()
+{
+    return threadBufferCount();
+}
+
+void nv::profilerThreadStats(int thread, ProfileThreadStats * stats)
+{
+    nvDebugCheck(thread >= 0 && thread < threadBufferCount());
+    nvDebugCheck(stats != NULL);
+
+    const ThreadBuffer * buffer = s_threadBuffers[thread];
+    if (buffer == NULL) {
+        // The thread has been counted, but its buffer is not published yet.
+        stats->busyTime = 0.0;
+        stats->callCount = 0;
+        return;
+    }
+
+    stats->busyTime = double(buffer->busyTicks) / ticksPerSecond();
+    stats->callCount = buffer->outerCallCount;
+}
+
+uint64 nv::profilerBegin()
+{
+    ThreadBuffer * buffer = threadBuffer();
+
+    if (buffer != NULL) {
+        if (buffer->depth >= 0 && buffer->depth < ProfilerMaxDepth) buffer->childTicks[buffer->depth] = 0;
+        buffer->depth++;
+    }
+
+    return profilerClock();
+}
+
+void nv::profilerEnd(int zone, uint64 start, uint64 itemCount)
+{
+    const uint64 ticks = profilerClock() - start;
+
+    ThreadBuffer * buffer = threadBuffer();
+    if (buffer == NULL) return;
+
+    nvDebugCheck(buffer->depth > 0);
+    if (buffer->depth <= 0) return;
+
+    const int depth = --buffer->depth;
+    const uint64 childTicks = depth < ProfilerMaxDepth ? buffer->childTicks[depth] : 0;
+
+    buffer->callCount[zone]++;
+    buffer->itemCount[zone] += itemCount;
+    buffer->totalTicks[zone] += ticks;
+    buffer->selfTicks[zone] += ticks > childTicks ? ticks - childTicks : 0;
+
+    if (depth > 0) {
+        if (depth <= ProfilerMaxDepth) buffer->childTicks[depth - 1] += ticks;
+    }
+    else {
+        buffer->busyTicks += ticks;
+        buffer->outerCallCount++;
+    }
+}
@@ -0,0 +1,103 @@
+// This code is in the public domain -- castano@gmail.com
+
+#pragma once
+#ifndef NV_CORE_PROFILER_H
+#define NV_CORE_PROFILER_H
+
+#include "nvcore.h"
+#include "Timer.h"
+
+// Lightweight instrumentation.
+//
+// Zones are registered once by name and every thread accumulates call counts, ticks and item counts in its own
+// buffer, so entering and leaving a zone never takes a lock. Nested zones are tracked per thread: the total time of
+// a zone includes the zones opened inside of it, the self time does not.
+//
+// Profiling is disabled by default. A disabled zone costs a load and a branch.
+
+namespace nv
+{
+    const int ProfilerMaxZones = 64;
+    const int ProfilerMaxThreads = 256;
+    const int ProfilerMaxDepth = 32;
+
+    struct ProfileZoneStats
+    {
+        const char * name;
+        uint64 callCount;
+        uint64 itemCount;
+        double totalTime;   // Seconds, including nested zones.
+        double selfTime;    // Seconds, excluding nested zones.
+    };
+
+    struct ProfileThreadStats
+    {
+        double busyTime;    // Seconds spent in outermost zones.
+        uint64 callCount;
+    };
+
+    extern NVCORE_API volatile bool g_profilerEnabled;
+
+    inline bool profilerIsEnabled() { return g_profilerEnabled; }
+
+    // Register a zone and return its id. Registering the same name twice returns the same id. Returns -1 when there
+    // are no zones left.
+    NVCORE_API int profilerZone(const char * name);
+
+    // Enabling the profiler restarts the elapsed time clock, but does not clear the accumulated counters.
+    NVCORE_API void profilerEnable(bool enable);
+
+    // Clear all counters. Must not be called while other threads are inside a zone.
+    NVCORE_API void profilerReset();
+
+    NVCORE_API double profilerElapsedTime();
+
+    NVCORE_API int profilerZoneCount();
+    NVCORE_API void profilerZoneStats(int zone, ProfileZoneStats * stats);
+
+    NVCORE_API int profilerThreadCount();
+    NVCORE_API void profilerThreadStats(int thread, ProfileThreadStats * stats);
+
+    // Each thread gets a buffer the first time it enters a zone. Buffers are not recycled, so after ProfilerMaxThreads
+    // threads have entered a zone, the zones of new threads are not recorded.
+    NVCORE_API uint64 profilerBegin();
+    NVCORE_API void profilerEnd(int zone, uint64 start, uint64 itemCount);
+
+
+    class ProfileScope
+    {
+        NV_FORBID_COPY(ProfileScope);
+    public:
+        NV_FORCEINLINE ProfileScope(int zone, uint64 itemCount = 0) : m_zone(-1), m_start(0), m_itemCount(itemCount)
+        {
+            if (g_profilerEnabled && zone >= 0) {
+                m_zone = zone;
+                m_start = profilerBegin();
+            }
+        }
+
+        NV_FORCEINLINE ~ProfileScope()
+        {
+            if (m_zone >= 0) profilerEnd(m_zone, m_start, m_itemCount);
+        }
+
+        void setItemCount(uint64 itemCount) { m_itemCount = itemCount; }
+
+    private:
+        int m_zone;
+        uint64 m_start;
+        uint64 m_itemCount;
+    };
+
+} // nv namespace
+
+
+#define NV_PROFILE_ZONE(name) \
+    static const int NV_STRING_JOIN2(nv_profile_zone_, __LINE__) = nv::profilerZone(name); \
+    nv::ProfileScope NV_STRING_JOIN2(nv_profile_scope_, __LINE__)(NV_STRING_JOIN2(nv_profile_zone_, __LINE__))
+
+#define NV_PROFILE_ZONE_ITEMS(name, itemCount) \
+    static const int NV_STRING_JOIN2(nv_profile_zone_, __LINE__) = nv::profilerZone(name); \
+    nv::ProfileScope NV_STRING_JOIN2(nv_profile_scope_, __LINE__)(NV_STRING_JOIN2(nv_profile_zone_, __LINE__), itemCount)
+
+#endif // NV_CORE_PROFILER_H
@@ -0,0 +1,28 @@
+// This code is in the public domain -- castano@gmail.com
+
+#pragma once
+#ifndef NV_CORE_SPINLOCK_H
+#define NV_CORE_SPINLOCK_H
+
+#include "nvcore.h"
+
+#include <atomic>
+#include <thread> // std::this_thread::yield
+
+namespace nv
+{
+    // For locks that are only held for a few instructions. The lock is constant initialized, so spin locks with static
+    // storage can be used during static initialization.
+    struct SpinLock
+    {
+        void lock() {
+            while (flag.test_and_set(std::memory_order_acquire)) std::this_thread::yield();
+        }
+        void unlock() { flag.clear(std::memory_order_release); }
+
+        std::atomic_flag flag = ATOMIC_FLAG_INIT;
+    };
+
+} // nv namespace
+
+#endif // NV_CORE_SPINLOCK_H
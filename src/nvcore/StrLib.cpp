@@ -570,7 +570,7 @@ void Path::appendSeparator(char pathSeparator/*=NV_PATH_SEPARATOR*/)
 
     const uint l = length();
     
-    if (m_str[l] != '\\' && m_str[l] != '/') {
+    if (l == 0 || (m_str[l-1] != '\\' && m_str[l-1] != '/')) {
         char separatorString[] = { pathSeparator, '\0' };
         append(separatorString);
     }
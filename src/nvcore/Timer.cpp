@@ -29,16 +29,39 @@ uint64 nv::systemClock()
 
 #else
 
-#include <time.h> // clock
+#include <time.h> // clock_gettime
+#include <sys/time.h> // gettimeofday
+
+// Use wall clock time, clock() measures the CPU time of all threads of the process.
+
+#if defined(CLOCK_MONOTONIC)
+
+uint64 nv::systemClockFrequency()
+{
+    return 1000000000;
+}
+
+uint64 nv::systemClock()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+#else
 
 uint64 nv::systemClockFrequency()
 {
-    return CLOCKS_PER_SEC;
+    return 1000000;
 }
 
 uint64 nv::systemClock()
 {
-    return clock();
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return uint64(tv.tv_sec) * 1000000 + tv.tv_usec;
 }
 
 #endif
+
+#endif
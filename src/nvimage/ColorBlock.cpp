@@ -91,8 +91,15 @@ void ColorBlock::init(uint w, uint h, const uint * data, uint x, uint y)
 }
 
 void ColorBlock::init(uint w, uint h, const float * data, uint x, uint y)
+{
+    init(w, h, 1, data, x, y, 0);
+}
+
+// Init from a slice of a volume. The channels of data are w * h * d floats apart.
+void ColorBlock::init(uint w, uint h, uint d, const float * data, uint x, uint y, uint z)
 {
     nvDebugCheck(data != NULL);
+    nvDebugCheck(z < d);
 
     const uint bw = min(w - x, 4U);
     const uint bh = min(h - y, 4U);
@@ -102,7 +109,8 @@ void ColorBlock::init(uint w, uint h, const float * data, uint x, uint y)
     // @@ Thats only correct when block size is 1, 2 or 4, but not with 3. :(
     // @@ Ideally we should zero the weights of the pixels out of range.
 
-    uint srcPlane = w * h;
+    const uint srcPlane = w * h * d;
+    data += z * w * h;
 
     for (uint i = 0; i < 4; i++)
     {
@@ -480,7 +488,13 @@ void ColorSet::allocate(uint w, uint h)
 // Allocate 4x4 block and fill with 
 void ColorSet::setColors(const float * data, uint img_w, uint img_h, uint img_x, uint img_y)
 {
-    nvDebugCheck(img_x < img_w && img_y < img_h);
+    setColors(data, img_w, img_h, 1, img_x, img_y, 0);
+}
+
+// Set the colors of a block of a volume slice. The channels of data are img_w * img_h * img_d floats apart.
+void ColorSet::setColors(const float * data, uint img_w, uint img_h, uint img_d, uint img_x, uint img_y, uint img_z)
+{
+    nvDebugCheck(img_x < img_w && img_y < img_h && img_z < img_d);
 
     const uint block_w = min(4U, img_w - img_x);
     const uint block_h = min(4U, img_h - img_y);
@@ -488,10 +502,13 @@ void ColorSet::setColors(const float * data, uint img_w, uint img_h, uint img_x,
 
     allocate(block_w, block_h);
 
-    const float * r = data + img_w * img_h * 0;
-    const float * g = data + img_w * img_h * 1;
-    const float * b = data + img_w * img_h * 2;
-    const float * a = data + img_w * img_h * 3;
+    const uint plane = img_w * img_h * img_d;
+    data += img_z * img_w * img_h;
+
+    const float * r = data + plane * 0;
+    const float * g = data + plane * 1;
+    const float * b = data + plane * 2;
+    const float * a = data + plane * 3;
 
     // Set colors.
     for (uint y = 0, i = 0; y < block_h; y++)
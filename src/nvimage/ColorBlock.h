@@ -24,6 +24,7 @@ namespace nv
         void init(const Image * img, uint x, uint y);
         void init(uint w, uint h, const uint * data, uint x, uint y);
         void init(uint w, uint h, const float * data, uint x, uint y);
+        void init(uint w, uint h, uint d, const float * data, uint x, uint y, uint z);
 
         void swizzle(uint x, uint y, uint z, uint w); // 0=r, 1=g, 2=b, 3=a, 4=0xFF, 5=0
 
@@ -90,6 +91,7 @@ namespace nv
         void allocate(uint w, uint h);
 
         void setColors(const float * data, uint img_w, uint img_h, uint img_x, uint img_y);
+        void setColors(const float * data, uint img_w, uint img_h, uint img_d, uint img_x, uint img_y, uint img_z);
         void setColors(const Vector3 colors[16], const float weights[16]);
         void setColors(const Vector4 colors[16], const float weights[16]);
 
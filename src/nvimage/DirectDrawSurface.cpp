@@ -30,7 +30,9 @@
 #include "nvcore/Debug.h"
 #include "nvcore/Utils.h" // max
 #include "nvcore/StdStream.h"
+#include "nvcore/Memory.h" // malloc, free
 #include "nvmath/Vector.inl"
+#include "nvthread/ParallelFor.h"
 
 #include <string.h> // memset
 
@@ -585,6 +587,13 @@ void DDSHeader::setTextureCube()
     this->header10.arraySize = 1;
 }
 
+void DDSHeader::setTexture2DArray(uint arraySize)
+{
+    this->header10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+    this->header10.miscFlag = 0;
+    this->header10.arraySize = arraySize;
+}
+
 void DDSHeader::setLinearSize(uint size)
 {
     this->flags &= ~DDSD_PITCH;
@@ -1288,6 +1297,43 @@ void DirectDrawSurface::readLinearImage(Image * img)
     }
 }
 
+static void decodeBlock(const DDSHeader & header, Stream & stream, ColorBlock * rgba);
+
+struct BlockImageContext {
+    const DDSHeader * header;
+    const uint8 * data;
+    uint blockSize;
+    uint blockWidth;
+    Image * img;
+};
+
+// Each task decodes a row of blocks from the surface data in memory.
+static void BlockImageTask(void * context, int by)
+{
+    BlockImageContext * ctx = (BlockImageContext *)context;
+    Image * img = ctx->img;
+
+    const uint w = img->width();
+    const uint h = img->height();
+    const uint rowSize = ctx->blockSize * ctx->blockWidth;
+
+    MemoryInputStream stream(ctx->data + by * rowSize, rowSize);
+
+    for (uint bx = 0; bx < ctx->blockWidth; bx++)
+    {
+        ColorBlock block;
+        decodeBlock(*ctx->header, stream, &block);
+
+        for (uint y = 0; y < min(4U, h-4*by); y++)
+        {
+            for (uint x = 0; x < min(4U, w-4*bx); x++)
+            {
+                img->pixel(4*bx+x, 4*by+y) = block.color(x, y);
+            }
+        }
+    }
+}
+
 void DirectDrawSurface::readBlockImage(Image * img)
 {
     nvDebugCheck(stream != NULL);
@@ -1299,6 +1345,31 @@ void DirectDrawSurface::readBlockImage(Image * img)
     const uint bw = (w + 3) / 4;
     const uint bh = (h + 3) / 4;
 
+    const uint blockSize = header.blockSize();
+
+    if (blockSize != 0)
+    {
+        // Read the whole surface at once and decode the rows of blocks in parallel.
+        const uint size = blockSize * bw * bh;
+        uint8 * data = malloc<uint8>(size);
+
+        const uint readSize = stream->serialize(data, size);
+        if (readSize < size) memset(data + readSize, 0, size - readSize);
+
+        BlockImageContext context;
+        context.header = &header;
+        context.data = data;
+        context.blockSize = blockSize;
+        context.blockWidth = bw;
+        context.img = img;
+
+        ParallelFor parallelFor(BlockImageTask, &context);
+        parallelFor.run(bh);
+
+        free(data);
+        return;
+    }
+
     for (uint by = 0; by < bh; by++)
     {
         for (uint bx = 0; bx < bw; bx++)
@@ -1335,6 +1406,11 @@ static Color32 buildNormal(uint8 x, uint8 y)
 void DirectDrawSurface::readBlock(ColorBlock * rgba)
 {
     nvDebugCheck(stream != NULL);
+    decodeBlock(header, *stream, rgba);
+}
+
+static void decodeBlock(const DDSHeader & header, Stream & stream, ColorBlock * rgba)
+{
     nvDebugCheck(rgba != NULL);
 
     uint fourcc = header.pf.fourcc;
@@ -1352,19 +1428,19 @@ void DirectDrawSurface::readBlock(ColorBlock * rgba)
     if (fourcc == FOURCC_DXT1)
     {
         BlockDXT1 block;
-        *stream << block;
+        stream << block;
         block.decodeBlock(rgba);
     }
     else if (fourcc == FOURCC_DXT2 || fourcc == FOURCC_DXT3)
     {
         BlockDXT3 block;
-        *stream << block;
+        stream << block;
         block.decodeBlock(rgba);
     }
     else if (fourcc == FOURCC_DXT4 || fourcc == FOURCC_DXT5 || fourcc == FOURCC_RXGB)
     {
         BlockDXT5 block;
-        *stream << block;
+        stream << block;
         block.decodeBlock(rgba);
 
         if (fourcc == FOURCC_RXGB)
@@ -1382,19 +1458,19 @@ void DirectDrawSurface::readBlock(ColorBlock * rgba)
     else if (fourcc == FOURCC_ATI1)
     {
         BlockATI1 block;
-        *stream << block;
+        stream << block;
         block.decodeBlock(rgba);
     }
     else if (fourcc == FOURCC_ATI2)
     {
         BlockATI2 block;
-        *stream << block;
+        stream << block;
         block.decodeBlock(rgba);
     }
     else if (header.hasDX10Header() && header.header10.dxgiFormat == DXGI_FORMAT_BC6H_UF16)
     {
         BlockBC6 block;
-        *stream << block;
+        stream << block;
         ColorSet set;
         block.decodeBlock(&set);
 
@@ -1415,7 +1491,7 @@ void DirectDrawSurface::readBlock(ColorBlock * rgba)
     else if (header.hasDX10Header() && header.header10.dxgiFormat == DXGI_FORMAT_BC7_UNORM)
     {
         BlockBC7 block;
-        *stream << block;
+        stream << block;
         block.decodeBlock(rgba);
     }
     else
@@ -39,6 +39,7 @@
 #include "nvcore/Utils.h" // swap
 
 #include <string.h> // memset
+#include <math.h> // sqrt
 
 using namespace nv;
 
@@ -558,6 +559,96 @@ void Kernel2::initBlendedSobel(const Vector4 & scale)
 }
 
 
+// Each term is found with power iterations on the residual, which converge to its largest singular value and vectors.
+// Terms are extracted until the residual falls below the tolerance, relative to the norm of the kernel.
+uint Kernel2::separate(float * columns, float * rows, uint maxTerms, float tolerance/*= 1e-5f*/) const
+{
+    const uint n = m_windowSize;
+
+    double * residual = new double[n * n];
+    double * u = new double[n];
+    double * v = new double[n];
+
+    double norm = 0.0;
+    for (uint i = 0; i < n * n; i++) {
+        residual[i] = m_data[i];
+        norm += residual[i] * residual[i];
+    }
+
+    uint termCount = 0;
+    double error = norm;
+
+    while (error > tolerance * tolerance * norm && termCount < maxTerms)
+    {
+        // Start from the row with the largest norm.
+        uint best = 0;
+        double bestNorm = -1.0;
+        for (uint y = 0; y < n; y++) {
+            double rowNorm = 0.0;
+            for (uint x = 0; x < n; x++) rowNorm += residual[y * n + x] * residual[y * n + x];
+            if (rowNorm > bestNorm) { bestNorm = rowNorm; best = y; }
+        }
+        for (uint x = 0; x < n; x++) v[x] = residual[best * n + x];
+
+        for (int iteration = 0; iteration < 100; iteration++)
+        {
+            // u = normalize(R v)
+            double length = 0.0;
+            for (uint y = 0; y < n; y++) {
+                double sum = 0.0;
+                for (uint x = 0; x < n; x++) sum += residual[y * n + x] * v[x];
+                u[y] = sum;
+                length += sum * sum;
+            }
+            if (length == 0.0) break;
+
+            length = 1.0 / sqrt(length);
+            for (uint y = 0; y < n; y++) u[y] *= length;
+
+            // v = R^t u
+            double change = 0.0, total = 0.0;
+            for (uint x = 0; x < n; x++) {
+                double sum = 0.0;
+                for (uint y = 0; y < n; y++) sum += residual[y * n + x] * u[y];
+                change += (sum - v[x]) * (sum - v[x]);
+                total += sum * sum;
+                v[x] = sum;
+            }
+            if (change <= 1e-24 * total) break;
+        }
+
+        error = 0.0;
+        for (uint y = 0; y < n; y++) {
+            for (uint x = 0; x < n; x++) {
+                residual[y * n + x] -= u[y] * v[x];
+                error += residual[y * n + x] * residual[y * n + x];
+            }
+        }
+
+        for (uint i = 0; i < n; i++) {
+            columns[termCount * n + i] = float(u[i]);
+            rows[termCount * n + i] = float(v[i]);
+        }
+        termCount++;
+    }
+
+    // The zero kernel is a single term.
+    if (norm == 0.0 && maxTerms > 0) {
+        for (uint i = 0; i < n; i++) columns[i] = rows[i] = 0.0f;
+        termCount = 1;
+    }
+    else if (error > tolerance * tolerance * norm) {
+        termCount = 0;
+    }
+
+    delete [] residual;
+    delete [] u;
+    delete [] v;
+
+    return termCount;
+}
+
+
 PolyphaseKernel::PolyphaseKernel(const Filter & f, uint srcLength, uint dstLength, int samples/*= 32*/)
 {
     nvDebugCheck(samples > 0);
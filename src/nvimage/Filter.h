@@ -188,6 +188,10 @@ namespace nv
 
         void initBlendedSobel(const Vector4 & scale);
 
+        // Approximate the kernel by a sum of separable terms: kernel(x, y) = sum of columns[t][y] * rows[t][x].
+        // Returns the number of terms, or 0 if more than maxTerms are needed. Buffers hold maxTerms * windowSize values.
+        uint separate(float * columns, float * rows, uint maxTerms, float tolerance = 1e-5f) const;
+
     private:
         const uint m_windowSize;
         float * m_data;
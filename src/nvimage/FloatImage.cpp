@@ -14,8 +14,11 @@
 #include "nvcore/Memory.h"
 #include "nvcore/Array.inl"
 
+#include "nvthread/ParallelFor.h"
+
 #include <math.h>
 #include <string.h> // memset, memcpy
+#include <float.h> // FLT_MAX
 
 
 using namespace nv;
@@ -129,14 +132,14 @@ void FloatImage::allocate(uint c, uint w, uint h, uint d)
         m_componentCount = c;
         m_pixelCount = w * h * d;
         m_floatCount = m_pixelCount * c;
-        m_mem = malloc<float>(m_floatCount);
+        m_mem = allocateBuffer<float>(m_floatCount);
     }
 }
 
 /// Free the image, but don't clear the members.
 void FloatImage::free()
 {
-    ::free(m_mem);
+    freeBuffer(m_mem, m_floatCount);
     m_mem = NULL;
 }
 
@@ -144,7 +147,11 @@ void FloatImage::resizeChannelCount(uint c)
 {
     if (m_componentCount != c) {
         uint count = m_pixelCount * c;
-        m_mem = realloc<float>(m_mem, count);
+
+        float * mem = allocateBuffer<float>(count);
+        memcpy(mem, m_mem, min(count, m_floatCount) * sizeof(float));
+        freeBuffer(m_mem, m_floatCount);
+        m_mem = mem;
 
         if (c > m_componentCount) {
             memset(m_mem + m_floatCount, 0, (count - m_floatCount) * sizeof(float));
@@ -727,12 +734,22 @@ FloatImage * FloatImage::resize(const Filter & filter, uint w, uint h, WrapMode
 {
     // @@ Use monophase filters when frac(m_width / w) == 0
 
-    AutoPtr<FloatImage> tmp_image( new FloatImage() );
-    AutoPtr<FloatImage> dst_image( new FloatImage() );	
-
     PolyphaseKernel xkernel(filter, m_width, w, 32);
     PolyphaseKernel ykernel(filter, m_height, h, 32);
 
+    return resize(xkernel, ykernel, wm);
+}
+
+/// Resize using prebuilt kernels, so that images of the same size can share them.
+/// The kernels must have been built for the dimensions of this image.
+FloatImage * FloatImage::resize(const PolyphaseKernel & xkernel, const PolyphaseKernel & ykernel, WrapMode wm) const
+{
+    const uint w = xkernel.length();
+    const uint h = ykernel.length();
+
+    AutoPtr<FloatImage> tmp_image( new FloatImage() );
+    AutoPtr<FloatImage> dst_image( new FloatImage() );	
+
     // @@ Select fastest filtering order:
     //if (w * m_height <= h * m_width)
     {
@@ -838,15 +855,24 @@ FloatImage * FloatImage::resize(const Filter & filter, uint w, uint h, uint d, W
 
 /// Downsample applying a 1D kernel separately in each dimension.
 FloatImage * FloatImage::resize(const Filter & filter, uint w, uint h, WrapMode wm, uint alpha) const
+{
+    PolyphaseKernel xkernel(filter, m_width, w, 32);
+    PolyphaseKernel ykernel(filter, m_height, h, 32);
+
+    return resize(xkernel, ykernel, wm, alpha);
+}
+
+/// Resize using prebuilt kernels, processing the alpha channel first.
+FloatImage * FloatImage::resize(const PolyphaseKernel & xkernel, const PolyphaseKernel & ykernel, WrapMode wm, uint alpha) const
 {
     nvCheck(alpha < m_componentCount);
 
+    const uint w = xkernel.length();
+    const uint h = ykernel.length();
+
     AutoPtr<FloatImage> tmp_image( new FloatImage() );
     AutoPtr<FloatImage> dst_image( new FloatImage() );	
 
-    PolyphaseKernel xkernel(filter, m_width, w, 32);
-    PolyphaseKernel ykernel(filter, m_height, h, 32);
-
     {
         tmp_image->allocate(m_componentCount, w, m_height);
         dst_image->allocate(m_componentCount, w, h);
@@ -957,23 +983,378 @@ FloatImage * FloatImage::resize(const Filter & filter, uint w, uint h, uint d, W
 }
 
 
+// Convolution works on a copy of the plane with a border of the kernel radius on each side. The border is filled
+// according to the wrap mode once, so that the loops over the taps don't need to wrap the coordinates. Rows are
+// processed in bands, in parallel.
+struct ConvolutionContext {
+    const FloatImage * image;
+    uint c, z;
+    FloatImage::WrapMode wm;
+
+    uint w, h;
+    uint windowSize;
+    uint bandHeight;
+
+    float * padded;         // (w + windowSize - 1) x (h + windowSize - 1)
+    float * output;         // w x h
+
+    // Direct convolution.
+    const Kernel2 * kernel;
+
+    // Separable convolution. The row pass filters all the padded rows, the column pass filters the result.
+    const float * rowKernel;
+    const float * columnKernel;
+    float * rows;           // w x (h + windowSize - 1)
+    bool accumulate;
+
+    // FFT convolution.
+    float * spectrum;       // Complex, n x m
+    uint n, m;
+    bool inverse;
+};
+
+static void ConvolutionPadTask(void * context, int id)
+{
+    ConvolutionContext * ctx = (ConvolutionContext *)context;
+    const FloatImage * image = ctx->image;
+
+    const uint w = ctx->w, h = ctx->h;
+    const int radius = int(ctx->windowSize / 2);
+    const uint pw = w + ctx->windowSize - 1;
+    const uint ph = h + ctx->windowSize - 1;
+
+    const uint y0 = id * ctx->bandHeight;
+    const uint y1 = min(y0 + ctx->bandHeight, ph);
+
+    // index() returns offsets from the start of the channel, the plane is only used for the interior rows.
+    const float * channel = image->channel(ctx->c);
+    const float * plane = image->plane(ctx->c, ctx->z);
+
+    for (uint py = y0; py < y1; py++) {
+        float * dst = ctx->padded + py * pw;
+        const int y = int(py) - radius;
+
+        if (y >= 0 && y < int(h)) {
+            // Interior rows: copy the row and only wrap the border columns.
+            memcpy(dst + radius, plane + y * w, w * sizeof(float));
+            for (int x = -radius; x < 0; x++) {
+                dst[x + radius] = channel[image->index(x, y, int(ctx->z), ctx->wm)];
+            }
+            for (int x = int(w); x < int(pw) - radius; x++) {
+                dst[x + radius] = channel[image->index(x, y, int(ctx->z), ctx->wm)];
+            }
+        }
+        else {
+            for (uint px = 0; px < pw; px++) {
+                dst[px] = channel[image->index(int(px) - radius, y, int(ctx->z), ctx->wm)];
+            }
+        }
+    }
+}
+
+static void ConvolutionDirectTask(void * context, int id)
+{
+    ConvolutionContext * ctx = (ConvolutionContext *)context;
+
+    const uint w = ctx->w;
+    const uint ws = ctx->windowSize;
+    const uint pw = w + ws - 1;
+
+    const uint y0 = id * ctx->bandHeight;
+    const uint y1 = min(y0 + ctx->bandHeight, ctx->h);
+
+    for (uint y = y0; y < y1; y++) {
+        float * dst = ctx->output + y * w;
+        for (uint x = 0; x < w; x++) dst[x] = 0.0f;
+
+        for (uint i = 0; i < ws; i++) {
+            for (uint e = 0; e < ws; e++) {
+                const float weight = ctx->kernel->valueAt(e, i);
+                if (weight == 0.0f) continue;
+
+                const float * src = ctx->padded + (y + i) * pw + e;
+                for (uint x = 0; x < w; x++) {
+                    dst[x] += weight * src[x];
+                }
+            }
+        }
+    }
+}
+
+static void ConvolutionRowTask(void * context, int id)
+{
+    ConvolutionContext * ctx = (ConvolutionContext *)context;
+
+    const uint w = ctx->w;
+    const uint ws = ctx->windowSize;
+    const uint pw = w + ws - 1;
+
+    const uint y0 = id * ctx->bandHeight;
+    const uint y1 = min(y0 + ctx->bandHeight, ctx->h + ws - 1);
+
+    for (uint y = y0; y < y1; y++) {
+        float * dst = ctx->rows + y * w;
+        for (uint x = 0; x < w; x++) dst[x] = 0.0f;
+
+        for (uint e = 0; e < ws; e++) {
+            const float weight = ctx->rowKernel[e];
+            const float * src = ctx->padded + y * pw + e;
+            for (uint x = 0; x < w; x++) {
+                dst[x] += weight * src[x];
+            }
+        }
+    }
+}
+
+static void ConvolutionColumnTask(void * context, int id)
+{
+    ConvolutionContext * ctx = (ConvolutionContext *)context;
+
+    const uint w = ctx->w;
+    const uint ws = ctx->windowSize;
+
+    const uint y0 = id * ctx->bandHeight;
+    const uint y1 = min(y0 + ctx->bandHeight, ctx->h);
+
+    for (uint y = y0; y < y1; y++) {
+        float * dst = ctx->output + y * w;
+        if (!ctx->accumulate) {
+            for (uint x = 0; x < w; x++) dst[x] = 0.0f;
+        }
+
+        for (uint i = 0; i < ws; i++) {
+            const float weight = ctx->columnKernel[i];
+            const float * src = ctx->rows + (y + i) * w;
+            for (uint x = 0; x < w; x++) {
+                dst[x] += weight * src[x];
+            }
+        }
+    }
+}
+
+// In place radix-2 FFT of n interleaved complex values.
+static void fft(float * data, uint n, bool inverse)
+{
+    // Bit reversal permutation.
+    for (uint i = 1, j = 0; i < n; i++) {
+        uint bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            swap(data[2*i+0], data[2*j+0]);
+            swap(data[2*i+1], data[2*j+1]);
+        }
+    }
+
+    for (uint length = 2; length <= n; length <<= 1) {
+        const double angle = (inverse ? 2.0 : -2.0) * 3.14159265358979323846 / length;
+        const double wr = cos(angle), wi = sin(angle);
+
+        for (uint i = 0; i < n; i += length) {
+            double cr = 1.0, ci = 0.0;
+            for (uint j = 0; j < length / 2; j++) {
+                float * a = data + 2 * (i + j);
+                float * b = data + 2 * (i + j + length / 2);
+
+                const float br = float(b[0] * cr - b[1] * ci);
+                const float bi = float(b[0] * ci + b[1] * cr);
+                b[0] = a[0] - br; b[1] = a[1] - bi;
+                a[0] += br; a[1] += bi;
+
+                const double t = cr * wr - ci * wi;
+                ci = cr * wi + ci * wr;
+                cr = t;
+            }
+        }
+    }
+}
+
+// Each task transforms a band of rows.
+static void ConvolutionRowFFTTask(void * context, int id)
+{
+    ConvolutionContext * ctx = (ConvolutionContext *)context;
+
+    const uint y0 = id * ctx->bandHeight;
+    const uint y1 = min(y0 + ctx->bandHeight, ctx->m);
+
+    for (uint y = y0; y < y1; y++) {
+        fft(ctx->spectrum + 2 * y * ctx->n, ctx->n, ctx->inverse);
+    }
+}
+
+// Each task transforms a band of columns.
+static void ConvolutionColumnFFTTask(void * context, int id)
+{
+    ConvolutionContext * ctx = (ConvolutionContext *)context;
+
+    const uint n = ctx->n, m = ctx->m;
+    const uint x0 = id * ctx->bandHeight;
+    const uint x1 = min(x0 + ctx->bandHeight, n);
+
+    Array<float> column;
+    column.resize(2 * m);
+
+    for (uint x = x0; x < x1; x++) {
+        for (uint y = 0; y < m; y++) {
+            column[2*y+0] = ctx->spectrum[2 * (y * n + x) + 0];
+            column[2*y+1] = ctx->spectrum[2 * (y * n + x) + 1];
+        }
+        fft(column.buffer(), m, ctx->inverse);
+        for (uint y = 0; y < m; y++) {
+            ctx->spectrum[2 * (y * n + x) + 0] = column[2*y+0];
+            ctx->spectrum[2 * (y * n + x) + 1] = column[2*y+1];
+        }
+    }
+}
+
+static void fft2D(ConvolutionContext & context, float * spectrum, bool inverse)
+{
+    context.spectrum = spectrum;
+    context.inverse = inverse;
+    context.bandHeight = 16;
+
+    {
+        ParallelFor parallelFor(ConvolutionRowFFTTask, &context);
+        parallelFor.run((context.m + 15) / 16);
+    }
+    {
+        ParallelFor parallelFor(ConvolutionColumnFFTTask, &context);
+        parallelFor.run((context.n + 15) / 16);
+    }
+}
+
+// Large kernels are cheaper to apply as a product in the frequency domain. Separable kernels are applied as a
+// sequence of 1D passes, and the remaining ones with the direct 2D loop.
 void FloatImage::convolve(const Kernel2 & k, uint c, WrapMode wm)
 {
-    AutoPtr<FloatImage> tmpImage(clone());
+    const uint w = m_width;
+    const uint h = m_height;
+    const uint d = m_depth;
+    const uint ws = k.windowSize();
+
+    if (ws == 0 || w == 0 || h == 0) return;
+
+    const uint pw = w + ws - 1;
+    const uint ph = h + ws - 1;
+
+    // Per pixel cost of each method, in multiply-adds.
+    const uint maxTerms = min(8U, ws / 2);
+    Array<float> columnKernels, rowKernels;
+    columnKernels.resize(max(1U, maxTerms) * ws);
+    rowKernels.resize(max(1U, maxTerms) * ws);
+    const uint termCount = (maxTerms != 0) ? k.separate(columnKernels.buffer(), rowKernels.buffer(), maxTerms) : 0;
+
+    const uint n = nextPowerOfTwo(pw);
+    const uint m = nextPowerOfTwo(ph);
+
+    const float directCost = float(ws * ws);
+    const float separableCost = termCount != 0 ? float(2 * ws * termCount) * float(ph) / float(h) : FLT_MAX;
+    const float fftCost = 6.0f * log2f(float(n) * float(m)) * float(n) * float(m) / (float(w) * float(h));
 
-    uint w = m_width;
-    uint h = m_height;
-    uint d = m_depth;
+    ConvolutionContext context;
+    context.image = this;
+    context.c = c;
+    context.wm = wm;
+    context.w = w;
+    context.h = h;
+    context.windowSize = ws;
+    context.kernel = &k;
+
+    Array<float> padded;
+    padded.resize(pw * ph);
+    context.padded = padded.buffer();
+
+    Array<float> output;
+    output.resize(w * h);
+    context.output = output.buffer();
+
+    Array<float> rows;
+    Array<float> spectrum, kernelSpectrum;
 
     for (uint z = 0; z < d; z++)
     {
-        for (uint y = 0; y < h; y++)
+        context.z = z;
+        context.bandHeight = 16;
+
+        {
+            ParallelFor parallelFor(ConvolutionPadTask, &context);
+            parallelFor.run((ph + 15) / 16);
+        }
+
+        if (fftCost < directCost && fftCost < separableCost)
+        {
+            context.n = n;
+            context.m = m;
+
+            // Transform the kernel once, it's the same for all the slices. Flip it, so that the product computes
+            // the same correlation as applyKernelXY.
+            if (kernelSpectrum.isEmpty()) {
+                kernelSpectrum.resize(2 * n * m, 0.0f);
+                for (uint i = 0; i < ws; i++) {
+                    for (uint e = 0; e < ws; e++) {
+                        kernelSpectrum[2 * (i * n + e)] = k.valueAt(ws - 1 - e, ws - 1 - i);
+                    }
+                }
+                fft2D(context, kernelSpectrum.buffer(), /*inverse=*/false);
+
+                spectrum.resize(2 * n * m);
+            }
+
+            for (uint i = 0; i < 2 * n * m; i++) spectrum[i] = 0.0f;
+            for (uint y = 0; y < ph; y++) {
+                for (uint x = 0; x < pw; x++) {
+                    spectrum[2 * (y * n + x)] = padded[y * pw + x];
+                }
+            }
+
+            fft2D(context, spectrum.buffer(), /*inverse=*/false);
+
+            const float scale = 1.0f / (float(n) * float(m));
+            for (uint i = 0; i < n * m; i++) {
+                const float ar = spectrum[2*i+0], ai = spectrum[2*i+1];
+                const float br = kernelSpectrum[2*i+0], bi = kernelSpectrum[2*i+1];
+                spectrum[2*i+0] = (ar * br - ai * bi) * scale;
+                spectrum[2*i+1] = (ar * bi + ai * br) * scale;
+            }
+
+            fft2D(context, spectrum.buffer(), /*inverse=*/true);
+
+            // The result of the window centered at (x, y) is at (x + ws - 1, y + ws - 1).
+            for (uint y = 0; y < h; y++) {
+                for (uint x = 0; x < w; x++) {
+                    output[y * w + x] = spectrum[2 * ((y + ws - 1) * n + x + ws - 1)];
+                }
+            }
+        }
+        else if (separableCost < directCost)
         {
-            for (uint x = 0; x < w; x++)
+            rows.resize(w * ph);
+            context.rows = rows.buffer();
+            context.bandHeight = 16;
+
+            for (uint t = 0; t < termCount; t++)
             {
-                pixel(c, x, y, 0) = tmpImage->applyKernelXY(&k, x, y, z, c, wm);
+                context.rowKernel = rowKernels.buffer() + t * ws;
+                context.columnKernel = columnKernels.buffer() + t * ws;
+                context.accumulate = (t != 0);
+
+                {
+                    ParallelFor parallelFor(ConvolutionRowTask, &context);
+                    parallelFor.run((ph + 15) / 16);
+                }
+                {
+                    ParallelFor parallelFor(ConvolutionColumnTask, &context);
+                    parallelFor.run((h + 15) / 16);
+                }
             }
         }
+        else
+        {
+            ParallelFor parallelFor(ConvolutionDirectTask, &context);
+            parallelFor.run((h + 15) / 16);
+        }
+
+        memcpy(plane(c, z), output.buffer(), w * h * sizeof(float));
     }
 }
 
@@ -986,7 +1367,7 @@ float FloatImage::applyKernelXY(const Kernel2 * k, int x, int y, int z, uint c,
     const uint kernelWindow = k->windowSize();
     const int kernelOffset = int(kernelWindow / 2);
 
-    const float * channel = this->plane(c, z);
+    const float * channel = this->channel(c);
 
     float sum = 0.0f;
     for (uint i = 0; i < kernelWindow; i++)
@@ -1380,61 +1761,155 @@ float FloatImage::alphaTestCoverage(float alphaRef, int alphaChannel, float alph
 #endif
 }
 
-void FloatImage::scaleAlphaToCoverage(float desiredCoverage, float alphaRef, int alphaChannel)
+// Alpha scales are solved in the [0, 4] range, with a resolution much finer than the old 10 step binary search.
+static const uint s_coverageBinCount = 4096;
+static const float s_coverageMaxScale = 4.0f;
+
+// Return the smallest alpha scale for which the bilinear interpolation of the saturated corner alphas reaches alphaRef.
+// The interpolated value is a piecewise linear function of the scale that grows until all the corners saturate.
+// alpha[] must be sorted in decreasing order, with the corresponding weights in weight[].
+static float coverageThresholdScale(const float alpha[4], const float weight[4], float alphaRef)
 {
-#if 0
-    float minAlphaRef = 0.0f;
-    float maxAlphaRef = 1.0f;
-    float midAlphaRef = 0.5f;
+    float saturated = 0.0f;     // Contribution of the corners that already reached 1.
+    float slope = 0.0f;         // Contribution of the remaining corners per unit of scale.
+    for (int i = 0; i < 4; i++) {
+        slope += weight[i] * alpha[i];
+    }
 
-    // Determine desired scale using a binary search. Hardcoded to 8 steps max.
-    for (int i = 0; i < 10; i++) {
-        float currentCoverage = alphaTestCoverage(midAlphaRef, alphaChannel);
+    float segmentStart = 0.0f;
+    for (int i = 0; i < 4; i++) {
+        if (slope <= 0.0f) break;
 
-        if (currentCoverage > desiredCoverage) {
-            minAlphaRef = midAlphaRef;
-        }
-        else if (currentCoverage < desiredCoverage) {
-            maxAlphaRef = midAlphaRef;
-        }
-        else {
-            break;
+        float scale = (alphaRef - saturated) / slope;
+        float segmentEnd = 1.0f / alpha[i];     // Corner i saturates at this scale.
+
+        if (scale <= segmentEnd) {
+            return max(scale, segmentStart);
         }
 
-        midAlphaRef = (minAlphaRef + maxAlphaRef) * 0.5f;
+        saturated += weight[i];
+        slope -= weight[i] * alpha[i];
+        segmentStart = segmentEnd;
     }
 
-    float alphaScale = alphaRef / midAlphaRef;
+    return FLT_MAX;
+}
 
-    // Scale alpha channel.
-    scaleBias(alphaChannel, 1, alphaScale, 0.0f);
-    clamp(alphaChannel, 1, 0.0f, 1.0f); 
-#else
-    float minAlphaScale = 0.0f;
-    float maxAlphaScale = 4.0f;
-    float alphaScale = 1.0f;
+struct AlphaCoverageContext {
+    const FloatImage * image;
+    int alphaChannel;
+    float alphaRef;
+    uint bandHeight;
+    uint * histograms;  // One histogram per band.
+};
 
-    // Determine desired scale using a binary search. Hardcoded to 8 steps max.
-    for (int i = 0; i < 10; i++) {
-        float currentCoverage = alphaTestCoverage(alphaRef, alphaChannel, alphaScale);
+// Each task bins the threshold scales of all the subsamples of a band of 2x2 quads.
+static void AlphaCoverageTask(void * context, int id)
+{
+    AlphaCoverageContext * ctx = (AlphaCoverageContext *)context;
+    const FloatImage * image = ctx->image;
 
-        if (currentCoverage < desiredCoverage) {
-            minAlphaScale = alphaScale;
-        }
-        else if (currentCoverage > desiredCoverage) {
-            maxAlphaScale = alphaScale;
+    const uint w = image->width();
+    const uint h = image->height();
+    const uint n = 8;
+    const float binScale = float(s_coverageBinCount) / s_coverageMaxScale;
+
+    // Clear the band histogram here, so that it's first touched by the worker that fills it.
+    uint * histogram = ctx->histograms + id * s_coverageBinCount;
+    memset(histogram, 0, s_coverageBinCount * sizeof(uint));
+
+    const uint y0 = id * ctx->bandHeight;
+    const uint y1 = min(y0 + ctx->bandHeight, h - 1);
+
+    for (uint y = y0; y < y1; y++) {
+        const float * row0 = image->scanline(ctx->alphaChannel, y+0, 0);
+        const float * row1 = image->scanline(ctx->alphaChannel, y+1, 0);
+
+        for (uint x = 0; x < w-1; x++) {
+            // Sort corners by decreasing alpha, so that they saturate in order.
+            float alpha[4] = { max(row0[x], 0.0f), max(row0[x+1], 0.0f), max(row1[x], 0.0f), max(row1[x+1], 0.0f) };
+            int order[4] = { 0, 1, 2, 3 };
+            for (int i = 1; i < 4; i++) {
+                for (int j = i; j > 0 && alpha[order[j]] > alpha[order[j-1]]; j--) {
+                    swap(order[j], order[j-1]);
+                }
+            }
+
+            float sortedAlpha[4];
+            for (int i = 0; i < 4; i++) sortedAlpha[i] = alpha[order[i]];
+
+            // Same subsample positions as alphaTestCoverage.
+            for (float fy = 0.5f/n; fy < 1.0f; fy++) {
+                for (float fx = 0.5f/n; fx < 1.0f; fx++) {
+                    const float cornerWeight[4] = { (1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy };
+
+                    float sortedWeight[4];
+                    for (int i = 0; i < 4; i++) sortedWeight[i] = cornerWeight[order[i]];
+
+                    float scale = coverageThresholdScale(sortedAlpha, sortedWeight, ctx->alphaRef);
+                    if (scale < s_coverageMaxScale) {
+                        histogram[min(uint(scale * binScale), s_coverageBinCount - 1)]++;
+                    }
+                }
+            }
         }
-        else {
-            break;
+    }
+}
+
+// Solve for the alpha scale in a single pass. Instead of measuring the coverage at several scales, we compute
+// the scale at which each subsample passes the alpha test and build a histogram of these scales. The coverage
+// at any scale is then the number of subsamples in the bins below it.
+void FloatImage::scaleAlphaToCoverage(float desiredCoverage, float alphaRef, int alphaChannel)
+{
+    const uint w = m_width;
+    const uint h = m_height;
+    const uint n = 8;
+
+    float alphaScale = s_coverageMaxScale;
+
+    if (w > 1 && h > 1)
+    {
+        AlphaCoverageContext context;
+        context.image = this;
+        context.alphaChannel = alphaChannel;
+        context.alphaRef = alphaRef;
+        context.bandHeight = max(16U, (h - 1 + 63) / 64);
+
+        const uint bandCount = (h - 1 + context.bandHeight - 1) / context.bandHeight;
+
+        Array<uint> histograms;
+        histograms.resize(bandCount * s_coverageBinCount);
+        context.histograms = histograms.buffer();
+
+        ParallelFor parallelFor(AlphaCoverageTask, &context);
+        parallelFor.run(bandCount);
+
+        // Merge band histograms.
+        for (uint b = 1; b < bandCount; b++) {
+            for (uint i = 0; i < s_coverageBinCount; i++) {
+                histograms[i] += histograms[b * s_coverageBinCount + i];
+            }
         }
 
-        alphaScale = (minAlphaScale + maxAlphaScale) * 0.5f;
+        // Find the bin where the cumulative coverage crosses the desired coverage.
+        const float binWidth = s_coverageMaxScale / s_coverageBinCount;
+        const float desiredCount = desiredCoverage * float(w) * float(h) * float(n * n);   // Same normalization as alphaTestCoverage.
+
+        float count = 0.0f;
+        for (uint i = 0; i < s_coverageBinCount; i++) {
+            const float binCount = float(histograms[i]);
+            if (count + binCount > desiredCount) {
+                alphaScale = (float(i) + (desiredCount - count) / binCount) * binWidth;
+                break;
+            }
+            count += binCount;
+        }
     }
 
     // Scale alpha channel.
     scaleBias(alphaChannel, 1, alphaScale, 0.0f);
     clamp(alphaChannel, 1, 0.0f, 1.0f); 
-#endif
+
 #if _DEBUG
     alphaTestCoverage(alphaRef, alphaChannel);
 #endif
@@ -80,6 +80,8 @@ namespace nv
         NVIMAGE_API FloatImage * resize(const Filter & filter, uint w, uint h, uint d, WrapMode wm) const;
         NVIMAGE_API FloatImage * resize(const Filter & filter, uint w, uint h, WrapMode wm, uint alpha) const;
         NVIMAGE_API FloatImage * resize(const Filter & filter, uint w, uint h, uint d, WrapMode wm, uint alpha) const;
+        NVIMAGE_API FloatImage * resize(const PolyphaseKernel & xkernel, const PolyphaseKernel & ykernel, WrapMode wm) const;
+        NVIMAGE_API FloatImage * resize(const PolyphaseKernel & xkernel, const PolyphaseKernel & ykernel, WrapMode wm, uint alpha) const;
 
         NVIMAGE_API void convolve(const Kernel2 & k, uint c, WrapMode wm);
 
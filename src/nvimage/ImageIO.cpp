@@ -13,11 +13,17 @@
 
 #include "nvcore/Ptr.h"
 #include "nvcore/Utils.h"
-#include "nvcore/Array.h"
+#include "nvcore/Array.inl"
 #include "nvcore/StrLib.h"
 #include "nvcore/StdStream.h"
 #include "nvcore/TextWriter.h"
 
+#include <math.h> // powf, ceilf
+
+#if NV_USE_SSE
+#   include <xmmintrin.h>
+#endif
+
 // Extern
 #if defined(HAVE_FREEIMAGE)
 #   include <FreeImage.h>
@@ -1830,6 +1836,179 @@ Image * nv::ImageIO::load(const char * fileName, Stream & s)
     return NULL;
 }
 
+// Box filter footprint of each texel of a downsampled row or column: the first source texel and the coverage of the
+// source texels, normalized so that the weights add up to one.
+static uint boxFootprints(uint srcLength, uint dstLength, Array<uint> & first, Array<float> & weights)
+{
+    const float scale = float(srcLength) / float(dstLength);
+    const uint tapCount = uint(ceilf(scale)) + 1;
+
+    first.resize(dstLength);
+    weights.resize(dstLength * tapCount);
+
+    for (uint i = 0; i < dstLength; i++)
+    {
+        const float x0 = i * scale;
+        const float x1 = min(x0 + scale, float(srcLength));
+
+        first[i] = min(uint(x0), srcLength - 1);
+
+        for (uint t = 0; t < tapCount; t++)
+        {
+            const float j = float(first[i] + t);
+            const float coverage = min(j + 1, x1) - max(j, x0);
+            weights[i * tapCount + t] = (j < srcLength && coverage > 0) ? coverage / scale : 0.0f;
+        }
+    }
+
+    return tapCount;
+}
+
+// Gamma correct box filter downsampling of 8 bit images. Texels are converted to linear space with a lookup table
+// and the four channels are filtered at once.
+static Image * downSampleBox(const Image * img, uint w, uint h, float gamma)
+{
+    nvDebugCheck(w <= img->width() && h <= img->height());
+
+    const uint srcWidth = img->width();
+    const uint srcHeight = img->height();
+
+    float toLinear[256];
+    for (uint i = 0; i < 256; i++) {
+        toLinear[i] = powf(i / 255.0f, gamma);
+    }
+
+    Array<uint> xfirst, yfirst;
+    Array<float> xweights, yweights;
+    const uint xtaps = boxFootprints(srcWidth, w, xfirst, xweights);
+    const uint ytaps = boxFootprints(srcHeight, h, yfirst, yweights);
+
+    Array<float> row(4 * srcWidth);
+    row.resize(4 * srcWidth);
+    Array<float> sum(4 * w);
+    sum.resize(4 * w);
+
+    AutoPtr<Image> result(new Image());
+    result->allocate(w, h);
+    result->setFormat(img->format());
+
+    for (uint y = 0; y < h; y++)
+    {
+        for (uint i = 0; i < 4 * w; i++) sum[i] = 0.0f;
+
+        for (uint ty = 0; ty < ytaps; ty++)
+        {
+            const float yweight = yweights[y * ytaps + ty];
+            if (yweight == 0.0f) continue;
+
+            const Color32 * src = img->scanline(yfirst[y] + ty);
+            for (uint x = 0; x < srcWidth; x++)
+            {
+                row[4 * x + 0] = toLinear[src[x].r];
+                row[4 * x + 1] = toLinear[src[x].g];
+                row[4 * x + 2] = toLinear[src[x].b];
+                row[4 * x + 3] = src[x].a * (1.0f / 255.0f);
+            }
+
+            for (uint x = 0; x < w; x++)
+            {
+                const float * texel = row.buffer() + 4 * xfirst[x];
+                const float * weight = xweights.buffer() + x * xtaps;
+#if NV_USE_SSE
+                __m128 acc = _mm_setzero_ps();
+                for (uint t = 0; t < xtaps; t++) {
+                    if (weight[t] != 0.0f) acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(texel + 4 * t), _mm_set1_ps(weight[t])));
+                }
+                float * s = sum.buffer() + 4 * x;
+                _mm_storeu_ps(s, _mm_add_ps(_mm_loadu_ps(s), _mm_mul_ps(acc, _mm_set1_ps(yweight))));
+#else
+                float acc[4] = { 0, 0, 0, 0 };
+                for (uint t = 0; t < xtaps; t++) {
+                    if (weight[t] == 0.0f) continue;
+                    for (uint c = 0; c < 4; c++) acc[c] += texel[4 * t + c] * weight[t];
+                }
+                for (uint c = 0; c < 4; c++) sum[4 * x + c] += acc[c] * yweight;
+#endif
+            }
+        }
+
+        Color32 * dst = result->scanline(y);
+        for (uint x = 0; x < w; x++)
+        {
+            dst[x].r = clamp(int(255.0f * powf(sum[4 * x + 0], 1.0f / gamma)), 0, 255);
+            dst[x].g = clamp(int(255.0f * powf(sum[4 * x + 1], 1.0f / gamma)), 0, 255);
+            dst[x].b = clamp(int(255.0f * powf(sum[4 * x + 2], 1.0f / gamma)), 0, 255);
+            dst[x].a = clamp(int(255.0f * sum[4 * x + 3]), 0, 255);
+        }
+    }
+
+    return result.release();
+}
+
+// Thumbnails preserve the aspect ratio, images that fit are not resized.
+static void thumbnailSize(uint w, uint h, uint size, uint * thumbWidth, uint * thumbHeight)
+{
+    if (w <= size && h <= size) {
+        *thumbWidth = w;
+        *thumbHeight = h;
+    }
+    else if (w > h) {
+        *thumbWidth = size;
+        *thumbHeight = max(1U, uint((float(h) / float(w)) * size));
+    }
+    else {
+        *thumbWidth = max(1U, uint((float(w) / float(h)) * size));
+        *thumbHeight = size;
+    }
+}
+
+Image * nv::ImageIO::loadThumbnail(const char * fileName, uint size, float gamma, uint * width/*= NULL*/, uint * height/*= NULL*/)
+{
+    nvDebugCheck(size > 0);
+
+    AutoPtr<Image> image(new Image());
+    uint w, h, thumbWidth, thumbHeight;
+
+    if (strCaseDiff(Path::extension(fileName), ".dds") == 0)
+    {
+        DirectDrawSurface dds(fileName);
+        if (!dds.isValid() || !dds.isSupported()) {
+            return NULL;
+        }
+
+        w = dds.width();
+        h = dds.height();
+        thumbnailSize(w, h, size, &thumbWidth, &thumbHeight);
+
+        // Only decode the smallest stored mipmap that is not smaller than the thumbnail.
+        uint mipmap = 0;
+        while (mipmap + 1 < dds.mipmapCount() && dds.surfaceWidth(mipmap + 1) >= thumbWidth && dds.surfaceHeight(mipmap + 1) >= thumbHeight) {
+            mipmap++;
+        }
+
+        dds.mipmap(image.ptr(), 0, mipmap);
+    }
+    else
+    {
+        if (!image->load(fileName)) {
+            return NULL;
+        }
+
+        w = image->width();
+        h = image->height();
+        thumbnailSize(w, h, size, &thumbWidth, &thumbHeight);
+    }
+
+    if (width != NULL) *width = w;
+    if (height != NULL) *height = h;
+
+    if (image->width() == thumbWidth && image->height() == thumbHeight) {
+        return image.release();
+    }
+
+    return downSampleBox(image.ptr(), thumbWidth, thumbHeight, gamma);
+}
+
 bool nv::ImageIO::save(const char * fileName, Stream & s, const Image * img, const char ** tags/*=NULL*/)
 {
     nvDebugCheck(fileName != NULL);
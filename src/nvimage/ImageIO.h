@@ -23,6 +23,10 @@ namespace nv
         NVIMAGE_API FloatImage * loadFloat(const char * fileName);
         NVIMAGE_API FloatImage * loadFloat(const char * fileName, Stream & s);
 
+        // Load a gamma correct box filtered thumbnail that fits in size x size. Only the smallest mipmap of DDS files
+        // that covers the thumbnail is decoded. Returns the extents of the full image in width and height.
+        NVIMAGE_API Image * loadThumbnail(const char * fileName, uint size, float gamma, uint * width = NULL, uint * height = NULL);
+
         NVIMAGE_API bool save(const char * fileName, const Image * img, const char ** tags=NULL); // NULL terminated list.
         NVIMAGE_API bool save(const char * fileName, Stream & s, const Image * img, const char ** tags=NULL);
 
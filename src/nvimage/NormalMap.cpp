@@ -29,13 +29,200 @@
 #include "nvmath/Color.inl"
 #include "nvmath/Vector.h"
 
+#include "nvthread/ParallelFor.h"
+
 #include "nvcore/Ptr.h"
+#include "nvcore/Array.inl"
 
 #include <string.h> // memcpy
 
 
 using namespace nv;
 
+// Normal maps are computed in bands of rows, in parallel. The heights are first copied to a plane with a border of
+// the kernel radius, filled according to the wrap mode, so that the kernels don't need to wrap the coordinates.
+struct NormalMapContext {
+    const FloatImage * image;   // Heights in the alpha channel.
+    FloatImage::WrapMode wm;
+    const Kernel2 * kdu;
+    const Kernel2 * kdv;
+    bool antisymmetric;         // kdu(x, y) == -kdu(-x, y) and kdv is its transpose.
+
+    float heightScale;
+    float scale, bias;          // Applied to the normals.
+
+    uint w, h;
+    uint windowSize;
+    float * padded;             // (w + windowSize - 1) x (h + windowSize - 1)
+
+    FloatImage * output;
+};
+
+static const uint s_normalMapBandHeight = 16;
+
+static void NormalMapPadTask(void * context, int id)
+{
+    NormalMapContext * ctx = (NormalMapContext *)context;
+    const FloatImage * image = ctx->image;
+
+    const uint w = ctx->w, h = ctx->h;
+    const int radius = int(ctx->windowSize / 2);
+    const uint pw = w + ctx->windowSize - 1;
+    const uint ph = h + ctx->windowSize - 1;
+
+    const uint y0 = id * s_normalMapBandHeight;
+    const uint y1 = min(y0 + s_normalMapBandHeight, ph);
+
+    const float * channel = image->channel(3);
+
+    for (uint py = y0; py < y1; py++) {
+        float * dst = ctx->padded + py * pw;
+        const int y = int(py) - radius;
+
+        if (y >= 0 && y < int(h)) {
+            memcpy(dst + radius, channel + y * w, w * sizeof(float));
+            for (int x = -radius; x < 0; x++) {
+                dst[x + radius] = channel[image->index(x, y, 0, ctx->wm)];
+            }
+            for (int x = int(w); x < int(pw) - radius; x++) {
+                dst[x + radius] = channel[image->index(x, y, 0, ctx->wm)];
+            }
+        }
+        else {
+            for (uint px = 0; px < pw; px++) {
+                dst[px] = channel[image->index(int(px) - radius, y, 0, ctx->wm)];
+            }
+        }
+    }
+}
+
+static void NormalMapTask(void * context, int id)
+{
+    NormalMapContext * ctx = (NormalMapContext *)context;
+    const Kernel2 * kdu = ctx->kdu;
+
+    const uint w = ctx->w;
+    const uint ws = ctx->windowSize;
+    const uint radius = ws / 2;
+    const uint pw = w + ws - 1;
+
+    const uint y0 = id * s_normalMapBandHeight;
+    const uint y1 = min(y0 + s_normalMapBandHeight, ctx->h);
+
+    Array<float> du, dv, tmp;
+    du.resize(w);
+    dv.resize(w);
+    tmp.resize(pw);
+
+    for (uint y = y0; y < y1; y++)
+    {
+        for (uint x = 0; x < w; x++) du[x] = dv[x] = 0.0f;
+
+        if (ctx->antisymmetric)
+        {
+            // Derivative kernels are antisymmetric, so the taps on both sides of the center share the weight. The du
+            // kernel is applied as a column pass for each horizontal offset, followed by a difference of the columns.
+            // The dv kernel is applied as a difference of the rows, followed by a row pass.
+            for (uint d = 1; d <= radius; d++)
+            {
+                for (uint x = 0; x < pw; x++) tmp[x] = 0.0f;
+                for (uint i = 0; i < ws; i++) {
+                    const float weight = kdu->valueAt(radius + d, i);
+                    if (weight == 0.0f) continue;
+
+                    const float * src = ctx->padded + (y + i) * pw;
+                    for (uint x = 0; x < pw; x++) tmp[x] += weight * src[x];
+                }
+                for (uint x = 0; x < w; x++) du[x] += tmp[x + radius + d] - tmp[x + radius - d];
+
+                const float * above = ctx->padded + (y + radius - d) * pw;
+                const float * below = ctx->padded + (y + radius + d) * pw;
+                for (uint x = 0; x < pw; x++) tmp[x] = below[x] - above[x];
+                for (uint e = 0; e < ws; e++) {
+                    const float weight = kdu->valueAt(radius + d, e);
+                    if (weight == 0.0f) continue;
+
+                    for (uint x = 0; x < w; x++) dv[x] += weight * tmp[x + e];
+                }
+            }
+        }
+        else
+        {
+            for (uint i = 0; i < ws; i++) {
+                const float * src = ctx->padded + (y + i) * pw;
+                for (uint e = 0; e < ws; e++) {
+                    const float wu = kdu->valueAt(e, i);
+                    const float wv = ctx->kdv->valueAt(e, i);
+                    for (uint x = 0; x < w; x++) {
+                        du[x] += wu * src[x + e];
+                        dv[x] += wv * src[x + e];
+                    }
+                }
+            }
+        }
+
+        float * nx = ctx->output->scanline(0, y, 0);
+        float * ny = ctx->output->scanline(1, y, 0);
+        float * nz = ctx->output->scanline(2, y, 0);
+
+        for (uint x = 0; x < w; x++)
+        {
+            Vector3 n = normalize(Vector3(du[x], dv[x], ctx->heightScale));
+
+            nx[x] = ctx->scale * n.x + ctx->bias;
+            ny[x] = ctx->scale * n.y + ctx->bias;
+            nz[x] = ctx->scale * n.z + ctx->bias;
+        }
+    }
+}
+
+// Compute the normals of the heights stored in the alpha channel of img, and write them to the rgb channels of output.
+static void computeNormals(const FloatImage * img, FloatImage * output, FloatImage::WrapMode wm, const Kernel2 * kdu, const Kernel2 * kdv, float heightScale, float scale, float bias)
+{
+    nvDebugCheck(kdu->windowSize() == kdv->windowSize());
+
+    NormalMapContext context;
+    context.image = img;
+    context.wm = wm;
+    context.kdu = kdu;
+    context.kdv = kdv;
+    context.heightScale = heightScale;
+    context.scale = scale;
+    context.bias = bias;
+    context.w = img->width();
+    context.h = img->height();
+    context.windowSize = kdu->windowSize();
+    context.output = output;
+
+    const uint ws = context.windowSize;
+
+    context.antisymmetric = true;
+    for (uint i = 0; i < ws; i++) {
+        for (uint e = 0; e < ws; e++) {
+            if (kdu->valueAt(e, i) != -kdu->valueAt(ws - 1 - e, i) || kdv->valueAt(e, i) != kdu->valueAt(i, e)) {
+                context.antisymmetric = false;
+            }
+        }
+    }
+
+    const uint pw = context.w + ws - 1;
+    const uint ph = context.h + ws - 1;
+
+    Array<float> padded;
+    padded.resize(pw * ph);
+    context.padded = padded.buffer();
+
+    {
+        ParallelFor parallelFor(NormalMapPadTask, &context);
+        parallelFor.run((ph + s_normalMapBandHeight - 1) / s_normalMapBandHeight);
+    }
+    {
+        ParallelFor parallelFor(NormalMapTask, &context);
+        parallelFor.run((context.h + s_normalMapBandHeight - 1) / s_normalMapBandHeight);
+    }
+}
+
+
 // Create normal map using the given kernels.
 static FloatImage * createNormalMap(const Image * img, FloatImage::WrapMode wm, Vector4::Arg heightWeights, const Kernel2 * kdu, const Kernel2 * kdv)
 {
@@ -59,20 +246,7 @@ static FloatImage * createNormalMap(const Image * img, FloatImage::WrapMode wm,
 
     float heightScale = 1.0f / 16.0f;	// @@ Use a user defined factor.
 
-    for(uint y = 0; y < h; y++)
-    {
-        for(uint x = 0; x < w; x++)
-        {
-            const float du = fimage->applyKernelXY(kdu, x, y, 0, 3, wm);
-            const float dv = fimage->applyKernelXY(kdv, x, y, 0, 3, wm);
-
-            Vector3 n = normalize(Vector3(du, dv, heightScale));
-
-            fimage->pixel(0, x, y, 0) = 0.5f * n.x + 0.5f;
-            fimage->pixel(1, x, y, 0) = 0.5f * n.y + 0.5f;
-            fimage->pixel(2, x, y, 0) = 0.5f * n.z + 0.5f;
-        }
-    }
+    computeNormals(fimage.ptr(), fimage.ptr(), wm, kdu, kdv, heightScale, 0.5f, 0.5f);
 
     return fimage.release();
 }
@@ -94,30 +268,9 @@ static FloatImage * createNormalMap(const FloatImage * img, FloatImage::WrapMode
     AutoPtr<FloatImage> img_out(new FloatImage());
     img_out->allocate(4, w, h);
 
-    for (uint y = 0; y < h; y++)
-    {
-        for (uint x = 0; x < w; x++)
-        {
-            const float du = img->applyKernelXY(kdu, x, y, 0, 3, wm);
-            const float dv = img->applyKernelXY(kdv, x, y, 0, 3, wm);
-
-            Vector3 n = normalize(Vector3(du, dv, heightScale));
-
-            img_out->pixel(0, x, y, 0) = n.x;
-            img_out->pixel(1, x, y, 0) = n.y;
-            img_out->pixel(2, x, y, 0) = n.z;
-        }
-    }
+    computeNormals(img, img_out.ptr(), wm, kdu, kdv, heightScale, 1.0f, 0.0f);
 
     // Copy alpha channel.
-    /*for (uint y = 0; y < h; y++)
-    {
-        for (uint x = 0; x < w; x++)
-        {
-            
-            img_out->pixel(3, x, y, 0) = img->pixel(3, x, y, 0);
-        }
-    }*/
     memcpy(img_out->channel(3), img->channel(3), w * h * sizeof(float));
 
     return img_out.release();
@@ -8,6 +8,19 @@
 #include "nvcore/Debug.h"
 
 
+// Use the standard atomics when the compiler has them, they let us specify the memory order of every operation.
+#if !defined(NV_HAVE_STD_ATOMIC)
+#if __cplusplus >= 201103L || (NV_CC_MSVC && _MSC_VER >= 1700)
+#define NV_HAVE_STD_ATOMIC 1
+#else
+#define NV_HAVE_STD_ATOMIC 0
+#endif
+#endif
+
+#if NV_HAVE_STD_ATOMIC
+#include <atomic>
+#endif
+
 #if NV_CC_MSVC
 
 #include <intrin.h> // Already included by nvthread.h
@@ -15,58 +28,74 @@
 #pragma intrinsic(_InterlockedIncrement, _InterlockedDecrement)
 #pragma intrinsic(_InterlockedCompareExchange, _InterlockedExchange)
 
-/*
-extern "C"
-{
-    #pragma intrinsic(_InterlockedIncrement, _InterlockedDecrement)
-    LONG  __cdecl _InterlockedIncrement(long volatile *Addend);
-    LONG  __cdecl _InterlockedDecrement(long volatile *Addend);
-
-    #pragma intrinsic(_InterlockedCompareExchange, _InterlockedExchange)
-    LONG  __cdecl _InterlockedCompareExchange(long volatile * Destination, long Exchange, long Compared);
-    LONG  __cdecl _InterlockedExchange(long volatile * Target, LONG Value);
-}
-*/
+#if NV_CPU_X86 || NV_CPU_X86_64
+#pragma intrinsic(_mm_pause)
+#endif
 
 #endif // NV_CC_MSVC
 
-#if NV_CC_CLANG && POSH_CPU_STRONGARM
-// LLVM/Clang do not yet have functioning atomics as of 2.1
-// #include <atomic>
-#endif
 
-//ACS: need this if we want to use Apple's atomics.
-/*
-#if NV_OS_IOS || NV_OS_DARWIN
-// for iOS & OSX we use apple's atomics
-#include "libkern/OSAtomic.h"
+namespace nv {
+
+    // Tell the processor that we are in a spin loop, so that it doesn't starve the other hardware thread of the core.
+    NV_FORCEINLINE void cpuPause()
+    {
+#if NV_CC_MSVC && (NV_CPU_X86 || NV_CPU_X86_64)
+        _mm_pause();
+#elif (NV_CC_GNUC || NV_CC_CLANG) && (NV_CPU_X86 || NV_CPU_X86_64)
+        __asm__ __volatile__ ("pause");
+#elif (NV_CC_GNUC || NV_CC_CLANG) && NV_CPU_ARM
+        __asm__ __volatile__ ("yield");
+#else
+        nvCompilerReadWriteBarrier();
 #endif
-*/
+    }
 
-namespace nv {
 
     // Load and stores.
     inline uint32 loadRelaxed(const uint32 * ptr) { return *ptr; }
     inline void storeRelaxed(uint32 * ptr, uint32 value) { *ptr = value; }
 
+#if NV_CC_GNUC || NV_CC_CLANG
+
+    inline uint32 loadAcquire(const volatile uint32 * ptr)
+    {
+        nvDebugCheck((intptr_t(ptr) & 3) == 0);
+        return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+    }
+
+    inline void storeRelease(volatile uint32 * ptr, uint32 value)
+    {
+        nvDebugCheck((intptr_t(ptr) & 3) == 0);
+        __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+    }
+
+    template <typename T>
+    inline void storeReleasePointer(volatile T * pTo, T from)
+    {
+        NV_COMPILER_CHECK(sizeof(T) == sizeof(intptr_t));
+        nvDebugCheck((((intptr_t)pTo) % sizeof(intptr_t)) == 0);
+        __atomic_store_n(pTo, from, __ATOMIC_RELEASE);
+    }
+
+    template <typename T>
+    inline T loadAcquirePointer(volatile T * ptr)
+    {
+        NV_COMPILER_CHECK(sizeof(T) == sizeof(intptr_t));
+        nvDebugCheck((((intptr_t)ptr) % sizeof(intptr_t)) == 0);
+        return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+    }
+
+#else
+
     inline uint32 loadAcquire(const volatile uint32 * ptr)
     {
         nvDebugCheck((intptr_t(ptr) & 3) == 0);
 
-#if POSH_CPU_X86 || POSH_CPU_X86_64
+#if NV_CPU_X86 || NV_CPU_X86_64
         uint32 ret = *ptr;  // on x86, loads are Acquire
         nvCompilerReadBarrier();
         return ret;
-#elif POSH_CPU_STRONGARM 
-        // need more specific cpu type for armv7?
-        // also utilizes a full barrier
-        // currently treating laod like x86 - this could be wrong
-        
-        // this is the easiest but slowest way to do this
-        nvCompilerReadWriteBarrier();
-		uint32 ret = *ptr; // replace with ldrex?
-        nvCompilerReadWriteBarrier();
-        return ret;
 #else
 #error "Not implemented"
 #endif
@@ -75,29 +104,20 @@ namespace nv {
     inline void storeRelease(volatile uint32 * ptr, uint32 value)
     {
         nvDebugCheck((intptr_t(ptr) & 3) == 0);
-        nvDebugCheck((intptr_t(&value) & 3) == 0);
 
-#if POSH_CPU_X86 || POSH_CPU_X86_64
+#if NV_CPU_X86 || NV_CPU_X86_64
         nvCompilerWriteBarrier();
         *ptr = value;   // on x86, stores are Release
-        //nvCompilerWriteBarrier(); // @@ IC: Where does this barrier go? In nvtt it was after, in Witness before. Not sure which one is right.
-#elif POSH_CPU_STRONGARM
-        // this is the easiest but slowest way to do this
-        nvCompilerReadWriteBarrier();
-		*ptr = value; //strex?
-		nvCompilerReadWriteBarrier();
 #else
 #error "Atomics not implemented."
 #endif
     }
 
-
     template <typename T>
     inline void storeReleasePointer(volatile T * pTo, T from)
     {
         NV_COMPILER_CHECK(sizeof(T) == sizeof(intptr_t));
         nvDebugCheck((((intptr_t)pTo) % sizeof(intptr_t)) == 0);
-        nvDebugCheck((((intptr_t)&from) % sizeof(intptr_t)) == 0);
         nvCompilerWriteBarrier();
         *pTo = from;    // on x86, stores are Release
     }
@@ -110,10 +130,12 @@ namespace nv {
         T ret = *ptr;   // on x86, loads are Acquire
         nvCompilerReadBarrier();
         return ret;
-    } 
+    }
+
+#endif
 
 
-    // Atomics. @@ Assuming sequential memory order?
+    // Read-modify-write operations. These are sequentially consistent.
 
 #if NV_CC_MSVC
     NV_COMPILER_CHECK(sizeof(uint32) == sizeof(long));
@@ -131,8 +153,7 @@ namespace nv {
     }
 
     // Compare '*value' against 'expected', if equal, then stores 'desired' in '*value'.
-    // @@ C++0x style CAS? Unlike the C++0x version, 'expected' is not passed by reference and not mutated.
-    // @@ Is this strong or weak? Does InterlockedCompareExchange have spurious failures?
+    // Unlike the C++11 version, 'expected' is not passed by reference and not mutated. Never fails spuriously.
     inline bool atomicCompareAndSwap(uint32 * value, uint32 expected, uint32 desired)
     {
         nvDebugCheck((intptr_t(value) & 3) == 0);
@@ -140,211 +161,108 @@ namespace nv {
         return result == (long)expected;
     }
 
-
     inline uint32 atomicSwap(uint32 * value, uint32 desired)
     {
         nvDebugCheck((intptr_t(value) & 3) == 0);
         return (uint32)_InterlockedExchange((long *)value, (long)desired);
     }
 
-#elif NV_CC_CLANG && (NV_OS_IOS || NV_OS_DARWIN)
-    NV_COMPILER_CHECK(sizeof(uint32) == sizeof(long));
+#elif NV_CC_GNUC || NV_CC_CLANG
 
-    //ACS: Use Apple's atomics instead? I don't know if these are better in any way; there are non-barrier versions too. There's no OSAtomicSwap32 tho'
-    /*
     inline uint32 atomicIncrement(uint32 * value)
     {
         nvDebugCheck((intptr_t(value) & 3) == 0);
-        return (uint32)OSAtomicIncrement32Barrier((int32_t *)value);
+        return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST);
     }
-    
+
     inline uint32 atomicDecrement(uint32 * value)
     {
         nvDebugCheck((intptr_t(value) & 3) == 0);
-        return (uint32)OSAtomicDecrement32Barrier((int32_t *)value);
+        return __atomic_sub_fetch(value, 1, __ATOMIC_SEQ_CST);
     }
 
     // Compare '*value' against 'expected', if equal, then stores 'desired' in '*value'.
-    // @@ C++0x style CAS? Unlike the C++0x version, 'expected' is not passed by reference and not mutated.
-    // @@ Is this strong or weak?
+    // Unlike the C++11 version, 'expected' is not passed by reference and not mutated. Never fails spuriously.
     inline bool atomicCompareAndSwap(uint32 * value, uint32 expected, uint32 desired)
     {
         nvDebugCheck((intptr_t(value) & 3) == 0);
-        return OSAtomicCompareAndSwap32Barrier((int32_t)expected, (int32_t)desired, (int32_t *)value);
+        return __atomic_compare_exchange_n(value, &expected, desired, /*weak=*/false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
     }
-    */
-
-    inline uint32 atomicIncrement(uint32 * value)
-    {
-        nvDebugCheck((intptr_t(value) & 3) == 0);
-
-        return __sync_add_and_fetch(value, 1);
-    }
-
-    inline uint32 atomicDecrement(uint32 * value)
-    {
-        nvDebugCheck((intptr_t(value) & 3) == 0);
 
-        return __sync_sub_and_fetch(value, 1);
-    }
-    
-    // Compare '*value' against 'expected', if equal, then stores 'desired' in '*value'.
-    // @@ C++0x style CAS? Unlike the C++0x version, 'expected' is not passed by reference and not mutated.
-    // @@ Is this strong or weak?
-    inline bool atomicCompareAndSwap(uint32 * value, uint32 expected, uint32 desired)
-    {
-        nvDebugCheck((intptr_t(value) & 3) == 0);
-        return __sync_bool_compare_and_swap(value, expected, desired);
-    }
-    
     inline uint32 atomicSwap(uint32 * value, uint32 desired)
     {
         nvDebugCheck((intptr_t(value) & 3) == 0);
-        // this is confusingly named, it doesn't actually do a test but always sets
-        return __sync_lock_test_and_set(value, desired);
-    }
-
-
-#elif NV_CC_CLANG && POSH_CPU_STRONGARM
-    NV_COMPILER_CHECK(sizeof(uint32) == sizeof(long));
-    
-    inline uint32 atomicIncrement(uint32 * value)
-    {
-        nvDebugCheck((intptr_t(value) & 3) == 0);
-        
-        // this should work in LLVM eventually, but not as of 2.1
-        // return (uint32)AtomicIncrement((long *)value);
-        
-        // in the mean time,
-        register uint32 result;
-        asm volatile (
-                      "1:   ldrexb  %0,  [%1]	\n\t"
-                      "add     %0,   %0, #1     \n\t"
-                      "strexb  r1,   %0, [%1]	\n\t"
-                      "cmp     r1,   #0			\n\t"
-                      "bne     1b"
-                      : "=&r" (result)
-                      : "r"(value)
-                      : "r1"
-                      );
-        return result;
-
+        return __atomic_exchange_n(value, desired, __ATOMIC_SEQ_CST);
     }
-    
-    inline uint32 atomicDecrement(uint32 * value)
-    {
-        nvDebugCheck((intptr_t(value) & 3) == 0);
-        
-        // this should work in LLVM eventually, but not as of 2.1:
-        // return (uint32)sys::AtomicDecrement((long *)value);
-
-        // in the mean time,
-        
-        register uint32 result;
-        asm volatile (
-                      "1:   ldrexb  %0,  [%1]	\n\t"
-                      "sub     %0,   %0, #1     \n\t"
-                      "strexb  r1,   %0, [%1]	\n\t"
-                      "cmp     r1,   #0			\n\t"
-                      "bne     1b"
-                      : "=&r" (result)
-                      : "r"(value)
-                      : "r1"
-                      );
-        return result;
-         
-    }
-
-#elif NV_CC_GNUC
-    // Many alternative implementations at:
-    // http://www.memoryhole.net/kyle/2007/05/atomic_incrementing.html
-
-    inline uint32 atomicIncrement(uint32 * value)
-    {
-        nvDebugCheck((intptr_t(value) & 3) == 0);
-
-        return __sync_add_and_fetch(value, 1);
-    }
-
-    inline uint32 atomicDecrement(uint32 * value)
-    {
-        nvDebugCheck((intptr_t(value) & 3) == 0);
 
-        return __sync_sub_and_fetch(value, 1);
-    }
-    
-    // Compare '*value' against 'expected', if equal, then stores 'desired' in '*value'.
-    // @@ C++0x style CAS? Unlike the C++0x version, 'expected' is not passed by reference and not mutated.
-    // @@ Is this strong or weak?
-    inline bool atomicCompareAndSwap(uint32 * value, uint32 expected, uint32 desired)
-    {
-        nvDebugCheck((intptr_t(value) & 3) == 0);
-        return __sync_bool_compare_and_swap(value, expected, desired);
-    }
-    
-    inline uint32 atomicSwap(uint32 * value, uint32 desired)
-    {
-        nvDebugCheck((intptr_t(value) & 3) == 0);
-        // this is confusingly named, it doesn't actually do a test but always sets
-        return __sync_lock_test_and_set(value, desired);
-    }
-    
 #else
 #error "Atomics not implemented."
 
 #endif
 
 
-
-
-    // It would be nice to have C++0x-style atomic types, but I'm not in the mood right now. Only uint32 supported so far.
-#if 0
+    // Atomic variable with explicit memory orders. The read-modify-write operations are acquire-release, which is
+    // what the synchronization primitives built on top of it need.
+    // Without the standard atomics only 32 bit types are supported and every operation is sequentially consistent.
     template <typename T>
-    void increment(T * value);
+    class Atomic
+    {
+        NV_FORBID_COPY(Atomic);
+    public:
+        Atomic() : m_value() { }
+        explicit Atomic(T value) : m_value(value) { }
 
-    template <typename T>
-    void decrement(T * value);
+#if NV_HAVE_STD_ATOMIC
+        T loadRelaxed() const { return m_value.load(std::memory_order_relaxed); }
+        void storeRelaxed(T value) { m_value.store(value, std::memory_order_relaxed); }
 
-    template <>
-    void increment(uint32 * value) {
-    }
+        T loadAcquire() const { return m_value.load(std::memory_order_acquire); }
+        void storeRelease(T value) { m_value.store(value, std::memory_order_release); }
 
-    template <>
-    void increment(uint64 * value) {
-    }
+        // Return the new value.
+        T increment() { return m_value.fetch_add(1, std::memory_order_acq_rel) + 1; }
+        T decrement() { return m_value.fetch_sub(1, std::memory_order_acq_rel) - 1; }
+        T add(T value) { return m_value.fetch_add(value, std::memory_order_acq_rel) + value; }
 
+        T exchange(T value) { return m_value.exchange(value, std::memory_order_acq_rel); }
 
+        bool compareAndSwap(T expected, T desired) {
+            return m_value.compare_exchange_strong(expected, desired, std::memory_order_acq_rel, std::memory_order_acquire);
+        }
+#else
+        T loadRelaxed() const { return (T)nv::loadRelaxed(ptr()); }
+        void storeRelaxed(T value) { nv::storeRelaxed(ptr(), (uint32)value); }
 
-    template <typename T>
-    class Atomic
-    {
-    public:
-        explicit Atomic()  : m_value() { }
-        explicit Atomic( T val ) : m_value(val) { }
-        ~Atomic() { }
+        T loadAcquire() const { return (T)nv::loadAcquire(ptr()); }
+        void storeRelease(T value) { nv::storeRelease(ptr(), (uint32)value); }
 
-        T loadRelaxed()  const { return m_value; }
-        void storeRelaxed(T val) { m_value = val; }
+        T increment() { return (T)nv::atomicIncrement(ptr()); }
+        T decrement() { return (T)nv::atomicDecrement(ptr()); }
+        T add(T value) {
+            for (;;) {
+                uint32 current = nv::loadRelaxed(ptr());
+                if (nv::atomicCompareAndSwap(ptr(), current, current + (uint32)value)) return (T)(current + (uint32)value);
+            }
+        }
 
-        //T loadAcquire() const volatile { return nv::loadAcquire(&m_value); }
-        //void storeRelease(T val) volatile { nv::storeRelease(&m_value, val); }
+        T exchange(T value) { return (T)nv::atomicSwap(ptr(), (uint32)value); }
 
-        void increment() /*volatile*/ { nv::atomicIncrement(m_value); }
-        void decrement() /*volatile*/ { nv::atomicDecrement(m_value); }
+        bool compareAndSwap(T expected, T desired) { return nv::atomicCompareAndSwap(ptr(), (uint32)expected, (uint32)desired); }
+#endif
 
-        void compareAndStore(T oldVal, T newVal) { nv::atomicCompareAndStore(&m_value, oldVal, newVal); }
-        T compareAndExchange(T oldVal, T newVal) { nv::atomicCompareAndStore(&m_value, oldVal, newVal); }
-        T exchange(T newVal) { nv::atomicExchange(&m_value, newVal); }
+        // Address of the value, for OS primitives that wait on a memory location, like futexes.
+        void * address() { return &m_value; }
 
     private:
-        // don't provide operator = or == ; make the client write Store( Load() )
-        NV_FORBID_COPY(Atomic);
-
-        NV_COMPILER_CHECK(sizeof(T) == sizeof(uint32) || sizeof(T) == sizeof(uint64));
-
-        T m_value;
-    };
+#if NV_HAVE_STD_ATOMIC
+        NV_COMPILER_CHECK(sizeof(std::atomic<T>) == sizeof(T));
+        std::atomic<T> m_value;
+#else
+        NV_COMPILER_CHECK(sizeof(T) == sizeof(uint32));
+        uint32 * ptr() const { return (uint32 *)&m_value; }
+        volatile T m_value;
 #endif
+    };
 
 } // nv namespace 
 
@@ -1,21 +1,54 @@
 // This code is in the public domain -- castano@gmail.com
 
 #include "Event.h"
+#include "Atomic.h"
 
 #if NV_OS_WIN32
 #include "Win32.h"
+#elif NV_OS_LINUX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #elif NV_OS_USE_PTHREAD
 #include <pthread.h>
 #endif
 
 using namespace nv;
 
-#if NV_OS_WIN32
+// The state of the event is 1 when posted, 0 when not, and -1 when the waiter is asleep, so that post only has to go
+// to the OS when somebody is actually waiting. Before going to sleep the waiter spins for a while, the thread pool
+// posts events at short intervals and most of the time the post arrives before the waiter has to sleep.
+
+enum {
+    State_Sleeping = -1,
+    State_Reset = 0,
+    State_Posted = 1,
+};
+
+// Spinning only makes sense when the poster can run at the same time as the waiter.
+static uint spinCount()
+{
+    static const uint count = hardwareThreadCount() > 1 ? 4000 : 0;
+    return count;
+}
 
 struct Event::Private {
+    Atomic<int32> state;
+
+#if NV_OS_WIN32
     HANDLE handle;
+#elif !NV_OS_LINUX && NV_OS_USE_PTHREAD
+    pthread_cond_t pt_cond;
+    pthread_mutex_t pt_mutex;
+#endif
+
+    // Block until the state is not State_Sleeping anymore. May return spuriously.
+    void sleep();
+    void wake();
 };
 
+#if NV_OS_WIN32
+
 Event::Event() : m(new Private) {
     m->handle = CreateEvent(NULL, FALSE, FALSE, NULL);
 }
@@ -24,26 +57,34 @@ Event::~Event() {
     CloseHandle(m->handle);
 }
 
-void Event::post() {
-    SetEvent(m->handle);
+void Event::Private::sleep() {
+    WaitForSingleObject(handle, INFINITE);
 }
 
-void Event::wait() {
-    WaitForSingleObject(m->handle, INFINITE);
+void Event::Private::wake() {
+    SetEvent(handle);
 }
 
-#elif NV_OS_USE_PTHREAD
+#elif NV_OS_LINUX
 
-struct Event::Private {
-    pthread_cond_t pt_cond;
-    pthread_mutex_t pt_mutex;
-    int count;
-    int wait_count;
-};
+Event::Event() : m(new Private) {
+}
+
+Event::~Event() {
+}
+
+void Event::Private::sleep() {
+    // Returns immediately if the state has already changed.
+    syscall(SYS_futex, (int *)state.address(), FUTEX_WAIT_PRIVATE, State_Sleeping, NULL, NULL, 0);
+}
+
+void Event::Private::wake() {
+    syscall(SYS_futex, (int *)state.address(), FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+#elif NV_OS_USE_PTHREAD
 
 Event::Event() : m(new Private) {
-    m->count=0;
-    m->wait_count=0;
     pthread_mutex_init(&m->pt_mutex, NULL);
     pthread_cond_init(&m->pt_cond, NULL);
 }
@@ -53,33 +94,52 @@ Event::~Event() {
     pthread_mutex_destroy(&m->pt_mutex);
 }
 
-void Event::post() {
-    pthread_mutex_lock(&m->pt_mutex);
+void Event::Private::sleep() {
+    pthread_mutex_lock(&pt_mutex);
+    while (state.loadAcquire() == State_Sleeping) {
+        pthread_cond_wait(&pt_cond, &pt_mutex);
+    }
+    pthread_mutex_unlock(&pt_mutex);
+}
 
-    m->count++;
-    
-    //ACS: move this after the unlock?
-    if(m->wait_count>0) {
-    pthread_cond_signal(&m->pt_cond);
+void Event::Private::wake() {
+    // Taking the lock guarantees the waiter is either before its state check or inside pthread_cond_wait.
+    pthread_mutex_lock(&pt_mutex);
+    pthread_cond_signal(&pt_cond);
+    pthread_mutex_unlock(&pt_mutex);
+}
+
+#endif // NV_OS_UNIX
+
+
+void Event::post() {
+    if (m->state.exchange(State_Posted) == State_Sleeping) {
+        m->wake();
     }
-    
-    pthread_mutex_unlock(&m->pt_mutex);
 }
 
 void Event::wait() {
-    pthread_mutex_lock(&m->pt_mutex);
-    
-    while(m->count==0) {
-        m->wait_count++;
-    pthread_cond_wait(&m->pt_cond, &m->pt_mutex);
-        m->wait_count--;
+    for (uint i = 0, count = spinCount(); i < count; i++) {
+        if (m->state.loadRelaxed() == State_Posted && m->state.compareAndSwap(State_Posted, State_Reset)) {
+            return;
+        }
+        cpuPause();
     }
-    m->count--;
-    
-    pthread_mutex_unlock(&m->pt_mutex);
-}
 
-#endif // NV_OS_UNIX
+    while (true) {
+        int32 state = m->state.loadAcquire();
+
+        if (state == State_Posted) {
+            if (m->state.compareAndSwap(State_Posted, State_Reset)) return;
+            continue;
+        }
+        if (state == State_Reset) {
+            if (!m->state.compareAndSwap(State_Reset, State_Sleeping)) continue;
+        }
+
+        m->sleep();
+    }
+}
 
 
 /*static*/ void Event::post(Event * events, uint count) {
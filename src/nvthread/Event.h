@@ -10,7 +10,8 @@
 
 namespace nv
 {
-    // This is intended to be used by a single waiter thread.
+    // This is intended to be used by a single waiter thread. Like an auto-reset event, posts are not counted: posting an
+    // event that is already posted does nothing.
     class NVTHREAD_CLASS Event
     {
         NV_FORBID_COPY(Event);
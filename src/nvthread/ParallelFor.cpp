@@ -16,7 +16,7 @@ static void worker(void * arg) {
 
     while(true) {
         // Consume one element at a time. @@ Might be more efficient to have custom grain.
-        uint i = atomicIncrement(&owner->idx);
+        uint i = owner->idx.increment();
         if (i > owner->count) {
             break;
         }
@@ -26,24 +26,42 @@ static void worker(void * arg) {
 }
 
 
-ParallelFor::ParallelFor(ForTask * task, void * context) : task(task), context(context) {
+ParallelFor::ParallelFor(ForTask * task, void * context, ThreadPool * pool/*= NULL*/) : task(task), context(context), pool(pool) {
 #if ENABLE_PARALLEL_FOR
-    pool = ThreadPool::acquire();
+    if (pool == NULL) {
+        if (ThreadPool::isSerial()) return;
+        pool = ThreadPool::current();
+    }
+
+    // Loops nested in the tasks of another loop on the same pool run in the calling worker, the others are busy.
+    if (pool->isWorkerThread()) {
+        this->pool = NULL;
+        return;
+    }
+
+    this->pool = ThreadPool::acquire(pool);
 #endif
 }
 
 ParallelFor::~ParallelFor() {
 #if ENABLE_PARALLEL_FOR
-    ThreadPool::release(pool);
+    if (pool != NULL) ThreadPool::release(pool);
 #endif
 }
 
 void ParallelFor::run(uint count) {
 #if ENABLE_PARALLEL_FOR
-    storeRelease(&this->count, count);
+    // Don't wake up the workers for a single task, or from a worker of the pool.
+    if (count <= 1 || pool == NULL) {
+        for (uint i = 0; i < count; i++) task(context, i);
+        return;
+    }
+
+    // Published to the workers by the start events.
+    this->count = count;
 
     // Init atomic counter to zero.
-    storeRelease(&idx, 0);
+    idx.storeRelaxed(0);
 
     // Start threads.
     pool->start(worker, this);
@@ -51,7 +69,7 @@ void ParallelFor::run(uint count) {
     // Wait for all threads to complete.
     pool->wait();
 
-    nvDebugCheck(idx >= count);
+    nvDebugCheck(idx.loadRelaxed() >= count);
 #else
     for (int i = 0; i < toI32(count); i++) {
         task(context, i);
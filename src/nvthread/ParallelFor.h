@@ -5,7 +5,7 @@
 #define NV_THREAD_PARALLELFOR_H
 
 #include "nvthread.h"
-//#include "Atomic.h" // atomic<uint>
+#include "Atomic.h" // Atomic<uint>
 
 namespace nv
 {
@@ -15,7 +15,8 @@ namespace nv
     typedef void ForTask(void * context, int id);
 
     struct ParallelFor {
-        ParallelFor(ForTask * task, void * context);
+        // Runs on the default pool of the calling thread unless a pool is given, see ThreadPoolScope.
+        ParallelFor(ForTask * task, void * context, ThreadPool * pool = NULL);
         ~ParallelFor();
 
         void run(uint count);
@@ -29,7 +30,7 @@ namespace nv
 
         // State:
         uint count;
-        /*atomic<uint>*/ uint idx;
+        Atomic<uint> idx;
     };
 
 } // nv namespace
@@ -1,6 +1,7 @@
 // This code is in the public domain -- castano@gmail.com
 
 #include "Thread.h"
+#include "Atomic.h" // cpuPause
 
 #if NV_OS_WIN32
     #include "Win32.h"
@@ -94,7 +95,9 @@ bool Thread::isRunning () const
 
 /*static*/ void Thread::spinWait(uint count)
 {
-    for (uint i = 0; i < count; i++) {}
+    for (uint i = 0; i < count; i++) {
+        cpuPause();
+    }
 }
 
 /*static*/ void Thread::yield()
@@ -19,30 +19,76 @@ Mutex s_pool_mutex;
 
 AutoPtr<ThreadPool> s_pool;
 
+// Set by ThreadPoolScope.
+NV_THREAD_LOCAL ThreadPool * s_currentPool = NULL;
+NV_THREAD_LOCAL bool s_currentSerial = false;
 
-/*static*/ ThreadPool * ThreadPool::acquire()
+// Pool of the calling thread, when it is a worker.
+NV_THREAD_LOCAL ThreadPool * s_workerPool = NULL;
+
+static ThreadPool * sharedPool()
 {
 #if PROTECT_THREAD_POOL 
-    s_pool_mutex.lock();    // @@ If same thread tries to lock twice, this should assert.
+    s_pool_mutex.lock();
 #endif
-
     if (s_pool == NULL) {
-        ThreadPool * p = new ThreadPool;
-        nvDebugCheck(s_pool == p);
+        s_pool = new ThreadPool;
+    }
+    ThreadPool * pool = s_pool.ptr();
+#if PROTECT_THREAD_POOL 
+    s_pool_mutex.unlock();
+#endif
+    return pool;
+}
+
+/*static*/ ThreadPool * ThreadPool::current()
+{
+    if (s_currentPool != NULL) return s_currentPool;
+    return sharedPool();
+}
+
+/*static*/ bool ThreadPool::isSerial()
+{
+    return s_currentSerial;
+}
+
+ThreadPoolScope::ThreadPoolScope(ThreadPool * pool, bool serial/*= false*/) : previousPool(s_currentPool), previousSerial(s_currentSerial)
+{
+    s_currentPool = pool;
+    s_currentSerial = serial;
+}
+
+ThreadPoolScope::~ThreadPoolScope()
+{
+    s_currentPool = previousPool;
+    s_currentSerial = previousSerial;
+}
+
+
+/*static*/ ThreadPool * ThreadPool::acquire(ThreadPool * pool/*= NULL*/)
+{
+    if (pool == NULL) {
+        pool = current();
     }
 
-    return s_pool.ptr();
+    nvDebugCheck(!pool->isWorkerThread());
+
+#if PROTECT_THREAD_POOL 
+    pool->mutex.lock();
+#endif
+
+    return pool;
 }
 
 /*static*/ void ThreadPool::release(ThreadPool * pool)
 {
-    nvDebugCheck(pool == s_pool);
+    nvDebugCheck(pool != NULL);
 
     // Make sure the threads of the pool are idle.
-    s_pool->wait();
+    pool->wait();
 
 #if PROTECT_THREAD_POOL 
-    s_pool_mutex.unlock();
+    pool->mutex.unlock();
 #endif
 }
 
@@ -50,42 +96,84 @@ AutoPtr<ThreadPool> s_pool;
 
 
 /*static*/ void ThreadPool::workerFunc(void * arg) {
-    uint i = U32((uintptr_t)arg); // This is OK, because workerCount should always be much smaller than 2^32
+    const Worker * worker = (const Worker *)arg;
+    ThreadPool * pool = worker->pool;
+    const uint i = worker->index;
+
+    pool->bindWorker(i);
+
+    s_workerPool = pool;
 
     while(true) 
     {
-        s_pool->startEvents[i].wait();
+        pool->startEvents[i].wait();
 
-        nv::ThreadFunc * func = loadAcquirePointer(&s_pool->func);
+        nv::ThreadFunc * func = pool->func;
 
         if (func == NULL) {
             return;
         }
         
-        func(s_pool->arg);
+        func(pool->arg);
+
+        if (pool->busyCount.decrement() == 0) {
+            pool->finishEvent.post();
+        }
+    }
+}
+
+// Runs in the worker thread, so that the policies apply to it and to the memory it touches first.
+void ThreadPool::bindWorker(uint i)
+{
+    if (numaNode >= 0) {
+        nv::setThreadNumaNode(U32(numaNode));
+    }
 
-        s_pool->finishEvents[i].post();
+    if (processorCount != 0) {
+        // Explicit processors pin each worker to a single one, otherwise workers float within the node.
+        if (pinWorkers) nv::setThreadAffinity(processors + (i % processorCount), 1);
+        else nv::setThreadAffinity(processors, processorCount);
     }
 }
 
 
-ThreadPool::ThreadPool() 
+ThreadPool::ThreadPool(uint workerCount/*= 0*/, const uint * processors/*= NULL*/, uint processorCount/*= 0*/, int numaNode/*= -1*/)
 {
-    s_pool = this;  // Worker threads need this to be initialized before they start.
+    this->processorCount = 0;
+    this->processors = NULL;
+    this->pinWorkers = processorCount != 0;
+    this->numaNode = numaNode;
+
+    uint nodeProcessors[1024];
+    if (processorCount == 0 && numaNode >= 0) {
+        // Size the pool to the processors of the node.
+        processorCount = nv::numaNodeProcessors(U32(numaNode), nodeProcessors, 1024);
+        processors = nodeProcessors;
+    }
+
+    if (processorCount != 0) {
+        this->processorCount = processorCount;
+        this->processors = new uint[processorCount];
+        for (uint i = 0; i < processorCount; i++) this->processors[i] = processors[i];
+    }
 
-    workerCount = nv::hardwareThreadCount();
+    if (workerCount == 0) {
+        workerCount = this->processorCount != 0 ? this->processorCount : nv::hardwareThreadCount();
+    }
+
+    this->workerCount = workerCount;
     workers = new Thread[workerCount];
+    workerArgs = new Worker[workerCount];
 
     startEvents = new Event[workerCount];
-    finishEvents = new Event[workerCount];
 
-    nvCompilerWriteBarrier(); // @@ Use a memory fence?
+    allIdle = true;
 
     for (uint i = 0; i < workerCount; i++) {
-        workers[i].start(workerFunc, (void *)i);
+        workerArgs[i].pool = this;
+        workerArgs[i].index = i;
+        workers[i].start(workerFunc, workerArgs + i);
     }
-
-    allIdle = true;
 }
 
 ThreadPool::~ThreadPool()
@@ -97,8 +185,9 @@ ThreadPool::~ThreadPool()
     Thread::wait(workers, workerCount);
 
     delete [] workers;
+    delete [] workerArgs;
     delete [] startEvents;
-    delete [] finishEvents;
+    delete [] processors;
 }
 
 void ThreadPool::start(ThreadFunc * func, void * arg)
@@ -107,8 +196,11 @@ void ThreadPool::start(ThreadFunc * func, void * arg)
     wait();
 
     // Set our desired function.
-    storeReleasePointer(&this->func, func);
-    storeReleasePointer(&this->arg, arg);
+    this->func = func;
+    this->arg = arg;
+
+    // The last worker to finish posts the finish event.
+    busyCount.storeRelaxed(workerCount);
 
     allIdle = false;
 
@@ -116,12 +208,17 @@ void ThreadPool::start(ThreadFunc * func, void * arg)
     Event::post(startEvents, workerCount);
 }
 
+bool ThreadPool::isWorkerThread() const
+{
+    return s_workerPool == this;
+}
+
 void ThreadPool::wait()
 {
     if (!allIdle)
     {
         // Wait for threads to complete.
-        Event::wait(finishEvents, workerCount);
+        finishEvent.wait();
 
         allIdle = true;
     }
@@ -7,12 +7,20 @@
 #include "nvthread.h"
 
 #include "Event.h"
+#include "Mutex.h"
 #include "Thread.h"
+#include "Atomic.h"
 
 // The thread pool creates one worker thread for each physical core. 
 // The threads are idle waiting for their start events so that they do not consume any resources while inactive. 
 // The thread pool runs the same function in all worker threads, the idea is to use this as the foundation of a custom task scheduler.
 // When the thread pool starts, the main thread continues running, but the common use case is to inmmediately wait of the termination events of the worker threads.
+// The last worker to finish posts a single finish event, so waiting costs one wake-up regardless of the number of workers.
+// Events spin before sleeping, so the short dispatches of small mipmaps usually find the workers still awake.
+// Besides the shared pool, clients can create their own pools with a specific number of workers, optionally pinned to a set of 
+// processors or bound to a NUMA node. Workers first-touch the memory of the tasks they run, so binding them keeps that memory local.
+// A ThreadPoolScope makes such a pool the default of the loops started by the calling thread, so that code that doesn't know
+// about the pool, like the image processing of nvtt, honors the same settings.
 // @@ The start and wait methods could probably be merged.
 
 namespace nv {
@@ -24,31 +32,74 @@ namespace nv {
         NV_FORBID_COPY(ThreadPool);
     public:
 
-        static ThreadPool * acquire();
+        // Lock the given pool, or the default pool of the calling thread if NULL, for exclusive use until released.
+        static ThreadPool * acquire(ThreadPool * pool = NULL);
         static void release(ThreadPool *);
 
-        ThreadPool();
+        // A workerCount of 0 uses one worker per processor in the given set, or per hardware thread if the set is empty.
+        // When processors are given each worker is pinned to one of them. A numaNode >= 0 binds the workers to that node.
+        ThreadPool(uint workerCount = 0, const uint * processors = NULL, uint processorCount = 0, int numaNode = -1);
         ~ThreadPool();
 
         void start(ThreadFunc * func, void * arg);
         void wait();
 
+        uint threadCount() const { return workerCount; }
+
+        // True when called from one of the workers of this pool, that can't wait for the pool without deadlocking.
+        bool isWorkerThread() const;
+
+        // Default pool of the calling thread: the pool of the innermost ThreadPoolScope, or the shared pool.
+        static ThreadPool * current();
+
+        // True when the innermost ThreadPoolScope of the calling thread asks for loops to run in the calling thread.
+        static bool isSerial();
+
     private:
 
+        struct Worker {
+            ThreadPool * pool;
+            uint index;
+        };
+
         static void workerFunc(void * arg);
+        void bindWorker(uint i);
+
+        Mutex mutex;
 
         uint workerCount;
         Thread * workers;
+        Worker * workerArgs;
+
+        uint processorCount;
+        uint * processors;
+        bool pinWorkers;
+        int numaNode;
+
         Event * startEvents;
-        Event * finishEvents;
+        Event finishEvent;
+        Atomic<uint> busyCount;
 
         uint allIdle;
 
-        // Current function:
+        // Current function, published to the workers by the start events.
         ThreadFunc * func;
         void * arg;
     };
 
+    // Sets the default pool of the calling thread until the end of the scope. A NULL pool selects the shared pool, or
+    // no pool at all when serial is set. Scopes can be nested.
+    class ThreadPoolScope {
+        NV_FORBID_COPY(ThreadPoolScope);
+    public:
+        ThreadPoolScope(ThreadPool * pool, bool serial = false);
+        ~ThreadPoolScope();
+
+    private:
+        ThreadPool * previousPool;
+        bool previousSerial;
+    };
+
 } // namespace nv
 
 
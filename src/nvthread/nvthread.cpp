@@ -25,6 +25,14 @@
 #include <syslog.h>
 #endif
 
+#include <stdlib.h> // strtol
+
+#if NV_OS_LINUX
+#include <sched.h> // sched_setaffinity
+#include <sys/syscall.h> // SYS_set_mempolicy
+#include <stdio.h> // fopen
+#endif
+
 using namespace nv;
 
 
@@ -72,3 +80,117 @@ uint nv::hardwareThreadCount() {
 #endif
 }
 
+
+uint nv::parseProcessorList(const char * list, uint * processors, uint maxCount)
+{
+    uint count = 0;
+
+    const char * ptr = list;
+    while (*ptr != '\0' && *ptr != '\n') {
+        char * end;
+        long first = strtol(ptr, &end, 10);
+        if (end == ptr || first < 0) return 0;
+
+        long last = first;
+        ptr = end;
+        if (*ptr == '-') {
+            ptr++;
+            last = strtol(ptr, &end, 10);
+            if (end == ptr || last < first) return 0;
+            ptr = end;
+        }
+
+        for (long i = first; i <= last && count < maxCount; i++) {
+            processors[count++] = uint(i);
+        }
+
+        if (*ptr == ',') ptr++;
+        else if (*ptr != '\0' && *ptr != '\n') return 0;
+    }
+
+    return count;
+}
+
+// The topology comes from sysfs, so that we don't depend on libnuma.
+uint nv::numaNodeCount()
+{
+#if NV_OS_LINUX
+    uint count = 0;
+    while (true) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%u", count);
+        if (access(path, F_OK) != 0) break;
+        count++;
+    }
+    return count > 0 ? count : 1;
+#else
+    // @@ Use GetNumaHighestNodeNumber on Windows.
+    return 1;
+#endif
+}
+
+uint nv::numaNodeProcessors(uint node, uint * processors, uint maxCount)
+{
+#if NV_OS_LINUX
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+
+    FILE * fp = fopen(path, "r");
+    if (fp == NULL) return 0;
+
+    char list[1024];
+    uint count = 0;
+    if (fgets(list, sizeof(list), fp) != NULL) {
+        count = parseProcessorList(list, processors, maxCount);
+    }
+
+    fclose(fp);
+    return count;
+#else
+    // Without topology information everything is in node 0.
+    if (node != 0) return 0;
+
+    uint count = hardwareThreadCount();
+    if (count > maxCount) count = maxCount;
+    for (uint i = 0; i < count; i++) processors[i] = i;
+    return count;
+#endif
+}
+
+bool nv::setThreadAffinity(const uint * processors, uint count)
+{
+#if NV_OS_WIN32
+    DWORD_PTR mask = 0;
+    for (uint i = 0; i < count; i++) {
+        if (processors[i] < sizeof(DWORD_PTR) * 8) mask |= DWORD_PTR(1) << processors[i];
+    }
+    return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif NV_OS_LINUX
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (uint i = 0; i < count; i++) {
+        if (processors[i] < CPU_SETSIZE) CPU_SET(processors[i], &set);
+    }
+    // On Linux this only affects the calling thread.
+    return CPU_COUNT(&set) != 0 && sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+bool nv::setThreadNumaNode(uint node)
+{
+#if NV_OS_LINUX && defined(SYS_set_mempolicy)
+    const int MPOL_PREFERRED = 1; // From linux/mempolicy.h
+
+    unsigned long mask[16] = { 0 };
+    const uint bitsPerWord = sizeof(unsigned long) * 8;
+    if (node >= sizeof(mask) * 8) return false;
+    mask[node / bitsPerWord] |= 1UL << (node % bitsPerWord);
+
+    // Prefer the node, but fall back to other nodes when it runs out of memory.
+    return syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, sizeof(mask) * 8) == 0;
+#else
+    return false;
+#endif
+}
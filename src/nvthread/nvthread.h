@@ -85,6 +85,21 @@ namespace nv
     // Reentrant.
     uint hardwareThreadCount();
 
+    // Parse a list of processor ranges like "0-7,16-23". Returns the number of processors, 0 if the list is invalid.
+    NVTHREAD_API uint parseProcessorList(const char * list, uint * processors, uint maxCount);
+
+    // Number of NUMA nodes, 1 when the system is not NUMA or the topology is not available.
+    NVTHREAD_API uint numaNodeCount();
+
+    // Get the processors of a NUMA node. Returns the number of processors, 0 if the node doesn't exist.
+    NVTHREAD_API uint numaNodeProcessors(uint node, uint * processors, uint maxCount);
+
+    // Restrict the calling thread to the given processors. Returns false if that's not supported.
+    NVTHREAD_API bool setThreadAffinity(const uint * processors, uint count);
+
+    // Allocate the memory of the calling thread in the given NUMA node when possible. Returns false if that's not supported.
+    NVTHREAD_API bool setThreadNumaNode(uint node);
+
     // Not thread-safe. Use from main thread only.
     void initWorkers();
     void shutWorkers();
@@ -23,6 +23,7 @@
 // OTHER DEALINGS IN THE SOFTWARE.
 
 #include "BlockCompressor.h"
+#include "CompressionOptions.h"
 #include "OutputOptions.h"
 #include "TaskDispatcher.h"
 
@@ -33,6 +34,8 @@
 #include "nvmath/Vector.inl"
 
 #include "nvcore/Memory.h"
+#include "nvcore/Profiler.h"
+#include "nvcore/Array.inl"
 
 #include <new> // placement new
 
@@ -116,7 +119,7 @@ void ColorBlockCompressor::compress(nvtt::AlphaMode alphaMode, uint w, uint h, c
 struct ColorBlockCompressorContext
 {
     nvtt::AlphaMode alphaMode;
-    uint w, h;
+    uint w, h, d;
     const float * data;
     const nvtt::CompressionOptions::Private * compressionOptions;
 
@@ -125,32 +128,34 @@ struct ColorBlockCompressorContext
     ColorBlockCompressor * compressor;
 };
 
-// Each task compresses one block.
+// Each task compresses one block. The blocks of all the slices of a volume are dispatched together.
 void ColorBlockCompressorTask(void * data, int i)
 {
+    NV_PROFILE_ZONE("Encode blocks");
+
     ColorBlockCompressorContext * d = (ColorBlockCompressorContext *) data;
 
     uint x = i % d->bw;
-    uint y = i / d->bw;
+    uint y = (i / d->bw) % d->bh;
+    uint z = i / (d->bw * d->bh);
 
     //for (uint x = 0; x < d->bw; x++)
     {
         ColorBlock rgba;
-        rgba.init(d->w, d->h, d->data, 4*x, 4*y);
+        rgba.init(d->w, d->h, d->d, d->data, 4*x, 4*y, z);
 
-        uint8 * ptr = d->mem + (y * d->bw + x) * d->bs;
+        uint8 * ptr = d->mem + i * d->bs;
         d->compressor->compressBlock(rgba, d->alphaMode, *d->compressionOptions, ptr);
     }
 }
 
 void ColorBlockCompressor::compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * data, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions)
 {
-    nvDebugCheck(d == 1);
-
     ColorBlockCompressorContext context;
     context.alphaMode = alphaMode;
     context.w = w;
     context.h = h;
+    context.d = d;
     context.data = data;
     context.compressionOptions = &compressionOptions;
 
@@ -163,28 +168,29 @@ void ColorBlockCompressor::compress(nvtt::AlphaMode alphaMode, uint w, uint h, u
     SequentialTaskDispatcher sequential;
 
     // Use a single thread to compress small textures.
-    if (context.bh < 4) dispatcher = &sequential;
+    if (context.bh * d < 4) dispatcher = &sequential;
 
 #if _DEBUG
     dispatcher = &sequential;
 #endif
 
-    const uint count = context.bw * context.bh;
+    // Slices are stored one after the other, as in DDS volume textures.
+    const uint count = context.bw * context.bh * d;
     const uint size = context.bs * count;
-    context.mem = new uint8[size];
+    context.mem = allocateBuffer<uint8>(size);
 
     dispatcher->dispatch(ColorBlockCompressorTask, &context, count);
 
     outputOptions.writeData(context.mem, size);
 
-    delete [] context.mem;
+    freeBuffer(context.mem, size);
 }
 
 
 struct ColorSetCompressorContext
 {
     nvtt::AlphaMode alphaMode;
-    uint w, h;
+    uint w, h, d;
     const float * data;
     const nvtt::CompressionOptions::Private * compressionOptions;
 
@@ -194,20 +200,23 @@ struct ColorSetCompressorContext
 };
 
 
-// Each task compresses one block.
+// Each task compresses one block. The blocks of all the slices of a volume are dispatched together.
 void ColorSetCompressorTask(void * data, int i)
 {
+    NV_PROFILE_ZONE("Encode blocks");
+
     ColorSetCompressorContext * d = (ColorSetCompressorContext *) data;
 
     uint x = i % d->bw;
-    uint y = i / d->bw;
+    uint y = (i / d->bw) % d->bh;
+    uint z = i / (d->bw * d->bh);
 
     //for (uint x = 0; x < d->bw; x++)
     {
         ColorSet set;
-        set.setColors(d->data, d->w, d->h, x * 4, y * 4);
+        set.setColors(d->data, d->w, d->h, d->d, x * 4, y * 4, z);
 
-        uint8 * ptr = d->mem + (y * d->bw + x) * d->bs;
+        uint8 * ptr = d->mem + i * d->bs;
         d->compressor->compressBlock(set, d->alphaMode, *d->compressionOptions, ptr);
     }
 }
@@ -215,12 +224,11 @@ void ColorSetCompressorTask(void * data, int i)
 
 void ColorSetCompressor::compress(AlphaMode alphaMode, uint w, uint h, uint d, const float * data, nvtt::TaskDispatcher * dispatcher, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions)
 {
-    nvDebugCheck(d == 1);
-
     ColorSetCompressorContext context;
     context.alphaMode = alphaMode;
     context.w = w;
     context.h = h;
+    context.d = d;
     context.data = data;
     context.compressionOptions = &compressionOptions;
 
@@ -233,19 +241,339 @@ void ColorSetCompressor::compress(AlphaMode alphaMode, uint w, uint h, uint d, c
     SequentialTaskDispatcher sequential;
 
     // Use a single thread to compress small textures.
-    if (context.bh < 4) dispatcher = &sequential;
+    if (context.bh * d < 4) dispatcher = &sequential;
 
 #if _DEBUG
     dispatcher = &sequential;
 #endif
 
-    const uint count = context.bw * context.bh;
+    // Slices are stored one after the other, as in DDS volume textures.
+    const uint count = context.bw * context.bh * d;
     const uint size = context.bs * count;
-    context.mem = new uint8[size];
+    context.mem = allocateBuffer<uint8>(size);
+
+    prepare(alphaMode, compressionOptions);
 
     dispatcher->dispatch(ColorSetCompressorTask, &context, count);
 
     outputOptions.writeData(context.mem, size);
 
-    delete [] context.mem;
+    freeBuffer(context.mem, size);
+}
+
+
+// Batches of small images are compressed with a single dispatch. Each task compresses one block, the block index is
+// mapped to an image using the index of the first block of each image.
+struct BatchCompressorContext
+{
+    nvtt::AlphaMode alphaMode;
+    const CompressorImage * images;
+    uint count;
+    const uint * firstBlock;    // count + 1 entries.
+    const nvtt::CompressionOptions::Private * compressionOptions;
+
+    uint bs;
+    ColorBlockCompressor * blockCompressor;
+    ColorSetCompressor * setCompressor;
+};
+
+static uint findBatchImage(const BatchCompressorContext * d, uint i)
+{
+    uint lo = 0, hi = d->count;
+    while (hi - lo > 1) {
+        const uint mid = (lo + hi) / 2;
+        if (d->firstBlock[mid] <= i) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+void BatchCompressorTask(void * data, int i)
+{
+    NV_PROFILE_ZONE("Encode blocks");
+
+    BatchCompressorContext * d = (BatchCompressorContext *) data;
+
+    const uint k = findBatchImage(d, i);
+    const CompressorImage & image = d->images[k];
+
+    const uint b = i - d->firstBlock[k];
+    const uint bw = (image.w + 3) / 4;
+    const uint bh = (image.h + 3) / 4;
+
+    const uint x = b % bw;
+    const uint y = (b / bw) % bh;
+    const uint z = b / (bw * bh);
+
+    uint8 * ptr = (uint8 *)image.output + b * d->bs;
+
+    if (d->blockCompressor != NULL) {
+        ColorBlock rgba;
+        rgba.init(image.w, image.h, image.d, image.data, 4*x, 4*y, z);
+        d->blockCompressor->compressBlock(rgba, d->alphaMode, *d->compressionOptions, ptr);
+    }
+    else {
+        ColorSet set;
+        set.setColors(image.data, image.w, image.h, image.d, x * 4, y * 4, z);
+        d->setCompressor->compressBlock(set, d->alphaMode, *d->compressionOptions, ptr);
+    }
+}
+
+static void compressBatch(BatchCompressorContext & context, nvtt::TaskDispatcher * dispatcher)
+{
+    Array<uint> firstBlock;
+    firstBlock.resize(context.count + 1);
+
+    uint blockCount = 0, blockRows = 0;
+    for (uint k = 0; k < context.count; k++) {
+        const CompressorImage & image = context.images[k];
+        firstBlock[k] = blockCount;
+        blockCount += ((image.w + 3) / 4) * ((image.h + 3) / 4) * image.d;
+        blockRows += ((image.h + 3) / 4) * image.d;
+    }
+    firstBlock[context.count] = blockCount;
+    context.firstBlock = firstBlock.buffer();
+
+    SequentialTaskDispatcher sequential;
+
+    // Use a single thread to compress small batches.
+    if (blockRows < 4) dispatcher = &sequential;
+
+#if _DEBUG
+    dispatcher = &sequential;
+#endif
+
+    dispatcher->dispatch(BatchCompressorTask, &context, blockCount);
+}
+
+bool ColorBlockCompressor::compressBatch(nvtt::AlphaMode alphaMode, const CompressorImage * images, uint count, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions)
+{
+    BatchCompressorContext context;
+    context.alphaMode = alphaMode;
+    context.images = images;
+    context.count = count;
+    context.compressionOptions = &compressionOptions;
+    context.bs = blockSize();
+    context.blockCompressor = this;
+    context.setCompressor = NULL;
+
+    ::compressBatch(context, dispatcher);
+
+    return true;
+}
+
+bool ColorSetCompressor::compressBatch(nvtt::AlphaMode alphaMode, const CompressorImage * images, uint count, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions)
+{
+    BatchCompressorContext context;
+    context.alphaMode = alphaMode;
+    context.images = images;
+    context.count = count;
+    context.compressionOptions = &compressionOptions;
+    context.bs = blockSize();
+    context.blockCompressor = NULL;
+    context.setCompressor = this;
+
+    prepare(alphaMode, compressionOptions);
+
+    ::compressBatch(context, dispatcher);
+
+    return true;
+}
+
+
+AdaptiveCompressor::AdaptiveCompressor(nvtt::Format format, Atomic<uint64> * blockCounts) : format(format), blockCounts(blockCounts)
+{
+}
+
+void AdaptiveCompressor::setFastCompressor(ColorBlockCompressor * compressor)
+{
+    fastBlockCompressor = compressor;
+    fastSetCompressor = NULL;
+}
+
+void AdaptiveCompressor::setFastCompressor(ColorSetCompressor * compressor)
+{
+    fastBlockCompressor = NULL;
+    fastSetCompressor = compressor;
+}
+
+void AdaptiveCompressor::setQualityCompressor(ColorBlockCompressor * compressor)
+{
+    qualityBlockCompressor = compressor;
+    qualitySetCompressor = NULL;
+}
+
+void AdaptiveCompressor::setQualityCompressor(ColorSetCompressor * compressor)
+{
+    qualityBlockCompressor = NULL;
+    qualitySetCompressor = compressor;
+}
+
+uint AdaptiveCompressor::blockSize() const
+{
+    if (fastBlockCompressor != NULL) return fastBlockCompressor->blockSize();
+    return fastSetCompressor->blockSize();
+}
+
+
+struct AdaptiveCompressorContext
+{
+    nvtt::AlphaMode alphaMode;
+    uint w, h, d;
+    const float * data;
+    const nvtt::CompressionOptions::Private * compressionOptions;
+
+    uint bw, bh, bs;
+    uint8 * mem;
+    uint8 * refined;        // One entry per block, set when the block was encoded again with the quality compressor.
+
+    Vector4 weights;        // Channel weights of the error metric.
+    float maxError;         // Weighted squared error of a block at the threshold.
+
+    AdaptiveCompressor * compressor;
+};
+
+static void compressTier(const AdaptiveCompressorContext * d, ColorBlockCompressor * blockCompressor, ColorSetCompressor * setCompressor, const ColorBlock & rgba, uint x, uint y, uint z, void * output)
+{
+    if (blockCompressor != NULL) {
+        // Block compressors are allowed to modify their input.
+        ColorBlock tmp(rgba);
+        blockCompressor->compressBlock(tmp, d->alphaMode, *d->compressionOptions, output);
+    }
+    else {
+        ColorSet set;
+        set.setColors(d->data, d->w, d->h, d->d, x * 4, y * 4, z);
+        setCompressor->compressBlock(set, d->alphaMode, *d->compressionOptions, output);
+    }
+}
+
+// Weighted sum of the squared errors of the encoded block, in 8 bit units.
+static float blockError(const AdaptiveCompressorContext * d, const ColorBlock & rgba, const void * output)
+{
+    const bool d3d9 = (d->compressionOptions->decoder == Decoder_D3D9);
+    const bool nv5x = (d->compressionOptions->decoder == Decoder_NV5x);
+
+    ColorBlock decoded;
+
+    switch (d->compressor->format) {
+        case Format_DXT1:
+            if (nv5x) ((const BlockDXT1 *)output)->decodeBlockNV5x(&decoded);
+            else ((const BlockDXT1 *)output)->decodeBlock(&decoded, d3d9);
+            break;
+        case Format_DXT5:
+            if (nv5x) ((const BlockDXT5 *)output)->decodeBlockNV5x(&decoded);
+            else ((const BlockDXT5 *)output)->decodeBlock(&decoded, d3d9);
+            break;
+        case Format_BC4:
+            ((const BlockATI1 *)output)->decodeBlock(&decoded, d3d9);
+            break;
+        case Format_BC5:
+            ((const BlockATI2 *)output)->decodeBlock(&decoded, d3d9);
+            break;
+        case Format_BC7:
+            ((const BlockBC7 *)output)->decodeBlock(&decoded);
+            break;
+        default:
+            nvUnreachable();
+    }
+
+    float error = 0.0f;
+    for (uint i = 0; i < 16; i++) {
+        const Color32 c0 = rgba.color(i);
+        const Color32 c1 = decoded.color(i);
+        error += d->weights.x * square(float(c0.r) - float(c1.r));
+        error += d->weights.y * square(float(c0.g) - float(c1.g));
+        error += d->weights.z * square(float(c0.b) - float(c1.b));
+        error += d->weights.w * square(float(c0.a) - float(c1.a));
+    }
+    return error;
+}
+
+// Each task compresses one block with the fast compressor, and again with the quality compressor when needed.
+void AdaptiveCompressorTask(void * data, int i)
+{
+    NV_PROFILE_ZONE("Encode blocks");
+
+    AdaptiveCompressorContext * d = (AdaptiveCompressorContext *) data;
+    AdaptiveCompressor * compressor = d->compressor;
+
+    uint x = i % d->bw;
+    uint y = (i / d->bw) % d->bh;
+    uint z = i / (d->bw * d->bh);
+
+    ColorBlock rgba;
+    rgba.init(d->w, d->h, d->d, d->data, 4*x, 4*y, z);
+
+    uint8 * ptr = d->mem + i * d->bs;
+    compressTier(d, compressor->fastBlockCompressor.ptr(), compressor->fastSetCompressor.ptr(), rgba, x, y, z, ptr);
+
+    d->refined[i] = blockError(d, rgba, ptr) > d->maxError;
+
+    if (d->refined[i]) {
+        compressTier(d, compressor->qualityBlockCompressor.ptr(), compressor->qualitySetCompressor.ptr(), rgba, x, y, z, ptr);
+    }
+}
+
+void AdaptiveCompressor::compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * data, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions)
+{
+    AdaptiveCompressorContext context;
+    context.alphaMode = alphaMode;
+    context.w = w;
+    context.h = h;
+    context.d = d;
+    context.data = data;
+    context.compressionOptions = &compressionOptions;
+
+    context.bs = blockSize();
+    context.bw = (w + 3) / 4;
+    context.bh = (h + 3) / 4;
+
+    context.compressor = this;
+
+    // Only the channels stored by the format contribute to the error.
+    const Vector4 & cw = compressionOptions.colorWeight;
+    if (format == Format_DXT1) context.weights = Vector4(cw.x, cw.y, cw.z, 0.0f);
+    else if (format == Format_BC4) context.weights = Vector4(cw.x, 0.0f, 0.0f, 0.0f);
+    else if (format == Format_BC5) context.weights = Vector4(cw.x, cw.y, 0.0f, 0.0f);
+    else context.weights = cw;
+
+    const float weightSum = context.weights.x + context.weights.y + context.weights.z + context.weights.w;
+    context.maxError = square(compressionOptions.adaptiveThreshold) * 16.0f * weightSum;
+
+    SequentialTaskDispatcher sequential;
+
+    // Use a single thread to compress small textures.
+    if (context.bh * d < 4) dispatcher = &sequential;
+
+#if _DEBUG
+    dispatcher = &sequential;
+#endif
+
+    // Slices are stored one after the other, as in DDS volume textures.
+    const uint count = context.bw * context.bh * d;
+    const uint size = context.bs * count;
+    context.mem = allocateBuffer<uint8>(size);
+
+    Array<uint8> refined;
+    refined.resize(count);
+    context.refined = refined.buffer();
+
+    if (fastSetCompressor != NULL) fastSetCompressor->prepare(alphaMode, compressionOptions);
+    if (qualitySetCompressor != NULL) qualitySetCompressor->prepare(alphaMode, compressionOptions);
+
+    dispatcher->dispatch(AdaptiveCompressorTask, &context, count);
+
+    outputOptions.writeData(context.mem, size);
+
+    freeBuffer(context.mem, size);
+
+    if (blockCounts != NULL) {
+        uint refinedCount = 0;
+        for (uint i = 0; i < count; i++) {
+            refinedCount += refined[i];
+        }
+        // The counts are shared by all the calls of the context, which may run concurrently.
+        blockCounts[Quality_Fastest].add(count - refinedCount);
+        blockCounts[compressionOptions.quality].add(refinedCount);
+    }
 }
@@ -27,6 +27,9 @@
 
 #include "Compressor.h"
 
+#include "nvcore/Ptr.h"
+#include "nvthread/Atomic.h"
+
 
 namespace nv
 {
@@ -36,6 +39,7 @@ namespace nv
     struct ColorBlockCompressor : public CompressorInterface
     {
         virtual void compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * rgba, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions);
+        virtual bool compressBatch(nvtt::AlphaMode alphaMode, const CompressorImage * images, uint count, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions);
 
         virtual void compressBlock(ColorBlock & rgba, nvtt::AlphaMode alphaMode, const nvtt::CompressionOptions::Private & compressionOptions, void * output) = 0;
         virtual uint blockSize() const = 0;
@@ -44,11 +48,41 @@ namespace nv
     struct ColorSetCompressor : public CompressorInterface
     {
         virtual void compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * rgba, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions);
+        virtual bool compressBatch(nvtt::AlphaMode alphaMode, const CompressorImage * images, uint count, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions);
+
+        // Called once per image, before compressing its blocks in parallel.
+        virtual void prepare(nvtt::AlphaMode alphaMode, const nvtt::CompressionOptions::Private & compressionOptions) {}
 
         virtual void compressBlock(ColorSet & set, nvtt::AlphaMode alphaMode, const nvtt::CompressionOptions::Private & compressionOptions, void * output) = 0;
         virtual uint blockSize() const = 0;
     };
 
+    // Encodes every block with the fast compressor, and encodes it again with the quality compressor only when the
+    // error of the fast encoding is above the adaptive threshold of the compression options.
+    struct AdaptiveCompressor : public CompressorInterface
+    {
+        // Blocks encoded at each quality level are added to blockCounts, indexed by nvtt::Quality. It may be NULL.
+        AdaptiveCompressor(nvtt::Format format, Atomic<uint64> * blockCounts);
+
+        // Each tier is either a block or a set compressor. The adaptive compressor owns them.
+        void setFastCompressor(ColorBlockCompressor * compressor);
+        void setFastCompressor(ColorSetCompressor * compressor);
+        void setQualityCompressor(ColorBlockCompressor * compressor);
+        void setQualityCompressor(ColorSetCompressor * compressor);
+
+        virtual void compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * rgba, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions);
+
+        uint blockSize() const;
+
+        nvtt::Format format;
+        Atomic<uint64> * blockCounts;
+
+        AutoPtr<ColorBlockCompressor> fastBlockCompressor;
+        AutoPtr<ColorSetCompressor> fastSetCompressor;
+        AutoPtr<ColorBlockCompressor> qualityBlockCompressor;
+        AutoPtr<ColorSetCompressor> qualitySetCompressor;
+    };
+
 } // nv namespace
 
 
@@ -71,6 +71,9 @@ void CompressionOptions::reset()
     m.alphaThreshold = 127;
 
     m.decoder = Decoder_D3D10;
+
+    m.adaptiveQuality = false;
+    m.adaptiveThreshold = 4.0f;
 }
 
 
@@ -193,6 +196,16 @@ void CompressionOptions::setTargetDecoder(Decoder decoder)
     m.decoder = decoder;
 }
 
+/// Enable adaptive quality. Most blocks are encoded well enough by the fastest compressor, only the blocks whose RMS
+/// error exceeds the threshold are encoded again at the selected quality. The error is in 8 bit units and weighted by
+/// the color weights.
+void CompressionOptions::setAdaptiveQuality(bool enable, float threshold/*= 4.0f*/)
+{
+    nvCheck(threshold >= 0.0f);
+    m.adaptiveQuality = enable;
+    m.adaptiveThreshold = threshold;
+}
+
 
 
 // Translate to and from D3D formats.
@@ -64,6 +64,10 @@ namespace nvtt
 
         Decoder decoder;
 
+        // Adaptive quality.
+        bool adaptiveQuality;
+        float adaptiveThreshold;    // RMS error of a block, in 8 bit units.
+
         uint getBitCount() const
         {
             if (format == Format_RGBA) {
@@ -30,10 +30,22 @@
 
 namespace nv
 {
+    // One of the images of a batch, compressed to the given output buffer.
+    struct CompressorImage
+    {
+        uint w, h, d;
+        const float * data;
+        void * output;
+    };
+
     struct CompressorInterface
     {
         virtual ~CompressorInterface() {}
         virtual void compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * rgba, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions) = 0;
+
+        // Compress several small images, like the levels of a mipmap tail, with a single dispatch. Returns false if the
+        // compressor does not support it, then the images have to be compressed one at a time.
+        virtual bool compressBatch(nvtt::AlphaMode alphaMode, const CompressorImage * images, uint count, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions) { return false; }
     };
 
 } // nv namespace
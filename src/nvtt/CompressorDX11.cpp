@@ -39,11 +39,9 @@ using namespace nv;
 using namespace nvtt;
 
 
-void CompressorBC6::compressBlock(ColorSet & tile, AlphaMode alphaMode, const CompressionOptions::Private & compressionOptions, void * output)
+// The codec flags are globals, they are set once per image instead of by every block.
+void CompressorBC6::prepare(AlphaMode alphaMode, const CompressionOptions::Private & compressionOptions)
 {
-    // !!!UNDONE: support channel weights
-    // !!!UNDONE: set flags once, not per block (this is especially sketchy since block compression is multithreaded...)
-
     if (compressionOptions.pixelType == PixelType_UnsignedFloat ||
         compressionOptions.pixelType == PixelType_UnsignedNorm ||
         compressionOptions.pixelType == PixelType_UnsignedInt)
@@ -54,6 +52,11 @@ void CompressorBC6::compressBlock(ColorSet & tile, AlphaMode alphaMode, const Co
     {
         ZOH::Utils::FORMAT = ZOH::SIGNED_F16;
     }
+}
+
+void CompressorBC6::compressBlock(ColorSet & tile, AlphaMode alphaMode, const CompressionOptions::Private & compressionOptions, void * output)
+{
+    // !!!UNDONE: support channel weights
 
     // Convert NVTT's tile struct to ZOH's, and convert float to half.
     ZOH::Tile zohTile(tile.w, tile.h);
@@ -83,18 +86,17 @@ void CompressorBC6::compressBlock(ColorSet & tile, AlphaMode alphaMode, const Co
     ZOH::compress(zohTile, (char *)output);
 }
 
-void CompressorBC7::compressBlock(ColorSet & tile, AlphaMode alphaMode, const CompressionOptions::Private & compressionOptions, void * output)
+void CompressorBC7::prepare(AlphaMode alphaMode, const CompressionOptions::Private & compressionOptions)
 {
-    // !!!UNDONE: support channel weights
-    // !!!UNDONE: set flags once, not per block (this is especially sketchy since block compression is multithreaded...)
-
     AVPCL::mode_rgb = false;
     AVPCL::flag_premult = (alphaMode == AlphaMode_Premultiplied);
     AVPCL::flag_nonuniform = false;
     AVPCL::flag_nonuniform_ati = false;
-    
-    // Convert NVTT's tile struct to AVPCL's.
-    AVPCL::Tile avpclTile(tile.w, tile.h);
+}
+
+// Convert NVTT's tile struct to AVPCL's.
+static void initTile(const ColorSet & tile, AVPCL::Tile & avpclTile)
+{
     memset(avpclTile.data, 0, sizeof(avpclTile.data));
     for (uint y = 0; y < tile.h; ++y) {
         for (uint x = 0; x < tile.w; ++x) {
@@ -109,6 +111,22 @@ void CompressorBC7::compressBlock(ColorSet & tile, AlphaMode alphaMode, const Co
             }
         }
     }
+}
+
+void CompressorBC7::compressBlock(ColorSet & tile, AlphaMode alphaMode, const CompressionOptions::Private & compressionOptions, void * output)
+{
+    // !!!UNDONE: support channel weights
+
+    AVPCL::Tile avpclTile(tile.w, tile.h);
+    initTile(tile, avpclTile);
 
     AVPCL::compress(avpclTile, (char *)output);
 }
+
+void FastCompressorBC7::compressBlock(ColorSet & tile, AlphaMode alphaMode, const CompressionOptions::Private & compressionOptions, void * output)
+{
+    AVPCL::Tile avpclTile(tile.w, tile.h);
+    initTile(tile, avpclTile);
+
+    AVPCL::compress_mode6(avpclTile, (char *)output);
+}
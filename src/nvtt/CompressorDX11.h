@@ -30,15 +30,23 @@ namespace nv
 {
     struct CompressorBC6 : public ColorSetCompressor
     {
+        virtual void prepare(nvtt::AlphaMode alphaMode, const nvtt::CompressionOptions::Private & compressionOptions);
         virtual void compressBlock(ColorSet & set, nvtt::AlphaMode alphaMode, const nvtt::CompressionOptions::Private & compressionOptions, void * output);
         virtual uint blockSize() const { return 16; }
     };
 
     struct CompressorBC7 : public ColorSetCompressor
     {
+        virtual void prepare(nvtt::AlphaMode alphaMode, const nvtt::CompressionOptions::Private & compressionOptions);
         virtual void compressBlock(ColorSet & set, nvtt::AlphaMode alphaMode, const nvtt::CompressionOptions::Private & compressionOptions, void * output);
         virtual uint blockSize() const { return 16; }
     };
+
+    // Only tries mode 6, a single RGBA subset. Fast tier of the adaptive quality mode.
+    struct FastCompressorBC7 : public CompressorBC7
+    {
+        virtual void compressBlock(ColorSet & set, nvtt::AlphaMode alphaMode, const nvtt::CompressionOptions::Private & compressionOptions, void * output);
+    };
 	
 } // nv namespace
 
@@ -374,6 +374,50 @@ void CompressorDXT5n::compressBlock(ColorBlock & rgba, nvtt::AlphaMode alphaMode
 
 
 
+// Compress the colors of src divided by their M values.
+static void compressColorRGBM(const ColorSet & src, const float M[16], const nvtt::CompressionOptions::Private & compressionOptions, BlockDXT1 * output)
+{
+    ColorSet rgb;
+    rgb.allocate(src.w, src.h);     // @@ Handle smaller blocks.
+
+    if (src.colorCount != 16) {
+        nvDebugBreak();
+    }
+
+    for (uint i = 0; i < src.colorCount; i++) {
+        const Vector4 & c = src.color(i);
+
+        float R = saturate(c.x);
+        float G = saturate(c.y);
+        float B = saturate(c.z);
+
+        float r = saturate(R / M[i]);
+        float g = saturate(G / M[i]);
+        float b = saturate(B / M[i]);
+        float a = c.w;
+
+        rgb.colors[i] = Vector4(r, g, b, a);
+        rgb.indices[i] = i;
+        rgb.weights[i] = max(c.w, 0.001f);// src.weights[i];   // IC: For some reason 0 weights are causing problems, even if we eliminate the corresponding colors from the set.
+    }
+
+    rgb.createMinimalSet(/*ignoreTransparent=*/true);
+
+    if (rgb.isSingleColor(/*ignoreAlpha=*/true)) {
+        OptimalCompress::compressDXT1(toColor32(rgb.color(0)), output);
+    }
+    else {
+        ClusterFit fit;
+        fit.setColorWeights(compressionOptions.colorWeight);
+        fit.setColorSet(&rgb);
+
+        Vector3 start, end;
+        fit.compress4(&start, &end);
+
+        QuickCompress::outputBlock4(rgb, start, end, output);
+    }
+}
+
 void CompressorBC3_RGBM::compressBlock(ColorSet & src, nvtt::AlphaMode alphaMode, const nvtt::CompressionOptions::Private & compressionOptions, void * output)
 {
     BlockDXT5 * block = new(output)BlockDXT5;
@@ -433,54 +477,48 @@ void CompressorBC3_RGBM::compressBlock(ColorSet & src, nvtt::AlphaMode alphaMode
         fit.Compress(&block->color);
     }
 #endif
-#if 1
-    ColorSet rgb;
-    rgb.allocate(src.w, src.h);     // @@ Handle smaller blocks.
-
-    if (src.colorCount != 16) {
-        nvDebugBreak();
-    }
-
+    float multipliers[16];
     for (uint i = 0; i < src.colorCount; i++) {
         const Vector4 & c = src.color(i);
+        multipliers[i] = max(max(saturate(c.x), saturate(c.y)), max(saturate(c.z), threshold));
+    }
 
-        float R = saturate(c.x);
-        float G = saturate(c.y);
-        float B = saturate(c.z);
+    compressColorRGBM(src, multipliers, compressionOptions, &block->color);
 
-        float M = max(max(R, G), max(B, threshold));
-        float r = R / M;
-        float g = G / M;
-        float b = B / M;
-        float a = c.w;
+    // Decompress RGB/M block.
+    nv::ColorBlock RGB;
+    block->color.decodeBlock(&RGB);
 
-        rgb.colors[i] = Vector4(r, g, b, a);
-        rgb.indices[i] = i;
-        rgb.weights[i] = max(c.w, 0.001f);// src.weights[i];   // IC: For some reason 0 weights are causing problems, even if we eliminate the corresponding colors from the set.
-    }
+    if (compressionOptions.quality == Quality_Production || compressionOptions.quality == Quality_Highest) {
+        // Optimize RGB and M jointly. Fit M to the decoded colors, then alternate between fitting the colors to the
+        // decoded M values and M to the decoded colors, while the error keeps improving.
+        const bool exhaustive = (compressionOptions.quality == Quality_Highest);
+        const int iterationCount = exhaustive ? 4 : 1;
 
-    rgb.createMinimalSet(/*ignoreTransparent=*/true);
+        float bestError = OptimalCompress::compressDXT5A_RGBM(src, RGB, threshold, exhaustive, &block->alpha);
 
-    if (rgb.isSingleColor(/*ignoreAlpha=*/true)) {
-        OptimalCompress::compressDXT1(toColor32(rgb.color(0)), &block->color);
-    }
-    else {
-        ClusterFit fit;
-        fit.setColorWeights(compressionOptions.colorWeight);
-        fit.setColorSet(&rgb);
+        for (int it = 0; it < iterationCount; it++) {
+            AlphaBlock4x4 M;
+            block->alpha.decodeBlock(&M);
 
-        Vector3 start, end;
-        fit.compress4(&start, &end);
+            for (uint i = 0; i < src.colorCount; i++) {
+                multipliers[i] = M.alpha[i] / 255.0f * (1 - threshold) + threshold;
+            }
+
+            BlockDXT5 candidate;
+            compressColorRGBM(src, multipliers, compressionOptions, &candidate.color);
+
+            candidate.color.decodeBlock(&RGB);
+            float error = OptimalCompress::compressDXT5A_RGBM(src, RGB, threshold, exhaustive, &candidate.alpha);
+
+            if (!(error < bestError)) break;
 
-        QuickCompress::outputBlock4(rgb, start, end, &block->color);
+            bestError = error;
+            *block = candidate;
+        }
+        return;
     }
-#endif
 
-    // Decompress RGB/M block.
-    nv::ColorBlock RGB;
-    block->color.decodeBlock(&RGB);
-    
-#if 1
     AlphaBlock4x4 M;
     for (int i = 0; i < 16; i++) {
         const Vector4 & c = src.color(i);
@@ -510,51 +548,6 @@ void CompressorBC3_RGBM::compressBlock(ColorSet & src, nvtt::AlphaMode alphaMode
     else {
         OptimalCompress::compressDXT5A(M, &block->alpha);
     }
-#else
-    OptimalCompress::compressDXT5A_RGBM(src, RGB, &block->alpha);
-#endif
-
-#if 0
-    // Decompress M.
-    block->alpha.decodeBlock(&M);
-
-    rgb.allocate(src.w, src.h);     // @@ Handle smaller blocks.
-
-    for (uint i = 0; i < src.colorCount; i++) {
-        const Vector4 & c = src.color(i);
-
-        float R = saturate(c.x);
-        float G = saturate(c.y);
-        float B = saturate(c.z);
-
-        //float m = max(max(R, G), max(B, threshold));
-        float m = float(M.alpha[i]) / 255.0f * (1 - threshold) + threshold;
-        float r = R / m;
-        float g = G / m;
-        float b = B / m;
-        float a = c.w;
-
-        rgb.colors[i] = Vector4(r, g, b, a);
-        rgb.indices[i] = i;
-        rgb.weights[i] = max(c.w, 0.001f);// src.weights[i];   // IC: For some reason 0 weights are causing problems, even if we eliminate the corresponding colors from the set.
-    }
-
-    rgb.createMinimalSet(/*ignoreTransparent=*/true);
-
-    if (rgb.isSingleColor(/*ignoreAlpha=*/true)) {
-        OptimalCompress::compressDXT1(toColor32(rgb.color(0)), &block->color);
-    }
-    else {
-        ClusterFit fit;
-        fit.setMetric(compressionOptions.colorWeight);
-        fit.setColourSet(&rgb);
-
-        Vector3 start, end;
-        fit.compress4(&start, &end);
-
-        QuickCompress::outputBlock4(rgb, start, end, &block->color);
-    }
-#endif
 
 #if 0
     block->color.decodeBlock(&RGB);
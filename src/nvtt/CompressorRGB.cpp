@@ -25,6 +25,7 @@
 #include "CompressorRGB.h"
 #include "CompressionOptions.h"
 #include "OutputOptions.h"
+#include "TaskDispatcher.h"
 
 #include "nvimage/Image.h"
 #include "nvimage/FloatImage.h"
@@ -35,6 +36,13 @@
 #include "nvmath/ftoi.h"
 
 #include "nvcore/Debug.h"
+#include "nvcore/Memory.h" // allocateBuffer
+
+#include <string.h> // memset
+
+#if NV_USE_SSE >= 2
+#include <emmintrin.h>
+#endif
 
 using namespace nv;
 using namespace nvtt;
@@ -237,15 +245,167 @@ namespace
 
 
 
+// Scanlines are converted in parallel into a buffer that holds the whole image.
+struct PixelFormatConverterContext
+{
+    const nvtt::CompressionOptions::Private * compressionOptions;
+    const float * data;
+    uint w, whd;
+    uint pitch;
+    uint8 * mem;
+
+    uint bitCount;
+    uint rshift, rsize;
+    uint gshift, gsize;
+    uint bshift, bsize;
+    uint ashift, asize;
+};
+
+static void PixelFormatConverterTask(void * context, int row)
+{
+    const PixelFormatConverterContext & ctx = *(const PixelFormatConverterContext *)context;
+    const nvtt::CompressionOptions::Private & compressionOptions = *ctx.compressionOptions;
+
+    const uint w = ctx.w;
+    const uint whd = ctx.whd;
+    const uint bitCount = ctx.bitCount;
+    const uint rshift = ctx.rshift, rsize = ctx.rsize;
+    const uint gshift = ctx.gshift, gsize = ctx.gsize;
+    const uint bshift = ctx.bshift, bsize = ctx.bsize;
+    const uint ashift = ctx.ashift, asize = ctx.asize;
+
+    // Slices are stored one after the other, as in DDS volume textures.
+    const float * src = ctx.data + row * w;
+    uint8 * const dst = ctx.mem + row * ctx.pitch;
+
+    uint x = 0;
+
+#if NV_USE_SSE >= 2
+    // The most common formats have their own loops, they produce the same bits as the generic code below.
+    if (compressionOptions.pixelType == nvtt::PixelType_Float && rsize == 32 && gsize == 32 && bsize == 32 && asize == 32)
+    {
+        for (; x + 4 <= w; x += 4)
+        {
+            __m128 r = _mm_loadu_ps(src + x + 0 * whd);
+            __m128 g = _mm_loadu_ps(src + x + 1 * whd);
+            __m128 b = _mm_loadu_ps(src + x + 2 * whd);
+            __m128 a = _mm_loadu_ps(src + x + 3 * whd);
+            _MM_TRANSPOSE4_PS(r, g, b, a);
+            _mm_storeu_ps((float *)(dst + 16 * x) + 0, r);
+            _mm_storeu_ps((float *)(dst + 16 * x) + 4, g);
+            _mm_storeu_ps((float *)(dst + 16 * x) + 8, b);
+            _mm_storeu_ps((float *)(dst + 16 * x) + 12, a);
+        }
+    }
+    else if (compressionOptions.pixelType == nvtt::PixelType_UnsignedNorm && bitCount == 32 && rsize <= 16 && gsize <= 16 && bsize <= 16 && asize <= 16)
+    {
+        const uint shifts[4] = { rshift, gshift, bshift, ashift };
+        const uint sizes[4] = { rsize, gsize, bsize, asize };
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 scale = _mm_set1_ps(65535.0f);
+
+        for (; x + 4 <= w; x += 4)
+        {
+            __m128i p = _mm_setzero_si128();
+            for (uint c = 0; c < 4; c++)
+            {
+                // iround(clamp(f * 65535, 0, 65535)) truncated to the channel size.
+                const __m128 f = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + x + c * whd), scale), zero), scale);
+                const __m128i i = _mm_srl_epi32(_mm_cvttps_epi32(_mm_add_ps(f, half)), _mm_cvtsi32_si128(16 - sizes[c]));
+                p = _mm_or_si128(p, _mm_sll_epi32(i, _mm_cvtsi32_si128(shifts[c])));
+            }
+            _mm_storeu_si128((__m128i *)(dst + 4 * x), p);
+        }
+    }
+#endif
+
+    BitStream stream(dst + x * bitCount / 8);
+
+    for (; x < w; x++)
+    {
+        float r = src[x + 0 * whd];
+        float g = src[x + 1 * whd];
+        float b = src[x + 2 * whd];
+        float a = src[x + 3 * whd];
+
+        if (compressionOptions.pixelType == nvtt::PixelType_Float)
+        {
+            if (rsize == 32) stream.putFloat(r);
+            else if (rsize == 16) stream.putHalf(r);
+            else if (rsize == 11) stream.putFloat11(r);
+            else if (rsize == 10) stream.putFloat10(r);
+            else stream.putBits(0, rsize);
+
+            if (gsize == 32) stream.putFloat(g);
+            else if (gsize == 16) stream.putHalf(g);
+            else if (gsize == 11) stream.putFloat11(g);
+            else if (gsize == 10) stream.putFloat10(g);
+            else stream.putBits(0, gsize);
+
+            if (bsize == 32) stream.putFloat(b);
+            else if (bsize == 16) stream.putHalf(b);
+            else if (bsize == 11) stream.putFloat11(b);
+            else if (bsize == 10) stream.putFloat10(b);
+            else stream.putBits(0, bsize);
+
+            if (asize == 32) stream.putFloat(a);
+            else if (asize == 16) stream.putHalf(a);
+            else if (asize == 11) stream.putFloat11(a);
+            else if (asize == 10) stream.putFloat10(a);
+            else stream.putBits(0, asize);
+        }
+        else
+        {
+            // We first convert to 16 bits, then to the target size. @@ If greater than 16 bits, this will truncate and bitexpand.
+            
+            // @@ Add support for nvtt::PixelType_SignedInt, nvtt::PixelType_SignedNorm, nvtt::PixelType_UnsignedInt
+
+            int ir, ig, ib, ia;
+            if (compressionOptions.pixelType == nvtt::PixelType_UnsignedNorm) {
+                ir = iround(clamp(r * 65535.0f, 0.0f, 65535.0f));
+                ig = iround(clamp(g * 65535.0f, 0.0f, 65535.0f));
+                ib = iround(clamp(b * 65535.0f, 0.0f, 65535.0f));
+                ia = iround(clamp(a * 65535.0f, 0.0f, 65535.0f));
+            }
+            else if (compressionOptions.pixelType == nvtt::PixelType_SignedNorm) {
+                // @@
+            }
+            else if (compressionOptions.pixelType == nvtt::PixelType_UnsignedInt) {
+                ir = iround(clamp(r, 0.0f, 65535.0f));
+                ig = iround(clamp(g, 0.0f, 65535.0f));
+                ib = iround(clamp(b, 0.0f, 65535.0f));
+                ia = iround(clamp(a, 0.0f, 65535.0f));
+            }
+            else if (compressionOptions.pixelType == nvtt::PixelType_SignedInt) {
+                // @@
+            }
+            
+            uint p = 0;
+            p |= PixelFormat::convert(ir, 16, rsize) << rshift;
+            p |= PixelFormat::convert(ig, 16, gsize) << gshift;
+            p |= PixelFormat::convert(ib, 16, bsize) << bshift;
+            p |= PixelFormat::convert(ia, 16, asize) << ashift;
+
+            stream.putBits(p, bitCount);
+        }
+    }
+
+    // Zero padding up to the pitch, the rows of the buffer may not be aligned themselves.
+    stream.flush();
+    nvDebugCheck(stream.ptr <= dst + ctx.pitch);
+    memset(stream.ptr, 0, dst + ctx.pitch - stream.ptr);
+}
+
 void PixelFormatConverter::compress(nvtt::AlphaMode /*alphaMode*/, uint w, uint h, uint d, const float * data, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions)
 {
     nvDebugCheck (compressionOptions.format == nvtt::Format_RGBA);
 
     uint bitCount;
-    uint rmask, rshift, rsize;
-    uint gmask, gshift, gsize;
-    uint bmask, bshift, bsize;
-    uint amask, ashift, asize;
+    uint rmask, rshift = 0, rsize;
+    uint gmask, gshift = 0, gsize;
+    uint bmask, bshift = 0, bsize;
+    uint amask, ashift = 0, asize;
 
     if (compressionOptions.pixelType == nvtt::PixelType_Float)
     {
@@ -301,97 +461,30 @@ void PixelFormatConverter::compress(nvtt::AlphaMode /*alphaMode*/, uint w, uint
         }
     }
 
-    const uint pitch = computeBytePitch(w, bitCount, compressionOptions.pitchAlignment);
-    const uint whd = w * h * d;
+    PixelFormatConverterContext context;
+    context.compressionOptions = &compressionOptions;
+    context.data = data;
+    context.w = w;
+    context.whd = w * h * d;
+    context.pitch = computeBytePitch(w, bitCount, compressionOptions.pitchAlignment);
+    context.bitCount = bitCount;
+    context.rshift = rshift; context.rsize = rsize;
+    context.gshift = gshift; context.gsize = gsize;
+    context.bshift = bshift; context.bsize = bsize;
+    context.ashift = ashift; context.asize = asize;
 
-    // Allocate output scanline.
-    uint8 * const dst = malloc<uint8>(pitch);
-
-    for (uint z = 0; z < d; z++)
-    {
-        for (uint y = 0; y < h; y++)
-        {
-            const float * src = (const float *)data + (z * h + y) * w;
+    SequentialTaskDispatcher sequential;
 
-            BitStream stream(dst);
+    // Use a single thread to convert small textures.
+    const uint rowCount = h * d;
+    if (rowCount < 16) dispatcher = &sequential;
 
-            for (uint x = 0; x < w; x++)
-            {
-                float r = src[x + 0 * whd];
-                float g = src[x + 1 * whd];
-                float b = src[x + 2 * whd];
-                float a = src[x + 3 * whd];
-
-                if (compressionOptions.pixelType == nvtt::PixelType_Float)
-                {
-                    if (rsize == 32) stream.putFloat(r);
-                    else if (rsize == 16) stream.putHalf(r);
-                    else if (rsize == 11) stream.putFloat11(r);
-                    else if (rsize == 10) stream.putFloat10(r);
-                    else stream.putBits(0, rsize);
-
-                    if (gsize == 32) stream.putFloat(g);
-                    else if (gsize == 16) stream.putHalf(g);
-                    else if (gsize == 11) stream.putFloat11(g);
-                    else if (gsize == 10) stream.putFloat10(g);
-                    else stream.putBits(0, gsize);
-
-                    if (bsize == 32) stream.putFloat(b);
-                    else if (bsize == 16) stream.putHalf(b);
-                    else if (bsize == 11) stream.putFloat11(b);
-                    else if (bsize == 10) stream.putFloat10(b);
-                    else stream.putBits(0, bsize);
-
-                    if (asize == 32) stream.putFloat(a);
-                    else if (asize == 16) stream.putHalf(a);
-                    else if (asize == 11) stream.putFloat11(a);
-                    else if (asize == 10) stream.putFloat10(a);
-                    else stream.putBits(0, asize);
-                }
-                else
-                {
-                    // We first convert to 16 bits, then to the target size. @@ If greater than 16 bits, this will truncate and bitexpand.
-                    
-                    // @@ Add support for nvtt::PixelType_SignedInt, nvtt::PixelType_SignedNorm, nvtt::PixelType_UnsignedInt
-
-                    int ir, ig, ib, ia;
-                    if (compressionOptions.pixelType == nvtt::PixelType_UnsignedNorm) {
-                        ir = iround(clamp(r * 65535.0f, 0.0f, 65535.0f));
-                        ig = iround(clamp(g * 65535.0f, 0.0f, 65535.0f));
-                        ib = iround(clamp(b * 65535.0f, 0.0f, 65535.0f));
-                        ia = iround(clamp(a * 65535.0f, 0.0f, 65535.0f));
-                    }
-                    else if (compressionOptions.pixelType == nvtt::PixelType_SignedNorm) {
-                        // @@
-                    }
-                    else if (compressionOptions.pixelType == nvtt::PixelType_UnsignedInt) {
-                        ir = iround(clamp(r, 0.0f, 65535.0f));
-                        ig = iround(clamp(g, 0.0f, 65535.0f));
-                        ib = iround(clamp(b, 0.0f, 65535.0f));
-                        ia = iround(clamp(a, 0.0f, 65535.0f));
-                    }
-                    else if (compressionOptions.pixelType == nvtt::PixelType_SignedInt) {
-                        // @@
-                    }
-                    
-                    uint p = 0;
-                    p |= PixelFormat::convert(ir, 16, rsize) << rshift;
-                    p |= PixelFormat::convert(ig, 16, gsize) << gshift;
-                    p |= PixelFormat::convert(ib, 16, bsize) << bshift;
-                    p |= PixelFormat::convert(ia, 16, asize) << ashift;
-
-                    stream.putBits(p, bitCount);
-                }
-            }
+    const uint size = context.pitch * rowCount;
+    context.mem = allocateBuffer<uint8>(size);
 
-            // Zero padding.
-            stream.align(compressionOptions.pitchAlignment);
-            nvDebugCheck(stream.ptr == dst + pitch);
+    dispatcher->dispatch(PixelFormatConverterTask, &context, rowCount);
 
-            // Scanlines are always byte-aligned.
-            outputOptions.writeData(dst, pitch);
-        }
-    }
+    outputOptions.writeData(context.mem, size);
 
-    free(dst);
+    freeBuffer(context.mem, size);
 }
@@ -50,11 +50,18 @@
 #include "nvimage/ColorSpace.h"
 
 #include "nvcore/Memory.h"
+#include "nvcore/Profiler.h"
 #include "nvcore/Ptr.h"
+#include "nvcore/Array.inl"
+
+#include "nvthread/nvthread.h"
 
 using namespace nv;
 using namespace nvtt;
 
+// Deferred output is written early once it reaches this size, even if that splits the batch of small mipmaps.
+static const uint s_maxDeferredSize = 16 * 1024 * 1024;
+
 Compressor::Compressor() : m(*new Compressor::Private())
 {
     // CUDA initialization.
@@ -65,6 +72,12 @@ Compressor::Compressor() : m(*new Compressor::Private())
     enableCudaAcceleration(m.cudaSupported);
 
     m.dispatcher = &m.defaultDispatcher;
+    m.customDispatcher = false;
+
+    m.threadCount = 0;
+    m.numaNode = -1;
+
+    resetAdaptiveQualityStats();
 }
 
 Compressor::~Compressor()
@@ -90,6 +103,10 @@ void Compressor::enableCudaAcceleration(bool enable)
             m.cuda = NULL;
         }
     }
+
+    // The GPU compressors reference the CUDA context.
+    m.cachedGpuCompressor.compressor = NULL;
+    m.cachedGpuCompressor.valid = false;
 }
 
 bool Compressor::isCudaAccelerationEnabled() const
@@ -99,11 +116,165 @@ bool Compressor::isCudaAccelerationEnabled() const
 
 void Compressor::setTaskDispatcher(TaskDispatcher * disp)
 {
+    m.customDispatcher = (disp != NULL);
+
     if (disp == NULL) {
-        m.dispatcher = &m.defaultDispatcher;
+        m.updateDispatcher();
     }
     else {
         m.dispatcher = disp;
+        m.threadPool = NULL;
+    }
+}
+
+void Compressor::setThreadCount(int count)
+{
+    m.threadCount = max(0, count);
+    m.updateDispatcher();
+}
+
+int Compressor::threadCount() const
+{
+    if (m.customDispatcher) return 0;
+    if (m.dispatcher == &m.sequentialDispatcher) return 1;
+    if (m.threadPool != NULL) return int(m.threadPool->threadCount());
+    return int(nv::hardwareThreadCount());
+}
+
+void Compressor::setThreadAffinity(const int * processors, int count)
+{
+    m.affinity.clear();
+    for (int i = 0; i < count; i++) {
+        if (processors[i] >= 0) m.affinity.append(uint(processors[i]));
+    }
+    m.updateDispatcher();
+}
+
+void Compressor::setNumaNode(int node)
+{
+    m.numaNode = max(-1, node);
+    m.updateDispatcher();
+}
+
+// Rebuild the private thread pool after a change to the thread settings. The pool is only created when the
+// settings differ from the defaults, otherwise the context runs on the shared pool like before.
+void Compressor::Private::updateDispatcher()
+{
+    threadPool = NULL;
+    poolDispatcher.pool = NULL;
+
+    if (customDispatcher) {
+        return;
+    }
+
+    if (threadCount == 1) {
+        dispatcher = &sequentialDispatcher;
+    }
+    else if (threadCount == 0 && affinity.isEmpty() && numaNode < 0) {
+        dispatcher = &defaultDispatcher;
+    }
+    else {
+        threadPool = new nv::ThreadPool(threadCount, affinity.buffer(), affinity.count(), numaNode);
+        poolDispatcher.pool = threadPool.ptr();
+        dispatcher = &poolDispatcher;
+    }
+}
+
+
+void Compressor::setMemoryBudget(int maxCachedMegabytes)
+{
+    setBufferPoolBudget(size_t(max(0, maxCachedMegabytes)) * 1024 * 1024);
+}
+
+void Compressor::getMemoryStats(MemoryStats * stats) const
+{
+    nvDebugCheck(stats != NULL);
+
+    BufferStats bufferStats;
+    getBufferStats(&bufferStats);
+
+    stats->allocatedBytes = bufferStats.allocatedBytes;
+    stats->peakAllocatedBytes = bufferStats.peakAllocatedBytes;
+    stats->cachedBytes = bufferStats.cachedBytes;
+    stats->allocationCount = bufferStats.allocationCount;
+    stats->reusedCount = bufferStats.reusedCount;
+}
+
+void Compressor::resetMemoryStats()
+{
+    resetBufferPeak();
+}
+
+
+void Compressor::enableTimingStats(bool enable)
+{
+    profilerEnable(enable);
+}
+
+bool Compressor::isTimingStatsEnabled() const
+{
+    return profilerIsEnabled();
+}
+
+void Compressor::resetTimingStats()
+{
+    profilerReset();
+}
+
+float Compressor::timingStatsElapsedTime() const
+{
+    return float(profilerElapsedTime());
+}
+
+int Compressor::timingStageCount() const
+{
+    return profilerZoneCount();
+}
+
+bool Compressor::getTimingStage(int index, StageStats * stats) const
+{
+    nvDebugCheck(stats != NULL);
+
+    if (index < 0 || index >= profilerZoneCount()) return false;
+
+    ProfileZoneStats zoneStats;
+    profilerZoneStats(index, &zoneStats);
+
+    stats->name = zoneStats.name;
+    stats->callCount = zoneStats.callCount;
+    stats->itemCount = zoneStats.itemCount;
+    stats->totalTime = float(zoneStats.totalTime);
+    stats->selfTime = float(zoneStats.selfTime);
+    return true;
+}
+
+int Compressor::timingThreadCount() const
+{
+    return profilerThreadCount();
+}
+
+float Compressor::timingThreadBusyTime(int index) const
+{
+    if (index < 0 || index >= profilerThreadCount()) return 0.0f;
+
+    ProfileThreadStats threadStats;
+    profilerThreadStats(index, &threadStats);
+
+    return float(threadStats.busyTime);
+}
+
+void Compressor::getAdaptiveQualityStats(AdaptiveQualityStats * stats) const
+{
+    nvDebugCheck(stats != NULL);
+    for (int i = 0; i < 4; i++) {
+        stats->blockCount[i] = m.adaptiveBlockCount[i].loadAcquire();
+    }
+}
+
+void Compressor::resetAdaptiveQualityStats()
+{
+    for (int i = 0; i < 4; i++) {
+        m.adaptiveBlockCount[i].storeRelease(0);
     }
 }
 
@@ -111,6 +282,7 @@ void Compressor::setTaskDispatcher(TaskDispatcher * disp)
 // Input Options API.
 bool Compressor::process(const InputOptions & inputOptions, const CompressionOptions & compressionOptions, const OutputOptions & outputOptions) const
 {
+    nv::ThreadPoolScope scope(m.threadPool.ptr(), m.isSequential());
     return m.compress(inputOptions.m, compressionOptions.m, outputOptions.m);
 }
 
@@ -135,11 +307,12 @@ int Compressor::estimateSize(const InputOptions & inputOptions, const Compressio
 // Surface API.
 bool Compressor::outputHeader(const Surface & tex, int mipmapCount, const CompressionOptions & compressionOptions, const OutputOptions & outputOptions) const
 {
-    return m.outputHeader(tex.type(), tex.width(), tex.height(), tex.depth(), mipmapCount, tex.isNormalMap(), compressionOptions.m, outputOptions.m);
+    return m.outputHeader(tex.type(), tex.width(), tex.height(), tex.depth(), 1, mipmapCount, tex.isNormalMap(), compressionOptions.m, outputOptions.m);
 }
 
 bool Compressor::compress(const Surface & tex, int face, int mipmap, const CompressionOptions & compressionOptions, const OutputOptions & outputOptions) const
 {
+    nv::ThreadPoolScope scope(m.threadPool.ptr(), m.isSequential());
     return m.compress(tex, face, mipmap, compressionOptions.m, outputOptions.m);
 }
 
@@ -154,11 +327,25 @@ int Compressor::estimateSize(const Surface & tex, int mipmapCount, const Compres
 
 bool Compressor::outputHeader(const CubeSurface & cube, int mipmapCount, const CompressionOptions & compressionOptions, const OutputOptions & outputOptions) const
 {
-    return m.outputHeader(TextureType_Cube, cube.edgeLength(), cube.edgeLength(), 1, mipmapCount, false, compressionOptions.m, outputOptions.m);
+    return m.outputHeader(TextureType_Cube, cube.edgeLength(), cube.edgeLength(), 1, 1, mipmapCount, false, compressionOptions.m, outputOptions.m);
 }
 
 bool Compressor::compress(const CubeSurface & cube, int mipmap, const CompressionOptions & compressionOptions, const OutputOptions & outputOptions) const
 {
+    nv::ThreadPoolScope scope(m.threadPool.ptr(), m.isSequential());
+
+    // Compress the faces of small mipmaps together.
+    const int edgeLength = cube.edgeLength();
+    if (m.isSmallImage(edgeLength, edgeLength, 1)) {
+        nv::Array<Compressor::Private::PendingImage *> faces;
+        for (int i = 0; i < 6; i++) {
+            faces.append(new Compressor::Private::PendingImage(cube.face(i), i, mipmap));
+        }
+        bool success = m.compressBatch(faces, compressionOptions.m, outputOptions.m);
+        deleteAll(faces);
+        return success;
+    }
+
     for (int i = 0; i < 6; i++) {
         if(!m.compress(cube.face(i), i, mipmap, compressionOptions.m, outputOptions.m)) {
             return false;
@@ -176,11 +363,17 @@ int Compressor::estimateSize(const CubeSurface & cube, int mipmapCount, const Co
 // Raw API.
 bool Compressor::outputHeader(TextureType type, int w, int h, int d, int mipmapCount, bool isNormalMap, const CompressionOptions & compressionOptions, const OutputOptions & outputOptions) const
 {
-    return m.outputHeader(type, w, h, d, mipmapCount, isNormalMap, compressionOptions.m, outputOptions.m);
+    return m.outputHeader(type, w, h, d, 1, mipmapCount, isNormalMap, compressionOptions.m, outputOptions.m);
+}
+
+bool Compressor::outputHeader(TextureType type, int w, int h, int d, int arraySize, int mipmapCount, bool isNormalMap, const CompressionOptions & compressionOptions, const OutputOptions & outputOptions) const
+{
+    return m.outputHeader(type, w, h, d, arraySize, mipmapCount, isNormalMap, compressionOptions.m, outputOptions.m);
 }
 
 bool Compressor::compress(int w, int h, int d, int face, int mipmap, const float * rgba, const CompressionOptions & compressionOptions, const OutputOptions & outputOptions) const
 {
+    nv::ThreadPoolScope scope(m.threadPool.ptr(), m.isSequential());
     return m.compress(AlphaMode_None, w, h, d, face, mipmap, rgba, compressionOptions.m, outputOptions.m);
 }
 
@@ -226,6 +419,7 @@ bool Compressor::Private::compress(const InputOptions::Private & inputOptions, c
     img.setWrapMode(inputOptions.wrapMode);
     img.setAlphaMode(inputOptions.alphaMode);
     img.setNormalMap(inputOptions.isNormalMap);
+    img.setAtlas(inputOptions.atlasColumns, inputOptions.atlasRows);
 
     const int faceCount = inputOptions.faceCount;
     int width = inputOptions.width;
@@ -243,11 +437,20 @@ bool Compressor::Private::compress(const InputOptions::Private & inputOptions, c
         if (inputOptions.maxLevel > 0) mipmapCount = min(mipmapCount, inputOptions.maxLevel);
     }
 
-    if (!outputHeader(inputOptions.textureType, width, height, depth, mipmapCount, img.isNormalMap(), compressionOptions, outputOptions)) {
+    const int arraySize = (inputOptions.textureType == TextureType_Array) ? faceCount : 1;
+    if (!outputHeader(inputOptions.textureType, width, height, depth, arraySize, mipmapCount, img.isNormalMap(), compressionOptions, outputOptions)) {
         return false;
     }
 
 
+    // Small mipmaps of all faces are compressed together. While they are pending, the output of the following images
+    // is deferred, so that everything is written in file order once they are compressed.
+    nv::Array<PendingImage *> tail;
+    DeferredOutputHandler deferredHandler;
+    OutputOptions::Private deferredOptions = outputOptions;
+    deferredOptions.outputHandler = &deferredHandler;
+    deferredOptions.deleteOutputHandler = false;
+
     // Output images.
     for (int f = 0; f < faceCount; f++)
     {
@@ -278,7 +481,11 @@ bool Compressor::Private::compress(const InputOptions::Private & inputOptions, c
         }
 
         quantize(tmp, compressionOptions);
-        compress(tmp, f, 0, compressionOptions, outputOptions);
+        if (isSmallImage(w, h, d)) tail.append(new PendingImage(tmp, f, 0));
+        else if (!compress(tmp, f, 0, compressionOptions, tail.isEmpty() ? outputOptions : deferredOptions)) {
+            deleteAll(tail);
+            return false;
+        }
 
         for (int m = 1; m < mipmapCount; m++) {
             w = max(1, w/2);
@@ -330,13 +537,76 @@ bool Compressor::Private::compress(const InputOptions::Private & inputOptions, c
             }
 
             quantize(tmp, compressionOptions);
-            compress(tmp, f, m, compressionOptions, outputOptions);
+            if (isSmallImage(w, h, d)) tail.append(new PendingImage(tmp, f, m));
+            else if (!compress(tmp, f, m, compressionOptions, tail.isEmpty() ? outputOptions : deferredOptions)) {
+                deleteAll(tail);
+                return false;
+            }
+        }
+
+        // Don't hold too much output of large array layers in memory.
+        if (deferredHandler.data.count() >= s_maxDeferredSize) {
+            if (!compressPending(tail, deferredHandler, compressionOptions, deferredOptions, outputOptions)) {
+                return false;
+            }
         }
     }
 
+    return compressPending(tail, deferredHandler, compressionOptions, deferredOptions, outputOptions);
+}
+
+void Compressor::Private::DeferredOutputHandler::beginImage(int size, int width, int height, int depth, int face, int miplevel)
+{
+    Image image = { size, width, height, depth, face, miplevel, data.count(), 0 };
+    images.append(image);
+}
+
+bool Compressor::Private::DeferredOutputHandler::writeData(const void * buffer, int size)
+{
+    nvDebugCheck(!images.isEmpty());
+    data.append((const uint8 *)buffer, size);
+    images.back().length += size;
     return true;
 }
 
+void Compressor::Private::DeferredOutputHandler::flush(const OutputOptions::Private & outputOptions)
+{
+    // Images are stored face by face, and mipmaps of each face from largest to smallest.
+    const uint count = images.count();
+    for (uint i = 1; i < count; i++) {
+        Image image = images[i];
+        uint j = i;
+        for (; j > 0 && (images[j-1].face > image.face || (images[j-1].face == image.face && images[j-1].miplevel > image.miplevel)); j--) {
+            images[j] = images[j-1];
+        }
+        images[j] = image;
+    }
+
+    for (uint i = 0; i < count; i++) {
+        const Image & image = images[i];
+        outputOptions.beginImage(image.size, image.width, image.height, image.depth, image.face, image.miplevel);
+        outputOptions.writeData(data.buffer() + image.offset, image.length);
+        outputOptions.endImage();
+    }
+
+    images.clear();
+    data.clear();
+}
+
+// Compresses the pending images into the deferred output, and then writes all the deferred images.
+bool Compressor::Private::compressPending(nv::Array<PendingImage *> & images, DeferredOutputHandler & deferredHandler, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & deferredOptions, const OutputOptions::Private & outputOptions) const
+{
+    bool success = compressBatch(images, compressionOptions, deferredOptions);
+    deleteAll(images);
+    images.clear();
+
+    if (success) {
+        deferredHandler.flush(outputOptions);
+    }
+
+    return success;
+}
+
 bool Compressor::Private::compress(const Surface & tex, int face, int mipmap, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions) const
 {
     if (!compress(tex.alphaMode(), tex.width(), tex.height(), tex.depth(), face, mipmap, tex.data(), compressionOptions, outputOptions)) {
@@ -346,22 +616,47 @@ bool Compressor::Private::compress(const Surface & tex, int face, int mipmap, co
     return true;
 }
 
+// Each format has its own zone, so that the throughput of each format is reported separately.
+static int compressZone(Format format)
+{
+    static const char * const s_compressZoneNames[Format_Count] = {
+        "Compress RGB", "Compress BC1", "Compress BC1a", "Compress BC2", "Compress BC3", "Compress BC3n", "Compress BC4", "Compress BC5",
+        "Compress DXT1n", "Compress CTX1", "Compress BC6", "Compress BC7", "Compress BC5 Luma", "Compress BC3 RGBM"
+    };
+
+    if (profilerIsEnabled()) {
+        return profilerZone(s_compressZoneNames[format]);
+    }
+    return -1;
+}
+
+// Count blocks for compressed formats and pixels for uncompressed ones.
+static uint64 compressItemCount(Format format, int w, int h, int d)
+{
+    if (format == Format_RGB) return uint64(w) * uint64(h) * uint64(d);
+    return uint64((w + 3) / 4) * uint64((h + 3) / 4) * uint64(d);
+}
+
 bool Compressor::Private::compress(AlphaMode alphaMode, int w, int h, int d, int face, int mipmap, const float * rgba, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions) const
 {
+    ProfileScope scope(compressZone(compressionOptions.format), compressItemCount(compressionOptions.format, w, h, d));
+
     int size = computeImageSize(w, h, d, compressionOptions.getBitCount(), compressionOptions.pitchAlignment, compressionOptions.format);
     outputOptions.beginImage(size, w, h, d, face, mipmap);
 
     // Decide what compressor to use.
-    AutoPtr<CompressorInterface> compressor;
+    CompressorLease gpuLease, cpuLease;
+    CompressorInterface * compressor = NULL;
 #if defined HAVE_CUDA
-    if (cudaEnabled && w * h >= 512)
+    // The GPU compressors only handle 2D images, volumes are compressed on the CPU.
+    if (cudaEnabled && w * h >= 512 && d == 1)
     {
-        compressor = chooseGpuCompressor(compressionOptions);
+        compressor = gpuCompressor(compressionOptions, gpuLease);
     }
 #endif
     if (compressor == NULL)
     {
-        compressor = chooseCpuCompressor(compressionOptions);
+        compressor = cpuCompressor(compressionOptions, cpuLease);
     }
 
     if (compressor == NULL)
@@ -379,6 +674,95 @@ bool Compressor::Private::compress(AlphaMode alphaMode, int w, int h, int d, int
 }
 
 
+// Images that are too small to keep all the threads busy. Images that would go to the GPU are never batched.
+bool Compressor::Private::isSmallImage(int w, int h, int d) const
+{
+    if (w * h * d >= 64 * 64) return false;
+#if defined HAVE_CUDA
+    if (cudaEnabled && w * h >= 512 && d == 1) return false;
+#endif
+    return true;
+}
+
+bool Compressor::Private::compressBatch(const nv::Array<PendingImage *> & images, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions) const
+{
+    const uint count = images.count();
+    if (count == 0) return true;
+
+    // All the images of a batch are compressed with the same alpha mode.
+    bool sameAlphaMode = true;
+    for (uint i = 1; i < count; i++) {
+        if (images[i]->surface.alphaMode() != images[0]->surface.alphaMode()) sameAlphaMode = false;
+    }
+
+    CompressorLease lease;
+    CompressorInterface * compressor = (count > 1 && sameAlphaMode) ? cpuCompressor(compressionOptions, lease) : NULL;
+
+    if (compressor != NULL)
+    {
+        const Format format = compressionOptions.format;
+        const uint bitCount = compressionOptions.getBitCount();
+
+        nv::Array<CompressorImage> batch;
+        nv::Array<uint> sizes;
+        batch.resize(count);
+        sizes.resize(count);
+
+        uint64 itemCount = 0;
+        uint totalSize = 0;
+        for (uint i = 0; i < count; i++) {
+            const Surface & tex = images[i]->surface;
+            sizes[i] = computeImageSize(tex.width(), tex.height(), tex.depth(), bitCount, compressionOptions.pitchAlignment, format);
+            itemCount += compressItemCount(format, tex.width(), tex.height(), tex.depth());
+            totalSize += sizes[i];
+        }
+
+        uint8 * mem = allocateBuffer<uint8>(totalSize);
+
+        uint offset = 0;
+        for (uint i = 0; i < count; i++) {
+            const Surface & tex = images[i]->surface;
+            batch[i].w = tex.width();
+            batch[i].h = tex.height();
+            batch[i].d = tex.depth();
+            batch[i].data = tex.data();
+            batch[i].output = mem + offset;
+            offset += sizes[i];
+        }
+
+        bool compressed = false;
+        {
+            ProfileScope scope(compressZone(format), itemCount);
+            compressed = compressor->compressBatch(images[0]->surface.alphaMode(), batch.buffer(), count, dispatcher, compressionOptions);
+        }
+
+        if (compressed) {
+            offset = 0;
+            for (uint i = 0; i < count; i++) {
+                outputOptions.beginImage(sizes[i], batch[i].w, batch[i].h, batch[i].d, images[i]->face, images[i]->mipmap);
+                outputOptions.writeData(mem + offset, sizes[i]);
+                outputOptions.endImage();
+                offset += sizes[i];
+            }
+        }
+
+        freeBuffer(mem, totalSize);
+
+        if (compressed) return true;
+    }
+
+    // Compressors that don't support batches compress one image at a time. Each call leases the cached compressor.
+    lease.release();
+
+    for (uint i = 0; i < count; i++) {
+        if (!compress(images[i]->surface, images[i]->face, images[i]->mipmap, compressionOptions, outputOptions)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 void Compressor::Private::quantize(Surface & img, const CompressionOptions::Private & compressionOptions) const
 {
     if (compressionOptions.enableColorDithering) {
@@ -404,9 +788,9 @@ void Compressor::Private::quantize(Surface & img, const CompressionOptions::Priv
 }
 
 
-bool Compressor::Private::outputHeader(nvtt::TextureType textureType, int w, int h, int d, int mipmapCount, bool isNormalMap, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions) const
+bool Compressor::Private::outputHeader(nvtt::TextureType textureType, int w, int h, int d, int arraySize, int mipmapCount, bool isNormalMap, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions) const
 {
-    if (w <= 0 || h <= 0 || d <= 0 || mipmapCount <= 0)
+    if (w <= 0 || h <= 0 || d <= 0 || arraySize <= 0 || mipmapCount <= 0)
     {
         outputOptions.error(Error_InvalidInput);
         return false;
@@ -434,12 +818,16 @@ bool Compressor::Private::outputHeader(nvtt::TextureType textureType, int w, int
             header.setTexture3D();
             header.setDepth(d);
         }
+        else if (textureType == TextureType_Array) {
+            header.setTexture2DArray(arraySize);
+        }
 
         header.setWidth(w);
         header.setHeight(h);
         header.setMipmapCount(mipmapCount);
 
-        bool supported = true;
+        // The DX9 header can't describe arrays.
+        bool supported = (textureType != TextureType_Array || outputOptions.container == Container_DDS10);
 
         if (outputOptions.container == Container_DDS10)
         {
@@ -663,8 +1051,115 @@ bool Compressor::Private::outputHeader(nvtt::TextureType textureType, int w, int
 }
 
 
+bool Compressor::Private::CachedCompressor::matches(const CompressionOptions::Private & compressionOptions) const
+{
+    return valid && format == compressionOptions.format && quality == compressionOptions.quality &&
+        adaptiveQuality == compressionOptions.adaptiveQuality && strEqual(externalCompressor.str(), compressionOptions.externalCompressor.str());
+}
+
+void Compressor::Private::CachedCompressor::set(CompressorInterface * c, const CompressionOptions::Private & compressionOptions)
+{
+    compressor = c;
+    valid = true;
+    format = compressionOptions.format;
+    quality = compressionOptions.quality;
+    adaptiveQuality = compressionOptions.adaptiveQuality;
+    externalCompressor = compressionOptions.externalCompressor;
+}
+
+void Compressor::Private::CompressorLease::release()
+{
+    if (cache != NULL) {
+        cache->mutex.unlock();
+        cache = NULL;
+    }
+    owned = NULL;
+    compressor = NULL;
+}
+
+CompressorInterface * Compressor::Private::leaseCompressor(CachedCompressor & cache, bool gpu, const CompressionOptions::Private & compressionOptions, CompressorLease & lease) const
+{
+    nvDebugCheck(lease.compressor == NULL && lease.cache == NULL);
+
+    if (cache.mutex.tryLock()) {
+        if (!cache.matches(compressionOptions)) {
+            cache.set(gpu ? chooseGpuCompressor(compressionOptions) : chooseCpuCompressor(compressionOptions), compressionOptions);
+        }
+        lease.cache = &cache;
+        lease.compressor = cache.compressor.ptr();
+    }
+    else {
+        // Another call is using the cached compressor.
+        lease.owned = gpu ? chooseGpuCompressor(compressionOptions) : chooseCpuCompressor(compressionOptions);
+        lease.compressor = lease.owned.ptr();
+    }
+
+    return lease.compressor;
+}
+
+CompressorInterface * Compressor::Private::cpuCompressor(const CompressionOptions::Private & compressionOptions, CompressorLease & lease) const
+{
+    return leaseCompressor(cachedCpuCompressor, false, compressionOptions, lease);
+}
+
+CompressorInterface * Compressor::Private::gpuCompressor(const CompressionOptions::Private & compressionOptions, CompressorLease & lease) const
+{
+    return leaseCompressor(cachedGpuCompressor, true, compressionOptions, lease);
+}
+
+// The fast tier is the compressor of Quality_Fastest, the quality tier the one of the selected quality.
+static CompressorInterface * chooseAdaptiveCompressor(const CompressionOptions::Private & compressionOptions, nv::Atomic<uint64> * blockCounts)
+{
+    const Format format = compressionOptions.format;
+    const Quality quality = compressionOptions.quality;
+
+    if (quality == Quality_Fastest || !compressionOptions.externalCompressor.isNull()) return NULL;
+
+    AdaptiveCompressor * compressor = new AdaptiveCompressor(format, blockCounts);
+
+    if (format == Format_DXT1)
+    {
+        compressor->setFastCompressor(new FastCompressorDXT1);
+        compressor->setQualityCompressor(new CompressorDXT1);
+    }
+    else if (format == Format_DXT5)
+    {
+        compressor->setFastCompressor(new FastCompressorDXT5);
+        compressor->setQualityCompressor(new CompressorDXT5);
+    }
+    else if (format == Format_BC4 && quality != Quality_Normal)
+    {
+        compressor->setFastCompressor(new FastCompressorBC4);
+        compressor->setQualityCompressor(new ProductionCompressorBC4);
+    }
+    else if (format == Format_BC5 && quality != Quality_Normal)
+    {
+        compressor->setFastCompressor(new FastCompressorBC5);
+        compressor->setQualityCompressor(new ProductionCompressorBC5);
+    }
+    else if (format == Format_BC7)
+    {
+        compressor->setFastCompressor(new FastCompressorBC7);
+        compressor->setQualityCompressor(new CompressorBC7);
+    }
+    else
+    {
+        // Formats with a single tier.
+        delete compressor;
+        return NULL;
+    }
+
+    return compressor;
+}
+
 CompressorInterface * Compressor::Private::chooseCpuCompressor(const CompressionOptions::Private & compressionOptions) const
 {
+    if (compressionOptions.adaptiveQuality)
+    {
+        CompressorInterface * compressor = chooseAdaptiveCompressor(compressionOptions, adaptiveBlockCount);
+        if (compressor != NULL) return compressor;
+    }
+
     if (compressionOptions.format == Format_RGB)
     {
         return new PixelFormatConverter;
@@ -796,6 +1291,12 @@ CompressorInterface * Compressor::Private::chooseGpuCompressor(const Compression
         return NULL;
     }
 
+    if (compressionOptions.adaptiveQuality)
+    {
+        // The error of each block is measured on the CPU.
+        return NULL;
+    }
+
 #if defined HAVE_CUDA
     if (compressionOptions.format == Format_DXT1)
     {
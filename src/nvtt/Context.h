@@ -26,6 +26,12 @@
 #define NV_TT_CONTEXT_H
 
 #include "nvcore/Ptr.h"
+#include "nvcore/Array.h"
+#include "nvcore/StrLib.h"
+
+#include "nvthread/ThreadPool.h"
+#include "nvthread/Mutex.h"
+#include "nvthread/Atomic.h"
 
 #include "nvtt/Compressor.h"
 #include "nvtt/cuda/CudaCompressorDXT.h"
@@ -49,22 +55,114 @@ namespace nvtt
         bool compress(const Surface & tex, int face, int mipmap, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions) const;
         bool compress(AlphaMode alphaMode, int w, int h, int d, int face, int mipmap, const float * data, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions) const;
 
+        // Small images, like the tail of a mipmap chain, are queued and compressed together with a single dispatch.
+        struct PendingImage
+        {
+            PendingImage(const Surface & surface, int face, int mipmap) : surface(surface), face(face), mipmap(mipmap) {}
+
+            Surface surface;
+            int face;
+            int mipmap;
+        };
+
+        // Holds the output of the images that follow queued images, so that they can be written in file order.
+        struct DeferredOutputHandler : public OutputHandler
+        {
+            virtual void beginImage(int size, int width, int height, int depth, int face, int miplevel);
+            virtual bool writeData(const void * data, int size);
+            virtual void endImage() {}
+
+            // Writes the held images sorted by face and mipmap, and clears them.
+            void flush(const OutputOptions::Private & outputOptions);
+
+            struct Image
+            {
+                int size, width, height, depth, face, miplevel;
+                uint offset, length;
+            };
+
+            nv::Array<Image> images;
+            nv::Array<uint8> data;
+        };
+
+        bool isSmallImage(int w, int h, int d) const;
+        bool compressBatch(const nv::Array<PendingImage *> & images, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions) const;
+        bool compressPending(nv::Array<PendingImage *> & images, DeferredOutputHandler & deferredHandler, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & deferredOptions, const OutputOptions::Private & outputOptions) const;
+
         void quantize(Surface & tex, const CompressionOptions::Private & compressionOptions) const;
 
-        bool outputHeader(nvtt::TextureType textureType, int w, int h, int d, int mipmapCount, bool isNormalMap, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions) const;
+        bool outputHeader(nvtt::TextureType textureType, int w, int h, int d, int arraySize, int mipmapCount, bool isNormalMap, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions) const;
 
         nv::CompressorInterface * chooseCpuCompressor(const CompressionOptions::Private & compressionOptions) const;
         nv::CompressorInterface * chooseGpuCompressor(const CompressionOptions::Private & compressionOptions) const;
 
+        // Compressors are kept while the options that select them don't change, so that compressing each face and
+        // mipmap doesn't create a new one. One call at a time uses the cached compressor, calls made concurrently from
+        // other threads create their own.
+        struct CachedCompressor
+        {
+            CachedCompressor() : valid(false) {}
+
+            bool matches(const CompressionOptions::Private & compressionOptions) const;
+            void set(nv::CompressorInterface * compressor, const CompressionOptions::Private & compressionOptions);
+
+            nv::AutoPtr<nv::CompressorInterface> compressor;
+            bool valid;
+            Format format;
+            Quality quality;
+            bool adaptiveQuality;
+            nv::String externalCompressor;
+
+            nv::Mutex mutex;    // Held by the call that uses the compressor.
+        };
+
+        // Compressor of a single call: the cached compressor, locked until released, or a compressor owned by the call.
+        struct CompressorLease
+        {
+            CompressorLease() : cache(NULL), compressor(NULL) {}
+            ~CompressorLease() { release(); }
+
+            void release();
+
+            CachedCompressor * cache;
+            nv::CompressorInterface * compressor;
+            nv::AutoPtr<nv::CompressorInterface> owned;
+        };
+
+        nv::CompressorInterface * cpuCompressor(const CompressionOptions::Private & compressionOptions, CompressorLease & lease) const;
+        nv::CompressorInterface * gpuCompressor(const CompressionOptions::Private & compressionOptions, CompressorLease & lease) const;
+        nv::CompressorInterface * leaseCompressor(CachedCompressor & cache, bool gpu, const CompressionOptions::Private & compressionOptions, CompressorLease & lease) const;
+
 
         bool cudaSupported;
         bool cudaEnabled;
 
         nv::AutoPtr<nv::CudaContext> cuda;
 
+        void updateDispatcher();
+
+        // The image processing of the compress calls follows the thread settings too, through a ThreadPoolScope.
+        bool isSequential() const { return dispatcher == &sequentialDispatcher; }
+
         TaskDispatcher * dispatcher;
         //SequentialTaskDispatcher defaultDispatcher;
         ConcurrentTaskDispatcher defaultDispatcher;
+        bool customDispatcher;
+
+        // Thread settings. Contexts that change them get their own thread pool.
+        int threadCount;
+        nv::Array<uint> affinity;
+        int numaNode;
+        nv::AutoPtr<nv::ThreadPool> threadPool;
+        ParallelTaskDispatcher poolDispatcher;
+        SequentialTaskDispatcher sequentialDispatcher;
+
+        // Declared last, the GPU compressors must be destroyed before the CUDA context.
+        mutable CachedCompressor cachedCpuCompressor;
+        mutable CachedCompressor cachedGpuCompressor;
+
+        // Blocks encoded by each tier of the adaptive quality mode, indexed by Quality.
+        mutable nv::Atomic<uint64> adaptiveBlockCount[4];
     };
 
 } // nvtt namespace
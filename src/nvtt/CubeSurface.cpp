@@ -31,6 +31,8 @@
 #include "nvcore/Array.inl"
 #include "nvcore/StrLib.h"
 
+#include "nvthread/ParallelFor.h"
+
 using namespace nv;
 using namespace nvtt;
 
@@ -165,6 +167,12 @@ const Vector3 & TexelTable::direction(uint f, uint x, uint y) const {
     return directionArray[(f * size + y) * size + x];
 }
 
+const Vector2 & TexelTable::latLong(uint f, uint x, uint y) const {
+    nvDebugCheck(f < 6 && x < size && y < size);
+    nvDebugCheck(latLongArray.count() == 6 * size * size);
+    return latLongArray[(f * size + y) * size + x];
+}
+
 float TexelTable::solidAngle(uint f, uint x, uint y) const {
     uint hsize = size/2;
     if (x >= hsize) x -= hsize;
@@ -380,6 +388,265 @@ static const ivec2 foldOffsetHorizontalCross[6] = { {2, 1}, {0, 1}, {1, 0}, {1,
 static const ivec2 foldOffsetColumn[6]          = { {0, 0}, {0, 1}, {0, 2}, {0, 3}, {0, 4}, {0, 5} };
 static const ivec2 foldOffsetRow[6]             = { {0, 0}, {1, 0}, {2, 0}, {3, 0}, {4, 0}, {5, 0} };
 
+// The faces are copied a row at a time. The back face of the vertical cross is rotated 180 degrees, so its rows are
+// copied in reverse.
+struct CubeLayoutContext {
+    CubeSurface::Private * cube;
+    FloatImage * image;
+    const ivec2 * offsets;
+    bool rotateBackFace;
+    bool toFaces;
+};
+
+static void CubeLayoutTask(void * context, int id)
+{
+    CubeLayoutContext * ctx = (CubeLayoutContext *)context;
+
+    const uint edgeLength = ctx->cube->edgeLength;
+    const uint f = id / edgeLength;
+    const uint y = id % edgeLength;
+
+    FloatImage * faceImage = ctx->cube->face[f].m->image;
+    FloatImage * image = ctx->image;
+
+    const bool rotate = ctx->rotateBackFace && f == 5;
+    const uint x0 = ctx->offsets[f].x * edgeLength;
+    const uint y0 = ctx->offsets[f].y * edgeLength + (rotate ? edgeLength - 1 - y : y);
+
+    for (uint c = 0; c < 4; c++) {
+        float * faceRow = faceImage->channel(c) + y * edgeLength;
+        float * imageRow = image->channel(c) + y0 * image->width() + x0;
+
+        if (!rotate) {
+            if (ctx->toFaces) memcpy(faceRow, imageRow, edgeLength * sizeof(float));
+            else memcpy(imageRow, faceRow, edgeLength * sizeof(float));
+        }
+        else {
+            if (ctx->toFaces) for (uint x = 0; x < edgeLength; x++) faceRow[x] = imageRow[edgeLength - 1 - x];
+            else for (uint x = 0; x < edgeLength; x++) imageRow[edgeLength - 1 - x] = faceRow[x];
+        }
+    }
+}
+
+// Latitude-longitude maps have +y at the top row, and -z, -x, +z, +x, -z from left to right.
+static inline Vector2 latLongCoordinates(const Vector3 & dir)
+{
+    const float longitude = atan2f(dir.x, dir.z);
+    const float latitude = atan2f(sqrtf(dir.x * dir.x + dir.z * dir.z), dir.y);
+
+    return Vector2(longitude * (0.5f / PI) + 0.5f, latitude * (1.0f / PI));
+}
+
+static inline float wrapLongitude(float x)
+{
+    if (x >= 1.0f) return x - 1.0f;
+    if (x < 0.0f) return x + 1.0f;
+    return x;
+}
+
+// Only the +z and +y faces are evaluated. The other side faces are rotations of +z around the y axis, and -y is the
+// reflection of +y.
+static void LatLongTableTask(void * context, int id)
+{
+    TexelTable * table = (TexelTable *)context;
+
+    const uint size = table->size;
+    const uint y = id % size;
+    Vector2 * coords = table->latLongArray.buffer();
+
+    if (id < int(size)) {
+        for (uint x = 0; x < size; x++) {
+            const Vector2 c = latLongCoordinates(table->direction(4, x, y));
+            coords[(4 * size + y) * size + x] = c;
+            coords[(0 * size + y) * size + x] = Vector2(wrapLongitude(c.x + 0.25f), c.y);
+            coords[(5 * size + y) * size + x] = Vector2(wrapLongitude(c.x + 0.5f), c.y);
+            coords[(1 * size + y) * size + x] = Vector2(wrapLongitude(c.x - 0.25f), c.y);
+        }
+    }
+    else {
+        for (uint x = 0; x < size; x++) {
+            const Vector2 c = latLongCoordinates(table->direction(2, x, y));
+            coords[(2 * size + y) * size + x] = c;
+            coords[(3 * size + (size - 1 - y)) * size + x] = Vector2(c.x, 1.0f - c.y);
+        }
+    }
+}
+
+void CubeSurface::Private::allocateLatLongTable()
+{
+    allocateTexelTable();
+
+    if (texelTable->latLongArray.isEmpty()) {
+        texelTable->latLongArray.resize(6 * edgeLength * edgeLength);
+
+        nv::ParallelFor parallelFor(LatLongTableTask, texelTable);
+        parallelFor.run(2 * edgeLength);
+    }
+}
+
+// Bilinear taps of a run of texels. The taps are computed once and applied to each channel in turn, channels are often
+// a multiple of 4KB apart and interleaving them thrashes the cache.
+struct BilinearTaps {
+    enum { Count = 256 };
+
+    void sample(const float * src, float * dst, uint begin, uint end) const
+    {
+        for (uint i = begin; i < end; i++) {
+            const float top = lerp(src[index[i][0]], src[index[i][1]], fx[i]);
+            const float bottom = lerp(src[index[i][2]], src[index[i][3]], fx[i]);
+            dst[i] = lerp(top, bottom, fy[i]);
+        }
+    }
+
+    uint index[Count][4];
+    float fx[Count];
+    float fy[Count];
+};
+
+// Samples the latitude-longitude map at the texel centers of the faces. The map wraps horizontally and is clamped
+// vertically.
+struct LatLongFoldContext {
+    CubeSurface::Private * cube;
+    const FloatImage * image;
+};
+
+static void LatLongFoldTask(void * context, int id)
+{
+    LatLongFoldContext * ctx = (LatLongFoldContext *)context;
+
+    const uint edgeLength = ctx->cube->edgeLength;
+    const uint f = id / edgeLength;
+    const uint y = id % edgeLength;
+
+    const FloatImage * image = ctx->image;
+    const int w = image->width();
+    const int h = image->height();
+
+    FloatImage * faceImage = ctx->cube->face[f].m->image;
+    const TexelTable * texelTable = ctx->cube->texelTable;
+
+    for (uint begin = 0; begin < edgeLength; begin += BilinearTaps::Count) {
+        const uint count = min(edgeLength - begin, uint(BilinearTaps::Count));
+
+        BilinearTaps taps;
+        for (uint i = 0; i < count; i++) {
+            const Vector2 & coord = texelTable->latLong(f, begin + i, y);
+
+            const float s = coord.x * w - 0.5f;
+            const float t = clamp(coord.y * h - 0.5f, 0.0f, float(h - 1));
+
+            // s >= -0.5 and t >= 0, so truncation is enough.
+            int x0 = int(s + 1.0f) - 1;
+            const int y0 = int(t);
+
+            taps.fx[i] = s - x0;
+            taps.fy[i] = t - y0;
+
+            // Coordinates are in [0, 1], so the taps wrap at most once.
+            if (x0 < 0) x0 += w;
+            const int x1 = (x0 + 1 >= w) ? x0 + 1 - w : x0 + 1;
+            const int y1 = min(y0 + 1, h - 1);
+
+            taps.index[i][0] = y0 * w + x0;
+            taps.index[i][1] = y0 * w + x1;
+            taps.index[i][2] = y1 * w + x0;
+            taps.index[i][3] = y1 * w + x1;
+        }
+
+        for (uint c = 0; c < 4; c++) {
+            taps.sample(image->channel(c), faceImage->channel(c) + y * edgeLength + begin, 0, count);
+        }
+    }
+}
+
+// Samples the faces in the direction of the texel centers of the latitude-longitude map. The sines and cosines are
+// separable, so they are tabulated per row and per column.
+struct LatLongUnfoldContext {
+    const CubeSurface::Private * cube;
+    FloatImage * image;
+    const float * sinLongitude;
+    const float * cosLongitude;
+};
+
+static void LatLongUnfoldTask(void * context, int id)
+{
+    LatLongUnfoldContext * ctx = (LatLongUnfoldContext *)context;
+
+    FloatImage * image = ctx->image;
+    const uint w = image->width();
+    const uint h = image->height();
+    const int edgeLength = ctx->cube->edgeLength;
+
+    const float latitude = (id + 0.5f) * (PI / h);
+    const float sinLatitude = sinf(latitude);
+    const float cosLatitude = cosf(latitude);
+
+    for (uint begin = 0; begin < w; begin += BilinearTaps::Count) {
+        const uint count = min(w - begin, uint(BilinearTaps::Count));
+
+        BilinearTaps taps;
+        uint faces[BilinearTaps::Count];
+
+        for (uint i = 0; i < count; i++) {
+            const uint x = begin + i;
+            const Vector3 dir(sinLatitude * ctx->sinLongitude[x], cosLatitude, sinLatitude * ctx->cosLongitude[x]);
+            const Vector3 a(fabsf(dir.x), fabsf(dir.y), fabsf(dir.z));
+
+            // Inverse of texelDirection.
+            uint f;
+            float u, v, ma;
+            if (a.x >= a.y && a.x >= a.z) {
+                f = (dir.x > 0) ? 0 : 1;
+                ma = a.x;
+                u = (dir.x > 0) ? -dir.z : dir.z;
+                v = -dir.y;
+            }
+            else if (a.y >= a.z) {
+                f = (dir.y > 0) ? 2 : 3;
+                ma = a.y;
+                u = dir.x;
+                v = (dir.y > 0) ? dir.z : -dir.z;
+            }
+            else {
+                f = (dir.z > 0) ? 4 : 5;
+                ma = a.z;
+                u = (dir.z > 0) ? dir.x : -dir.x;
+                v = -dir.y;
+            }
+
+            const float scale = 0.5f * edgeLength / ma;
+            const float s = clamp(u * scale + 0.5f * edgeLength - 0.5f, 0.0f, float(edgeLength - 1));
+            const float t = clamp(v * scale + 0.5f * edgeLength - 0.5f, 0.0f, float(edgeLength - 1));
+
+            const int x0 = int(s);
+            const int y0 = int(t);
+            const int x1 = min(x0 + 1, edgeLength - 1);
+            const int y1 = min(y0 + 1, edgeLength - 1);
+
+            faces[i] = f;
+            taps.fx[i] = s - x0;
+            taps.fy[i] = t - y0;
+            taps.index[i][0] = y0 * edgeLength + x0;
+            taps.index[i][1] = y0 * edgeLength + x1;
+            taps.index[i][2] = y1 * edgeLength + x0;
+            taps.index[i][3] = y1 * edgeLength + x1;
+        }
+
+        for (uint c = 0; c < 4; c++) {
+            float * dst = image->channel(c) + id * w + begin;
+
+            // Runs of texels that sample the same face.
+            for (uint i = 0; i < count; ) {
+                uint end = i + 1;
+                while (end < count && faces[end] == faces[i]) end++;
+
+                taps.sample(ctx->cube->face[faces[i]].m->image->channel(c), dst, i, end);
+                i = end;
+            }
+        }
+    }
+}
+
 void CubeSurface::fold(const Surface & tex, CubeLayout layout)
 {
     ivec2 const* offsets = 0;
@@ -387,6 +654,8 @@ void CubeSurface::fold(const Surface & tex, CubeLayout layout)
 
     switch(layout) {
         case CubeLayout_LatitudeLongitude:
+            edgeLength = tex.width() / 4;
+            break;
         case CubeLayout_VerticalCross:
             edgeLength = tex.height() / 4;
             offsets = foldOffsetVerticalCross;
@@ -405,17 +674,37 @@ void CubeSurface::fold(const Surface & tex, CubeLayout layout)
             break;
     }
 
-    m->edgeLength = edgeLength;
-    for(uint f = 0; f < 6; f++) {
-        uint x = offsets[f].x * edgeLength;
-        uint y = offsets[f].y * edgeLength;
-        m->face[f] = tex.createSubImage(x, x + edgeLength - 1, y, y + edgeLength - 1, 0, 0);
+    detach();
+
+    // The texel table depends on the edge length.
+    if (m->edgeLength != edgeLength) {
+        delete m->texelTable;
+        m->texelTable = NULL;
     }
 
-    if(layout == CubeLayout_VerticalCross || layout == CubeLayout_LatitudeLongitude) {
-        // Back face needs to be rotated 180 degrees
-        m->face[5].flipX();
-        m->face[5].flipY();
+    m->allocate(edgeLength);
+    if (edgeLength == 0) return;
+
+    if (layout == CubeLayout_LatitudeLongitude) {
+        m->allocateLatLongTable();
+
+        LatLongFoldContext context;
+        context.cube = m;
+        context.image = tex.m->image;
+
+        nv::ParallelFor parallelFor(LatLongFoldTask, &context);
+        parallelFor.run(6 * edgeLength);
+    }
+    else {
+        CubeLayoutContext context;
+        context.cube = m;
+        context.image = tex.m->image;
+        context.offsets = offsets;
+        context.rotateBackFace = (layout == CubeLayout_VerticalCross);
+        context.toFaces = true;
+
+        nv::ParallelFor parallelFor(CubeLayoutTask, &context);
+        parallelFor.run(6 * edgeLength);
     }
 }
 
@@ -428,13 +717,13 @@ Surface CubeSurface::unfold(CubeLayout layout) const
 
     switch(layout) {
         case CubeLayout_LatitudeLongitude:
+            width = 4 * edgeLength;
+            height = 2 * edgeLength;
+            break;
         case CubeLayout_VerticalCross:
             offsets = foldOffsetVerticalCross;
             width = 3 * edgeLength;
             height = 4 * edgeLength;
-            // Back face needs to be rotated 180 degrees
-            m->face[5].flipX();
-            m->face[5].flipY();
             break;
         case CubeLayout_HorizontalCross:
             offsets = foldOffsetHorizontalCross;
@@ -455,62 +744,115 @@ Surface CubeSurface::unfold(CubeLayout layout) const
 
     Surface surface;
     surface.setImage(width, height, 1);
-    for(uint f = 0; f < 6; f++) {
-        uint x = offsets[f].x * edgeLength;
-        uint y = offsets[f].y * edgeLength;
-        surface.copy(m->face[f], 0, 0, 0, edgeLength, edgeLength, 1, x, y, 0);
-    }
+    if (edgeLength == 0) return surface;
+
+    if (layout == CubeLayout_LatitudeLongitude) {
+        nv::Array<float> sinLongitude, cosLongitude;
+        sinLongitude.resize(width);
+        cosLongitude.resize(width);
+        for (uint x = 0; x < width; x++) {
+            const float longitude = (x + 0.5f) * (2 * PI / width) - PI;
+            sinLongitude[x] = sinf(longitude);
+            cosLongitude[x] = cosf(longitude);
+        }
+
+        LatLongUnfoldContext context;
+        context.cube = m;
+        context.image = surface.m->image;
+        context.sinLongitude = sinLongitude.buffer();
+        context.cosLongitude = cosLongitude.buffer();
 
-    if(layout == CubeLayout_VerticalCross || layout == CubeLayout_LatitudeLongitude) {
-        // Undo back face rotation
-        m->face[5].flipY();
-        m->face[5].flipX();
+        nv::ParallelFor parallelFor(LatLongUnfoldTask, &context);
+        parallelFor.run(height);
+    }
+    else {
+        CubeLayoutContext context;
+        context.cube = m;
+        context.image = surface.m->image;
+        context.offsets = offsets;
+        context.rotateBackFace = (layout == CubeLayout_VerticalCross);
+        context.toFaces = false;
+
+        nv::ParallelFor parallelFor(CubeLayoutTask, &context);
+        parallelFor.run(6 * edgeLength);
     }
+
     return surface;
 }
 
+// Each row of the faces stores its partial sums in its own slot, the slots are combined in order so that the result
+// does not depend on the number of threads.
+struct CubeAverageContext {
+    CubeSurface::Private * cube;
+    int channel;
+    double * sums;          // 2 per row: weighted sum and total solid angle.
+};
+
+static void CubeAverageTask(void * context, int id)
+{
+    CubeAverageContext * ctx = (CubeAverageContext *)context;
+
+    const uint edgeLength = ctx->cube->edgeLength;
+    const uint f = id / edgeLength;
+    const uint y = id % edgeLength;
+
+    const float * c = ctx->cube->face[f].m->image->channel(ctx->channel) + y * edgeLength;
+    const TexelTable * texelTable = ctx->cube->texelTable;
+
+    double total = 0.0;
+    double sum = 0.0;
+
+    for (uint x = 0; x < edgeLength; x++) {
+        float solidAngle = texelTable->solidAngle(f, x, y);
+
+        total += solidAngle;
+        sum += c[x] * solidAngle;
+    }
+
+    ctx->sums[2 * id + 0] = sum;
+    ctx->sums[2 * id + 1] = total;
+}
+
 float CubeSurface::average(int channel) const
 {
     const uint edgeLength = m->edgeLength;
     m->allocateTexelTable();
 
-    float total = 0.0f;
-    float sum = 0.0f;
+    const uint rowCount = 6 * edgeLength;
 
-    for (int f = 0; f < 6; f++) {
-        float * c = m->face[f].m->image->channel(channel);
+    CubeAverageContext context;
+    context.cube = m;
+    context.channel = channel;
+    context.sums = new double[2 * rowCount];
 
-         for (uint y = 0; y < edgeLength; y++) {
-             for (uint x = 0; x < edgeLength; x++) {
-                float solidAngle = m->texelTable->solidAngle(f, x, y);
+    nv::ParallelFor parallelFor(CubeAverageTask, &context);
+    parallelFor.run(rowCount);
 
-                total += solidAngle;
-                sum += c[y * edgeLength + x] * solidAngle;
-            }
-        }
+    double total = 0.0;
+    double sum = 0.0;
+
+    for (uint i = 0; i < rowCount; i++) {
+        sum += context.sums[2 * i + 0];
+        total += context.sums[2 * i + 1];
     }
 
-    return sum / total;
+    delete [] context.sums;
+
+    return float(sum / total);
 }
 
 void CubeSurface::range(int channel, float * minimum_ptr, float * maximum_ptr) const
 {
-    const uint edgeLength = m->edgeLength;
-    m->allocateTexelTable();
-
     float minimum = NV_FLOAT_MAX;
     float maximum = 0.0f;
 
+    // Faces are reduced in parallel by Surface::range.
     for (int f = 0; f < 6; f++) {
-        float * c = m->face[f].m->image->channel(channel);
+        float faceMinimum, faceMaximum;
+        m->face[f].range(channel, &faceMinimum, &faceMaximum);
 
-         for (uint y = 0; y < edgeLength; y++) {
-             for (uint x = 0; x < edgeLength; x++) {
-
-                 minimum = nv::min(minimum, c[y * edgeLength + x]);
-                 maximum = nv::max(maximum, c[y * edgeLength + x]);
-            }
-        }
+        minimum = nv::min(minimum, faceMinimum);
+        maximum = nv::max(maximum, faceMaximum);
     }
 
     *minimum_ptr = minimum;
@@ -790,8 +1132,6 @@ Vector3 CubeSurface::Private::applyCosinePowerFilter(const Vector3 & filterDir,
     return color;
 }
 
-#include "nvthread/ParallelFor.h"
-
 struct ApplyAngularFilterContext {
     CubeSurface::Private * inputCube;
     CubeSurface::Private * filteredCube;
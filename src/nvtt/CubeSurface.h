@@ -43,10 +43,12 @@ namespace nvtt
 
         float solidAngle(uint f, uint x, uint y) const;
         const nv::Vector3 & direction(uint f, uint x, uint y) const;
+        const nv::Vector2 & latLong(uint f, uint x, uint y) const;
 
         uint size;
         nv::Array<float> solidAngleArray;
         nv::Array<nv::Vector3> directionArray;
+        nv::Array<nv::Vector2> latLongArray;    // Latitude-longitude map coordinates in [0, 1], see allocateLatLongTable.
     };
 
 
@@ -81,7 +83,9 @@ namespace nvtt
             this->edgeLength = edgeLength;
             for (uint i = 0; i < 6; i++) {
                 face[i].detach();
-                face[i].m->image = new nv::FloatImage;
+                if (face[i].m->image == NULL) {
+                    face[i].m->image = new nv::FloatImage;
+                }
                 face[i].m->image->allocate(4, edgeLength, edgeLength, 1);
             }
         }
@@ -93,6 +97,8 @@ namespace nvtt
             }
         }
 
+        void allocateLatLongTable();
+
         // Filtering helpers:
         nv::Vector3 applyAngularFilter(const nv::Vector3 & dir, float coneAngle, float * filterTable, int tableSize);
         nv::Vector3 applyCosinePowerFilter(const nv::Vector3 & dir, float coneAngle, float cosinePower);
@@ -112,6 +112,9 @@ void InputOptions::reset()
     m.kaiserAlpha = 4.0f;
     m.kaiserStretch = 1.0f;
 
+    m.atlasColumns = 1;
+    m.atlasRows = 1;
+
     m.isNormalMap = false;
     m.normalizeMipmaps = true;
     m.convertToNormalMap = false;
@@ -125,16 +128,24 @@ void InputOptions::reset()
 
 // Setup the input image.
 void InputOptions::setTextureLayout(TextureType type, int width, int height, int depth /*= 1*/)
+{
+    setTextureLayout(type, width, height, depth, 1);
+}
+
+void InputOptions::setTextureLayout(TextureType type, int width, int height, int depth, int arraySize)
 {
     // Validate arguments.
     nvCheck(width >= 0);
     nvCheck(height >= 0);
     nvCheck(depth >= 0);
+    nvCheck(arraySize >= 0);
 
     // Correct arguments.
     if (width == 0) width = 1;
     if (height == 0) height = 1;
     if (depth == 0) depth = 1;
+    if (arraySize == 0) arraySize = 1;
+    if (type == TextureType_Array) depth = 1;
 
     // Delete previous images.
     resetTextureLayout();
@@ -145,12 +156,15 @@ void InputOptions::setTextureLayout(TextureType type, int width, int height, int
     m.depth = depth;
 
     // Allocate images.
-    m.faceCount = (type == TextureType_Cube) ? 6 : 1;
+    // Array layers are stored like the faces of a cube map, each one followed by its mipmaps.
+    m.faceCount = (type == TextureType_Cube) ? 6 : (type == TextureType_Array) ? arraySize : 1;
     m.mipmapCount = countMipmaps(width, height, depth);
     m.imageCount = m.mipmapCount * m.faceCount;
     m.images = new void *[m.imageCount];
+    m.imageReferences = new bool[m.imageCount];
 
     memset(m.images, 0, sizeof(void *) * m.imageCount);
+    memset(m.imageReferences, 0, sizeof(bool) * m.imageCount);
 }
 
 
@@ -160,12 +174,14 @@ void InputOptions::resetTextureLayout()
     {
         // Delete images.
         for (uint i = 0; i < m.imageCount; i++) {
-            free(m.images[i]);
+            if (!m.imageReferences[i]) free(m.images[i]);
         }
 
         // Delete image array.
         delete [] m.images;
         m.images = NULL;
+        delete [] m.imageReferences;
+        m.imageReferences = NULL;
 
         m.faceCount = 0;
         m.mipmapCount = 0;
@@ -174,22 +190,22 @@ void InputOptions::resetTextureLayout()
 }
 
 
-// Copies the data to our internal structures.
-bool InputOptions::setMipmapData(const void * data, int width, int height, int depth /*= 1*/, int face /*= 0*/, int mipLevel /*= 0*/)
+// Index and size in bytes of the given mipmap, 0 if the mipmap doesn't match the layout or the format.
+static uint mipmapImageSize(const InputOptions::Private & m, int width, int height, int depth, int face, int mipLevel, uint * idx)
 {
     if (uint(face) >= m.faceCount) {
-        return false;
+        return 0;
     }
     if (uint(mipLevel) >= m.mipmapCount) {
-        return false;
+        return 0;
     }
 
-    const uint idx = mipLevel * m.faceCount + face;
-    if (idx >= m.imageCount) {
-        return false;
+    *idx = mipLevel * m.faceCount + face;
+    if (*idx >= m.imageCount) {
+        return 0;
     }
 
-    // Compute expected width, height and depth for this mipLevel. Return false if it doesn't match.
+    // Compute expected width, height and depth for this mipLevel.
     int w = m.width;
     int h = m.height;
     int d = m.depth;
@@ -199,10 +215,10 @@ bool InputOptions::setMipmapData(const void * data, int width, int height, int d
         d = max(1, d/2);
     }
     if (w != width || h != height || d != depth) {
-        return false;
+        return 0;
     }
 
-    int imageSize = width * height * depth;
+    uint imageSize = width * height * depth;
     if (m.inputFormat == InputFormat_BGRA_8UB)
     {
         imageSize *= 4 * sizeof(uint8);
@@ -221,9 +237,26 @@ bool InputOptions::setMipmapData(const void * data, int width, int height, int d
     }
     else
     {
+        return 0;
+    }
+
+    return imageSize;
+}
+
+// Copies the data to our internal structures.
+bool InputOptions::setMipmapData(const void * data, int width, int height, int depth /*= 1*/, int face /*= 0*/, int mipLevel /*= 0*/)
+{
+    uint idx;
+    const uint imageSize = mipmapImageSize(m, width, height, depth, face, mipLevel, &idx);
+    if (imageSize == 0) {
         return false;
     }
 
+    if (m.imageReferences[idx]) {
+        m.images[idx] = NULL;
+        m.imageReferences[idx] = false;
+    }
+
     m.images[idx] = realloc(m.images[idx], imageSize);
     if (m.images[idx] == NULL) {
         // Out of memory.
@@ -235,6 +268,24 @@ bool InputOptions::setMipmapData(const void * data, int width, int height, int d
     return true;
 }
 
+// Stores a pointer to the caller's data, the compressor converts it to floating point directly from there.
+bool InputOptions::setMipmapDataReference(const void * data, int width, int height, int depth /*= 1*/, int face /*= 0*/, int mipLevel /*= 0*/)
+{
+    uint idx;
+    if (data == NULL || mipmapImageSize(m, width, height, depth, face, mipLevel, &idx) == 0) {
+        return false;
+    }
+
+    if (!m.imageReferences[idx]) {
+        free(m.images[idx]);
+    }
+
+    m.images[idx] = const_cast<void *>(data);
+    m.imageReferences[idx] = true;
+
+    return true;
+}
+
 
 /// Describe the format of the input.
 void InputOptions::setFormat(InputFormat format)
@@ -286,6 +337,13 @@ void InputOptions::setKaiserParameters(float width, float alpha, float stretch)
     m.kaiserStretch = stretch;
 }
 
+/// Set the tiles of an atlas, mipmaps are filtered per tile.
+void InputOptions::setAtlas(int columns, int rows)
+{
+    m.atlasColumns = max(columns, 1);
+    m.atlasRows = max(rows, 1);
+}
+
 /// Indicate whether input is a normal map or not.
 void InputOptions::setNormalMap(bool b)
 {
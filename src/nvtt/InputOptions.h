@@ -35,7 +35,7 @@ namespace nvtt
 
     struct InputOptions::Private
     {
-        Private() : images(NULL) {}
+        Private() : images(NULL), imageReferences(NULL) {}
 
         WrapMode wrapMode;
         TextureType textureType;
@@ -50,6 +50,7 @@ namespace nvtt
         uint imageCount;
 
         void ** images;
+        bool * imageReferences;     // Images owned by the caller.
 
         // Gamma conversion.
         float inputGamma;
@@ -65,6 +66,10 @@ namespace nvtt
         float kaiserAlpha;
         float kaiserStretch;
 
+        // Atlas tiles.
+        int atlasColumns;
+        int atlasRows;
+
         // Normal map options.
         bool isNormalMap;
         bool normalizeMipmaps;
@@ -24,11 +24,14 @@
 
 #include "OptimalCompressDXT.h"
 #include "SingleColorLookup.h"
+#include "ClusterFit.h" // NVTT_USE_SIMD
 
 #include <nvimage/ColorBlock.h>
 #include <nvimage/BlockDXT.h>
 
 #include <nvmath/Color.h>
+#include <nvmath/Vector.inl>
+#include <nvmath/ftoi.h>
 
 #include <nvcore/Utils.h> // swap
 
@@ -615,197 +618,314 @@ void OptimalCompress::compressDXT5A(const ColorBlock & src, AlphaBlockDXT5 * dst
 }
 
 
-#include "nvmath/Vector.inl"
-#include "nvmath/ftoi.h"
-const float threshold = 0.15f;
-
-static float computeAlphaError_RGBM(const ColorSet & src, const ColorBlock & RGB, const AlphaBlockDXT5 * dst, float bestError = FLT_MAX)
+// RGBM error of a block for a given color block. The error of a texel is quadratic in its decoded multiplier M:
+//
+//   w |C - M c|^2 = w |c|^2 (M - t)^2 + w |C - t c|^2, with t = (C.c) / |c|^2
+//
+// So the best M block is a weighted fit of the optimal multipliers t, and each texel uses the palette entry closest to
+// its t. Multipliers are kept in the alpha scale, M = alpha / 255 * (1 - threshold) + threshold.
+struct RGBMErrorTerms
 {
-    uint8 alphas[8];
-    dst->evaluatePalette(alphas, /*d3d9=*/false); // @@ Use target decoder.
-
-    float totalError = 0;
-
-    for (uint i = 0; i < 16; i++)
+    void init(const ColorSet & src, const ColorBlock & RGB, float threshold)
     {
-        float R = src.color(i).x;
-        float G = src.color(i).y;
-        float B = src.color(i).z;
-        
-        float r = float(RGB.color(i).r) / 255.0f;
-        float g = float(RGB.color(i).g) / 255.0f;
-        float b = float(RGB.color(i).b) / 255.0f;
-
-        float minDist = FLT_MAX;
-        for (uint p = 0; p < 8; p++)
+        const float scale = 255.0f / (1 - threshold);
+        const float alphaToM = (1 - threshold) / 255.0f;
+
+        residual = 0;
+        for (uint i = 0; i < 16; i++)
         {
-            // Compute M.
-            float M = float(alphas[p]) / 255.0f * (1 - threshold) + threshold;
+            const Vector4 & color = src.color(i);
+            const Vector3 C(saturate(color.x), saturate(color.y), saturate(color.z));
+            const Vector3 c(RGB.color(i).r / 255.0f, RGB.color(i).g / 255.0f, RGB.color(i).b / 255.0f);
+            const float w = src.weight(i);
 
-            // Decode color.
-            float fr = r * M;
-            float fg = g * M;
-            float fb = b * M;
+            const float cc = dot(c, c);
+            const float t = (cc > 0) ? dot(C, c) / cc : 0.0f;
 
-            // Measure error.
-            float error = square(R - fr) + square(G - fg) + square(B - fb);
+            target[i] = (t - threshold) * scale;
+            weight[i] = w * cc * alphaToM * alphaToM;
+            residual += w * lengthSquared(C - t * c);
+        }
 
-            minDist = min(error, minDist);
+#if NVTT_USE_SIMD
+        for (uint i = 0; i < 4; i++)
+        {
+            simdTarget[i] = SimdVector(target[4*i+0], target[4*i+1], target[4*i+2], target[4*i+3]);
+            simdWeight[i] = SimdVector(weight[4*i+0], weight[4*i+1], weight[4*i+2], weight[4*i+3]);
         }
+#endif
+    }
 
-        totalError += minDist * src.weights[i];
+    float evaluate(const uint8 alphas[8]) const
+    {
+#if NVTT_USE_SIMD
+        SimdVector palette[8];
+        for (uint p = 0; p < 8; p++) palette[p] = SimdVector(float(alphas[p]));
 
-        if (totalError > bestError)
+        SimdVector total(0.0f);
+        for (uint i = 0; i < 4; i++)
+        {
+            SimdVector minDist(FLT_MAX);
+            for (uint p = 0; p < 8; p++)
+            {
+                SimdVector d = palette[p] - simdTarget[i];
+                minDist = min(minDist, d * d);
+            }
+            total = multiplyAdd(minDist, simdWeight[i], total);
+        }
+        total = total + total.splatY() + total.splatZ() + total.splatW();
+        return total.toFloat() + residual;
+#else
+        float total = residual;
+        for (uint i = 0; i < 16; i++)
         {
-            // early out
-            return totalError;
+            float minDist = FLT_MAX;
+            for (uint p = 0; p < 8; p++)
+            {
+                minDist = min(minDist, square(float(alphas[p]) - target[i]));
+            }
+            total += minDist * weight[i];
         }
+        return total;
+#endif
     }
 
-    return totalError;
-}
+    void computeIndices(AlphaBlockDXT5 * dst) const
+    {
+        uint8 alphas[8];
+        dst->evaluatePalette(alphas, /*d3d9=*/false); // @@ Use target decoder.
 
-static void computeAlphaIndices_RGBM(const ColorSet & src, const ColorBlock & RGB, AlphaBlockDXT5 * dst)
+        for (uint i = 0; i < 16; i++)
+        {
+            float minDist = FLT_MAX;
+            uint bestIndex = 0;
+            for (uint p = 0; p < 8; p++)
+            {
+                float dist = square(float(alphas[p]) - target[i]);
+                if (dist < minDist)
+                {
+                    minDist = dist;
+                    bestIndex = p;
+                }
+            }
+            dst->setIndex(i, bestIndex);
+        }
+    }
+
+#if NVTT_USE_SIMD
+    SimdVector simdTarget[4];
+    SimdVector simdWeight[4];
+#endif
+    float target[16];   // Optimal multiplier, in the alpha scale, unclamped.
+    float weight[16];   // Texel weight times |c|^2, in the alpha scale.
+    float residual;     // Error of the optimal multipliers.
+};
+
+static float evaluateAlphaEndpoints(const RGBMErrorTerms & terms, int a0, int a1, AlphaBlockDXT5 * dst)
 {
     uint8 alphas[8];
-    dst->evaluatePalette(alphas, /*d3d9=*/false); // @@ Use target decoder.
+    dst->alpha0 = a0;
+    dst->alpha1 = a1;
+    dst->evaluatePalette(alphas, /*d3d9=*/false);
 
-    for (uint i = 0; i < 16; i++)
-    {
-        float R = src.color(i).x;
-        float G = src.color(i).y;
-        float B = src.color(i).z;
-
-        float r = float(RGB.color(i).r) / 255.0f;
-        float g = float(RGB.color(i).g) / 255.0f;
-        float b = float(RGB.color(i).b) / 255.0f;
+    return terms.evaluate(alphas);
+}
 
-        float minDist = FLT_MAX;
-        int bestIndex = 8;
-        for (uint p = 0; p < 8; p++)
+// Try all the endpoints of the given palette mode in the [mina, maxa] range.
+static void searchAlphaEndpoints(const RGBMErrorTerms & terms, int mina, int maxa, bool sixStep, AlphaBlockDXT5 * dst, float * bestError, int * besta0, int * besta1)
+{
+    for (int a0 = mina + 9; a0 <= maxa; a0++)
+    {
+        for (int a1 = mina; a1 < a0 - 8; a1++)
         {
-            // Compute M.
-            float M = float(alphas[p]) / 255.0f * (1 - threshold) + threshold;
+            nvDebugCheck(a0 - a1 > 8);
 
-            // Decode color.
-            float fr = r * M;
-            float fg = g * M;
-            float fb = b * M;
+            // The 8 step encoding uses alpha0 > alpha1, the 6 step encoding alpha0 <= alpha1.
+            const int e0 = sixStep ? a1 : a0;
+            const int e1 = sixStep ? a0 : a1;
 
-            // Measure error.
-            float error = square(R - fr) + square(G - fg) + square(B - fb);
+            float error = evaluateAlphaEndpoints(terms, e0, e1, dst);
 
-            if (error < minDist)
+            if (error < *bestError)
             {
-                minDist = error;
-                bestIndex = p;
+                *bestError = error;
+                *besta0 = e0;
+                *besta1 = e1;
             }
         }
-        nvDebugCheck(bestIndex < 8);
-
-        dst->setIndex(i, bestIndex);
     }
 }
 
+// Weights of alpha0 and alpha1 in each palette entry. The last two entries of the 6 step palette are 0 and 255.
+static const float s_paletteWeights8[8][2] = {
+    { 1, 0 }, { 0, 1 }, { 6.0f/7, 1.0f/7 }, { 5.0f/7, 2.0f/7 }, { 4.0f/7, 3.0f/7 }, { 3.0f/7, 4.0f/7 }, { 2.0f/7, 5.0f/7 }, { 1.0f/7, 6.0f/7 }
+};
+static const float s_paletteWeights6[8][2] = {
+    { 1, 0 }, { 0, 1 }, { 4.0f/5, 1.0f/5 }, { 3.0f/5, 2.0f/5 }, { 2.0f/5, 3.0f/5 }, { 1.0f/5, 4.0f/5 }, { 0, 0 }, { 0, 0 }
+};
 
-void OptimalCompress::compressDXT5A_RGBM(const ColorSet & src, const ColorBlock & RGB, AlphaBlockDXT5 * dst)
+// Clamp the endpoints and order them for the palette mode.
+static void orderAlphaEndpoints(bool sixStep, int * a0, int * a1)
 {
-    uint8 mina = 255;
-    uint8 maxa = 0;
+    *a0 = clamp(*a0, 0, 255);
+    *a1 = clamp(*a1, 0, 255);
 
-    uint8 mina_no01 = 255;
-    uint8 maxa_no01 = 0;
+    if (sixStep) {
+        if (*a0 > *a1) *a0 = *a1 = (*a0 + *a1) / 2;
+    }
+    else if (*a0 <= *a1) {
+        if (*a1 == 255) *a1 = 254;
+        *a0 = *a1 + 1;
+    }
+}
 
-    // Get min/max alpha.
-    /*for (uint i = 0; i < 16; i++)
-    {
-        uint8 alpha = src.alpha[i];
-        mina = min(mina, alpha);
-        maxa = max(maxa, alpha);
+// Fit the endpoints of the given palette mode to the optimal multipliers. Alternates between selecting the closest
+// palette entries and solving the endpoints in the least squares sense, then tries the endpoints around the best ones.
+static void fitAlphaEndpoints(const RGBMErrorTerms & terms, bool sixStep, int radius, AlphaBlockDXT5 * dst, float * bestError, int * besta0, int * besta1)
+{
+    const float (* paletteWeights)[2] = sixStep ? s_paletteWeights6 : s_paletteWeights8;
 
-        if (alpha != 0 && alpha != 255) {
-            mina_no01 = min(mina_no01, alpha);
-            maxa_no01 = max(maxa_no01, alpha);
-        }
-    }*/
-    mina = 0;
-    maxa = 255;
-    mina_no01 = 0;
-    maxa_no01 = 255;
+    // Start with the range of the targets, 0 and 255 are already in the 6 step palette.
+    float mint = 255, maxt = 0;
+    for (uint i = 0; i < 16; i++)
+    {
+        if (terms.weight[i] == 0) continue;
 
-    /*if (maxa - mina < 8) {
-        dst->alpha0 = maxa;
-        dst->alpha1 = mina;
+        const float t = clamp(terms.target[i], 0.0f, 255.0f);
+        if (sixStep && (t < 0.5f || t > 254.5f)) continue;
 
-        nvDebugCheck(computeAlphaError(src, dst) == 0);
+        mint = min(mint, t);
+        maxt = max(maxt, t);
     }
-    else if (maxa_no01 - mina_no01 < 6) {
-        dst->alpha0 = mina_no01;
-        dst->alpha1 = maxa_no01;
+    if (mint > maxt) mint = maxt = 128;
 
-        nvDebugCheck(computeAlphaError(src, dst) == 0);
-    }
-    else*/
+    float fitError = FLT_MAX;
+    int fita0 = 0, fita1 = 0;
+
+    // The targets are often clustered, so try spanning the range of the targets with each number of palette intervals,
+    // anchored at either end of the range.
+    const int intervalCount = sixStep ? 5 : 7;
+    for (int s = 1; s < 2 * intervalCount; s++)
     {
-        float besterror = computeAlphaError_RGBM(src, RGB, dst);
-        int besta0 = maxa;
-        int besta1 = mina;
+        const float span = (maxt - mint) * intervalCount / (s <= intervalCount ? s : s - intervalCount);
+        const float lo = (s <= intervalCount) ? mint : maxt - span;
+        const float hi = (s <= intervalCount) ? mint + span : maxt;
 
-        // Expand search space a bit.
-        const int alphaExpand = 8;
-        mina = (mina <= alphaExpand) ? 0 : mina - alphaExpand;
-        maxa = (maxa >= 255 - alphaExpand) ? 255 : maxa + alphaExpand;
+        int a0 = ftoi_round(clamp(sixStep ? lo : hi, 0.0f, 255.0f));
+        int a1 = ftoi_round(clamp(sixStep ? hi : lo, 0.0f, 255.0f));
+        orderAlphaEndpoints(sixStep, &a0, &a1);
 
-        for (int a0 = mina + 9; a0 < maxa; a0++)
+        for (int it = 0; it < 8; it++)
         {
-            for (int a1 = mina; a1 < a0 - 8; a1++)
+            uint8 alphas[8];
+            dst->alpha0 = a0;
+            dst->alpha1 = a1;
+            dst->evaluatePalette(alphas, /*d3d9=*/false);
+
+            float error = terms.evaluate(alphas);
+            if (error < fitError)
             {
-                nvDebugCheck(a0 - a1 > 8);
+                fitError = error;
+                fita0 = a0;
+                fita1 = a1;
+            }
 
-                dst->alpha0 = a0;
-                dst->alpha1 = a1;
-                float error = computeAlphaError_RGBM(src, RGB, dst, besterror);
+            // Solve the endpoints for the closest palette entries.
+            float aa = 0, ab = 0, bb = 0, at = 0, bt = 0;
+            for (uint i = 0; i < 16; i++)
+            {
+                const float w = terms.weight[i];
+                const float t = terms.target[i];
+                if (w == 0) continue;
 
-                if (error < besterror)
+                uint index = 0;
+                float minDist = FLT_MAX;
+                for (uint p = 0; p < 8; p++)
                 {
-                    besterror = error;
-                    besta0 = a0;
-                    besta1 = a1;
+                    float dist = square(float(alphas[p]) - t);
+                    if (dist < minDist)
+                    {
+                        minDist = dist;
+                        index = p;
+                    }
                 }
+
+                const float alpha = paletteWeights[index][0];
+                const float beta = paletteWeights[index][1];
+                aa += w * alpha * alpha;
+                ab += w * alpha * beta;
+                bb += w * beta * beta;
+                at += w * alpha * t;
+                bt += w * beta * t;
             }
-        }
 
-        // Try using the 6 step encoding.
-        /*if (mina == 0 || maxa == 255)*/ {
+            const float det = aa * bb - ab * ab;
+            if (!(det > FLT_EPSILON * aa * bb)) break;
 
-            // Expand search space a bit.
-            const int alphaExpand = 6;
-            mina_no01 = (mina_no01 <= alphaExpand) ? 0 : mina_no01 - alphaExpand;
-            maxa_no01 = (maxa_no01 >= 255 - alphaExpand) ? 255 : maxa_no01 + alphaExpand;
+            int na0 = ftoi_round(clamp((at * bb - bt * ab) / det, -1.0f, 256.0f));
+            int na1 = ftoi_round(clamp((bt * aa - at * ab) / det, -1.0f, 256.0f));
+            orderAlphaEndpoints(sixStep, &na0, &na1);
 
-            for (int a0 = mina_no01 + 9; a0 < maxa_no01; a0++)
-            {
-                for (int a1 = mina_no01; a1 < a0 - 8; a1++)
-                {
-                    nvDebugCheck(a0 - a1 > 8);
+            if (na0 == a0 && na1 == a1) break;
+
+            a0 = na0;
+            a1 = na1;
+        }
+    }
 
-                    dst->alpha0 = a1;
-                    dst->alpha1 = a0;
-                    float error = computeAlphaError_RGBM(src, RGB, dst, besterror);
+    if (fitError < *bestError)
+    {
+        *bestError = fitError;
+        *besta0 = fita0;
+        *besta1 = fita1;
+    }
 
-                    if (error < besterror)
-                    {
-                        besterror = error;
-                        besta0 = a1;
-                        besta1 = a0;
-                    }
-                }
+    // Refine the fitted endpoints.
+    for (int d0 = -radius; d0 <= radius; d0++)
+    {
+        for (int d1 = -radius; d1 <= radius; d1++)
+        {
+            const int e0 = fita0 + d0;
+            const int e1 = fita1 + d1;
+            if (e0 < 0 || e0 > 255 || e1 < 0 || e1 > 255) continue;
+            if (sixStep ? (e0 > e1) : (e0 <= e1)) continue;
+
+            float error = evaluateAlphaEndpoints(terms, e0, e1, dst);
+
+            if (error < *bestError)
+            {
+                *bestError = error;
+                *besta0 = e0;
+                *besta1 = e1;
             }
         }
+    }
+}
+
+float OptimalCompress::compressDXT5A_RGBM(const ColorSet & src, const ColorBlock & RGB, float threshold, bool exhaustive, AlphaBlockDXT5 * dst)
+{
+    RGBMErrorTerms terms;
+    terms.init(src, RGB, threshold);
 
-        dst->alpha0 = besta0;
-        dst->alpha1 = besta1;
+    // Start with the full range.
+    float bestError = evaluateAlphaEndpoints(terms, 255, 0, dst);
+    int besta0 = 255;
+    int besta1 = 0;
+
+    if (exhaustive)
+    {
+        searchAlphaEndpoints(terms, 0, 255, /*sixStep=*/false, dst, &bestError, &besta0, &besta1);
+        searchAlphaEndpoints(terms, 0, 255, /*sixStep=*/true, dst, &bestError, &besta0, &besta1);
     }
+    else
+    {
+        fitAlphaEndpoints(terms, /*sixStep=*/false, /*radius=*/8, dst, &bestError, &besta0, &besta1);
+        fitAlphaEndpoints(terms, /*sixStep=*/true, /*radius=*/8, dst, &bestError, &besta0, &besta1);
+    }
+
+    dst->alpha0 = besta0;
+    dst->alpha1 = besta1;
+    terms.computeIndices(dst);
 
-    computeAlphaIndices_RGBM(src, RGB, dst);
+    return bestError;
 }
@@ -56,7 +56,10 @@ namespace nv
         
         void compressDXT1_Luma(const ColorBlock & src, BlockDXT1 * dst);
 
-        void compressDXT5A_RGBM(const ColorSet & src, const ColorBlock & RGB, AlphaBlockDXT5 * dst);
+        // Find the M block that best reproduces the colors of src with the decoded RGB block. Returns the weighted RGB error.
+        // The exhaustive search tries all the endpoints, otherwise the endpoints are fitted to the ideal M values
+        // and refined locally.
+        float compressDXT5A_RGBM(const ColorSet & src, const ColorBlock & RGB, float threshold, bool exhaustive, AlphaBlockDXT5 * dst);
 	}
 } // nv namespace
 
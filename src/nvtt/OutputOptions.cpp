@@ -24,6 +24,8 @@
 
 #include "OutputOptions.h"
 
+#include "nvcore/Profiler.h"
+
 using namespace nvtt;
 
 
@@ -163,6 +165,8 @@ void OutputOptions::Private::beginImage(int size, int width, int height, int dep
 
 bool OutputOptions::Private::writeData(const void * data, int size) const
 {
+    NV_PROFILE_ZONE("Output");
+
     return outputHandler == NULL || outputHandler->writeData(data, size);
 }
 
@@ -38,6 +38,12 @@
 #include "nvimage/PixelFormat.h"
 #include "nvimage/ErrorMetric.h"
 
+#include "nvcore/Array.inl"
+#include "nvcore/Memory.h" // NV_ALIGN_16
+#include "nvcore/Profiler.h"
+
+#include "nvthread/ParallelFor.h"
+
 #include <float.h>
 #include <string.h> // memset, memcpy
 
@@ -45,6 +51,10 @@
 #include <math.h> // exp2f and log2f
 #endif
 
+#if NV_USE_SSE >= 2
+#include <emmintrin.h>
+#endif
+
 using namespace nv;
 using namespace nvtt;
 
@@ -195,7 +205,7 @@ void nv::getTargetExtent(int * width, int * height, int * depth, int maxExtent,
         d = max((d * maxExtent) / m, 1);
     }
 
-    if (textureType == TextureType_2D)
+    if (textureType == TextureType_2D || textureType == TextureType_Array)
     {
         d = 1;
     }
@@ -259,6 +269,8 @@ void Surface::detach()
 {
     if (m->refCount() > 1)
     {
+        NV_PROFILE_ZONE("Copy");
+
         m->release();
         m = new Surface::Private(*m);
         m->addRef();
@@ -293,6 +305,26 @@ void Surface::setNormalMap(bool isNormalMap)
     }
 }
 
+void Surface::setAtlas(int columns, int rows, const WrapMode * tileWrapModes/*= NULL*/)
+{
+    detach();
+
+    m->atlasColumns = max(columns, 1);
+    m->atlasRows = max(rows, 1);
+
+    if (tileWrapModes != NULL) m->atlasWrapModes.copy(tileWrapModes, m->atlasColumns * m->atlasRows);
+    else m->atlasWrapModes.clear();
+}
+
+void Surface::setExactMath(bool exactMath)
+{
+    if (m->exactMath != exactMath)
+    {
+        detach();
+        m->exactMath = exactMath;
+    }
+}
+
 bool Surface::isNull() const
 {
     return m->image == NULL;
@@ -331,6 +363,11 @@ bool Surface::isNormalMap() const
     return m->isNormalMap;
 }
 
+bool Surface::exactMath() const
+{
+    return m->exactMath;
+}
+
 TextureType Surface::type() const
 {
     return m->type;
@@ -357,42 +394,6 @@ float Surface::alphaTestCoverage(float alphaRef/*= 0.5*/, int alpha_channel/*=3*
     return m->image->alphaTestCoverage(alphaRef, alpha_channel);
 }
 
-float Surface::average(int channel, int alpha_channel/*= -1*/, float gamma /*= 2.2f*/) const
-{
-    if (m->image == NULL) return 0.0f;
-
-    const uint count = m->image->width() * m->image->height();
-
-    float sum = 0.0f;
-    const float * c = m->image->channel(channel);
-
-    float denom;
-
-    if (alpha_channel == -1) {
-        for (uint i = 0; i < count; i++) {
-            sum += powf(c[i], gamma);
-        }
-
-        denom = float(count);
-    }
-    else {
-        float alpha_sum = 0.0f;
-        const float * a = m->image->channel(alpha_channel);
-        
-        for (uint i = 0; i < count; i++) {
-            sum += powf(c[i], gamma) * a[i];
-            alpha_sum += a[i];
-        }
-
-        denom = alpha_sum;
-    }
-
-    // Avoid division by zero.
-    if (denom == 0.0f) return 0.0f;
-
-    return powf(sum / denom, 1.0f/gamma);
-}
-
 const float * Surface::data() const
 {
     return m->image->channel(0);
@@ -405,70 +406,8 @@ const float * Surface::channel(int i) const
 }
 
 
-void Surface::histogram(int channel, float rangeMin, float rangeMax, int binCount, int * binPtr) const
-{
-    // We assume it's clear in case we want to accumulate multiple histograms.
-    //memset(bins, 0, sizeof(int)*count);
-
-    if (m->image == NULL) return;
-
-    const float * c = m->image->channel(channel);
-
-    float scale = float(binCount) / rangeMax;
-    float bias = - scale * rangeMin;
-
-    const uint count = m->image->pixelCount();
-    for (uint i = 0; i < count; i++) {
-        float f = c[i] * scale + bias;
-        int idx = ftoi_floor(f);
-        if (idx < 0) idx = 0;
-        if (idx > binCount-1) idx = binCount-1;
-        binPtr[idx]++;
-    }
-}
-
-void Surface::range(int channel, float * rangeMin, float * rangeMax, int alpha_channel/*= -1*/, float alpha_ref/*= 0.f*/) const
-{
-    Vector2 range(FLT_MAX, -FLT_MAX);
-
-    FloatImage * img = m->image;
-
-    if (alpha_channel == -1) { // no alpha channel; just like the original range function
-
-        if (m->image != NULL) {
-            float * c = img->channel(channel);
-
-            const uint count = img->pixelCount();
-            for (uint p = 0; p < count; p++) {
-                float f = c[p];
-                if (f < range.x) range.x = f;
-                if (f > range.y) range.y = f;
-            }
-        }
-    }
-    else { // use alpha test to ignore some pixels
-        //note, it's quite possible to get FLT_MAX,-FLT_MAX back if all pixels fail the test
-
-        if (m->image != NULL)
-        {
-            const float * c = img->channel(channel);
-            const float * a = img->channel(alpha_channel);
-
-            const uint count = img->pixelCount();
-            for (uint p = 0; p < count; p++) {
-                if(a[p]>alpha_ref) {
-                    float f = c[p];
-                    if (f < range.x) range.x = f;
-                    if (f > range.y) range.y = f;
-                }
-            }
-        }
-    }
-
-    *rangeMin = range.x;
-    *rangeMax = range.y;
-}
-
+// Conversion to and from interleaved texels, defined with the texel kernels below.
+static void convertTexels(FloatImage * img, InputFormat format, const void * src, Color32 * dst);
 
 bool Surface::load(const char * fileName, bool * hasAlpha/*= NULL*/)
 {
@@ -502,8 +441,9 @@ bool Surface::save(const char * fileName, bool hasAlpha/*=0*/, bool hdr/*=0*/) c
         return ImageIO::saveFloat(fileName, m->image, 0, 4);
     }
     else {
-        AutoPtr<Image> image(m->image->createImage(0, 4));
-        nvCheck(image != NULL);
+        AutoPtr<Image> image(new Image());
+        image->allocate(m->image->width(), m->image->height(), m->image->depth());
+        convertTexels(m->image, InputFormat_BGRA_8UB, NULL, image->pixels());
 
         if (hasAlpha) {
             image->setFormat(Image::Format_ARGB);
@@ -557,6 +497,8 @@ static int filter(unsigned int code, struct _EXCEPTION_POINTERS *ep) {
 
 bool Surface::setImage(nvtt::InputFormat format, int w, int h, int d, const void * data)
 {
+    NV_PROFILE_ZONE("Input");
+
     detach();
 
     if (m->image == NULL) {
@@ -565,87 +507,15 @@ bool Surface::setImage(nvtt::InputFormat format, int w, int h, int d, const void
     m->image->allocate(4, w, h, d);
     m->type = (d == 1) ? TextureType_2D : TextureType_3D;
 
-    const int count = m->image->pixelCount();
-
-    float * rdst = m->image->channel(0);
-    float * gdst = m->image->channel(1);
-    float * bdst = m->image->channel(2);
-    float * adst = m->image->channel(3);
-
-    if (format == InputFormat_BGRA_8UB)
-    {
-        const Color32 * src = (const Color32 *)data;
-
-        TRY {
-            for (int i = 0; i < count; i++)
-            {
-                rdst[i] = float(src[i].r) / 255.0f;
-                gdst[i] = float(src[i].g) / 255.0f;
-                bdst[i] = float(src[i].b) / 255.0f;
-                adst[i] = float(src[i].a) / 255.0f;
-            }
-        }
-        CATCH {
-            return false;
-        }
-    }
-    else if (format == InputFormat_RGBA_16F)
-    {
-        const uint16 * src = (const uint16 *)data;
-
-        TRY {
-            for (int i = 0; i < count; i++)
-            {
-                ((uint32 *)rdst)[i] = half_to_float(src[4*i+0]);
-                ((uint32 *)gdst)[i] = half_to_float(src[4*i+1]);
-                ((uint32 *)bdst)[i] = half_to_float(src[4*i+2]);
-                ((uint32 *)adst)[i] = half_to_float(src[4*i+3]);
-            }
-        }
-        CATCH {
-            return false;
-        }
-    }
-    else if (format == InputFormat_RGBA_32F)
-    {
-        const float * src = (const float *)data;
-
-        TRY {
-            for (int i = 0; i < count; i++)
-            {
-                rdst[i] = src[4 * i + 0];
-                gdst[i] = src[4 * i + 1];
-                bdst[i] = src[4 * i + 2];
-                adst[i] = src[4 * i + 3];
-            }
-        }
-        CATCH {
-            return false;
-        }
-    }
-    else if (format == InputFormat_R_32F)
-    {
-        const float * src = (const float *)data;
-
-        TRY {
-            for (int i = 0; i < count; i++)
-            {
-                rdst[i] = src[i];
-                gdst[i] = 0;
-                bdst[i] = 0;
-                adst[i] = 0;
-            }
-        }
-        CATCH {
-            return false;
-        }
-    }
+    convertTexels(m->image, format, data, NULL);
 
     return true;
 }
 
 bool Surface::setImage(InputFormat format, int w, int h, int d, const void * r, const void * g, const void * b, const void * a)
 {
+    NV_PROFILE_ZONE("Input");
+
     detach();
 
     if (m->image == NULL) {
@@ -730,8 +600,13 @@ bool Surface::setImage(InputFormat format, int w, int h, int d, const void * r,
     return true;
 }
 
-// @@ Add support for compressed 3D textures.
 bool Surface::setImage2D(Format format, Decoder decoder, int w, int h, const void * data)
+{
+    return setImage3D(format, decoder, w, h, 1, data);
+}
+
+// The slices of the volume are stored one after the other, as in DDS volume textures.
+bool Surface::setImage3D(Format format, Decoder decoder, int w, int h, int d, const void * data)
 {
     if (format != nvtt::Format_BC1 &&
         format != nvtt::Format_BC2 &&
@@ -749,8 +624,8 @@ bool Surface::setImage2D(Format format, Decoder decoder, int w, int h, const voi
     if (m->image == NULL) {
         m->image = new FloatImage();
     }
-    m->image->allocate(4, w, h, 1);
-    m->type = TextureType_2D;
+    m->image->allocate(4, w, h, d);
+    m->type = (d == 1) ? TextureType_2D : TextureType_3D;
 
     const int bw = (w + 3) / 4;
     const int bh = (h + 3) / 4;
@@ -764,31 +639,34 @@ bool Surface::setImage2D(Format format, Decoder decoder, int w, int h, const voi
 		{
 			// BC6 format - decode directly to float
 
-			for (int y = 0; y < bh; y++)
+			for (int z = 0; z < d; z++)
 			{
-				for (int x = 0; x < bw; x++)
+				for (int y = 0; y < bh; y++)
 				{
-					ColorSet colors;
-					const BlockBC6 * block = (const BlockBC6 *)ptr;
-					block->decodeBlock(&colors);
-
-					for (int yy = 0; yy < 4; yy++)
+					for (int x = 0; x < bw; x++)
 					{
-						for (int xx = 0; xx < 4; xx++)
-						{
-							Vector4 rgba = colors.colors[yy*4 + xx];
+						ColorSet colors;
+						const BlockBC6 * block = (const BlockBC6 *)ptr;
+						block->decodeBlock(&colors);
 
-							if (x * 4 + xx < w && y * 4 + yy < h)
+						for (int yy = 0; yy < 4; yy++)
+						{
+							for (int xx = 0; xx < 4; xx++)
 							{
-								m->image->pixel(0, x*4 + xx, y*4 + yy, 0) = rgba.x;
-								m->image->pixel(1, x*4 + xx, y*4 + yy, 0) = rgba.y;
-								m->image->pixel(2, x*4 + xx, y*4 + yy, 0) = rgba.z;
-								m->image->pixel(3, x*4 + xx, y*4 + yy, 0) = rgba.w;
+								Vector4 rgba = colors.colors[yy*4 + xx];
+
+								if (x * 4 + xx < w && y * 4 + yy < h)
+								{
+									m->image->pixel(0, x*4 + xx, y*4 + yy, z) = rgba.x;
+									m->image->pixel(1, x*4 + xx, y*4 + yy, z) = rgba.y;
+									m->image->pixel(2, x*4 + xx, y*4 + yy, z) = rgba.z;
+									m->image->pixel(3, x*4 + xx, y*4 + yy, z) = rgba.w;
+								}
 							}
 						}
-					}
 
-					ptr += bs;
+						ptr += bs;
+					}
 				}
 			}
 		}
@@ -796,91 +674,94 @@ bool Surface::setImage2D(Format format, Decoder decoder, int w, int h, const voi
 		{
 			// Non-BC6 - decode to 8-bit, then convert to float
 
-			for (int y = 0; y < bh; y++)
+			for (int z = 0; z < d; z++)
 			{
-				for (int x = 0; x < bw; x++)
+				for (int y = 0; y < bh; y++)
 				{
-					ColorBlock colors;
-
-					if (format == nvtt::Format_BC1)
+					for (int x = 0; x < bw; x++)
 					{
-						const BlockDXT1 * block = (const BlockDXT1 *)ptr;
+						ColorBlock colors;
 
-						if (decoder == Decoder_D3D10) {
-							block->decodeBlock(&colors, false);
-						}
-						else if (decoder == Decoder_D3D9) {
-							block->decodeBlock(&colors, false);
-						}
-						else if (decoder == Decoder_NV5x) {
-							block->decodeBlockNV5x(&colors);
+						if (format == nvtt::Format_BC1)
+						{
+							const BlockDXT1 * block = (const BlockDXT1 *)ptr;
+
+							if (decoder == Decoder_D3D10) {
+								block->decodeBlock(&colors, false);
+							}
+							else if (decoder == Decoder_D3D9) {
+								block->decodeBlock(&colors, false);
+							}
+							else if (decoder == Decoder_NV5x) {
+								block->decodeBlockNV5x(&colors);
+							}
 						}
-					}
-					else if (format == nvtt::Format_BC2)
-					{
-						const BlockDXT3 * block = (const BlockDXT3 *)ptr;
+						else if (format == nvtt::Format_BC2)
+						{
+							const BlockDXT3 * block = (const BlockDXT3 *)ptr;
 
-						if (decoder == Decoder_D3D10) {
-							block->decodeBlock(&colors, false);
+							if (decoder == Decoder_D3D10) {
+								block->decodeBlock(&colors, false);
+							}
+							else if (decoder == Decoder_D3D9) {
+								block->decodeBlock(&colors, false);
+							}
+							else if (decoder == Decoder_NV5x) {
+								block->decodeBlockNV5x(&colors);
+							}
 						}
-						else if (decoder == Decoder_D3D9) {
-							block->decodeBlock(&colors, false);
+						else if (format == nvtt::Format_BC3)
+						{
+							const BlockDXT5 * block = (const BlockDXT5 *)ptr;
+
+							if (decoder == Decoder_D3D10) {
+								block->decodeBlock(&colors, false);
+							}
+							else if (decoder == Decoder_D3D9) {
+								block->decodeBlock(&colors, false);
+							}
+							else if (decoder == Decoder_NV5x) {
+								block->decodeBlockNV5x(&colors);
+							}
 						}
-						else if (decoder == Decoder_NV5x) {
-							block->decodeBlockNV5x(&colors);
+						else if (format == nvtt::Format_BC4)
+						{
+							const BlockATI1 * block = (const BlockATI1 *)ptr;
+							block->decodeBlock(&colors, decoder == Decoder_D3D9);
 						}
-					}
-					else if (format == nvtt::Format_BC3)
-					{
-						const BlockDXT5 * block = (const BlockDXT5 *)ptr;
-
-						if (decoder == Decoder_D3D10) {
-							block->decodeBlock(&colors, false);
+						else if (format == nvtt::Format_BC5)
+						{
+							const BlockATI2 * block = (const BlockATI2 *)ptr;
+							block->decodeBlock(&colors, decoder == Decoder_D3D9);
 						}
-						else if (decoder == Decoder_D3D9) {
-							block->decodeBlock(&colors, false);
+						else if (format == nvtt::Format_BC7)
+						{
+							const BlockBC7 * block = (const BlockBC7 *)ptr;
+							block->decodeBlock(&colors);
 						}
-						else if (decoder == Decoder_NV5x) {
-							block->decodeBlockNV5x(&colors);
+						else
+						{
+							nvDebugCheck(false);
 						}
-					}
-					else if (format == nvtt::Format_BC4)
-					{
-						const BlockATI1 * block = (const BlockATI1 *)ptr;
-						block->decodeBlock(&colors, decoder == Decoder_D3D9);
-					}
-					else if (format == nvtt::Format_BC5)
-					{
-						const BlockATI2 * block = (const BlockATI2 *)ptr;
-						block->decodeBlock(&colors, decoder == Decoder_D3D9);
-					}
-					else if (format == nvtt::Format_BC7)
-					{
-						const BlockBC7 * block = (const BlockBC7 *)ptr;
-						block->decodeBlock(&colors);
-					}
-					else
-					{
-						nvDebugCheck(false);
-					}
 
-					for (int yy = 0; yy < 4; yy++)
-					{
-						for (int xx = 0; xx < 4; xx++)
+						for (int yy = 0; yy < 4; yy++)
 						{
-							Color32 c = colors.color(xx, yy);
-
-							if (x * 4 + xx < w && y * 4 + yy < h)
+							for (int xx = 0; xx < 4; xx++)
 							{
-								m->image->pixel(0, x*4 + xx, y*4 + yy, 0) = float(c.r) * 1.0f/255.0f;
-								m->image->pixel(1, x*4 + xx, y*4 + yy, 0) = float(c.g) * 1.0f/255.0f;
-								m->image->pixel(2, x*4 + xx, y*4 + yy, 0) = float(c.b) * 1.0f/255.0f;
-								m->image->pixel(3, x*4 + xx, y*4 + yy, 0) = float(c.a) * 1.0f/255.0f;
+								Color32 c = colors.color(xx, yy);
+
+								if (x * 4 + xx < w && y * 4 + yy < h)
+								{
+									m->image->pixel(0, x*4 + xx, y*4 + yy, z) = float(c.r) * 1.0f/255.0f;
+									m->image->pixel(1, x*4 + xx, y*4 + yy, z) = float(c.g) * 1.0f/255.0f;
+									m->image->pixel(2, x*4 + xx, y*4 + yy, z) = float(c.b) * 1.0f/255.0f;
+									m->image->pixel(3, x*4 + xx, y*4 + yy, z) = float(c.a) * 1.0f/255.0f;
+								}
 							}
 						}
-					}
 
-					ptr += bs;
+						ptr += bs;
+					}
 				}
 			}
 		}
@@ -930,6 +811,8 @@ void Surface::resize(int w, int h, int d, ResizeFilter filter, float filterWidth
         return;
     }
 
+    NV_PROFILE_ZONE("Resize");
+
     detach();
 
     FloatImage * img = m->image;
@@ -1069,36 +952,26 @@ bool Surface::buildNextMipmap(MipmapFilter filter, int min_size /*= 1*/)
     return buildNextMipmap(filter, filterWidth, params, min_size);
 }
 
-bool Surface::buildNextMipmap(MipmapFilter filter, float filterWidth, const float * params, int min_size /*= 1*/)
+static FloatImage * downSample(const FloatImage * img, MipmapFilter filter, float filterWidth, const float * params, FloatImage::WrapMode wrapMode, bool transparency)
 {
-    if (!canMakeNextMipmap(min_size)) {
-        return false;
-    }
-
-    detach();
-
-    FloatImage * img = m->image;
-
-    FloatImage::WrapMode wrapMode = (FloatImage::WrapMode)m->wrapMode;
-
-    if (m->alphaMode == AlphaMode_Transparency)
+    if (transparency)
     {
         if (filter == MipmapFilter_Box)
         {
             BoxFilter filter(filterWidth);
-            img = img->downSample(filter, wrapMode, 3);
+            return img->downSample(filter, wrapMode, 3);
         }
         else if (filter == MipmapFilter_Triangle)
         {
             TriangleFilter filter(filterWidth);
-            img = img->downSample(filter, wrapMode, 3);
+            return img->downSample(filter, wrapMode, 3);
         }
-        else if (filter == MipmapFilter_Kaiser)
+        else //if (filter == MipmapFilter_Kaiser)
         {
             nvDebugCheck(filter == MipmapFilter_Kaiser);
             KaiserFilter filter(filterWidth);
             if (params != NULL) filter.setParameters(params[0], params[1]);
-            img = img->downSample(filter, wrapMode, 3);
+            return img->downSample(filter, wrapMode, 3);
         }
     }
     else
@@ -1106,26 +979,146 @@ bool Surface::buildNextMipmap(MipmapFilter filter, float filterWidth, const floa
         if (filter == MipmapFilter_Box)
         {
             if (filterWidth == 0.5f && img->depth() == 1) {
-                img = img->fastDownSample();
+                return img->fastDownSample();
             }
             else {
                 BoxFilter filter(filterWidth);
-                img = img->downSample(filter, wrapMode);
+                return img->downSample(filter, wrapMode);
             }
         }
         else if (filter == MipmapFilter_Triangle)
         {
             TriangleFilter filter(filterWidth);
-            img = img->downSample(filter, wrapMode);
+            return img->downSample(filter, wrapMode);
         }
         else //if (filter == MipmapFilter_Kaiser)
         {
             nvDebugCheck(filter == MipmapFilter_Kaiser);
             KaiserFilter filter(filterWidth);
             if (params != NULL) filter.setParameters(params[0], params[1]);
-            img = img->downSample(filter, wrapMode);
+            return img->downSample(filter, wrapMode);
+        }
+    }
+}
+
+static Filter * createMipmapFilter(MipmapFilter filter, float filterWidth, const float * params)
+{
+    if (filter == MipmapFilter_Box) return new BoxFilter(filterWidth);
+    if (filter == MipmapFilter_Triangle) return new TriangleFilter(filterWidth);
+
+    nvDebugCheck(filter == MipmapFilter_Kaiser);
+    KaiserFilter * kaiser = new KaiserFilter(filterWidth);
+    if (params != NULL) kaiser->setParameters(params[0], params[1]);
+    return kaiser;
+}
+
+// Tiles of an atlas are copied out of the surface, filtered and copied into the next mipmap in parallel.
+// All tiles have the same size, so they share the filter kernels.
+struct AtlasMipmapContext {
+    const FloatImage * src;
+    FloatImage * dst;
+    uint columns;
+    uint rows;
+    const WrapMode * wrapModes;     // Per tile, or NULL.
+    FloatImage::WrapMode wrapMode;
+    const PolyphaseKernel * xkernel;
+    const PolyphaseKernel * ykernel;
+    bool transparency;
+};
+
+static void AtlasMipmapTask(void * context, int id)
+{
+    AtlasMipmapContext * ctx = (AtlasMipmapContext *)context;
+
+    const FloatImage * src = ctx->src;
+    FloatImage * dst = ctx->dst;
+    const uint componentCount = src->componentCount();
+
+    const uint tx = id % ctx->columns;
+    const uint ty = id / ctx->columns;
+
+    const uint srcWidth = src->width() / ctx->columns;
+    const uint srcHeight = src->height() / ctx->rows;
+    const uint dstWidth = dst->width() / ctx->columns;
+    const uint dstHeight = dst->height() / ctx->rows;
+
+    FloatImage tile;
+    tile.allocate(componentCount, srcWidth, srcHeight);
+
+    for (uint c = 0; c < componentCount; c++) {
+        for (uint y = 0; y < srcHeight; y++) {
+            memcpy(tile.scanline(c, y, 0), src->scanline(c, (ty * srcHeight) + y, 0) + tx * srcWidth, srcWidth * sizeof(float));
+        }
+    }
+
+    const FloatImage::WrapMode wrapMode = (ctx->wrapModes != NULL) ? (FloatImage::WrapMode)ctx->wrapModes[id] : ctx->wrapMode;
+
+    AutoPtr<FloatImage> result(ctx->transparency ?
+        tile.resize(*ctx->xkernel, *ctx->ykernel, wrapMode, 3) :
+        tile.resize(*ctx->xkernel, *ctx->ykernel, wrapMode));
+    nvDebugCheck(result->width() == dstWidth && result->height() == dstHeight);
+
+    for (uint c = 0; c < componentCount; c++) {
+        for (uint y = 0; y < dstHeight; y++) {
+            memcpy(dst->scanline(c, (ty * dstHeight) + y, 0) + tx * dstWidth, result->scanline(c, y, 0), dstWidth * sizeof(float));
         }
     }
+}
+
+bool Surface::buildNextMipmap(MipmapFilter filter, float filterWidth, const float * params, int min_size /*= 1*/)
+{
+    if (!canMakeNextMipmap(min_size)) {
+        return false;
+    }
+
+    NV_PROFILE_ZONE("Mipmap");
+
+    detach();
+
+    FloatImage * img = m->image;
+
+    const FloatImage::WrapMode wrapMode = (FloatImage::WrapMode)m->wrapMode;
+    const bool transparency = (m->alphaMode == AlphaMode_Transparency);
+
+    // Atlas tiles are filtered independently while their extents can be halved exactly. The 2x2 box filter never
+    // crosses the tile boundaries then, so it's applied to the whole surface.
+    const uint columns = m->atlasColumns;
+    const uint rows = m->atlasRows;
+    const uint tileWidth = img->width() / columns;
+    const uint tileHeight = img->height() / rows;
+
+    const bool tiled = (columns * rows > 1) && img->depth() == 1 &&
+        img->width() == tileWidth * columns && img->height() == tileHeight * rows &&
+        (columns == 1 || tileWidth % 2 == 0) && (rows == 1 || tileHeight % 2 == 0) &&
+        !(filter == MipmapFilter_Box && filterWidth == 0.5f && !transparency);
+
+    if (tiled)
+    {
+        AutoPtr<Filter> mipmapFilter(createMipmapFilter(filter, filterWidth, params));
+        PolyphaseKernel xkernel(*mipmapFilter, tileWidth, max(1U, tileWidth / 2), 32);
+        PolyphaseKernel ykernel(*mipmapFilter, tileHeight, max(1U, tileHeight / 2), 32);
+
+        AtlasMipmapContext context;
+        context.src = img;
+        context.dst = new FloatImage;
+        context.dst->allocate(img->componentCount(), max(1U, img->width() / 2), max(1U, img->height() / 2));
+        context.columns = columns;
+        context.rows = rows;
+        context.wrapModes = m->atlasWrapModes.isEmpty() ? NULL : m->atlasWrapModes.buffer();
+        context.wrapMode = wrapMode;
+        context.xkernel = &xkernel;
+        context.ykernel = &ykernel;
+        context.transparency = transparency;
+
+        ParallelFor parallelFor(AtlasMipmapTask, &context);
+        parallelFor.run(columns * rows);
+
+        img = context.dst;
+    }
+    else
+    {
+        img = downSample(img, filter, filterWidth, params, wrapMode, transparency);
+    }
 
     delete m->image;
     m->image = img;
@@ -1200,6 +1193,8 @@ void Surface::toLinear(float gamma)
     if (isNull()) return;
     if (equal(gamma, 1.0f)) return;
 
+    NV_PROFILE_ZONE("Linearize");
+
     detach();
 
     m->image->toLinear(0, 3, gamma);
@@ -1210,6 +1205,8 @@ void Surface::toGamma(float gamma)
     if (isNull()) return;
     if (equal(gamma, 1.0f)) return;
 
+    NV_PROFILE_ZONE("Gamma");
+
     detach();
 
     m->image->toGamma(0, 3, gamma);
@@ -1220,6 +1217,8 @@ void Surface::toLinear(int channel, float gamma)
     if (isNull()) return;
     if (equal(gamma, 1.0f)) return;
 
+    NV_PROFILE_ZONE("Linearize");
+
     detach();
 
     m->image->toLinear(channel, 1, gamma);
@@ -1230,6 +1229,8 @@ void Surface::toGamma(int channel, float gamma)
     if (isNull()) return;
     if (equal(gamma, 1.0f)) return;
 
+    NV_PROFILE_ZONE("Gamma");
+
     detach();
 
     m->image->toGamma(channel, 1, gamma);
@@ -1536,30 +1537,754 @@ void Surface::scaleAlphaToCoverage(float coverage, float alphaRef/*= 0.5f*/, int
     return true;
 }*/
 
-// Ideally you should compress/quantize the RGB and M portions independently.
-// Once you have M quantized, you would compute the corresponding RGB and quantize that.
-void Surface::toRGBM(float range/*= 1*/, float threshold/*= 0.25*/)
-{
-    if (isNull()) return;
+// Per texel color transforms run in parallel over bands of texels. Channels are planar, so a band is a contiguous range
+// in every channel. The SSE2 loops produce the same bits as the scalar code. Only the log2 and exp2 approximations
+// differ from the C library, and they are not used when the surface requests exact math.
+typedef void TexelKernel(float * const * channels, uint begin, uint end, const void * params);
 
-    detach();
+struct TexelBandContext {
+    TexelKernel * kernel;
+    float * channels[4];
+    const void * params;
+    uint count;
+    uint bandSize;
+};
 
-    threshold = ::clamp(threshold, 1e-6f, 1.0f);
+static void TexelBandTask(void * context, int id)
+{
+    TexelBandContext * ctx = (TexelBandContext *)context;
 
-    FloatImage * img = m->image;
-    float * r = img->channel(0);
-    float * g = img->channel(1);
-    float * b = img->channel(2);
-    float * a = img->channel(3);
+    const uint begin = id * ctx->bandSize;
+    const uint end = min(begin + ctx->bandSize, ctx->count);
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
-        float R = nv::clamp(r[i], 0.0f, 1.0f);
-        float G = nv::clamp(g[i], 0.0f, 1.0f);
-        float B = nv::clamp(b[i], 0.0f, 1.0f);
+    ctx->kernel(ctx->channels, begin, end, ctx->params);
+}
 
-#if 0
-        // Baseline, no compression:
+// Runs the kernel on the RGBA channels, or only on the given channel.
+static void processTexels(FloatImage * img, int channel, TexelKernel * kernel, const void * params)
+{
+    TexelBandContext context;
+    context.kernel = kernel;
+    for (int c = 0; c < 4; c++) {
+        context.channels[c] = (channel < 0) ? img->channel(c) : (c == 0 ? img->channel(channel) : NULL);
+    }
+    context.params = params;
+    context.count = img->pixelCount();
+
+    // A multiple of 4, so that bands start at aligned texels when the channels are aligned.
+    context.bandSize = 16384;
+
+    const uint bandCount = (context.count + context.bandSize - 1) / context.bandSize;
+    if (bandCount == 1) {
+        kernel(context.channels, 0, context.count, params);
+    }
+    else {
+        ParallelFor parallelFor(TexelBandTask, &context);
+        parallelFor.run(bandCount);
+    }
+}
+
+
+// Polynomial approximations of exp2 and log2, with relative errors below 4e-7. Arguments whose results are not normal
+// floats use the C library. The scalar and SSE2 versions produce the same bits.
+static inline float exp2Polynomial(float f) // f in [-0.5, 0.5]
+{
+    return 1.000000072f + f * (0.6931469670f + f * (0.2402211989f + f * (0.05550713467f + f * (0.009675533332f + f * 0.001327637436f))));
+}
+
+static inline float log2Polynomial(float u) // u in [sqrt(0.5) - 1, sqrt(2) - 1]
+{
+    return u * (1.442694962f + u * (-0.7213527887f + u * (0.4809232377f + u * (-0.3602395905f + u * (0.2870987307f + u * (-0.2488776104f + u * (0.2340430580f + u * -0.1458104497f)))))));
+}
+
+static inline float fastExp2(float x)
+{
+    if (x <= -150.0f) return 0.0f; // Rounds to zero.
+    if (!(x >= -126.0f && x <= 127.0f)) return exp2f(x);
+
+    const int n = ftoi_round(x);
+    Float754 scale;
+    scale.raw = uint(n + 127) << 23;
+
+    return exp2Polynomial(x - float(n)) * scale.value;
+}
+
+static inline float fastLog2(float x)
+{
+    if (x == 0.0f) return -FLT_MAX * 2; // -inf
+    if (!(x >= FLT_MIN && x <= FLT_MAX)) return log2f(x);
+
+    Float754 f;
+    f.value = x;
+    int e = int(f.raw >> 23) - 127;
+
+    // Mantissa in [sqrt(0.5), sqrt(2)).
+    f.raw = (f.raw & 0x007FFFFF) | 0x3F800000;
+    if (f.raw > 0x3FB504F3) {
+        f.raw -= 0x00800000;
+        e += 1;
+    }
+
+    return float(e) + log2Polynomial(f.value - 1.0f);
+}
+
+#if NV_USE_SSE >= 2
+
+// The SSE2 loops use aligned loads and stores, the unaligned ones are split in two on some of the targets we build for.
+// Channels are aligned when the allocation is and the texel count is a multiple of 4, otherwise the kernels run the
+// scalar loop over the whole range.
+static inline bool isAligned(float * const * channels, uint begin)
+{
+    for (int c = 0; c < 4; c++) {
+        if (channels[c] != NULL && (uintptr_t(channels[c] + begin) & 15) != 0) return false;
+    }
+    return true;
+}
+
+static inline __m128 saturate(__m128 x)
+{
+    return _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+}
+
+static inline __m128 select(__m128 off, __m128 on, __m128 mask)
+{
+    return _mm_or_ps(_mm_andnot_ps(mask, off), _mm_and_ps(mask, on));
+}
+
+static inline __m128i select(__m128i off, __m128i on, __m128i mask)
+{
+    return _mm_or_si128(_mm_andnot_si128(mask, off), _mm_and_si128(mask, on));
+}
+
+// 2^k for k in [-126, 127].
+static inline __m128 pow2(__m128i k)
+{
+    return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(k, _mm_set1_epi32(127)), 23));
+}
+
+static inline __m128 exp2Polynomial(__m128 f)
+{
+    __m128 p = _mm_set1_ps(0.001327637436f);
+    p = _mm_add_ps(_mm_set1_ps(0.009675533332f), _mm_mul_ps(f, p));
+    p = _mm_add_ps(_mm_set1_ps(0.05550713467f), _mm_mul_ps(f, p));
+    p = _mm_add_ps(_mm_set1_ps(0.2402211989f), _mm_mul_ps(f, p));
+    p = _mm_add_ps(_mm_set1_ps(0.6931469670f), _mm_mul_ps(f, p));
+    return _mm_add_ps(_mm_set1_ps(1.000000072f), _mm_mul_ps(f, p));
+}
+
+static inline __m128 log2Polynomial(__m128 u)
+{
+    __m128 p = _mm_set1_ps(-0.1458104497f);
+    p = _mm_add_ps(_mm_set1_ps(0.2340430580f), _mm_mul_ps(u, p));
+    p = _mm_add_ps(_mm_set1_ps(-0.2488776104f), _mm_mul_ps(u, p));
+    p = _mm_add_ps(_mm_set1_ps(0.2870987307f), _mm_mul_ps(u, p));
+    p = _mm_add_ps(_mm_set1_ps(-0.3602395905f), _mm_mul_ps(u, p));
+    p = _mm_add_ps(_mm_set1_ps(0.4809232377f), _mm_mul_ps(u, p));
+    p = _mm_add_ps(_mm_set1_ps(-0.7213527887f), _mm_mul_ps(u, p));
+    p = _mm_add_ps(_mm_set1_ps(1.442694962f), _mm_mul_ps(u, p));
+    return _mm_mul_ps(u, p);
+}
+
+static inline __m128 fastExp2(__m128 x)
+{
+    const __m128i n = _mm_cvtps_epi32(x);
+    __m128 result = _mm_mul_ps(exp2Polynomial(_mm_sub_ps(x, _mm_cvtepi32_ps(n))), pow2(n));
+
+    // Lanes that round to zero.
+    const __m128 zero = _mm_cmple_ps(x, _mm_set1_ps(-150.0f));
+    result = _mm_andnot_ps(zero, result);
+
+    // Other lanes out of range go through the C library.
+    const __m128 inRange = _mm_or_ps(zero, _mm_and_ps(_mm_cmpge_ps(x, _mm_set1_ps(-126.0f)), _mm_cmple_ps(x, _mm_set1_ps(127.0f))));
+    if (_mm_movemask_ps(inRange) != 0xF) {
+        float tmp[4];
+        _mm_storeu_ps(tmp, x);
+        for (int i = 0; i < 4; i++) tmp[i] = fastExp2(tmp[i]);
+        result = select(_mm_loadu_ps(tmp), result, inRange);
+    }
+    return result;
+}
+
+static inline __m128 fastLog2(__m128 x)
+{
+    __m128i bits = _mm_castps_si128(x);
+    __m128i e = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+
+    // Mantissa in [sqrt(0.5), sqrt(2)).
+    bits = _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000));
+    const __m128i high = _mm_cmpgt_epi32(bits, _mm_set1_epi32(0x3FB504F3));
+    bits = _mm_sub_epi32(bits, _mm_and_si128(high, _mm_set1_epi32(0x00800000)));
+    e = _mm_sub_epi32(e, high);
+
+    __m128 result = _mm_add_ps(_mm_cvtepi32_ps(e), log2Polynomial(_mm_sub_ps(_mm_castsi128_ps(bits), _mm_set1_ps(1.0f))));
+
+    const __m128 zero = _mm_cmpeq_ps(x, _mm_setzero_ps());
+    result = select(result, _mm_set1_ps(-FLT_MAX * 2), zero);
+
+    // Negative, denormal, infinite and NaN lanes go through the C library.
+    const __m128 inRange = _mm_or_ps(zero, _mm_and_ps(_mm_cmpge_ps(x, _mm_set1_ps(FLT_MIN)), _mm_cmple_ps(x, _mm_set1_ps(FLT_MAX))));
+    if (_mm_movemask_ps(inRange) != 0xF) {
+        float tmp[4];
+        _mm_storeu_ps(tmp, x);
+        for (int i = 0; i < 4; i++) tmp[i] = fastLog2(tmp[i]);
+        result = select(_mm_loadu_ps(tmp), result, inRange);
+    }
+    return result;
+}
+
+#endif // NV_USE_SSE >= 2
+
+
+// Conversion between the planar float channels and the interleaved formats of the API. Bands of texels are converted in
+// parallel, the SSE2 loops produce the same bits as the scalar ones.
+struct TexelConversion {
+    InputFormat format;
+    const void * src;   // Interleaved input, or NULL.
+    Color32 * dst;      // Interleaved output, or NULL.
+};
+
+static void InputConversionKernel(float * const * c, uint begin, uint end, const void * params)
+{
+    const TexelConversion * p = (const TexelConversion *)params;
+    uint i = begin;
+
+    if (p->format == InputFormat_BGRA_8UB)
+    {
+        const Color32 * src = (const Color32 *)p->src;
+#if NV_USE_SSE >= 2
+        if (isAligned(c, begin)) {
+            const __m128i mask = _mm_set1_epi32(0xFF);
+            const __m128 scale = _mm_set1_ps(255.0f);
+            for (; i + 4 <= end; i += 4) {
+                const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+                _mm_store_ps(c[0] + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 16), mask)), scale));
+                _mm_store_ps(c[1] + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 8), mask)), scale));
+                _mm_store_ps(c[2] + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(v, mask)), scale));
+                _mm_store_ps(c[3] + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_srli_epi32(v, 24)), scale));
+            }
+        }
+#endif
+        for (; i < end; i++) {
+            c[0][i] = float(src[i].r) / 255.0f;
+            c[1][i] = float(src[i].g) / 255.0f;
+            c[2][i] = float(src[i].b) / 255.0f;
+            c[3][i] = float(src[i].a) / 255.0f;
+        }
+    }
+    else if (p->format == InputFormat_RGBA_16F)
+    {
+        const uint16 * src = (const uint16 *)p->src;
+#if NV_USE_SSE >= 2
+        if (isAligned(c, begin)) {
+            // Halves are converted in chunks through aligned buffers, the input may not be aligned.
+            const uint chunkSize = 64;
+            NV_ALIGN_16 uint16 halves[4 * chunkSize];
+            NV_ALIGN_16 float floats[4 * chunkSize];
+            for (; i + chunkSize <= end; i += chunkSize) {
+                memcpy(halves, src + 4 * i, sizeof(halves));
+                half_to_float_array_SSE2(halves, floats, 4 * chunkSize);
+                for (uint j = 0; j < chunkSize; j += 4) {
+                    __m128 r = _mm_load_ps(floats + 4 * j + 0);
+                    __m128 g = _mm_load_ps(floats + 4 * j + 4);
+                    __m128 b = _mm_load_ps(floats + 4 * j + 8);
+                    __m128 a = _mm_load_ps(floats + 4 * j + 12);
+                    _MM_TRANSPOSE4_PS(r, g, b, a);
+                    _mm_store_ps(c[0] + i + j, r);
+                    _mm_store_ps(c[1] + i + j, g);
+                    _mm_store_ps(c[2] + i + j, b);
+                    _mm_store_ps(c[3] + i + j, a);
+                }
+            }
+        }
+#endif
+        for (; i < end; i++) {
+            ((uint32 *)c[0])[i] = half_to_float(src[4 * i + 0]);
+            ((uint32 *)c[1])[i] = half_to_float(src[4 * i + 1]);
+            ((uint32 *)c[2])[i] = half_to_float(src[4 * i + 2]);
+            ((uint32 *)c[3])[i] = half_to_float(src[4 * i + 3]);
+        }
+    }
+    else if (p->format == InputFormat_RGBA_32F)
+    {
+        const float * src = (const float *)p->src;
+#if NV_USE_SSE >= 2
+        if (isAligned(c, begin)) {
+            for (; i + 4 <= end; i += 4) {
+                __m128 r = _mm_loadu_ps(src + 4 * i + 0);
+                __m128 g = _mm_loadu_ps(src + 4 * i + 4);
+                __m128 b = _mm_loadu_ps(src + 4 * i + 8);
+                __m128 a = _mm_loadu_ps(src + 4 * i + 12);
+                _MM_TRANSPOSE4_PS(r, g, b, a);
+                _mm_store_ps(c[0] + i, r);
+                _mm_store_ps(c[1] + i, g);
+                _mm_store_ps(c[2] + i, b);
+                _mm_store_ps(c[3] + i, a);
+            }
+        }
+#endif
+        for (; i < end; i++) {
+            c[0][i] = src[4 * i + 0];
+            c[1][i] = src[4 * i + 1];
+            c[2][i] = src[4 * i + 2];
+            c[3][i] = src[4 * i + 3];
+        }
+    }
+    else if (p->format == InputFormat_R_32F)
+    {
+        const float * src = (const float *)p->src;
+        memcpy(c[0] + begin, src + begin, (end - begin) * sizeof(float));
+        for (int k = 1; k < 4; k++) {
+            memset(c[k] + begin, 0, (end - begin) * sizeof(float));
+        }
+    }
+}
+
+// Same as FloatImage::createImage.
+static void OutputConversionKernel(float * const * c, uint begin, uint end, const void * params)
+{
+    const TexelConversion * p = (const TexelConversion *)params;
+    Color32 * dst = p->dst;
+    uint i = begin;
+
+#if NV_USE_SSE >= 2
+    const __m128 scale = _mm_set1_ps(255.0f);
+    for (; i + 4 <= end; i += 4) {
+        const __m128i r = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(c[0] + i), scale));
+        const __m128i g = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(c[1] + i), scale));
+        const __m128i b = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(c[2] + i), scale));
+        const __m128i a = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(c[3] + i), scale));
+
+        // Saturating packs clamp to [0, 255], bytes are then interleaved in BGRA order.
+        const __m128i brga = _mm_packus_epi16(_mm_packs_epi32(b, r), _mm_packs_epi32(g, a));
+        const __m128i bgbgrara = _mm_unpacklo_epi8(brga, _mm_srli_si128(brga, 8));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi16(bgbgrara, _mm_srli_si128(bgbgrara, 8)));
+    }
+#endif
+    for (; i < end; i++) {
+        dst[i] = Color32(clamp(int(255.0f * c[0][i]), 0, 255), clamp(int(255.0f * c[1][i]), 0, 255),
+            clamp(int(255.0f * c[2][i]), 0, 255), clamp(int(255.0f * c[3][i]), 0, 255));
+    }
+}
+
+static void convertTexels(FloatImage * img, InputFormat format, const void * src, Color32 * dst)
+{
+    TexelConversion conversion;
+    conversion.format = format;
+    conversion.src = src;
+    conversion.dst = dst;
+
+    processTexels(img, -1, (src != NULL) ? InputConversionKernel : OutputConversionKernel, &conversion);
+}
+
+
+// Statistics are reduced in parallel over bands of texels. Each band stores its partial results in its own slot, and the
+// slots are combined in band order, so the results do not depend on the number of threads. Sums are accumulated in
+// double precision.
+struct ChannelReduction {
+    float minimum;
+    float maximum;
+    double sum;
+    double weightSum;
+};
+
+struct ReductionParams {
+    ReductionParams() : alphaTest(false), alphaRef(0.0f), alphaWeight(false), gamma(1.0f), exactMath(false), binCount(0), scale(0.0f), bias(0.0f) {}
+
+    // Only texels whose alpha is above alphaRef contribute to the range.
+    bool alphaTest;
+    float alphaRef;
+
+    // Sum of the texels raised to gamma, weighted by alpha if alphaWeight is set.
+    bool alphaWeight;
+    float gamma;
+    bool exactMath;
+
+    // Histogram bins, texels are mapped to them with scale and bias.
+    int binCount;
+    float scale;
+    float bias;
+};
+
+static inline float powGamma(float x, float gamma, bool exactMath)
+{
+    if (gamma == 1.0f) return x;
+    if (exactMath || !(x >= 0.0f)) return powf(x, gamma);
+    return fastExp2(gamma * fastLog2(x));
+}
+
+static inline int histogramBin(float x, const ReductionParams & p)
+{
+    float f = x * p.scale + p.bias;
+    if (!(f > 0.0f)) f = 0.0f;
+    if (f > float(p.binCount - 1)) f = float(p.binCount - 1);
+    return int(f);
+}
+
+static void reduceTexels(const float * c, const float * a, uint begin, uint end, const ReductionParams & p, ChannelReduction * result, int * bins)
+{
+    float minimum = FLT_MAX;
+    float maximum = -FLT_MAX;
+    double sum = 0.0;
+    double weightSum = 0.0;
+
+    uint i = begin;
+
+#if NV_USE_SSE >= 2
+    const float * const channels[4] = { c, a, NULL, NULL };
+    const bool aligned = isAligned((float * const *)channels, begin) && !(p.exactMath && p.gamma != 1.0f);
+
+    if (aligned && i + 4 <= end)
+    {
+        __m128 vmin = _mm_set1_ps(FLT_MAX);
+        __m128 vmax = _mm_set1_ps(-FLT_MAX);
+        __m128d sumLo = _mm_setzero_pd(), sumHi = _mm_setzero_pd();
+        __m128d weightLo = _mm_setzero_pd(), weightHi = _mm_setzero_pd();
+
+        const __m128 alphaRef = _mm_set1_ps(p.alphaRef);
+        const __m128 gamma = _mm_set1_ps(p.gamma);
+        const __m128 scale = _mm_set1_ps(p.scale);
+        const __m128 bias = _mm_set1_ps(p.bias);
+        const __m128 maxBin = _mm_set1_ps(float(p.binCount - 1));
+
+        for (; i + 4 <= end; i += 4)
+        {
+            const __m128 x = _mm_load_ps(c + i);
+
+            // The texel is the first operand, so that NaNs are ignored like in the scalar loop.
+            if (p.alphaTest) {
+                const __m128 mask = _mm_cmpgt_ps(_mm_load_ps(a + i), alphaRef);
+                vmin = _mm_min_ps(select(_mm_set1_ps(FLT_MAX), x, mask), vmin);
+                vmax = _mm_max_ps(select(_mm_set1_ps(-FLT_MAX), x, mask), vmax);
+            }
+            else {
+                vmin = _mm_min_ps(x, vmin);
+                vmax = _mm_max_ps(x, vmax);
+            }
+
+            __m128 f = x;
+            if (p.gamma != 1.0f) {
+                if (_mm_movemask_ps(_mm_cmpge_ps(x, _mm_setzero_ps())) == 0xF) {
+                    f = fastExp2(_mm_mul_ps(gamma, fastLog2(x)));
+                }
+                else {
+                    float tmp[4];
+                    _mm_storeu_ps(tmp, x);
+                    for (int k = 0; k < 4; k++) tmp[k] = powGamma(tmp[k], p.gamma, p.exactMath);
+                    f = _mm_loadu_ps(tmp);
+                }
+            }
+
+            if (p.alphaWeight) {
+                const __m128 w = _mm_load_ps(a + i);
+                f = _mm_mul_ps(f, w);
+                weightLo = _mm_add_pd(weightLo, _mm_cvtps_pd(w));
+                weightHi = _mm_add_pd(weightHi, _mm_cvtps_pd(_mm_movehl_ps(w, w)));
+            }
+
+            sumLo = _mm_add_pd(sumLo, _mm_cvtps_pd(f));
+            sumHi = _mm_add_pd(sumHi, _mm_cvtps_pd(_mm_movehl_ps(f, f)));
+
+            if (p.binCount != 0) {
+                __m128 b = _mm_add_ps(_mm_mul_ps(x, scale), bias);
+                b = _mm_min_ps(_mm_max_ps(b, _mm_setzero_ps()), maxBin);
+
+                int idx[4];
+                _mm_storeu_si128((__m128i *)idx, _mm_cvttps_epi32(b));
+                bins[idx[0]]++;
+                bins[idx[1]]++;
+                bins[idx[2]]++;
+                bins[idx[3]]++;
+            }
+        }
+
+        float tmp[4];
+        _mm_storeu_ps(tmp, vmin);
+        minimum = min(min(tmp[0], tmp[1]), min(tmp[2], tmp[3]));
+        _mm_storeu_ps(tmp, vmax);
+        maximum = max(max(tmp[0], tmp[1]), max(tmp[2], tmp[3]));
+
+        double dtmp[2];
+        _mm_storeu_pd(dtmp, _mm_add_pd(sumLo, sumHi));
+        sum = dtmp[0] + dtmp[1];
+        _mm_storeu_pd(dtmp, _mm_add_pd(weightLo, weightHi));
+        weightSum = dtmp[0] + dtmp[1];
+    }
+#endif
+
+    for (; i < end; i++)
+    {
+        const float x = c[i];
+
+        if (!p.alphaTest || a[i] > p.alphaRef) {
+            if (x < minimum) minimum = x;
+            if (x > maximum) maximum = x;
+        }
+
+        float f = powGamma(x, p.gamma, p.exactMath);
+        if (p.alphaWeight) {
+            f *= a[i];
+            weightSum += a[i];
+        }
+        sum += f;
+
+        if (p.binCount != 0) {
+            bins[histogramBin(x, p)]++;
+        }
+    }
+
+    result->minimum = minimum;
+    result->maximum = maximum;
+    result->sum = sum;
+    result->weightSum = weightSum;
+}
+
+struct ReductionContext {
+    const float * channels[4];
+    uint channelCount;
+    const float * alpha;
+    const ReductionParams * params;
+    uint count;
+    uint bandSize;
+    ChannelReduction * results;     // bandCount * channelCount
+    int * bins;                     // bandCount * channelCount * binCount
+};
+
+static void ReductionBandTask(void * context, int id)
+{
+    ReductionContext * ctx = (ReductionContext *)context;
+
+    const uint begin = id * ctx->bandSize;
+    const uint end = min(begin + ctx->bandSize, ctx->count);
+    const int binCount = ctx->params->binCount;
+
+    for (uint c = 0; c < ctx->channelCount; c++) {
+        const uint slot = id * ctx->channelCount + c;
+        reduceTexels(ctx->channels[c], ctx->alpha, begin, end, *ctx->params, ctx->results + slot, ctx->bins + slot * binCount);
+    }
+}
+
+// Reduces the given channels in a single pass over the image. Histogram bins are accumulated to bins[c * binCount].
+static void reduceChannels(const FloatImage * img, const int * channels, uint channelCount, int alphaChannel, const ReductionParams & params, ChannelReduction * results, int * bins)
+{
+    nvDebugCheck(channelCount <= 4);
+
+    ReductionContext context;
+    for (uint c = 0; c < channelCount; c++) {
+        context.channels[c] = img->channel(channels[c]);
+    }
+    context.channelCount = channelCount;
+    context.alpha = (alphaChannel >= 0) ? img->channel(alphaChannel) : NULL;
+    context.params = &params;
+    context.count = img->pixelCount();
+
+    // A multiple of 4, so that bands start at aligned texels when the channels are aligned.
+    context.bandSize = 65536;
+
+    const uint bandCount = max(1U, (context.count + context.bandSize - 1) / context.bandSize);
+    const uint slotCount = bandCount * channelCount;
+    const uint binCount = params.binCount;
+
+    context.results = new ChannelReduction[slotCount];
+    context.bins = NULL;
+    if (binCount != 0) {
+        context.bins = new int[slotCount * binCount];
+        memset(context.bins, 0, sizeof(int) * slotCount * binCount);
+    }
+
+    if (bandCount == 1) {
+        ReductionBandTask(&context, 0);
+    }
+    else {
+        ParallelFor parallelFor(ReductionBandTask, &context);
+        parallelFor.run(bandCount);
+    }
+
+    for (uint c = 0; c < channelCount; c++) {
+        ChannelReduction & result = results[c];
+        result.minimum = FLT_MAX;
+        result.maximum = -FLT_MAX;
+        result.sum = 0.0;
+        result.weightSum = 0.0;
+
+        for (uint b = 0; b < bandCount; b++) {
+            const uint slot = b * channelCount + c;
+            const ChannelReduction & partial = context.results[slot];
+            result.minimum = min(result.minimum, partial.minimum);
+            result.maximum = max(result.maximum, partial.maximum);
+            result.sum += partial.sum;
+            result.weightSum += partial.weightSum;
+
+            if (binCount != 0 && bins != NULL) {
+                for (uint i = 0; i < binCount; i++) {
+                    bins[c * binCount + i] += context.bins[slot * binCount + i];
+                }
+            }
+        }
+    }
+
+    delete [] context.results;
+    delete [] context.bins;
+}
+
+float Surface::average(int channel, int alpha_channel/*= -1*/, float gamma /*= 2.2f*/) const
+{
+    if (m->image == NULL) return 0.0f;
+
+    ReductionParams params;
+    params.alphaWeight = (alpha_channel != -1);
+    params.gamma = gamma;
+    params.exactMath = m->exactMath;
+
+    ChannelReduction result;
+    reduceChannels(m->image, &channel, 1, alpha_channel, params, &result, NULL);
+
+    const double denom = params.alphaWeight ? result.weightSum : double(m->image->pixelCount());
+
+    // Avoid division by zero.
+    if (denom == 0.0) return 0.0f;
+
+    return powf(float(result.sum / denom), 1.0f/gamma);
+}
+
+void Surface::histogram(int channel, float rangeMin, float rangeMax, int binCount, int * binPtr) const
+{
+    // We assume it's clear in case we want to accumulate multiple histograms.
+    //memset(bins, 0, sizeof(int)*count);
+
+    if (m->image == NULL || binCount <= 0) return;
+
+    ReductionParams params;
+    params.binCount = binCount;
+    params.scale = float(binCount) / (rangeMax - rangeMin);
+    params.bias = - params.scale * rangeMin;
+
+    ChannelReduction result;
+    reduceChannels(m->image, &channel, 1, -1, params, &result, binPtr);
+}
+
+void Surface::range(int channel, float * rangeMin, float * rangeMax, int alpha_channel/*= -1*/, float alpha_ref/*= 0.f*/) const
+{
+    // Note, it's quite possible to get FLT_MAX,-FLT_MAX back if all pixels fail the alpha test.
+    ChannelReduction result;
+    result.minimum = FLT_MAX;
+    result.maximum = -FLT_MAX;
+
+    if (m->image != NULL) {
+        ReductionParams params;
+        params.alphaTest = (alpha_channel != -1);
+        params.alphaRef = alpha_ref;
+
+        reduceChannels(m->image, &channel, 1, alpha_channel, params, &result, NULL);
+    }
+
+    *rangeMin = result.minimum;
+    *rangeMax = result.maximum;
+}
+
+void Surface::statistics(float * minimum, float * maximum, float * average, float rangeMin/*= 0.0f*/, float rangeMax/*= 1.0f*/, int binCount/*= 0*/, int * binPtr/*= NULL*/) const
+{
+    ChannelReduction results[4];
+    for (int c = 0; c < 4; c++) {
+        results[c].minimum = FLT_MAX;
+        results[c].maximum = -FLT_MAX;
+        results[c].sum = 0.0;
+    }
+
+    if (m->image != NULL) {
+        ReductionParams params;
+        if (binPtr != NULL && binCount > 0) {
+            params.binCount = binCount;
+            params.scale = float(binCount) / (rangeMax - rangeMin);
+            params.bias = - params.scale * rangeMin;
+        }
+
+        const int channels[4] = { 0, 1, 2, 3 };
+        reduceChannels(m->image, channels, 4, -1, params, results, binPtr);
+    }
+
+    const uint count = (m->image != NULL) ? m->image->pixelCount() : 0;
+
+    for (int c = 0; c < 4; c++) {
+        if (minimum != NULL) minimum[c] = results[c].minimum;
+        if (maximum != NULL) maximum[c] = results[c].maximum;
+        if (average != NULL) average[c] = (count != 0) ? float(results[c].sum / count) : 0.0f;
+    }
+}
+
+
+struct RGBMParams {
+    float range;
+    float threshold;
+};
+
+// Ideally you should compress/quantize the RGB and M portions independently.
+// Once you have M quantized, you would compute the corresponding RGB and quantize that.
+static void ToRGBMKernel(float * const * c, uint begin, uint end, const void * params)
+{
+    const float threshold = ((const RGBMParams *)params)->threshold;
+    float * r = c[0];
+    float * g = c[1];
+    float * b = c[2];
+    float * a = c[3];
+
+    uint i = begin;
+#if NV_USE_SSE >= 2
+    const bool aligned = isAligned(c, begin);
+    // Same search as below, four texels at a time. Lanes whose candidate is out of range are masked out.
+    const __m128 vthreshold = _mm_set1_ps(threshold);
+    const __m128 vscale = _mm_set1_ps(1 - threshold);
+    const __m128 v255 = _mm_set1_ps(255.0f);
+
+    for (; aligned && i + 4 <= end; i += 4) {
+        const __m128 R = saturate(_mm_load_ps(r + i));
+        const __m128 G = saturate(_mm_load_ps(g + i));
+        const __m128 B = saturate(_mm_load_ps(b + i));
+
+        // ftoi_ceil of a value in [0, 255].
+        const __m128 x = _mm_mul_ps(_mm_div_ps(_mm_sub_ps(_mm_max_ps(_mm_max_ps(R, G), _mm_max_ps(B, vthreshold)), vthreshold), vscale), v255);
+        __m128i iM = _mm_cvttps_epi32(x);
+        iM = _mm_sub_epi32(iM, _mm_castps_si128(_mm_cmplt_ps(_mm_cvtepi32_ps(iM), x)));
+
+        __m128 bestM = _mm_setzero_ps();
+        __m128 bestError = _mm_set1_ps(FLT_MAX);
+
+        __m128i m = _mm_sub_epi32(iM, _mm_set1_epi32(16));
+        for (int k = 0; k < 32; k++, m = _mm_add_epi32(m, _mm_set1_epi32(1))) {
+            const __m128i valid = _mm_andnot_si128(_mm_cmplt_epi32(m, _mm_setzero_si128()), _mm_cmplt_epi32(m, _mm_set1_epi32(256)));
+            if (_mm_movemask_epi8(valid) == 0) continue;
+
+            // Decode M
+            const __m128 M = _mm_add_ps(_mm_mul_ps(_mm_div_ps(_mm_cvtepi32_ps(m), v255), vscale), vthreshold);
+
+            // Encode, decode and measure error.
+            const __m128 fr = _mm_mul_ps(_mm_div_ps(_mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(v255, saturate(_mm_div_ps(R, M))))), v255), M);
+            const __m128 fg = _mm_mul_ps(_mm_div_ps(_mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(v255, saturate(_mm_div_ps(G, M))))), v255), M);
+            const __m128 fb = _mm_mul_ps(_mm_div_ps(_mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(v255, saturate(_mm_div_ps(B, M))))), v255), M);
+
+            const __m128 dr = _mm_sub_ps(R, fr);
+            const __m128 dg = _mm_sub_ps(G, fg);
+            const __m128 db = _mm_sub_ps(B, fb);
+            const __m128 error = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+
+            const __m128 better = _mm_and_ps(_mm_castsi128_ps(valid), _mm_cmplt_ps(error, bestError));
+            bestError = select(bestError, error, better);
+            bestM = select(bestM, M, better);
+        }
+
+        _mm_store_ps(r + i, saturate(_mm_div_ps(R, bestM)));
+        _mm_store_ps(g + i, saturate(_mm_div_ps(G, bestM)));
+        _mm_store_ps(b + i, saturate(_mm_div_ps(B, bestM)));
+        _mm_store_ps(a + i, _mm_div_ps(_mm_sub_ps(bestM, vthreshold), vscale));
+    }
+#endif
+
+    for (; i < end; i++) {
+        float R = nv::clamp(r[i], 0.0f, 1.0f);
+        float G = nv::clamp(g[i], 0.0f, 1.0f);
+        float B = nv::clamp(b[i], 0.0f, 1.0f);
+
+#if 0
+        // Baseline, no compression:
         r[i] = R;
         g[i] = G;
         b[i] = B;
@@ -1617,23 +2342,50 @@ void Surface::toRGBM(float range/*= 1*/, float threshold/*= 0.25*/)
     }
 }
 
-// @@ IC: Dubious merge. Review!
-void Surface::fromRGBM(float range/*= 1*/, float threshold/*= 0.25*/)
+void Surface::toRGBM(float range/*= 1*/, float threshold/*= 0.25*/)
 {
     if (isNull()) return;
 
     detach();
 
-    threshold = ::clamp(threshold, 1e-6f, 1.0f);
+    RGBMParams params;
+    params.range = range;
+    params.threshold = ::clamp(threshold, 1e-6f, 1.0f);
 
-	FloatImage * img = m->image;
-    float * r = img->channel(0);
-    float * g = img->channel(1);
-    float * b = img->channel(2);
-    float * a = img->channel(3);
+    processTexels(m->image, -1, ToRGBMKernel, &params);
+}
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
+static void FromRGBMKernel(float * const * c, uint begin, uint end, const void * params)
+{
+    const float range = ((const RGBMParams *)params)->range;
+    const float threshold = ((const RGBMParams *)params)->threshold;
+    float * r = c[0];
+    float * g = c[1];
+    float * b = c[2];
+    float * a = c[3];
+
+    uint i = begin;
+#if NV_USE_SSE >= 2
+    const bool aligned = isAligned(c, begin);
+    const __m128 vscale = _mm_set1_ps(range - threshold);
+    const __m128 vthreshold = _mm_set1_ps(threshold);
+
+    for (; aligned && i + 4 <= end; i += 4) {
+        // Load all the channels before storing. They are usually a multiple of 4KB apart, and interleaving the loads and
+        // stores of different channels stalls on false dependencies.
+        const __m128 R = _mm_load_ps(r + i);
+        const __m128 G = _mm_load_ps(g + i);
+        const __m128 B = _mm_load_ps(b + i);
+        const __m128 M = _mm_add_ps(_mm_mul_ps(_mm_load_ps(a + i), vscale), vthreshold);
+
+        _mm_store_ps(r + i, _mm_mul_ps(R, M));
+        _mm_store_ps(g + i, _mm_mul_ps(G, M));
+        _mm_store_ps(b + i, _mm_mul_ps(B, M));
+        _mm_store_ps(a + i, _mm_set1_ps(1.0f));
+    }
+#endif
+
+    for (; i < end; i++) {
         float M = a[i] * (range - threshold) + threshold;
 
         r[i] *= M;
@@ -1643,23 +2395,51 @@ void Surface::fromRGBM(float range/*= 1*/, float threshold/*= 0.25*/)
     }
 }
 
-// This is dumb way to encode luminance only values.
-void Surface::toLM(float range/*= 1*/, float threshold/*= 0.25*/)
+// @@ IC: Dubious merge. Review!
+void Surface::fromRGBM(float range/*= 1*/, float threshold/*= 0.25*/)
 {
     if (isNull()) return;
 
     detach();
 
-    threshold = ::clamp(threshold, 1e-6f, 1.0f);
+    RGBMParams params;
+    params.range = range;
+    params.threshold = ::clamp(threshold, 1e-6f, 1.0f);
 
-    FloatImage * img = m->image;
-    float * r = img->channel(0);
-    float * g = img->channel(1);
-    float * b = img->channel(2);
-    float * a = img->channel(3);
+    processTexels(m->image, -1, FromRGBMKernel, &params);
+}
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
+static void ToLMKernel(float * const * c, uint begin, uint end, const void * params)
+{
+    const float threshold = ((const RGBMParams *)params)->threshold;
+    float * r = c[0];
+    float * g = c[1];
+    float * b = c[2];
+    float * a = c[3];
+
+    uint i = begin;
+#if NV_USE_SSE >= 2
+    const bool aligned = isAligned(c, begin);
+    const __m128 vthreshold = _mm_set1_ps(threshold);
+    const __m128 vscale = _mm_set1_ps(1 - threshold);
+
+    for (; aligned && i + 4 <= end; i += 4) {
+        const __m128 R = saturate(_mm_load_ps(r + i));
+        const __m128 G = saturate(_mm_load_ps(g + i));
+        const __m128 B = saturate(_mm_load_ps(b + i));
+
+        const __m128 M = _mm_max_ps(_mm_max_ps(R, G), _mm_max_ps(B, vthreshold));
+
+        const __m128 L = _mm_div_ps(_mm_add_ps(_mm_add_ps(R, G), B), _mm_set1_ps(3.0f));
+        const __m128 LM = _mm_div_ps(L, M);
+        _mm_store_ps(r + i, LM);
+        _mm_store_ps(g + i, LM);
+        _mm_store_ps(b + i, LM);
+        _mm_store_ps(a + i, _mm_div_ps(_mm_sub_ps(M, vthreshold), vscale));
+    }
+#endif
+
+    for (; i < end; i++) {
         float R = nv::clamp(r[i], 0.0f, 1.0f);
         float G = nv::clamp(g[i], 0.0f, 1.0f);
         float B = nv::clamp(b[i], 0.0f, 1.0f);
@@ -1674,6 +2454,20 @@ void Surface::toLM(float range/*= 1*/, float threshold/*= 0.25*/)
     }
 }
 
+// This is dumb way to encode luminance only values.
+void Surface::toLM(float range/*= 1*/, float threshold/*= 0.25*/)
+{
+    if (isNull()) return;
+
+    detach();
+
+    RGBMParams params;
+    params.range = range;
+    params.threshold = ::clamp(threshold, 1e-6f, 1.0f);
+
+    processTexels(m->image, -1, ToLMKernel, &params);
+}
+
 
 static Color32 toRgbe8(float r, float g, float b)
 {
@@ -1754,6 +2548,134 @@ static Color32 toRgbe8(float r, float g, float b)
 }
 */
 
+struct RGBEParams {
+    int mantissaBits;
+    int exponentBits;
+    int exponentBias;
+    float maxValue;
+};
+
+#if NV_USE_SSE >= 2
+static inline __m128i max_epi32(__m128i a, __m128i b)
+{
+    return select(a, b, _mm_cmpgt_epi32(b, a));
+}
+
+static inline __m128i min_epi32(__m128i a, __m128i b)
+{
+    return select(a, b, _mm_cmplt_epi32(b, a));
+}
+#endif
+
+static void ToRGBEKernel(float * const * c, uint begin, uint end, const void * params)
+{
+    const RGBEParams * p = (const RGBEParams *)params;
+    const int mantissaBits = p->mantissaBits;
+    const int exponentBits = p->exponentBits;
+    const int exponentBias = p->exponentBias;
+    const float maxValue = p->maxValue;
+    float * r = c[0];
+    float * g = c[1];
+    float * b = c[2];
+    float * a = c[3];
+
+    uint i = begin;
+#if NV_USE_SSE >= 2
+    const bool aligned = isAligned(c, begin);
+    // Dividing by denom is the same as scaling by 2^k with k = exponentBias + mantissaBits - E. The scale is applied in two
+    // steps, 2^min(k, 127) and 2^(k - min(k, 127)), so that it's exact for all the exponents, like the double division.
+    const int kmax = exponentBias + mantissaBits;
+    const int kmin = exponentBias + mantissaBits - ((1 << exponentBits) - 1);
+    const bool simd = (kmin >= -126 && kmax <= 254); // Unusual formats use the scalar loop.
+
+    const __m128 vmax = _mm_set1_ps(maxValue);
+    const __m128i vbias = _mm_set1_epi32(exponentBias);
+    const __m128i v127 = _mm_set1_epi32(127);
+    const __m128 vmantissaMax = _mm_set1_ps(float((1 << mantissaBits) - 1));
+    const __m128 vexponentMax = _mm_set1_ps(float((1 << exponentBits) - 1));
+
+    for (; simd && aligned && i + 4 <= end; i += 4) {
+        // Clamp components:
+        const __m128 R = _mm_min_ps(_mm_max_ps(_mm_load_ps(r + i), _mm_setzero_ps()), vmax);
+        const __m128 G = _mm_min_ps(_mm_max_ps(_mm_load_ps(g + i), _mm_setzero_ps()), vmax);
+        const __m128 B = _mm_min_ps(_mm_max_ps(_mm_load_ps(b + i), _mm_setzero_ps()), vmax);
+
+        // Compute max:
+        const __m128 M = _mm_max_ps(R, _mm_max_ps(G, B));
+
+        // Preliminary exponent:
+        const __m128i exponent = _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(M), 23), v127);
+        __m128i E = _mm_add_epi32(_mm_add_epi32(max_epi32(_mm_set1_epi32(-exponentBias - 1), exponent), _mm_set1_epi32(1)), vbias);
+
+        __m128i k = _mm_sub_epi32(_mm_set1_epi32(kmax), E);
+        __m128i k0 = min_epi32(k, v127);
+        __m128 s0 = pow2(k0);
+        __m128 s1 = pow2(_mm_sub_epi32(k, k0));
+
+        // Refine exponent:
+        const __m128i m = _mm_cvtps_epi32(_mm_mul_ps(_mm_mul_ps(M, s0), s1));
+        const __m128i overflow = _mm_cmpeq_epi32(m, _mm_set1_epi32(1 << mantissaBits));
+        E = _mm_sub_epi32(E, overflow);
+        k = _mm_add_epi32(k, overflow);
+        k0 = min_epi32(k, v127);
+        s0 = pow2(k0);
+        s1 = pow2(_mm_sub_epi32(k, k0));
+
+        // floatRound of non negative values.
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 Rs = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(R, s0), s1), half)));
+        const __m128 Gs = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(G, s0), s1), half)));
+        const __m128 Bs = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(B, s0), s1), half)));
+
+        // Store as normalized float.
+        _mm_store_ps(r + i, _mm_div_ps(Rs, vmantissaMax));
+        _mm_store_ps(g + i, _mm_div_ps(Gs, vmantissaMax));
+        _mm_store_ps(b + i, _mm_div_ps(Bs, vmantissaMax));
+        _mm_store_ps(a + i, _mm_div_ps(_mm_cvtepi32_ps(E), vexponentMax));
+    }
+#endif
+
+    for (; i < end; i++) {
+        // Clamp components:
+        float R = ::clamp(r[i], 0.0f, maxValue);
+        float G = ::clamp(g[i], 0.0f, maxValue);
+        float B = ::clamp(b[i], 0.0f, maxValue);
+
+        // Compute max:
+        float M = max3(R, G, B);
+
+        // Preliminary exponent:
+        int E = max(- exponentBias - 1, floatExponent(M)) + 1 + exponentBias;
+        nvDebugCheck(E >= 0 && E < (1 << exponentBits));
+
+        double denom = pow(2.0, double(E - exponentBias - mantissaBits));
+
+        // Refine exponent:
+        int m = ftoi_round(float(M / denom));
+        nvDebugCheck(m <= (1 << mantissaBits));
+
+        if (m == (1 << mantissaBits)) {
+            denom *= 2;
+            E += 1;
+            nvDebugCheck(E < (1 << exponentBits));
+        }
+
+        R = floatRound(float(R / denom));
+        G = floatRound(float(G / denom));
+        B = floatRound(float(B / denom));
+
+        nvDebugCheck(R >= 0 && R < (1 << mantissaBits));
+        nvDebugCheck(G >= 0 && G < (1 << mantissaBits));
+        nvDebugCheck(B >= 0 && B < (1 << mantissaBits));
+
+        // Store as normalized float.
+        r[i] = R / ((1 << mantissaBits) - 1);
+        g[i] = G / ((1 << mantissaBits) - 1);
+        b[i] = B / ((1 << mantissaBits) - 1);
+        a[i] = float(E) / ((1 << exponentBits) - 1);
+    }
+}
+
 // For R9G9B9E5, use toRGBE(9, 5), for Ward's RGBE, use toRGBE(8, 8)
 // @@ Note that most Radiance HDR loaders use an exponent bias of 128 instead of 127! This implementation
 // matches the OpenGL extension.
@@ -1814,54 +2736,81 @@ void Surface::toRGBE(int mantissaBits, int exponentBits)
     const int exponentBias = (1 << (exponentBits - 1)) - 1;
 
     // Maximum representable value: 5 -> 63488, 8 -> HUGE
-    const float maxValue = float(exponentMax) / float(exponentMax + 1) * float(1 << (exponentMax - exponentBias));
-
-
-    FloatImage * img = m->image;
-    float * r = img->channel(0);
-    float * g = img->channel(1);
-    float * b = img->channel(2);
-    float * a = img->channel(3);
-
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
-        // Clamp components:
-        float R = ::clamp(r[i], 0.0f, maxValue);
-        float G = ::clamp(g[i], 0.0f, maxValue);
-        float B = ::clamp(b[i], 0.0f, maxValue);
-
-        // Compute max:
-        float M = max3(R, G, B);
-
-        // Preliminary exponent:
-        int E = max(- exponentBias - 1, floatExponent(M)) + 1 + exponentBias;
-        nvDebugCheck(E >= 0 && E < (1 << exponentBits));
+    RGBEParams params;
+    params.mantissaBits = mantissaBits;
+    params.exponentBits = exponentBits;
+    params.exponentBias = exponentBias;
+    params.maxValue = float(exponentMax) / float(exponentMax + 1) * float(1 << (exponentMax - exponentBias));
+
+    processTexels(m->image, -1, ToRGBEKernel, &params);
+}
+
+static void FromRGBEKernel(float * const * c, uint begin, uint end, const void * params)
+{
+    const RGBEParams * p = (const RGBEParams *)params;
+    const int mantissaBits = p->mantissaBits;
+    const int exponentBits = p->exponentBits;
+    const int exponentBias = p->exponentBias;
+    float * r = c[0];
+    float * g = c[1];
+    float * b = c[2];
+    float * a = c[3];
+
+    uint i = begin;
+#if NV_USE_SSE >= 2
+    const bool aligned = isAligned(c, begin);
+    // The scale is 2^k with k = E - exponentBias - mantissaBits. Denormal scales are applied in two steps, 2^(k+126) and
+    // 2^-126, so that the product is rounded once, like with powf. Scales that are zero or infinite with powf are handled
+    // separately.
+    const __m128 vmantissaMax = _mm_set1_ps(float((1 << mantissaBits) - 1));
+    const __m128 vexponentMax = _mm_set1_ps(float((1 << exponentBits) - 1));
+    const __m128i voffset = _mm_set1_epi32(exponentBias + mantissaBits);
+
+    for (; aligned && i + 4 <= end; i += 4) {
+        // Expand normalized float to to 9995
+        const __m128 R = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(r + i), vmantissaMax)));
+        const __m128 G = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(g + i), vmantissaMax)));
+        const __m128 B = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(b + i), vmantissaMax)));
+        const __m128i E = _mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(a + i), vexponentMax));
 
-        double denom = pow(2.0, double(E - exponentBias - mantissaBits));
+        const __m128i k = _mm_sub_epi32(E, voffset);
+        const __m128i denormal = _mm_cmplt_epi32(k, _mm_set1_epi32(-126));
+        const __m128i k1 = _mm_and_si128(denormal, _mm_set1_epi32(-126));
+        const __m128 s0 = pow2(min_epi32(max_epi32(_mm_sub_epi32(k, k1), _mm_set1_epi32(-126)), _mm_set1_epi32(127)));
+        const __m128 s1 = pow2(k1);
 
-        // Refine exponent:
-        int m = ftoi_round(float(M / denom));
-        nvDebugCheck(m <= (1 << mantissaBits));
+        const __m128 zero = _mm_castsi128_ps(_mm_cmplt_epi32(k, _mm_set1_epi32(-149)));
+        const __m128 infinite = _mm_castsi128_ps(_mm_cmpgt_epi32(k, _mm_set1_epi32(127)));
 
-        if (m == (1 << mantissaBits)) {
-            denom *= 2;
-            E += 1;
-            nvDebugCheck(E < (1 << exponentBits));
+        __m128 scaled[3] = { R, G, B };
+        for (int j = 0; j < 3; j++) {
+            __m128 x = _mm_mul_ps(_mm_mul_ps(scaled[j], s0), s1);
+            x = select(x, _mm_mul_ps(scaled[j], _mm_setzero_ps()), zero);
+            x = select(x, _mm_mul_ps(scaled[j], _mm_castsi128_ps(_mm_set1_epi32(0x7F800000))), infinite);
+            scaled[j] = x;
         }
 
-        R = floatRound(float(R / denom));
-        G = floatRound(float(G / denom));
-        B = floatRound(float(B / denom));
+        _mm_store_ps(r + i, scaled[0]);
+        _mm_store_ps(g + i, scaled[1]);
+        _mm_store_ps(b + i, scaled[2]);
+        _mm_store_ps(a + i, _mm_set1_ps(1.0f));
+    }
+#endif
 
-        nvDebugCheck(R >= 0 && R < (1 << mantissaBits));
-        nvDebugCheck(G >= 0 && G < (1 << mantissaBits));
-        nvDebugCheck(B >= 0 && B < (1 << mantissaBits));
+    for (; i < end; i++) {
+        // Expand normalized float to to 9995
+        int R = ftoi_round(r[i] * ((1 << mantissaBits) - 1));
+        int G = ftoi_round(g[i] * ((1 << mantissaBits) - 1));
+        int B = ftoi_round(b[i] * ((1 << mantissaBits) - 1));
+        int E = ftoi_round(a[i] * ((1 << exponentBits) - 1));
 
-        // Store as normalized float.
-        r[i] = R / ((1 << mantissaBits) - 1);
-        g[i] = G / ((1 << mantissaBits) - 1);
-        b[i] = B / ((1 << mantissaBits) - 1);
-        a[i] = float(E) / ((1 << exponentBits) - 1);
+        //float scale = ldexpf(1.0f, E - exponentBias - mantissaBits);
+        float scale = powf(2, float(E - exponentBias - mantissaBits));
+
+        r[i] = R * scale;
+        g[i] = G * scale;
+        b[i] = B * scale;
+        a[i] = 1;
     }
 }
 
@@ -1897,30 +2846,13 @@ void Surface::fromRGBE(int mantissaBits, int exponentBits)
     detach();
 
     // exponent bias: 5 -> 15, 8 -> 127
-    const int exponentBias = (1 << (exponentBits - 1)) - 1;
+    RGBEParams params;
+    params.mantissaBits = mantissaBits;
+    params.exponentBits = exponentBits;
+    params.exponentBias = (1 << (exponentBits - 1)) - 1;
+    params.maxValue = 0;
 
-    FloatImage * img = m->image;
-    float * r = img->channel(0);
-    float * g = img->channel(1);
-    float * b = img->channel(2);
-    float * a = img->channel(3);
-
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
-        // Expand normalized float to to 9995
-        int R = ftoi_round(r[i] * ((1 << mantissaBits) - 1));
-        int G = ftoi_round(g[i] * ((1 << mantissaBits) - 1));
-        int B = ftoi_round(b[i] * ((1 << mantissaBits) - 1));
-        int E = ftoi_round(a[i] * ((1 << exponentBits) - 1));
-
-        //float scale = ldexpf(1.0f, E - exponentBias - mantissaBits);
-        float scale = powf(2, float(E - exponentBias - mantissaBits));
-
-        r[i] = R * scale;
-        g[i] = G * scale;
-        b[i] = B * scale;
-        a[i] = 1;
-    }
+    processTexels(m->image, -1, FromRGBEKernel, &params);
 }
 
 // Y is in the [0, 1] range, while CoCg are in the [-1, 1] range.
@@ -2052,22 +2984,34 @@ void Surface::fromYCoCg()
     }
 }
 
-void Surface::toLUVW(float range/*= 1.0f*/)
+static void ToLUVWKernel(float * const * c, uint begin, uint end, const void * params)
 {
-    if (isNull()) return;
+    const float irange = *(const float *)params;
+    float * r = c[0];
+    float * g = c[1];
+    float * b = c[2];
+    float * a = c[3];
 
-    detach();
+    uint i = begin;
+#if NV_USE_SSE >= 2
+    const bool aligned = isAligned(c, begin);
+    const __m128 virange = _mm_set1_ps(irange);
 
-    float irange = 1.0f / range;
+    for (; aligned && i + 4 <= end; i += 4) {
+        const __m128 R = saturate(_mm_mul_ps(_mm_load_ps(r + i), virange));
+        const __m128 G = saturate(_mm_mul_ps(_mm_load_ps(g + i), virange));
+        const __m128 B = saturate(_mm_mul_ps(_mm_load_ps(b + i), virange));
 
-    FloatImage * img = m->image;
-    float * r = img->channel(0);
-    float * g = img->channel(1);
-    float * b = img->channel(2);
-    float * a = img->channel(3);
+        const __m128 L = _mm_max_ps(_mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(R, R), _mm_mul_ps(G, G)), _mm_mul_ps(B, B))), _mm_set1_ps(1e-6f));
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
+        _mm_store_ps(r + i, _mm_div_ps(R, L));
+        _mm_store_ps(g + i, _mm_div_ps(G, L));
+        _mm_store_ps(b + i, _mm_div_ps(B, L));
+        _mm_store_ps(a + i, _mm_div_ps(L, _mm_set1_ps(sqrtf(3))));
+    }
+#endif
+
+    for (; i < end; i++) {
         float R = nv::clamp(r[i] * irange, 0.0f, 1.0f);
         float G = nv::clamp(g[i] * irange, 0.0f, 1.0f);
         float B = nv::clamp(b[i] * irange, 0.0f, 1.0f);
@@ -2081,6 +3025,17 @@ void Surface::toLUVW(float range/*= 1.0f*/)
     }
 }
 
+void Surface::toLUVW(float range/*= 1.0f*/)
+{
+    if (isNull()) return;
+
+    detach();
+
+    const float irange = 1.0f / range;
+
+    processTexels(m->image, -1, ToLUVWKernel, &irange);
+}
+
 void Surface::fromLUVW(float range/*= 1.0f*/)
 {
     // Decompression is the same as in RGBM.
@@ -2112,6 +3067,90 @@ void Surface::convolve(int channel, int kernelSize, float * kernelData)
     m->image->convolve(k, channel, (FloatImage::WrapMode)m->wrapMode);
 }
 
+// Clamp preserving the hue.
+static void ToneMapLinearKernel(float * const * c, uint begin, uint end, const void * params)
+{
+    float * r = c[0];
+    float * g = c[1];
+    float * b = c[2];
+
+    uint i = begin;
+#if NV_USE_SSE >= 2
+    const bool aligned = isAligned(c, begin);
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    for (; aligned && i + 4 <= end; i += 4) {
+        const __m128 R = _mm_load_ps(r + i);
+        const __m128 G = _mm_load_ps(g + i);
+        const __m128 B = _mm_load_ps(b + i);
+
+        const __m128 m = _mm_max_ps(R, _mm_max_ps(G, B));
+        const __m128 scale = _mm_div_ps(one, m);
+        const __m128 clamped = _mm_cmpgt_ps(m, one);
+
+        _mm_store_ps(r + i, select(R, _mm_mul_ps(R, scale), clamped));
+        _mm_store_ps(g + i, select(G, _mm_mul_ps(G, scale), clamped));
+        _mm_store_ps(b + i, select(B, _mm_mul_ps(B, scale), clamped));
+    }
+#endif
+
+    for (; i < end; i++) {
+        float m = max3(r[i], g[i], b[i]);
+        if (m > 1.0f) {
+            r[i] *= 1.0f / m;
+            g[i] *= 1.0f / m;
+            b[i] *= 1.0f / m;
+        }
+    }
+}
+
+static void ToneMapReindhartKernel(float * const * c, uint begin, uint end, const void * params)
+{
+    for (int j = 0; j < 3; j++) {
+        float * x = c[j];
+
+        uint i = begin;
+#if NV_USE_SSE >= 2
+        const bool aligned = isAligned(c, begin);
+        for (; aligned && i + 4 <= end; i += 4) {
+            const __m128 X = _mm_load_ps(x + i);
+            _mm_store_ps(x + i, _mm_div_ps(X, _mm_add_ps(X, _mm_set1_ps(1.0f))));
+        }
+#endif
+        for (; i < end; i++) {
+            x[i] /= x[i] + 1;
+        }
+    }
+}
+
+static void ToneMapHaloKernel(float * const * c, uint begin, uint end, const void * params)
+{
+    const bool exactMath = *(const bool *)params;
+
+    for (int j = 0; j < 3; j++) {
+        float * x = c[j];
+
+        if (exactMath) {
+            for (uint i = begin; i < end; i++) {
+                x[i] = 1 - exp2f(-x[i]);
+            }
+            continue;
+        }
+
+        uint i = begin;
+#if NV_USE_SSE >= 2
+        const bool aligned = isAligned(c, begin);
+        for (; aligned && i + 4 <= end; i += 4) {
+            const __m128 X = _mm_load_ps(x + i);
+            _mm_store_ps(x + i, _mm_sub_ps(_mm_set1_ps(1.0f), fastExp2(_mm_sub_ps(_mm_setzero_ps(), X))));
+        }
+#endif
+        for (; i < end; i++) {
+            x[i] = 1 - fastExp2(-x[i]);
+        }
+    }
+}
+
 // Assumes input has already been scaled by exposure.
 void Surface::toneMap(ToneMapper tm, float * parameters)
 {
@@ -2119,50 +3158,76 @@ void Surface::toneMap(ToneMapper tm, float * parameters)
 
     detach();
 
-    FloatImage * img = m->image;
-    float * r = img->channel(0);
-    float * g = img->channel(1);
-    float * b = img->channel(2);
-    const uint count = img->pixelCount();
-
     if (tm == ToneMapper_Linear) {
-        // Clamp preserving the hue.
-        for (uint i = 0; i < count; i++) {
-            float m = max3(r[i], g[i], b[i]);
-            if (m > 1.0f) {
-                r[i] *= 1.0f / m;
-                g[i] *= 1.0f / m;
-                b[i] *= 1.0f / m;
-            }
-        }
+        processTexels(m->image, -1, ToneMapLinearKernel, NULL);
     }
     else if (tm == ToneMapper_Reindhart) {
-        for (uint i = 0; i < count; i++) {
-            r[i] /= r[i] + 1;
-            g[i] /= g[i] + 1;
-            b[i] /= b[i] + 1;
-        }
+        processTexels(m->image, -1, ToneMapReindhartKernel, NULL);
     }
     else if (tm == ToneMapper_Halo) {
-        for (uint i = 0; i < count; i++) {
-            r[i] = 1 - exp2f(-r[i]);
-            g[i] = 1 - exp2f(-g[i]);
-            b[i] = 1 - exp2f(-b[i]);
-        }
+        processTexels(m->image, -1, ToneMapHaloKernel, &m->exactMath);
     }
     else if (tm == ToneMapper_Lightmap) {
         // @@ Goals:
         // Preserve hue.
         // Avoid clamping abrubtly.
         // Minimize color difference along most of the color range. [0, alpha)
-        for (uint i = 0; i < count; i++) {
-            float m = max3(r[i], g[i], b[i]);
-            if (m > 1.0f) {
-                r[i] *= 1.0f / m;
-                g[i] *= 1.0f / m;
-                b[i] *= 1.0f / m;
-            }
+        processTexels(m->image, -1, ToneMapLinearKernel, NULL);
+    }
+}
+
+struct LogScaleParams {
+    float scale;
+    bool exactMath;
+};
+
+static void ToLogScaleKernel(float * const * c, uint begin, uint end, const void * params)
+{
+    const LogScaleParams * p = (const LogScaleParams *)params;
+    float * x = c[0];
+
+    uint i = begin;
+    if (p->exactMath) {
+        for (; i < end; i++) {
+            x[i] = log2f(x[i]) * p->scale;
+        }
+        return;
+    }
+
+#if NV_USE_SSE >= 2
+    const bool aligned = isAligned(c, begin);
+    const __m128 scale = _mm_set1_ps(p->scale);
+    for (; aligned && i + 4 <= end; i += 4) {
+        _mm_store_ps(x + i, _mm_mul_ps(fastLog2(_mm_load_ps(x + i)), scale));
+    }
+#endif
+    for (; i < end; i++) {
+        x[i] = fastLog2(x[i]) * p->scale;
+    }
+}
+
+static void FromLogScaleKernel(float * const * c, uint begin, uint end, const void * params)
+{
+    const LogScaleParams * p = (const LogScaleParams *)params;
+    float * x = c[0];
+
+    uint i = begin;
+    if (p->exactMath) {
+        for (; i < end; i++) {
+            x[i] = exp2f(x[i] * p->scale);
         }
+        return;
+    }
+
+#if NV_USE_SSE >= 2
+    const bool aligned = isAligned(c, begin);
+    const __m128 scale = _mm_set1_ps(p->scale);
+    for (; aligned && i + 4 <= end; i += 4) {
+        _mm_store_ps(x + i, fastExp2(_mm_mul_ps(_mm_load_ps(x + i), scale)));
+    }
+#endif
+    for (; i < end; i++) {
+        x[i] = fastExp2(x[i] * p->scale);
     }
 }
 
@@ -2171,15 +3236,11 @@ void Surface::toLogScale(int channel, float base) {
 
     detach();
 
-    FloatImage * img = m->image;
-    float * c = img->channel(channel);
-
-    float scale = 1.0f / log2f(base);
+    LogScaleParams params;
+    params.scale = 1.0f / log2f(base);
+    params.exactMath = m->exactMath;
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
-        c[i] = log2f(c[i]) * scale;
-    }
+    processTexels(m->image, channel, ToLogScaleKernel, &params);
 }
 
 void Surface::fromLogScale(int channel, float base) {
@@ -2187,15 +3248,11 @@ void Surface::fromLogScale(int channel, float base) {
 
     detach();
 
-    FloatImage * img = m->image;
-    float * c = img->channel(channel);
-
-    float scale = log2f(base);
+    LogScaleParams params;
+    params.scale = log2f(base);
+    params.exactMath = m->exactMath;
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
-        c[i] = exp2f(c[i] * scale);
-    }
+    processTexels(m->image, channel, FromLogScaleKernel, &params);
 }
 
 
@@ -2392,6 +3449,8 @@ void Surface::quantize(int channel, int bits, bool exactEndPoints, bool dither)
 {
     if (isNull()) return;
 
+    NV_PROFILE_ZONE("Quantize");
+
     detach();
 
     FloatImage * img = m->image;
@@ -2467,6 +3526,8 @@ void Surface::toNormalMap(float sm, float medium, float big, float large)
 {
     if (isNull()) return;
 
+    NV_PROFILE_ZONE("Normal map");
+
     detach();
 
     const Vector4 filterWeights(sm, medium, big, large);
@@ -2484,6 +3545,8 @@ void Surface::normalizeNormalMap()
     if (isNull()) return;
     if (!m->isNormalMap) return;
 
+    NV_PROFILE_ZONE("Normal map");
+
     detach();
 
     nv::normalizeNormalMap(m->image);
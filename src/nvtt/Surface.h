@@ -29,6 +29,7 @@
 
 #include "nvcore/RefCounted.h"
 #include "nvcore/Ptr.h"
+#include "nvcore/Array.h"
 
 #include "nvimage/Image.h"
 #include "nvimage/FloatImage.h"
@@ -48,6 +49,9 @@ namespace nvtt
             wrapMode = WrapMode_Mirror;
             alphaMode = AlphaMode_None;
             isNormalMap = false;
+            exactMath = false;
+            atlasColumns = 1;
+            atlasRows = 1;
             
             image = NULL;
         }
@@ -59,6 +63,10 @@ namespace nvtt
             wrapMode = p.wrapMode;
             alphaMode = p.alphaMode;
             isNormalMap = p.isNormalMap;
+            exactMath = p.exactMath;
+            atlasColumns = p.atlasColumns;
+            atlasRows = p.atlasRows;
+            atlasWrapModes = p.atlasWrapModes;
 
             image = p.image->clone();
         }
@@ -71,6 +79,12 @@ namespace nvtt
         WrapMode wrapMode;
         AlphaMode alphaMode;
         bool isNormalMap;
+        bool exactMath;
+
+        // Atlas tiles, with their wrap modes in row order. The wrap mode of the surface is used when there are none.
+        int atlasColumns;
+        int atlasRows;
+        nv::Array<WrapMode> atlasWrapModes;
 
         nv::FloatImage * image;
     };
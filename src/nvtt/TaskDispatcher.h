@@ -41,12 +41,17 @@ namespace nvtt {
         }
     };
 
+    // Runs the tasks on the given thread pool, or on the shared pool if NULL.
     struct ParallelTaskDispatcher : public TaskDispatcher
     {
+        ParallelTaskDispatcher(nv::ThreadPool * pool = NULL) : pool(pool) {}
+
         virtual void dispatch(Task * task, void * context, int count) {
-            nv::ParallelFor parallelFor(task, context);
+            nv::ParallelFor parallelFor(task, context, pool);
             parallelFor.run(count); // @@ Add support for custom grain.
         }
+
+        nv::ThreadPool * pool;
     };
 
 
@@ -172,6 +172,10 @@ namespace nvtt
 
         NVTT_API void setTargetDecoder(Decoder decoder);
 
+        // Encode each block at Quality_Fastest first, and again at the selected quality only when its RMS error, weighted
+        // by the color weights, exceeds the threshold. Used by BC1, BC3, BC4, BC5 and BC7. (New in NVTT 2.1)
+        NVTT_API void setAdaptiveQuality(bool enable, float threshold = 4.0f);
+
         // Translate to and from D3D formats.
         NVTT_API unsigned int d3d9Format() const;
         //NVTT_API bool setD3D9Format(unsigned int format);
@@ -204,6 +208,7 @@ namespace nvtt
         TextureType_2D,
         TextureType_Cube,
         TextureType_3D,
+        TextureType_Array,  // 2D texture array, only supported by the DDS10 container. (New in NVTT 2.1)
     };
 
     // Input formats.
@@ -263,11 +268,17 @@ namespace nvtt
 
         // Setup input layout.
         NVTT_API void setTextureLayout(TextureType type, int w, int h, int d = 1);
+        // With TextureType_Array the layers are set as faces. (New in NVTT 2.1)
+        NVTT_API void setTextureLayout(TextureType type, int w, int h, int d, int arraySize);
         NVTT_API void resetTextureLayout();
 
         // Set mipmap data. Copies the data.
         NVTT_API bool setMipmapData(const void * data, int w, int h, int d = 1, int face = 0, int mipmap = 0);
 
+        // Set mipmap data without copying it. The caller keeps ownership, the data must remain valid and unchanged until
+        // the texture layout is reset and no Context::process call using these options is running. (New in NVTT 2.1)
+        NVTT_API bool setMipmapDataReference(const void * data, int w, int h, int d = 1, int face = 0, int mipmap = 0);
+
         // Describe the format of the input.
         NVTT_API void setFormat(InputFormat format);
 
@@ -285,6 +296,9 @@ namespace nvtt
         NVTT_API void setMipmapGeneration(bool enabled, int maxLevel = -1);
         NVTT_API void setKaiserParameters(float width, float alpha, float stretch);
 
+        // Filter the mipmaps of each tile of an atlas independently, see Surface::setAtlas. (New in NVTT 2.1)
+        NVTT_API void setAtlas(int columns, int rows);
+
         // Set normal map options.
         NVTT_API void setNormalMap(bool b);
         NVTT_API void setConvertToNormalMap(bool convert);
@@ -378,6 +392,32 @@ namespace nvtt
         virtual void dispatch(Task * task, void * context, int count) = 0;
     };
 
+    // Image memory statistics. (New in NVTT 2.1)
+    struct MemoryStats
+    {
+        unsigned long long allocatedBytes;      // Image memory currently in use.
+        unsigned long long peakAllocatedBytes;  // High water mark since the last call to resetMemoryStats.
+        unsigned long long cachedBytes;         // Memory retained by the pool for reuse.
+        unsigned long long allocationCount;
+        unsigned long long reusedCount;         // Allocations served by the pool.
+    };
+
+    // Timing of a processing stage. Stages are shared by all contexts and threads. (New in NVTT 2.1)
+    struct StageStats
+    {
+        const char * name;
+        unsigned long long callCount;
+        unsigned long long itemCount;   // Blocks for compressed formats, pixels for uncompressed ones.
+        float totalTime;                // Seconds, summed over all threads, including nested stages.
+        float selfTime;                 // Seconds, summed over all threads, excluding nested stages.
+    };
+
+    // Blocks encoded at each quality level in adaptive quality mode. (New in NVTT 2.1)
+    struct AdaptiveQualityStats
+    {
+        unsigned long long blockCount[4];   // Indexed by Quality.
+    };
+
     // Context.
     struct Compressor
     {
@@ -392,6 +432,33 @@ namespace nvtt
         NVTT_API bool isCudaAccelerationEnabled() const;
         NVTT_API void setTaskDispatcher(TaskDispatcher * disp); // (New in NVTT 2.1)
 
+        // Thread settings. Contexts that change them run on their own thread pool. (New in NVTT 2.1)
+        // They apply to the compression and to the image processing done by process() and compress(). Surface methods
+        // called by the application run on the shared thread pool.
+        NVTT_API void setThreadCount(int count);    // 0 = one thread per processor, 1 = no worker threads.
+        NVTT_API int threadCount() const;
+        NVTT_API void setThreadAffinity(const int * processors, int count); // Pins each worker to one of the processors.
+        NVTT_API void setNumaNode(int node);        // Keeps the workers and their memory on a NUMA node, -1 = any node.
+
+        // Image memory pool. The pool is shared by all contexts. (New in NVTT 2.1)
+        NVTT_API void setMemoryBudget(int maxCachedMegabytes);
+        NVTT_API void getMemoryStats(MemoryStats * stats) const;
+        NVTT_API void resetMemoryStats();
+
+        // Timing statistics. Stats are collected for all contexts while enabled. (New in NVTT 2.1)
+        NVTT_API void enableTimingStats(bool enable);
+        NVTT_API bool isTimingStatsEnabled() const;
+        NVTT_API void resetTimingStats();
+        NVTT_API float timingStatsElapsedTime() const;
+        NVTT_API int timingStageCount() const;
+        NVTT_API bool getTimingStage(int index, StageStats * stats) const;
+        NVTT_API int timingThreadCount() const;
+        NVTT_API float timingThreadBusyTime(int index) const;
+
+        // Adaptive quality statistics of this context. (New in NVTT 2.1)
+        NVTT_API void getAdaptiveQualityStats(AdaptiveQualityStats * stats) const;
+        NVTT_API void resetAdaptiveQualityStats();
+
         // InputOptions API.
         NVTT_API bool process(const InputOptions & inputOptions, const CompressionOptions & compressionOptions, const OutputOptions & outputOptions) const;
         NVTT_API int estimateSize(const InputOptions & inputOptions, const CompressionOptions & compressionOptions) const;
@@ -408,6 +475,7 @@ namespace nvtt
 
         // Raw API. (New in NVTT 2.1)
         NVTT_API bool outputHeader(TextureType type, int w, int h, int d, int mipmapCount, bool isNormalMap, const CompressionOptions & compressionOptions, const OutputOptions & outputOptions) const;
+        NVTT_API bool outputHeader(TextureType type, int w, int h, int d, int arraySize, int mipmapCount, bool isNormalMap, const CompressionOptions & compressionOptions, const OutputOptions & outputOptions) const;
         NVTT_API bool compress(int w, int h, int d, int face, int mipmap, const float * rgba, const CompressionOptions & compressionOptions, const OutputOptions & outputOptions) const;
         NVTT_API int estimateSize(int w, int h, int d, int mipmapCount, const CompressionOptions & compressionOptions) const;
     };
@@ -435,6 +503,7 @@ namespace nvtt
 
     // A surface is one level of a 2D or 3D texture. (New in NVTT 2.1)
     // @@ It would be nice to add support for texture borders for correct resizing of tiled textures and constrained DXT compression.
+    // Mipmaps of tiled textures are supported with setAtlas.
     struct Surface
     {
         NVTT_API Surface();
@@ -448,6 +517,15 @@ namespace nvtt
         NVTT_API void setAlphaMode(AlphaMode alphaMode);
         NVTT_API void setNormalMap(bool isNormalMap);
 
+        // Use the C library instead of polynomial approximations in toLogScale, fromLogScale, the Halo tone mapper and the
+        // gamma weighted average. All other color transforms produce the same results in both modes. (New in NVTT 2.1)
+        NVTT_API void setExactMath(bool exactMath);
+
+        // Treat the surface as an atlas of columns x rows tiles of equal size. Mipmaps filter each tile independently with
+        // the wrap mode of the surface, or with the given wrap modes of the tiles in row order. Tiles are only filtered
+        // together once their size can no longer be halved exactly. (New in NVTT 2.1)
+        NVTT_API void setAtlas(int columns, int rows, const WrapMode * tileWrapModes = 0);
+
         // Queries.
         NVTT_API bool isNull() const;
         NVTT_API int width() const;
@@ -457,15 +535,23 @@ namespace nvtt
         NVTT_API WrapMode wrapMode() const;
         NVTT_API AlphaMode alphaMode() const;
         NVTT_API bool isNormalMap() const;
+        NVTT_API bool exactMath() const; // (New in NVTT 2.1)
         NVTT_API int countMipmaps() const;
         NVTT_API int countMipmaps(int min_size) const;
         NVTT_API float alphaTestCoverage(float alphaRef = 0.5, int alpha_channel = 3) const;
         NVTT_API float average(int channel, int alpha_channel = -1, float gamma = 2.2f) const;
         NVTT_API const float * data() const;
         NVTT_API const float * channel(int i) const;
+        // The bins evenly split [rangeMin, rangeMax]. Before NVTT 2.1 the bin width was rangeMax / binCount.
         NVTT_API void histogram(int channel, float rangeMin, float rangeMax, int binCount, int * binPtr) const;
         NVTT_API void range(int channel, float * rangeMin, float * rangeMax, int alpha_channel = -1, float alpha_ref = 0.f) const;
 
+        // Minimum, maximum, average and histogram of the 4 channels in a single pass. Outputs are arrays of 4 values and may
+        // be NULL. The average is the linear mean of the stored values, unlike average(), which applies a 2.2 gamma by default.
+        // The histogram of channel c is accumulated to binPtr[c * binCount], with bins that split [rangeMin, rangeMax] like
+        // histogram(). (New in NVTT 2.1)
+        NVTT_API void statistics(float * minimum, float * maximum, float * average, float rangeMin = 0.0f, float rangeMax = 1.0f, int binCount = 0, int * binPtr = 0) const;
+
         // Texture data.
         NVTT_API bool load(const char * fileName, bool * hasAlpha = 0);
         NVTT_API bool save(const char * fileName, bool hasAlpha = 0, bool hdr = 0) const;
@@ -473,6 +559,7 @@ namespace nvtt
         NVTT_API bool setImage(InputFormat format, int w, int h, int d, const void * data);
         NVTT_API bool setImage(InputFormat format, int w, int h, int d, const void * r, const void * g, const void * b, const void * a);
         NVTT_API bool setImage2D(Format format, Decoder decoder, int w, int h, const void * data);
+        NVTT_API bool setImage3D(Format format, Decoder decoder, int w, int h, int d, const void * data); // (New in NVTT 2.1)
 
         // Resizing methods.
         NVTT_API void resize(int w, int h, int d, ResizeFilter filter);
@@ -570,7 +657,7 @@ namespace nvtt
         CubeLayout_HorizontalCross,
         CubeLayout_Column,
         CubeLayout_Row,
-        CubeLayout_LatitudeLongitude
+        CubeLayout_LatitudeLongitude    // Equirectangular map with +y at the top and -z at the left and right edges.
     };
 
     // (New in NVTT 2.1)
@@ -603,6 +690,8 @@ namespace nvtt
         NVTT_API const Surface & face(int face) const;
 
         // Layout conversion. @@ Not implemented.
+        // Latitude-longitude maps are resampled bilinearly. Folding uses an edge length of a quarter of the
+        // map width, unfolding produces a map 4 edge lengths wide and 2 high.
         NVTT_API void fold(const Surface & img, CubeLayout layout);
         NVTT_API Surface unfold(CubeLayout layout) const;
 
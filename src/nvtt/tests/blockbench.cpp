@@ -0,0 +1,717 @@
+// Copyright (c) 2009-2011 Ignacio Castano <castano@gmail.com>
+// Copyright (c) 2007-2009 NVIDIA Corporation -- Ignacio Castano <icastano@nvidia.com>
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+// Block-level micro-benchmark.
+//
+// Extracts small corpora of 4x4 blocks from test images and runs every CPU block compressor on them in isolation,
+// without the resizing, conversion and output stages of the pipeline. Reports the cost per block measured with the
+// time stamp counter and the RMSE of the decoded blocks.
+
+#include <nvtt/nvtt.h>
+#include <nvtt/CompressionOptions.h>
+#include <nvtt/CompressorDX9.h>
+#include <nvtt/CompressorDX10.h>
+#include <nvtt/CompressorDX11.h>
+#include <nvimage/BlockDXT.h>
+#include <nvimage/ColorBlock.h>
+#include <nvmath/Vector.inl>
+#include <nvcore/StrLib.h>
+#include <nvcore/Timer.h>
+#include <nvcore/Array.inl>
+
+#include <ctype.h> // tolower
+#include <math.h> // sqrt
+#include <stdio.h> // fopen
+#include <stdlib.h> // atoi
+#include <string.h> // strcmp
+
+using namespace nv;
+
+
+enum CorpusType
+{
+    Corpus_Constant,
+    Corpus_Smooth,
+    Corpus_Noisy,
+    Corpus_AlphaEdge,
+    Corpus_Normal,
+    Corpus_Count
+};
+
+static const char * s_corpusNames[Corpus_Count] = { "constant", "smooth", "noisy", "alpha-edge", "normal" };
+
+// Blocks are stored side by side in a planar RGBA image that is 4 texels high, so that they are read exactly like
+// the pipeline reads them.
+struct Corpus
+{
+    uint capacity;
+    uint blockCount;
+    uint64 candidateCount;  // Blocks seen, for reservoir sampling.
+    Array<float> data;
+
+    uint width() const { return 4 * capacity; }
+    const float * texels() const { return data.buffer(); }
+};
+
+// Blocks whose mean gradient is below the smooth threshold or above the noisy threshold, in 8 bit units.
+static const float s_smoothThreshold = 4.0f / 255.0f;
+static const float s_noisyThreshold = 20.0f / 255.0f;
+
+// Deterministic, so that runs sample the same blocks.
+static uint32 s_randomState = 0x12345678;
+
+static uint32 nextRandom()
+{
+    s_randomState = s_randomState * 1664525 + 1013904223;
+    return s_randomState;
+}
+
+static int classifyBlock(const float * data, uint w, uint h, uint x, uint y, bool hasAlpha)
+{
+    const uint plane = w * h;
+
+    float minValue[4] = { 1, 1, 1, 1 };
+    float maxValue[4] = { 0, 0, 0, 0 };
+    for (uint c = 0; c < 4; c++) {
+        for (uint j = 0; j < 4; j++) {
+            for (uint i = 0; i < 4; i++) {
+                const float v = clamp(data[c * plane + (y + j) * w + x + i], 0.0f, 1.0f);
+                minValue[c] = nv::min(minValue[c], v);
+                maxValue[c] = nv::max(maxValue[c], v);
+            }
+        }
+    }
+
+    if (hasAlpha && minValue[3] < 0.5f) {
+        // Blocks that are entirely transparent are not representative of anything.
+        return maxValue[3] >= 0.5f ? Corpus_AlphaEdge : -1;
+    }
+
+    bool constant = true;
+    for (uint c = 0; c < 4; c++) {
+        if (maxValue[c] - minValue[c] >= 1.0f / 255.0f) constant = false;
+    }
+    if (constant) {
+        return Corpus_Constant;
+    }
+
+    // Mean of the largest color difference between horizontal and vertical neighbors.
+    float gradient = 0.0f;
+    for (uint j = 0; j < 4; j++) {
+        for (uint i = 0; i < 4; i++) {
+            const uint idx = (y + j) * w + x + i;
+            for (uint n = 0; n < 2; n++) {
+                if ((n == 0 && i == 3) || (n == 1 && j == 3)) continue;
+                const uint neighbor = (n == 0) ? idx + 1 : idx + w;
+
+                float diff = 0.0f;
+                for (uint c = 0; c < 3; c++) {
+                    diff = nv::max(diff, fabsf(data[c * plane + idx] - data[c * plane + neighbor]));
+                }
+                gradient += diff;
+            }
+        }
+    }
+    gradient /= 24.0f;
+
+    if (gradient < s_smoothThreshold) return Corpus_Smooth;
+    if (gradient > s_noisyThreshold) return Corpus_Noisy;
+
+    return -1;
+}
+
+static void addBlock(Corpus & corpus, const float * data, uint w, uint h, uint x, uint y)
+{
+    corpus.candidateCount++;
+
+    uint slot;
+    if (corpus.blockCount < corpus.capacity) {
+        slot = corpus.blockCount++;
+    }
+    else {
+        slot = uint((uint64(nextRandom()) * corpus.candidateCount) >> 32);
+        if (slot >= corpus.capacity) return;
+    }
+
+    const uint plane = w * h;
+    const uint corpusPlane = corpus.width() * 4;
+
+    for (uint c = 0; c < 4; c++) {
+        for (uint j = 0; j < 4; j++) {
+            for (uint i = 0; i < 4; i++) {
+                corpus.data[c * corpusPlane + j * corpus.width() + 4 * slot + i] = data[c * plane + (y + j) * w + x + i];
+            }
+        }
+    }
+}
+
+static bool addImage(Corpus * corpora, const char * fileName, bool normalMap)
+{
+    nvtt::Surface image;
+    if (!image.load(fileName)) {
+        fprintf(stderr, "Cannot load '%s'.\n", fileName);
+        return false;
+    }
+
+    const uint w = uint(image.width());
+    const uint h = uint(image.height());
+    const float * data = image.data();
+
+    bool hasAlpha = false;
+    const float * alpha = image.channel(3);
+    for (uint i = 0; i < w * h; i++) {
+        if (alpha[i] < 1.0f) {
+            hasAlpha = true;
+            break;
+        }
+    }
+
+    // Partial blocks are skipped.
+    for (uint y = 0; y + 4 <= h; y += 4) {
+        for (uint x = 0; x + 4 <= w; x += 4) {
+            const int type = normalMap ? Corpus_Normal : classifyBlock(data, w, h, x, y, hasAlpha);
+            if (type >= 0) {
+                addBlock(corpora[type], data, w, h, x, y);
+            }
+        }
+    }
+
+    return true;
+}
+
+
+enum ErrorChannels
+{
+    Channels_RGB,
+    Channels_RGBA,
+    Channels_R,
+    Channels_RG,
+    Channels_Normal,    // X in alpha, Y in green.
+};
+
+struct EncoderDesc
+{
+    const char * name;
+    nvtt::Format format;
+    nvtt::Quality quality;
+    ErrorChannels channels;
+    bool colorSet;          // ColorSetCompressor instead of ColorBlockCompressor.
+    CompressorInterface * (* create)();
+};
+
+template <typename T>
+static CompressorInterface * createEncoder() { return new T; }
+
+// The BC5 luma compressor is not listed, its output can't be decoded without its own reconstruction.
+static const EncoderDesc s_encoders[] = {
+    { "FastCompressorDXT1",         nvtt::Format_BC1,   nvtt::Quality_Fastest,      Channels_RGB,       false,  createEncoder<FastCompressorDXT1> },
+    { "FastCompressorDXT1a",        nvtt::Format_BC1a,  nvtt::Quality_Fastest,      Channels_RGBA,      false,  createEncoder<FastCompressorDXT1a> },
+    { "FastCompressorDXT3",         nvtt::Format_BC2,   nvtt::Quality_Fastest,      Channels_RGBA,      false,  createEncoder<FastCompressorDXT3> },
+    { "FastCompressorDXT5",         nvtt::Format_BC3,   nvtt::Quality_Fastest,      Channels_RGBA,      false,  createEncoder<FastCompressorDXT5> },
+    { "FastCompressorDXT5n",        nvtt::Format_BC3n,  nvtt::Quality_Fastest,      Channels_Normal,    false,  createEncoder<FastCompressorDXT5n> },
+    { "FastCompressorBC4",          nvtt::Format_BC4,   nvtt::Quality_Fastest,      Channels_R,         false,  createEncoder<FastCompressorBC4> },
+    { "FastCompressorBC5",          nvtt::Format_BC5,   nvtt::Quality_Fastest,      Channels_RG,        false,  createEncoder<FastCompressorBC5> },
+    { "CompressorDXT1",             nvtt::Format_BC1,   nvtt::Quality_Production,   Channels_RGB,       true,   createEncoder<CompressorDXT1> },
+    { "CompressorDXT1a",            nvtt::Format_BC1a,  nvtt::Quality_Production,   Channels_RGBA,      false,  createEncoder<CompressorDXT1a> },
+    { "CompressorDXT1_Luma",        nvtt::Format_BC1,   nvtt::Quality_Production,   Channels_RGB,       false,  createEncoder<CompressorDXT1_Luma> },
+    { "CompressorDXT3",             nvtt::Format_BC2,   nvtt::Quality_Production,   Channels_RGBA,      false,  createEncoder<CompressorDXT3> },
+    { "CompressorDXT5",             nvtt::Format_BC3,   nvtt::Quality_Production,   Channels_RGBA,      false,  createEncoder<CompressorDXT5> },
+    { "CompressorDXT5n",            nvtt::Format_BC3n,  nvtt::Quality_Production,   Channels_Normal,    false,  createEncoder<CompressorDXT5n> },
+    { "ProductionCompressorBC4",    nvtt::Format_BC4,   nvtt::Quality_Production,   Channels_R,         false,  createEncoder<ProductionCompressorBC4> },
+    { "ProductionCompressorBC5",    nvtt::Format_BC5,   nvtt::Quality_Production,   Channels_RG,        false,  createEncoder<ProductionCompressorBC5> },
+    { "CompressorBC6",              nvtt::Format_BC6,   nvtt::Quality_Production,   Channels_RGB,       true,   createEncoder<CompressorBC6> },
+    { "CompressorBC7",              nvtt::Format_BC7,   nvtt::Quality_Production,   Channels_RGBA,      true,   createEncoder<CompressorBC7> },
+    { "CompressorBC3_RGBM",         nvtt::Format_BC3_RGBM, nvtt::Quality_Normal,    Channels_RGB,       true,   createEncoder<CompressorBC3_RGBM> },
+    { "CompressorBC3_RGBM_Production", nvtt::Format_BC3_RGBM, nvtt::Quality_Production, Channels_RGB,   true,   createEncoder<CompressorBC3_RGBM> },
+    { "CompressorBC3_RGBM_Highest", nvtt::Format_BC3_RGBM, nvtt::Quality_Highest,   Channels_RGB,       true,   createEncoder<CompressorBC3_RGBM> },
+};
+static const int s_encoderCount = sizeof(s_encoders) / sizeof(s_encoders[0]);
+
+
+static void decodeBlock(nvtt::Format format, const void * block, Vector4 colors[16])
+{
+    if (format == nvtt::Format_BC6) {
+        ColorSet set;
+        ((const BlockBC6 *)block)->decodeBlock(&set);
+        for (uint i = 0; i < 16; i++) colors[i] = set.colors[i];
+        return;
+    }
+
+    ColorBlock rgba;
+    switch (format) {
+        case nvtt::Format_BC1:
+        case nvtt::Format_BC1a:
+            ((const BlockDXT1 *)block)->decodeBlock(&rgba);
+            break;
+        case nvtt::Format_BC2:
+            ((const BlockDXT3 *)block)->decodeBlock(&rgba);
+            break;
+        case nvtt::Format_BC3:
+        case nvtt::Format_BC3n:
+        case nvtt::Format_BC3_RGBM:
+            ((const BlockDXT5 *)block)->decodeBlock(&rgba);
+            break;
+        case nvtt::Format_BC4:
+            ((const BlockATI1 *)block)->decodeBlock(&rgba);
+            break;
+        case nvtt::Format_BC5:
+            ((const BlockATI2 *)block)->decodeBlock(&rgba);
+            break;
+        case nvtt::Format_BC7:
+            ((const BlockBC7 *)block)->decodeBlock(&rgba);
+            break;
+        default:
+            nvDebugCheck(false);
+    }
+
+    for (uint i = 0; i < 16; i++) {
+        const Color32 c = rgba.color(i);
+        colors[i] = Vector4(c.r, c.g, c.b, c.a) * (1.0f / 255.0f);
+    }
+
+    if (format == nvtt::Format_BC3_RGBM) {
+        const float threshold = 0.15f; // Must match CompressorBC3_RGBM.
+        for (uint i = 0; i < 16; i++) {
+            const float M = colors[i].w * (1 - threshold) + threshold;
+            colors[i] = Vector4(colors[i].xyz() * M, 1.0f);
+        }
+    }
+}
+
+// Sum of squared errors of one block, in 8 bit units. Returns the number of channels compared per texel.
+// When alpha is compared the color error is weighted by alpha, the color of transparent texels doesn't matter.
+static uint blockError(ErrorChannels channels, const Vector4 decoded[16], const Corpus & corpus, uint index, double * sum)
+{
+    const uint plane = corpus.width() * 4;
+
+    uint channelCount = 0;
+    for (uint j = 0; j < 4; j++) {
+        for (uint i = 0; i < 4; i++) {
+            const uint idx = j * corpus.width() + 4 * index + i;
+
+            float ref[4];
+            for (uint c = 0; c < 4; c++) ref[c] = clamp(corpus.data[c * plane + idx], 0.0f, 1.0f);
+
+            const Vector4 & d = decoded[4 * j + i];
+
+            float diff[4];
+            channelCount = 0;
+            if (channels == Channels_Normal) {
+                diff[channelCount++] = d.w - ref[0];
+                diff[channelCount++] = d.y - ref[1];
+            }
+            else {
+                const uint count = (channels == Channels_R) ? 1 : (channels == Channels_RG) ? 2 : (channels == Channels_RGB) ? 3 : 4;
+                for (uint c = 0; c < count; c++) diff[channelCount++] = d.component[c] - ref[c];
+                if (channels == Channels_RGBA) {
+                    for (uint c = 0; c < 3; c++) diff[c] *= ref[3];
+                }
+            }
+
+            for (uint c = 0; c < channelCount; c++) {
+                *sum += double(255.0f * diff[c]) * double(255.0f * diff[c]);
+            }
+        }
+    }
+
+    return channelCount;
+}
+
+
+// Use the time stamp counter when available, otherwise fall back to the system clock.
+#if NV_CPU_X86 || NV_CPU_X86_64
+static const bool s_cycleCounter = true;
+static inline uint64 benchClock() { return fastCpuClock(); }
+#else
+static const bool s_cycleCounter = false;
+static inline uint64 benchClock() { return systemClock(); }
+#endif
+
+static double benchClockFrequency()
+{
+    if (!s_cycleCounter) return double(systemClockFrequency());
+
+    const uint64 clockFrequency = systemClockFrequency();
+    const uint64 startClock = systemClock();
+    const uint64 startTicks = benchClock();
+
+    uint64 clock;
+    do { clock = systemClock(); } while (clock - startClock < clockFrequency / 10);
+
+    return double(benchClock() - startTicks) * double(clockFrequency) / double(clock - startClock);
+}
+
+
+struct Result
+{
+    int encoder;
+    int corpus;
+    uint blockCount;
+    double ticksPerBlock;   // Fastest pass.
+    double rmse;
+};
+
+// Compress every block of the corpus once and return the elapsed ticks.
+static uint64 compressCorpus(const EncoderDesc & desc, CompressorInterface * compressor, const Corpus & corpus, nvtt::AlphaMode alphaMode, const nvtt::CompressionOptions::Private & compressionOptions, uint8 * output)
+{
+    const uint w = corpus.width();
+    const float * data = corpus.texels();
+
+    if (desc.colorSet) {
+        ColorSetCompressor * encoder = (ColorSetCompressor *)compressor;
+        const uint bs = encoder->blockSize();
+
+        encoder->prepare(alphaMode, compressionOptions);
+
+        const uint64 start = benchClock();
+        for (uint i = 0; i < corpus.blockCount; i++) {
+            ColorSet set;
+            set.setColors(data, w, 4, 4 * i, 0);
+            encoder->compressBlock(set, alphaMode, compressionOptions, output + i * bs);
+        }
+        return benchClock() - start;
+    }
+    else {
+        ColorBlockCompressor * encoder = (ColorBlockCompressor *)compressor;
+        const uint bs = encoder->blockSize();
+
+        const uint64 start = benchClock();
+        for (uint i = 0; i < corpus.blockCount; i++) {
+            ColorBlock rgba;
+            rgba.init(w, 4, data, 4 * i, 0);
+            encoder->compressBlock(rgba, alphaMode, compressionOptions, output + i * bs);
+        }
+        return benchClock() - start;
+    }
+}
+
+static Result runEncoder(int encoderIndex, int corpusIndex, const Corpus & corpus, int repeatCount)
+{
+    const EncoderDesc & desc = s_encoders[encoderIndex];
+
+    nvtt::CompressionOptions options;
+    options.setFormat(desc.format);
+    options.setQuality(desc.quality);
+    if (desc.format == nvtt::Format_BC6) {
+        options.setPixelType(nvtt::PixelType_UnsignedFloat);
+    }
+
+    const nvtt::AlphaMode alphaMode = (corpusIndex == Corpus_AlphaEdge) ? nvtt::AlphaMode_Transparency : nvtt::AlphaMode_None;
+
+    CompressorInterface * compressor = desc.create();
+
+    Array<uint8> output;
+    output.resize(16 * corpus.blockCount);
+
+    // The first pass warms up the caches and the lookup tables of the compressor.
+    uint64 bestTicks = ~uint64(0);
+    for (int r = 0; r <= repeatCount; r++) {
+        uint64 ticks = compressCorpus(desc, compressor, corpus, alphaMode, options.m, output.buffer());
+        if (r != 0 || repeatCount == 0) bestTicks = nv::min(bestTicks, ticks);
+    }
+
+    const uint bs = desc.colorSet ? ((ColorSetCompressor *)compressor)->blockSize() : ((ColorBlockCompressor *)compressor)->blockSize();
+
+    double sum = 0.0;
+    uint channelCount = 0;
+    for (uint i = 0; i < corpus.blockCount; i++) {
+        Vector4 decoded[16];
+        decodeBlock(desc.format, output.buffer() + i * bs, decoded);
+        channelCount = blockError(desc.channels, decoded, corpus, i, &sum);
+    }
+
+    delete compressor;
+
+    Result result;
+    result.encoder = encoderIndex;
+    result.corpus = corpusIndex;
+    result.blockCount = corpus.blockCount;
+    result.ticksPerBlock = double(bestTicks) / corpus.blockCount;
+    result.rmse = sqrt(sum / (double(corpus.blockCount) * 16 * channelCount));
+    return result;
+}
+
+
+// Match the comma separated list of name fragments against the encoder names.
+static bool matchEncoder(const char * list, const char * name)
+{
+    const char * ptr = list;
+    while (*ptr != '\0') {
+        const char * end = strchr(ptr, ',');
+        const uint length = end ? uint(end - ptr) : uint(strlen(ptr));
+
+        for (const char * n = name; *n != '\0'; n++) {
+            uint k = 0;
+            while (k < length && n[k] != '\0' && tolower(n[k]) == tolower(ptr[k])) k++;
+            if (k == length) return true;
+        }
+
+        ptr += length;
+        if (*ptr == ',') ptr++;
+    }
+    return false;
+}
+
+static bool matchCorpus(const char * list, const char * name)
+{
+    const char * ptr = list;
+    while (*ptr != '\0') {
+        const char * end = strchr(ptr, ',');
+        const uint length = end ? uint(end - ptr) : uint(strlen(ptr));
+
+        if (strlen(name) == length && strncmp(name, ptr, length) == 0) return true;
+
+        ptr += length;
+        if (*ptr == ',') ptr++;
+    }
+    return false;
+}
+
+
+// Default corpus, relative to the testsuite data directory.
+static const char * s_defaultColorImages[] = {
+    "kodak/kodim01.png", "kodak/kodim03.png", "kodak/kodim13.png", "kodak/kodim23.png",
+    "epic/Gradient.png", "epic/Text.png", "epic/Wall.png",
+    "lugaru/lugaru-bush.png", "lugaru/lugaru-hawk.png", "quake3/q3-proto_fence.tga", "quake3/q3-fan_grate.tga",
+};
+static const char * s_defaultNormalImages[] = {
+    "id_tnmap/05_lumpy.png", "id_tnmap/09_metal.png", "id_tnmap/13_arcade.png",
+};
+
+
+int main(int argc, char *argv[])
+{
+    const char * basePath = NULL;
+    const char * encoderList = NULL;
+    const char * corpusList = NULL;
+    const char * csvFileName = NULL;
+    int blockCount = 1024;
+    int repeatCount = 5;
+    bool listEncoders = false;
+    bool showHelp = false;
+
+    Array<const char *> colorImages;
+    Array<const char *> normalImages;
+
+    // Parse arguments.
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp("-path", argv[i]) == 0)
+        {
+            if (i+1 < argc && argv[i+1][0] != '-') {
+                basePath = argv[i+1];
+                i++;
+            }
+        }
+        else if (strcmp("-normal", argv[i]) == 0)
+        {
+            if (i+1 < argc && argv[i+1][0] != '-') {
+                normalImages.pushBack(argv[i+1]);
+                i++;
+            }
+        }
+        else if (strcmp("-encoders", argv[i]) == 0)
+        {
+            if (i+1 < argc && argv[i+1][0] != '-') {
+                encoderList = argv[i+1];
+                i++;
+            }
+        }
+        else if (strcmp("-corpora", argv[i]) == 0)
+        {
+            if (i+1 < argc && argv[i+1][0] != '-') {
+                corpusList = argv[i+1];
+                i++;
+            }
+        }
+        else if (strcmp("-blocks", argv[i]) == 0)
+        {
+            if (i+1 < argc && argv[i+1][0] != '-') {
+                blockCount = atoi(argv[i+1]);
+                i++;
+            }
+        }
+        else if (strcmp("-repeat", argv[i]) == 0)
+        {
+            if (i+1 < argc && argv[i+1][0] != '-') {
+                repeatCount = atoi(argv[i+1]);
+                i++;
+            }
+        }
+        else if (strcmp("-csv", argv[i]) == 0)
+        {
+            if (i+1 < argc && argv[i+1][0] != '-') {
+                csvFileName = argv[i+1];
+                i++;
+            }
+        }
+        else if (strcmp("-list", argv[i]) == 0)
+        {
+            listEncoders = true;
+        }
+        else if (strcmp("-help", argv[i]) == 0)
+        {
+            showHelp = true;
+        }
+        else if (argv[i][0] != '-')
+        {
+            colorImages.pushBack(argv[i]);
+        }
+        else
+        {
+            printf("Warning: unrecognized option \"%s\"\n", argv[i]);
+        }
+    }
+
+    if (showHelp || blockCount <= 0 || repeatCount < 0)
+    {
+        printf("usage: nvblockbench [options] [image ...]\n\n");
+
+        printf("Input options:\n");
+        printf("  -path <path>   \tTestsuite data directory, used when no images are given.\n");
+        printf("  -normal <file> \tAdd a normal map to the normal corpus.\n");
+        printf("  -blocks <n>    \tMaximum number of blocks per corpus (default: 1024).\n");
+        printf("  -corpora <list>\tComma separated corpora: constant, smooth, noisy, alpha-edge, normal.\n");
+
+        printf("Benchmark options:\n");
+        printf("  -encoders <list>\tComma separated name fragments, for example 'Fast,BC5'.\n");
+        printf("  -repeat <n>    \tTimed passes per encoder, the fastest one is reported (default: 5).\n");
+        printf("  -list          \tList the encoders and exit.\n");
+
+        printf("Output options:\n");
+        printf("  -csv <file>    \tWrite the results as comma separated values.\n");
+
+        return 1;
+    }
+
+    if (listEncoders)
+    {
+        for (int i = 0; i < s_encoderCount; i++) {
+            printf("%s\n", s_encoders[i].name);
+        }
+        return 0;
+    }
+
+    // Without explicit images use the default corpus of the testsuite.
+    Array<Path> colorPaths;
+    Array<Path> normalPaths;
+    if (colorImages.isEmpty() && normalImages.isEmpty())
+    {
+        if (basePath == NULL) {
+            printf("No input images, use -path to point to the testsuite data.\n");
+            return 1;
+        }
+
+        for (uint i = 0; i < sizeof(s_defaultColorImages) / sizeof(s_defaultColorImages[0]); i++) {
+            Path path(basePath);
+            path.appendSeparator();
+            path.append(s_defaultColorImages[i]);
+            colorPaths.pushBack(path);
+        }
+        for (uint i = 0; i < sizeof(s_defaultNormalImages) / sizeof(s_defaultNormalImages[0]); i++) {
+            Path path(basePath);
+            path.appendSeparator();
+            path.append(s_defaultNormalImages[i]);
+            normalPaths.pushBack(path);
+        }
+    }
+    else
+    {
+        for (uint i = 0; i < colorImages.count(); i++) colorPaths.pushBack(Path(colorImages[i]));
+        for (uint i = 0; i < normalImages.count(); i++) normalPaths.pushBack(Path(normalImages[i]));
+    }
+
+    // Build the corpora.
+    Corpus corpora[Corpus_Count];
+    for (int c = 0; c < Corpus_Count; c++) {
+        corpora[c].capacity = uint(blockCount);
+        corpora[c].blockCount = 0;
+        corpora[c].candidateCount = 0;
+        corpora[c].data.resize(corpora[c].width() * 4 * 4);
+    }
+
+    for (uint i = 0; i < colorPaths.count(); i++) {
+        if (!addImage(corpora, colorPaths[i].str(), false)) return EXIT_FAILURE;
+    }
+    for (uint i = 0; i < normalPaths.count(); i++) {
+        if (!addImage(corpora, normalPaths[i].str(), true)) return EXIT_FAILURE;
+    }
+
+    printf("Corpora:\n");
+    for (int c = 0; c < Corpus_Count; c++) {
+        printf("  %-10s\t%u blocks (%llu candidates)\n", s_corpusNames[c], corpora[c].blockCount, (unsigned long long)corpora[c].candidateCount);
+    }
+
+    const double frequency = benchClockFrequency();
+    if (s_cycleCounter) {
+        printf("Time stamp counter: %.0f MHz\n", frequency * 1e-6);
+    }
+    printf("\n");
+
+    printf("%-30s %-10s %7s %10s %10s %8s\n", "Encoder", "Corpus", "Blocks", "ns/block", s_cycleCounter ? "cyc/block" : "", "RMSE");
+
+    Array<Result> results;
+    for (int e = 0; e < s_encoderCount; e++)
+    {
+        if (encoderList != NULL && !matchEncoder(encoderList, s_encoders[e].name)) continue;
+
+        for (int c = 0; c < Corpus_Count; c++)
+        {
+            if (corpusList != NULL && !matchCorpus(corpusList, s_corpusNames[c])) continue;
+            if (corpora[c].blockCount == 0) continue;
+
+            Result result = runEncoder(e, c, corpora[c], repeatCount);
+            results.pushBack(result);
+
+            const double ns = result.ticksPerBlock * 1e9 / frequency;
+            if (s_cycleCounter) {
+                printf("%-30s %-10s %7u %10.1f %10.0f %8.3f\n", s_encoders[e].name, s_corpusNames[c], result.blockCount, ns, result.ticksPerBlock, result.rmse);
+            }
+            else {
+                printf("%-30s %-10s %7u %10.1f %10s %8.3f\n", s_encoders[e].name, s_corpusNames[c], result.blockCount, ns, "", result.rmse);
+            }
+            fflush(stdout);
+        }
+    }
+
+    if (csvFileName != NULL)
+    {
+        FILE * fp = fopen(csvFileName, "w");
+        if (fp == NULL) {
+            printf("Cannot open '%s' for writing.\n", csvFileName);
+            return EXIT_FAILURE;
+        }
+
+        fprintf(fp, "encoder,corpus,blocks,ns_per_block,cycles_per_block,rmse\n");
+        for (uint i = 0; i < results.count(); i++) {
+            const Result & r = results[i];
+            fprintf(fp, "%s,%s,%u,%.2f,%.1f,%.4f\n", s_encoders[r.encoder].name, s_corpusNames[r.corpus], r.blockCount,
+                r.ticksPerBlock * 1e9 / frequency, s_cycleCounter ? r.ticksPerBlock : 0.0, r.rmse);
+        }
+
+        fclose(fp);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -34,9 +34,22 @@
 #include <nvcore/TextWriter.h>
 #include <nvcore/FileSystem.h>
 #include <nvcore/Timer.h>
+#include <nvcore/Array.inl>
+#include <nvthread/ParallelFor.h>
 
 #include <stdlib.h> // free
 #include <string.h> // memcpy
+#include <stdio.h> // fopen
+
+#include <atomic>
+
+#if NV_OS_WIN32
+#include <direct.h> // _getcwd
+#include <process.h> // _getpid
+#define getpid _getpid
+#else
+#include <unistd.h> // getcwd, getpid
+#endif
 
 #include "../tools/cmdline.h"
 
@@ -259,6 +272,20 @@ static ImageSet s_imageSets[] = {
 const int s_imageSetCount = ARRAY_SIZE(s_imageSets);
 
 
+// Paths of the command line are relative to the directory the suite is started from, not to the image set directory.
+static Path resolvePath(const char * workingDirectory, const char * path)
+{
+    Path result;
+    if (path[0] == '/' || path[0] == '\\' || (path[0] != '\0' && path[1] == ':')) {
+        result = path;
+    }
+    else {
+        result.format("%s/%s", workingDirectory, path);
+    }
+    return result;
+}
+
+
 struct MyOutputHandler : public nvtt::OutputHandler
 {
     MyOutputHandler() : m_data(NULL), m_ptr(NULL) {}
@@ -302,6 +329,186 @@ struct MyOutputHandler : public nvtt::OutputHandler
     unsigned char * m_ptr;
 };
 
+
+// The images are distributed across the thread pool, so the contexts of the image jobs run their tasks sequentially.
+struct SequentialTaskDispatcher : public nvtt::TaskDispatcher
+{
+    virtual void dispatch(nvtt::Task * task, void * context, int count)
+    {
+        for (int i = 0; i < count; i++) {
+            task(context, i);
+        }
+    }
+};
+
+
+// Decoded images are cached in a compact binary form, so that following runs do not have to decode the PNG, TGA and
+// DDS files again. Images with 8 bit values are stored with 8 bits per channel, others with 32 bit floats. The cache
+// is invalidated when the source file is newer than the cache file.
+struct ImageCacheHeader
+{
+    uint32 magic;
+    uint32 width;
+    uint32 height;
+    uint32 bytesPerChannel;     // 1 or 4.
+};
+
+static const uint32 s_imageCacheMagic = 0x31435654; // 'TVC1'
+
+static bool loadCachedImage(nvtt::Surface & img, const char * fileName, const char * cachePath)
+{
+    if (cachePath == NULL) {
+        return img.load(fileName);
+    }
+
+    Path cacheFileName;
+    cacheFileName.format("%s/%s", cachePath, fileName);
+    for (char * ptr = cacheFileName.str() + strlen(cachePath) + 1; *ptr != '\0'; ptr++) {
+        if (*ptr == '/' || *ptr == '\\' || *ptr == ':') *ptr = '_';
+    }
+    cacheFileName.append(".bin");
+
+    const uint64 sourceTime = FileSystem::lastModified(fileName);
+    if (sourceTime != 0 && FileSystem::lastModified(cacheFileName.str()) >= sourceTime)
+    {
+        FILE * fp = fopen(cacheFileName.str(), "rb");
+        if (fp != NULL)
+        {
+            ImageCacheHeader header;
+            bool loaded = false;
+
+            if (fread(&header, sizeof(header), 1, fp) == 1 && header.magic == s_imageCacheMagic &&
+                (header.bytesPerChannel == 1 || header.bytesPerChannel == 4))
+            {
+                const uint planeSize = header.width * header.height * header.bytesPerChannel;
+                uint8 * data = (uint8 *)malloc(4 * planeSize);
+
+                if (fread(data, planeSize, 4, fp) == 4)
+                {
+                    nvtt::InputFormat format = (header.bytesPerChannel == 1) ? nvtt::InputFormat_BGRA_8UB : nvtt::InputFormat_RGBA_32F;
+                    loaded = img.setImage(format, header.width, header.height, 1, data, data + planeSize, data + 2 * planeSize, data + 3 * planeSize);
+                }
+
+                free(data);
+            }
+
+            fclose(fp);
+
+            if (loaded) return true;
+        }
+    }
+
+    if (!img.load(fileName)) {
+        return false;
+    }
+
+    // Use 8 bits per channel if that reproduces the decoded values exactly.
+    const uint count = img.width() * img.height();
+    const float * src = img.data();
+
+    bool is8bit = (img.depth() == 1);
+    for (uint i = 0; i < 4 * count && is8bit; i++) {
+        float f = src[i] * 255.0f;
+        is8bit = (f >= 0.0f && f <= 255.0f && float(uint8(f + 0.5f)) / 255.0f == src[i]);
+    }
+
+    if (img.depth() != 1) {
+        return true;
+    }
+
+    ImageCacheHeader header;
+    header.magic = s_imageCacheMagic;
+    header.width = img.width();
+    header.height = img.height();
+    header.bytesPerChannel = is8bit ? 1 : 4;
+
+    // Other processes and threads might be writing the same file, write to a temporary file with a unique name first.
+    static std::atomic<uint> s_tmpFileCount(0);
+    Path tmpFileName;
+    tmpFileName.format("%s.%d.%u.tmp", cacheFileName.str(), int(getpid()), s_tmpFileCount.fetch_add(1));
+
+    FILE * fp = fopen(tmpFileName.str(), "wb");
+    if (fp != NULL)
+    {
+        bool written = fwrite(&header, sizeof(header), 1, fp) == 1;
+
+        if (is8bit) {
+            uint8 * data = (uint8 *)malloc(4 * count);
+            for (uint i = 0; i < 4 * count; i++) {
+                data[i] = uint8(src[i] * 255.0f + 0.5f);
+            }
+            written = written && fwrite(data, count, 4, fp) == 4;
+            free(data);
+        }
+        else {
+            written = written && fwrite(src, count * sizeof(float), 4, fp) == 4;
+        }
+
+        fclose(fp);
+
+        if (!written || rename(tmpFileName.str(), cacheFileName.str()) != 0) {
+            FileSystem::removeFile(tmpFileName.str());
+        }
+    }
+
+    return true;
+}
+
+
+// Throughput baseline. Each line contains the set, test and mode names followed by the MPix/s of the mode.
+struct BaselineEntry
+{
+    char key[128];
+    float mpixPerSecond;
+};
+
+static void baselineKey(char * key, const char * setName, const char * testName, const char * modeName)
+{
+    snprintf(key, 128, "%s/%s/%s", setName, testName, modeName);
+}
+
+static void loadBaseline(const char * fileName, Array<BaselineEntry> & entries)
+{
+    FILE * fp = fopen(fileName, "r");
+    if (fp == NULL) return;
+
+    char line[256];
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        if (line[0] == '#') continue;
+
+        BaselineEntry entry;
+        if (sscanf(line, "%127s %f", entry.key, &entry.mpixPerSecond) == 2) {
+            entries.pushBack(entry);
+        }
+    }
+
+    fclose(fp);
+}
+
+static bool saveBaseline(const char * fileName, const Array<BaselineEntry> & entries)
+{
+    FILE * fp = fopen(fileName, "w");
+    if (fp == NULL) return false;
+
+    fprintf(fp, "# nvtestsuite throughput baseline: set/test/mode MPix/s\n");
+    for (uint i = 0; i < entries.count(); i++) {
+        fprintf(fp, "%s %.4f\n", entries[i].key, entries[i].mpixPerSecond);
+    }
+
+    fclose(fp);
+    return true;
+}
+
+static BaselineEntry * findBaseline(Array<BaselineEntry> & entries, const char * key)
+{
+    for (uint i = 0; i < entries.count(); i++) {
+        if (strcmp(entries[i].key, key) == 0) return &entries[i];
+    }
+    return NULL;
+}
+
+
 enum ErrorMode {
     ErrorMode_RMSE,
     ErrorMode_CieLab,
@@ -309,6 +516,396 @@ enum ErrorMode {
 };
 
 
+// Results of one image of a test mode.
+struct ImageJob
+{
+    int fileIndex;
+
+    bool loaded;
+    bool saveFailed;
+    bool hasRegress;
+
+    uint pixelCount;
+    float error;
+    float regressError;
+
+    // Timing breakdown in seconds.
+    float loadTime;
+    float compressTime;
+    float decompressTime;
+    float outputTime;
+};
+
+// Parameters shared by all the images of a test mode.
+struct ModeContext
+{
+    const ImageSet * set;
+    Mode mode;
+    nvtt::Format format;
+    nvtt::Decoder decoder;
+    const nvtt::CompressionOptions * compressionOptions;
+    int errorMode;
+    const Path * outputFilePath;
+    const char * regressPath;
+    const char * cachePath;
+    bool nocuda;
+    bool parallel;
+
+    ImageJob * jobs;
+};
+
+static void runImageJob(const ModeContext & ctx, ImageJob & job)
+{
+    const ImageSet & set = *ctx.set;
+    const Mode mode = ctx.mode;
+    const nvtt::Format format = ctx.format;
+    const nvtt::Decoder decoder = ctx.decoder;
+    const nvtt::CompressionOptions & compressionOptions = *ctx.compressionOptions;
+    const int errorMode = ctx.errorMode;
+    const Path & outputFilePath = *ctx.outputFilePath;
+    const char * fileName = set.fileNames[job.fileIndex];
+
+    Timer timer;
+
+    nvtt::Surface img;
+    if (set.type == ImageType_RGBA) {
+        img.setAlphaMode(nvtt::AlphaMode_Transparency);
+    }
+    else if (set.type == ImageType_Normal) { 
+        img.setNormalMap(true);
+    }
+    else if (set.type == ImageType_HDR) { // Lightmap's alpha channel is coverage.
+        img.setAlphaMode(nvtt::AlphaMode_Transparency);
+    }
+
+    timer.start();
+
+    job.loaded = loadCachedImage(img, fileName, ctx.cachePath);
+    if (!job.loaded) {
+        return;
+    }
+
+    if (img.isNormalMap()) {
+        img.normalizeNormalMap();
+    }
+    /*if (set.type == ImageType_HDR) {
+        img.scaleBias(0, 1.0f/4.0f, 0.0f); img.clamp(0);
+        img.scaleBias(1, 1.0f/4.0f, 0.0f); img.clamp(1);
+        img.scaleBias(2, 1.0f/4.0f, 0.0f); img.clamp(2);
+        img.toGamma(2);
+    }*/
+
+    timer.stop();
+    job.loadTime = timer.elapsed();
+    job.pixelCount = img.width() * img.height();
+
+    nvtt::Surface tmp = img;
+    if (mode == Mode_BC1) {
+        if (set.type == ImageType_HDR) {
+            /*for (int i = 0; i < 3; i++) {
+                tmp.scaleBias(i, 0.25f, 0);
+                tmp.clamp(i);
+            }*/
+        }
+    }
+    if (mode == Mode_BC3_YCoCg) {
+        tmp.setAlphaMode(nvtt::AlphaMode_None);
+        if (set.type == ImageType_HDR) {
+            /*for (int i = 0; i < 3; i++) {
+                tmp.scaleBias(i, 1.0f/4.0f, 0);
+                tmp.clamp(i);
+            }*/
+        }
+        tmp.toYCoCg();          // Y=3, Co=0, Cg=1
+        tmp.blockScaleCoCg();   // Co=0, Cg=1, Scale=2, ScaleBits = 5
+
+        tmp.scaleBias(0, 123.0f/255.0f, 123.0f/255.0f); tmp.clamp(0, 0, 246.0f/255.0f); // -1->0, 0->123, 1->246
+        tmp.scaleBias(1, 125.0f/255.0f, 125.0f/255.0f); tmp.clamp(1, 0, 250.0f/255.0f); // -1->0, 0->125, 1->250
+
+        //tmp.scaleBias(0, 0.5f, 0.5f); tmp.clamp(0);
+        //tmp.scaleBias(1, 0.5f, 0.5f); tmp.clamp(1);
+
+        tmp.clamp(2);
+        tmp.clamp(3);
+    }
+    else if (mode == Mode_BC3_RGBM) {
+        tmp.setAlphaMode(nvtt::AlphaMode_None);
+        if (set.type == ImageType_HDR) {
+					// Transform to gamma-2.0 space before applying RGBM - helps a lot with banding in the darks.
+					tmp.toGamma(2.0f);
+            tmp.toRGBM(3.0f);	// range of 3.0 in gamma-2.0 space == range of 9.0 in linear space
+        }
+        else {
+            tmp.toRGBM();
+        }
+    }
+    else if (mode == Mode_BC3_LUVW) {
+        tmp.setAlphaMode(nvtt::AlphaMode_None);
+        if (set.type == ImageType_HDR) {
+            tmp.toLUVW(8.0f);
+        }
+        else {
+            tmp.toLUVW();
+        }
+    }
+    else if (mode == Mode_BC3_RGBS) {
+        //tmp.toJPEGLS();
+        //tmp.scaleBias(0, 123.0f/255.0f, 123.0f/255.0f); tmp.clamp(0, 0, 246.0f/255.0f); // -1->0, 0->123, 1->246
+        //tmp.scaleBias(2, 123.0f/255.0f, 123.0f/255.0f); tmp.clamp(0, 0, 246.0f/255.0f); // -1->0, 0->123, 1->246
+
+        // Not helping...
+        //tmp.blockLuminanceScale(0.1f);
+        /*tmp.toYCoCg();
+        tmp.scaleBias(0, 0.5, 0.5);
+        tmp.scaleBias(1, 0.5, 0.5);
+        tmp.swizzle(0, 3, 1, 4); // Co Cg 1 Y -> Co Y Cg 1
+        tmp.copyChannel(img, 3); // Restore alpha channel for weighting.*/
+    }
+    else if (mode == Mode_BC5_Normal) {
+        tmp.transformNormals(nvtt::NormalTransform_Orthographic);
+    }
+    else if (mode == Mode_BC5_Normal_Stereographic) {
+        tmp.transformNormals(nvtt::NormalTransform_Stereographic);
+    }
+    else if (mode == Mode_BC5_Normal_Paraboloid) {
+        tmp.transformNormals(nvtt::NormalTransform_Paraboloid);
+    }
+    else if (mode == Mode_BC5_Normal_Quartic) {
+        tmp.transformNormals(nvtt::NormalTransform_Quartic);
+    }
+    /*else if (mode == Mode_BC5_Normal_DualParaboloid) {
+        tmp.transformNormals(nvtt::NormalTransform_DualParaboloid);
+    }*/
+
+
+    nvtt::OutputOptions outputOptions;
+    outputOptions.setOutputHeader(false);
+
+    MyOutputHandler outputHandler;
+    outputOptions.setOutputHandler(&outputHandler);
+
+    SequentialTaskDispatcher sequentialDispatcher;
+
+    nvtt::Context context;
+    context.enableCudaAcceleration(!ctx.nocuda);
+    if (ctx.parallel) {
+        context.setTaskDispatcher(&sequentialDispatcher);
+    }
+
+    timer.start();
+
+    context.compress(tmp, 0, 0, compressionOptions, outputOptions);
+
+    timer.stop();
+    job.compressTime = timer.elapsed();
+
+    timer.start();
+
+    nvtt::Surface img_out = outputHandler.decompress(mode, format, decoder);
+    img_out.setAlphaMode(img.alphaMode());
+    img_out.setNormalMap(img.isNormalMap());
+
+    if (mode == Mode_BC1) {
+        if (set.type == ImageType_HDR) {
+            /*for (int i = 0; i < 3; i++) {
+                img_out.scaleBias(i, 4.0f, 0);
+            }*/
+        }
+    }
+    else if (mode == Mode_BC3_YCoCg) {
+        img_out.scaleBias(0, 255.0f/123, -1.0f); // 0->-1, 123->0, 246->1
+        img_out.scaleBias(1, 255.0f/125, -1.0f); // 0->-1, 125->0, 150->1
+
+        //img_out.scaleBias(0, 2.0f, -1.0f);
+        //img_out.scaleBias(1, 2.0f, -1.0f);
+        
+        img_out.fromYCoCg();
+        img_out.clamp(0);
+        img_out.clamp(1);
+        img_out.clamp(2);
+        if (set.type == ImageType_HDR) {
+            /*for (int i = 0; i < 3; i++) {
+                img_out.scaleBias(i, 4.0f, 0);
+            }*/
+        }
+    }
+    else if (mode == Mode_BC3_RGBM) {
+        if (set.type == ImageType_HDR) {
+            img_out.fromRGBM(3.0f);
+					img_out.toLinear(2.0f);
+        }
+        else {
+            img_out.fromRGBM();
+        }
+    }
+    else if (mode == Mode_BC3_LUVW) {
+        if (set.type == ImageType_HDR) {
+            img_out.fromLUVW(8.0f);
+        }
+        else {
+            img_out.fromLUVW();
+        }
+    }
+    else if (mode == Mode_BC3_RGBS) {
+        //img_out.scaleBias(0, 255.0f/123, -1.0f);
+        //img_out.scaleBias(2, 255.0f/123, -1.0f);
+        //img_out.fromJPEGLS();
+        /*img_out.swizzle(0, 2, 4, 1);    // Co Y Cg 1 - > Co Cg 1 Y
+        img_out.scaleBias(0, 1.0, -0.5);
+        img_out.scaleBias(1, 1.0, -0.5);
+        img_out.fromYCoCg();*/
+    }
+    else if (mode == Mode_BC5_Normal) {
+        img_out.reconstructNormals(nvtt::NormalTransform_Orthographic);
+    }
+    else if (mode == Mode_BC5_Normal_Stereographic) {
+        img_out.reconstructNormals(nvtt::NormalTransform_Stereographic);
+    }
+    else if (mode == Mode_BC5_Normal_Paraboloid) {
+        img_out.reconstructNormals(nvtt::NormalTransform_Paraboloid);
+    }
+    else if (mode == Mode_BC5_Normal_Quartic) {
+        img_out.reconstructNormals(nvtt::NormalTransform_Quartic);
+    }
+    /*else if (mode == Mode_BC5_Normal_DualParaboloid) {
+        tmp.transformNormals(nvtt::NormalTransform_DualParaboloid);
+    }*/
+
+    nvtt::Surface diff = nvtt::diff(img, img_out, 1.0f);
+
+    //bool residualCompression = (set.type == ImageType_HDR);
+    bool residualCompression = (mode == Mode_BC3_RGBS);
+    if (residualCompression)
+    {
+        float residualScale = 8.0f;
+        nvtt::Surface residual = diff;
+        for (int j = 0; j < 3; j++) {
+            residual.scaleBias(j, residualScale, 0.5); // @@ The residual scale is fairly arbitrary.
+            residual.clamp(j);
+        }
+        residual.toGreyScale(1, 1, 1, 0);
+
+        /*outputFileName.format("%s/%s", outputFilePath.str(), fileName);
+        outputFileName.stripExtension();
+        outputFileName.append("_residual.png");
+        residual.save(outputFileName.str());*/
+
+        nvtt::CompressionOptions residualCompressionOptions;
+        residualCompressionOptions.setFormat(nvtt::Format_BC4);
+        residualCompressionOptions.setQuality(nvtt::Quality_Production);
+        
+        context.compress(residual, 0, 0, compressionOptions, outputOptions);
+
+        nvtt::Surface residual_out = outputHandler.decompress(mode, format, decoder);
+
+        /*outputFileName.format("%s/%s", outputFilePath.str(), fileName);
+        outputFileName.stripExtension();
+        outputFileName.append("_residual_out.png");
+        residual_out.save(outputFileName.str());*/
+
+        residual_out.scaleBias(0, 1.0f/residualScale, -0.5f/residualScale);
+        residual_out.scaleBias(1, 1.0f/residualScale, -0.5f/residualScale);
+        residual_out.scaleBias(2, 1.0f/residualScale, -0.5f/residualScale);
+
+        img_out.addChannel(residual_out, 0, 0, -1.0f); img_out.clamp(0);
+        img_out.addChannel(residual_out, 1, 1, -1.0f); img_out.clamp(1);
+        img_out.addChannel(residual_out, 2, 2, -1.0f); img_out.clamp(2);
+    }
+
+    /*if (set.type == ImageType_HDR)
+    {
+        Path outputFileName;
+        outputFileName.format("%s/%s", outPath, fileName);
+        outputFileName.stripExtension();
+        if (set.type == ImageType_HDR) outputFileName.append(".dds");
+        else outputFileName.append(".tga");
+        if (!img.save(outputFileName.str()))
+        {
+            printf("Error saving file '%s'.\n", outputFileName.str());
+        }
+    }*/
+
+    timer.stop();
+    job.decompressTime = timer.elapsed();
+
+    timer.start();
+
+    // Output compressed image.
+    Path outputFileName;
+    outputFileName.format("%s/%s", outputFilePath.str(), fileName);
+    outputFileName.stripExtension();
+    if (set.type == ImageType_HDR) outputFileName.append(".dds");
+    else outputFileName.append(".tga");
+    if (!img_out.save(outputFileName.str(), set.type == ImageType_RGBA, set.type == ImageType_HDR))
+    {
+        job.saveFailed = true;
+    }
+
+    // Output RMSE.
+    float error;
+    if (errorMode == ErrorMode_RMSE) {
+        error = nvtt::rmsError(img, img_out);
+    }
+    else if (errorMode == ErrorMode_CieLab) {
+        error = nvtt::cieLabError(img, img_out);
+    }
+    else if (errorMode == ErrorMode_AngularRMSE) {
+        error = nvtt::angularError(img, img_out);
+    }
+
+    job.error = error;
+
+    // Output diff.
+    for (int j = 0; j < 3; j++) {
+        diff.scaleBias(j, 4.0f, 0.0f); 
+        diff.abs(j);
+        diff.clamp(j);
+    }
+
+    outputFileName.format("%s/%s", outputFilePath.str(), fileName);
+    outputFileName.stripExtension();
+    outputFileName.append("_diff.tga");
+    diff.save(outputFileName.str());
+
+    // Compare against the output of a previous run.
+    if (ctx.regressPath != NULL)
+    {
+        Path regressFileName;
+        regressFileName.format("%s/%s/%s", ctx.regressPath, s_modeNames[mode], fileName);
+        regressFileName.stripExtension();
+        if (set.type == ImageType_HDR) regressFileName.append(".dds");
+        else regressFileName.append(".tga");
+
+        nvtt::Surface img_reg;
+        img_reg.setAlphaMode(img.alphaMode());
+        img_reg.setNormalMap(img.isNormalMap());
+
+        job.hasRegress = loadCachedImage(img_reg, regressFileName.str(), ctx.cachePath);
+        if (job.hasRegress)
+        {
+            if (errorMode == ErrorMode_RMSE) {
+                job.regressError = nvtt::rmsError(img, img_reg);
+            }
+            else if (errorMode == ErrorMode_CieLab) {
+                job.regressError = nvtt::cieLabError(img, img_reg);
+            }
+            else if (errorMode == ErrorMode_AngularRMSE) {
+                job.regressError = nvtt::angularError(img, img_reg);
+            }
+        }
+    }
+
+    timer.stop();
+    job.outputTime = timer.elapsed();
+}
+
+static void ImageJobTask(void * context, int i)
+{
+    ModeContext * ctx = (ModeContext *)context;
+    runImageJob(*ctx, ctx->jobs[i]);
+}
+
+
 int main(int argc, char *argv[])
 {
     MyAssertHandler assertHandler;
@@ -331,6 +928,11 @@ int main(int argc, char *argv[])
     Path basePath = "";
     const char * outPath = "output";
     const char * regressPath = NULL;
+    const char * cachePath = "cache";
+    const char * perfPath = NULL;
+    float perfTolerance = 10.0f;
+    bool perfSave = false;
+    bool serial = false;
 
     // Parse arguments.
     for (int i = 1; i < argc; i++)
@@ -403,6 +1005,39 @@ int main(int argc, char *argv[])
                 regressPath = argv[i+1];
                 i++;
             }
+        }
+        else if (strcmp("-cache", argv[i]) == 0)
+        {
+            if (i+1 < argc && argv[i+1][0] != '-') {
+                cachePath = argv[i+1];
+                i++;
+            }
+        }
+        else if (strcmp("-nocache", argv[i]) == 0)
+        {
+            cachePath = NULL;
+        }
+        else if (strcmp("-perf", argv[i]) == 0)
+        {
+            if (i+1 < argc && argv[i+1][0] != '-') {
+                perfPath = argv[i+1];
+                i++;
+            }
+        }
+        else if (strcmp("-perfsave", argv[i]) == 0)
+        {
+            perfSave = true;
+        }
+        else if (strcmp("-perftol", argv[i]) == 0)
+        {
+            if (i+1 < argc && argv[i+1][0] != '-') {
+                perfTolerance = float(atof(argv[i+1]));
+                i++;
+            }
+        }
+        else if (strcmp("-serial", argv[i]) == 0)
+        {
+            serial = true;
         }
 		else
 		{
@@ -426,7 +1061,9 @@ int main(int argc, char *argv[])
 
         printf("Input options:\n");
         printf("  -path <path>   \tInput image path.\n");
-        printf("  -regress <path>\tRegression directory.\n");
+        printf("  -regress <path>\tRegression directory, the output directory of a previous run.\n");
+        printf("  -cache <path>  \tDecoded image cache directory, one subdirectory per set (default: cache).\n");
+        printf("  -nocache       \tDo not cache decoded images.\n");
         printf("  -set [0:%d]     \tImage set.\n", s_imageSetCount-1);
         for (int i = 0; i < s_imageSetCount; i++) {
             printf("    %i:           \t%s.\n", i, s_imageSets[i].name);
@@ -443,6 +1080,7 @@ int main(int argc, char *argv[])
         printf("Compression options:\n");
         printf("  -fast          \tFast compression.\n");
         printf("  -nocuda        \tDo not use cuda compressor.\n");
+        printf("  -serial        \tCompress one image at a time instead of distributing them across threads.\n");
 
         printf("Output options:\n");
         printf("  -out <path>    \tOutput directory.\n");
@@ -450,6 +1088,9 @@ int main(int argc, char *argv[])
         printf("    0:           \tRMSE (default).\n");
         printf("    1:           \tCieLab.\n");
         printf("    2:           \tAngular RMSE.\n");
+        printf("  -perf <file>   \tFail if the throughput is lower than in the baseline file. Implies -serial.\n");
+        printf("  -perfsave      \tStore the throughput in the baseline file instead.\n");
+        printf("  -perftol <pct> \tThroughput drop tolerated, in percent (default: 10).\n");
 
         return 1;
     }
@@ -474,19 +1115,55 @@ int main(int argc, char *argv[])
     const Test & test = s_imageTests[testIndex];
 
 
-    nvtt::OutputOptions outputOptions;
-    outputOptions.setOutputHeader(false);
+    if (basePath.length() != 0) {
+        basePath.appendSeparator();
+    }
+    basePath.append(set.basePath);
 
-    MyOutputHandler outputHandler;
-    outputOptions.setOutputHandler(&outputHandler);
+    // Outputs, caches and baselines stay out of the image set directory, when run by ctest they go to the build directory.
+    char workingDirectory[1024];
+#if NV_OS_WIN32
+    if (_getcwd(workingDirectory, sizeof(workingDirectory)) == NULL) {
+#else
+    if (getcwd(workingDirectory, sizeof(workingDirectory)) == NULL) {
+#endif
+        printf("Error reading the working directory.\n");
+        return EXIT_FAILURE;
+    }
 
-    nvtt::Context context;
-    context.enableCudaAcceleration(!nocuda);
+    Path outDirectory = resolvePath(workingDirectory, outPath);
+    outPath = outDirectory.str();
 
-    basePath.append(set.basePath);
+    Path regressDirectory;
+    if (regressPath != NULL) {
+        regressDirectory = resolvePath(workingDirectory, regressPath);
+        regressPath = regressDirectory.str();
+    }
+
+    Path perfFileName;
+    if (perfPath != NULL) {
+        perfFileName = resolvePath(workingDirectory, perfPath);
+        perfPath = perfFileName.str();
+
+        // The throughput is computed from the compression time of each image, that only depends on the machine when
+        // images are compressed one at a time.
+        serial = true;
+    }
+
+    Path cacheDirectory;
+    if (cachePath != NULL) {
+        cacheDirectory = resolvePath(workingDirectory, cachePath);
+        FileSystem::createDirectory(cacheDirectory.str());
+        cacheDirectory.appendSeparator('/');
+        cacheDirectory.append(set.basePath);
+        cachePath = cacheDirectory.str();
+    }
 
     FileSystem::changeDirectory(basePath.str());
     FileSystem::createDirectory(outPath);
+    if (cachePath != NULL) {
+        FileSystem::createDirectory(cachePath);
+    }
 
     //Path csvFileName;
     //csvFileName.format("%s/result-%d.csv", outPath, setIndex);
@@ -581,23 +1258,33 @@ int main(int argc, char *argv[])
     else if (errorMode == ErrorMode_AngularRMSE) {
         graphWriter << "&chtt=" << set.name << "%20-%20" << test.name << "%20-%20Angular RMSE";
     }
-    
 
 
     Timer timer;
-    //int failedTests = 0;
-    //float totalDiff = 0;
 
-    nvtt::Surface img;
+    bool failed = false;
+
+    Array<BaselineEntry> baseline;
+    if (perfPath != NULL) {
+        loadBaseline(perfPath, baseline);
+    }
 
     printf("Running Test: %s with Set: %s\n", test.name, set.name);
 
     graphWriter << "&chd=t:";
 
+    Array<ImageJob> jobs;
+
     for (int t = 0; t < test.count; t++)
     {
         float totalCompressionTime = 0;
         float totalError = 0;
+        float totalLoadTime = 0;
+        float totalDecompressionTime = 0;
+        float totalOutputTime = 0;
+        uint64 totalPixelCount = 0;
+        int failedTests = 0;
+        float totalDiff = 0;
 
         Mode mode = test.modes[t];
 
@@ -629,16 +1316,6 @@ int main(int argc, char *argv[])
         
         compressionOptions.setFormat(format);
 
-        if (set.type == ImageType_RGBA) {
-            img.setAlphaMode(nvtt::AlphaMode_Transparency);
-        }
-        else if (set.type == ImageType_Normal) { 
-            img.setNormalMap(true);
-        }
-        else if (set.type == ImageType_HDR) { // Lightmap's alpha channel is coverage.
-            img.setAlphaMode(nvtt::AlphaMode_Transparency);
-        }
-
         // Create output directory.
         Path outputFilePath;
         outputFilePath.format("%s/%s", outPath, s_modeNames[test.modes[t]]);
@@ -646,331 +1323,163 @@ int main(int argc, char *argv[])
 
 
         printf("Processing Mode: %s\n", s_modeNames[test.modes[t]]);
+
+        jobs.resize(set.fileCount);
         for (int i = 0; i < set.fileCount; i++)
         {
-            if (!img.load(set.fileNames[i]))
-            {
-                printf("Input image '%s' not found.\n", set.fileNames[i]);
-                return EXIT_FAILURE;
-            }
-
-            if (img.isNormalMap()) {
-                img.normalizeNormalMap();
-            }
-            /*if (set.type == ImageType_HDR) {
-                img.scaleBias(0, 1.0f/4.0f, 0.0f); img.clamp(0);
-                img.scaleBias(1, 1.0f/4.0f, 0.0f); img.clamp(1);
-                img.scaleBias(2, 1.0f/4.0f, 0.0f); img.clamp(2);
-                img.toGamma(2);
-            }*/
+            memset(&jobs[i], 0, sizeof(ImageJob));
+            jobs[i].fileIndex = i;
+        }
 
-            nvtt::Surface tmp = img;
-            if (mode == Mode_BC1) {
-                if (set.type == ImageType_HDR) {
-                    /*for (int i = 0; i < 3; i++) {
-                        tmp.scaleBias(i, 0.25f, 0);
-                        tmp.clamp(i);
-                    }*/
-                }
+        ModeContext ctx;
+        ctx.set = &set;
+        ctx.mode = mode;
+        ctx.format = format;
+        ctx.decoder = decoder;
+        ctx.compressionOptions = &compressionOptions;
+        ctx.errorMode = errorMode;
+        ctx.outputFilePath = &outputFilePath;
+        ctx.regressPath = regressPath;
+        ctx.cachePath = cachePath;
+        ctx.nocuda = nocuda;
+        ctx.parallel = !serial;
+        ctx.jobs = jobs.buffer();
+
+        timer.start();
+
+        if (serial) {
+            for (int i = 0; i < set.fileCount; i++) {
+                ImageJobTask(&ctx, i);
             }
-            if (mode == Mode_BC3_YCoCg) {
-                tmp.setAlphaMode(nvtt::AlphaMode_None);
-                if (set.type == ImageType_HDR) {
-                    /*for (int i = 0; i < 3; i++) {
-                        tmp.scaleBias(i, 1.0f/4.0f, 0);
-                        tmp.clamp(i);
-                    }*/
-                }
-                tmp.toYCoCg();          // Y=3, Co=0, Cg=1
-                tmp.blockScaleCoCg();   // Co=0, Cg=1, Scale=2, ScaleBits = 5
+        }
+        else {
+            ParallelFor parallelFor(ImageJobTask, &ctx);
+            parallelFor.run(set.fileCount);
+        }
 
-                tmp.scaleBias(0, 123.0f/255.0f, 123.0f/255.0f); tmp.clamp(0, 0, 246.0f/255.0f); // -1->0, 0->123, 1->246
-                tmp.scaleBias(1, 125.0f/255.0f, 125.0f/255.0f); tmp.clamp(1, 0, 250.0f/255.0f); // -1->0, 0->125, 1->250
+        timer.stop();
+        const float wallTime = timer.elapsed();
 
-                //tmp.scaleBias(0, 0.5f, 0.5f); tmp.clamp(0);
-                //tmp.scaleBias(1, 0.5f, 0.5f); tmp.clamp(1);
+        // Report the results in order.
+        for (int i = 0; i < set.fileCount; i++)
+        {
+            const ImageJob & job = jobs[i];
 
-                tmp.clamp(2);
-                tmp.clamp(3);
-            }
-            else if (mode == Mode_BC3_RGBM) {
-                tmp.setAlphaMode(nvtt::AlphaMode_None);
-                if (set.type == ImageType_HDR) {
-					// Transform to gamma-2.0 space before applying RGBM - helps a lot with banding in the darks.
-					tmp.toGamma(2.0f);
-                    tmp.toRGBM(3.0f);	// range of 3.0 in gamma-2.0 space == range of 9.0 in linear space
-                }
-                else {
-                    tmp.toRGBM();
-                }
-            }
-            else if (mode == Mode_BC3_LUVW) {
-                tmp.setAlphaMode(nvtt::AlphaMode_None);
-                if (set.type == ImageType_HDR) {
-                    tmp.toLUVW(8.0f);
-                }
-                else {
-                    tmp.toLUVW();
-                }
-            }
-            else if (mode == Mode_BC3_RGBS) {
-                //tmp.toJPEGLS();
-                //tmp.scaleBias(0, 123.0f/255.0f, 123.0f/255.0f); tmp.clamp(0, 0, 246.0f/255.0f); // -1->0, 0->123, 1->246
-                //tmp.scaleBias(2, 123.0f/255.0f, 123.0f/255.0f); tmp.clamp(0, 0, 246.0f/255.0f); // -1->0, 0->123, 1->246
-
-                // Not helping...
-                //tmp.blockLuminanceScale(0.1f);
-                /*tmp.toYCoCg();
-                tmp.scaleBias(0, 0.5, 0.5);
-                tmp.scaleBias(1, 0.5, 0.5);
-                tmp.swizzle(0, 3, 1, 4); // Co Cg 1 Y -> Co Y Cg 1
-                tmp.copyChannel(img, 3); // Restore alpha channel for weighting.*/
-            }
-            else if (mode == Mode_BC5_Normal) {
-                tmp.transformNormals(nvtt::NormalTransform_Orthographic);
-            }
-            else if (mode == Mode_BC5_Normal_Stereographic) {
-                tmp.transformNormals(nvtt::NormalTransform_Stereographic);
-            }
-            else if (mode == Mode_BC5_Normal_Paraboloid) {
-                tmp.transformNormals(nvtt::NormalTransform_Paraboloid);
-            }
-            else if (mode == Mode_BC5_Normal_Quartic) {
-                tmp.transformNormals(nvtt::NormalTransform_Quartic);
+            if (!job.loaded)
+            {
+                printf("Input image '%s' not found.\n", set.fileNames[i]);
+                return EXIT_FAILURE;
             }
-            /*else if (mode == Mode_BC5_Normal_DualParaboloid) {
-                tmp.transformNormals(nvtt::NormalTransform_DualParaboloid);
-            }*/
-
 
             printf("Compressing: \t'%s'\n", set.fileNames[i]);
+            printf("  Time:  \t%.3f sec (load %.3f, decompress %.3f, output %.3f)\n", job.compressTime, job.loadTime, job.decompressTime, job.outputTime);
 
-            timer.start();
-
-            context.compress(tmp, 0, 0, compressionOptions, outputOptions);
-
-            timer.stop();
-            printf("  Time:  \t%.3f sec\n", timer.elapsed());
-            totalCompressionTime += timer.elapsed();
-
-            nvtt::Surface img_out = outputHandler.decompress(mode, format, decoder);
-            img_out.setAlphaMode(img.alphaMode());
-            img_out.setNormalMap(img.isNormalMap());
-
-            if (mode == Mode_BC1) {
-                if (set.type == ImageType_HDR) {
-                    /*for (int i = 0; i < 3; i++) {
-                        img_out.scaleBias(i, 4.0f, 0);
-                    }*/
-                }
-            }
-            else if (mode == Mode_BC3_YCoCg) {
-                img_out.scaleBias(0, 255.0f/123, -1.0f); // 0->-1, 123->0, 246->1
-                img_out.scaleBias(1, 255.0f/125, -1.0f); // 0->-1, 125->0, 150->1
-
-                //img_out.scaleBias(0, 2.0f, -1.0f);
-                //img_out.scaleBias(1, 2.0f, -1.0f);
-                
-                img_out.fromYCoCg();
-                img_out.clamp(0);
-                img_out.clamp(1);
-                img_out.clamp(2);
-                if (set.type == ImageType_HDR) {
-                    /*for (int i = 0; i < 3; i++) {
-                        img_out.scaleBias(i, 4.0f, 0);
-                    }*/
-                }
-            }
-            else if (mode == Mode_BC3_RGBM) {
-                if (set.type == ImageType_HDR) {
-                    img_out.fromRGBM(3.0f);
-					img_out.toLinear(2.0f);
-                }
-                else {
-                    img_out.fromRGBM();
-                }
-            }
-            else if (mode == Mode_BC3_LUVW) {
-                if (set.type == ImageType_HDR) {
-                    img_out.fromLUVW(8.0f);
-                }
-                else {
-                    img_out.fromLUVW();
-                }
-            }
-            else if (mode == Mode_BC3_RGBS) {
-                //img_out.scaleBias(0, 255.0f/123, -1.0f);
-                //img_out.scaleBias(2, 255.0f/123, -1.0f);
-                //img_out.fromJPEGLS();
-                /*img_out.swizzle(0, 2, 4, 1);    // Co Y Cg 1 - > Co Cg 1 Y
-                img_out.scaleBias(0, 1.0, -0.5);
-                img_out.scaleBias(1, 1.0, -0.5);
-                img_out.fromYCoCg();*/
-            }
-            else if (mode == Mode_BC5_Normal) {
-                img_out.reconstructNormals(nvtt::NormalTransform_Orthographic);
-            }
-            else if (mode == Mode_BC5_Normal_Stereographic) {
-                img_out.reconstructNormals(nvtt::NormalTransform_Stereographic);
-            }
-            else if (mode == Mode_BC5_Normal_Paraboloid) {
-                img_out.reconstructNormals(nvtt::NormalTransform_Paraboloid);
-            }
-            else if (mode == Mode_BC5_Normal_Quartic) {
-                img_out.reconstructNormals(nvtt::NormalTransform_Quartic);
-            }
-            /*else if (mode == Mode_BC5_Normal_DualParaboloid) {
-                tmp.transformNormals(nvtt::NormalTransform_DualParaboloid);
-            }*/
-
-            nvtt::Surface diff = nvtt::diff(img, img_out, 1.0f);
-
-            //bool residualCompression = (set.type == ImageType_HDR);
-            bool residualCompression = (mode == Mode_BC3_RGBS);
-            if (residualCompression)
+            if (job.saveFailed)
             {
-                float residualScale = 8.0f;
-                nvtt::Surface residual = diff;
-                for (int j = 0; j < 3; j++) {
-                    residual.scaleBias(j, residualScale, 0.5); // @@ The residual scale is fairly arbitrary.
-                    residual.clamp(j);
-                }
-                residual.toGreyScale(1, 1, 1, 0);
-
-                /*outputFileName.format("%s/%s", outputFilePath.str(), set.fileNames[i]);
-                outputFileName.stripExtension();
-                outputFileName.append("_residual.png");
-                residual.save(outputFileName.str());*/
-
-                nvtt::CompressionOptions residualCompressionOptions;
-                residualCompressionOptions.setFormat(nvtt::Format_BC4);
-                residualCompressionOptions.setQuality(nvtt::Quality_Production);
-                
-                context.compress(residual, 0, 0, compressionOptions, outputOptions);
-
-                nvtt::Surface residual_out = outputHandler.decompress(mode, format, decoder);
+                printf("Error saving output of '%s'.\n", set.fileNames[i]);
+            }
 
-                /*outputFileName.format("%s/%s", outputFilePath.str(), set.fileNames[i]);
-                outputFileName.stripExtension();
-                outputFileName.append("_residual_out.png");
-                residual_out.save(outputFileName.str());*/
+            totalCompressionTime += job.compressTime;
+            totalLoadTime += job.loadTime;
+            totalDecompressionTime += job.decompressTime;
+            totalOutputTime += job.outputTime;
+            totalPixelCount += job.pixelCount;
 
-                residual_out.scaleBias(0, 1.0f/residualScale, -0.5f/residualScale);
-                residual_out.scaleBias(1, 1.0f/residualScale, -0.5f/residualScale);
-                residual_out.scaleBias(2, 1.0f/residualScale, -0.5f/residualScale);
+            totalError += job.error;
+            printf("  Error: \t%.4f\n", job.error);
 
-                img_out.addChannel(residual_out, 0, 0, -1.0f); img_out.clamp(0);
-                img_out.addChannel(residual_out, 1, 1, -1.0f); img_out.clamp(1);
-                img_out.addChannel(residual_out, 2, 2, -1.0f); img_out.clamp(2);
-            }
+            graphWriter << job.error;
+            if (i != set.fileCount-1) graphWriter << ",";
 
-            /*if (set.type == ImageType_HDR)
+            if (regressPath != NULL)
             {
-                Path outputFileName;
-                outputFileName.format("%s/%s", outPath, set.fileNames[i]);
-                outputFileName.stripExtension();
-                if (set.type == ImageType_HDR) outputFileName.append(".dds");
-                else outputFileName.append(".tga");
-                if (!img.save(outputFileName.str()))
+                if (!job.hasRegress)
                 {
-                    printf("Error saving file '%s'.\n", outputFileName.str());
+                    printf("  Regression image of '%s' not found.\n", set.fileNames[i]);
+                    failedTests++;
                 }
-            }*/
+                else
+                {
+                    float diff = job.regressError - job.error;
+                    totalDiff += diff;
+
+                    const char * text = "PASSED";
+                    if (equal(diff, 0)) text = "PASSED";
+                    else if (diff < 0) {
+                        text = "FAILED";
+                        failedTests++;
+                    }
 
-            // Output compressed image.
-            Path outputFileName;
-            outputFileName.format("%s/%s", outputFilePath.str(), set.fileNames[i]);
-            outputFileName.stripExtension();
-            if (set.type == ImageType_HDR) outputFileName.append(".dds");
-            else outputFileName.append(".tga");
-            if (!img_out.save(outputFileName.str(), set.type == ImageType_RGBA, set.type == ImageType_HDR))
-            {
-                printf("Error saving file '%s'.\n", outputFileName.str());
+                    printf("  Diff: \t%.4f (%s)\n", diff, text);
+                }
             }
+        }
 
-            // Output RMSE.
-            float error;
-            if (errorMode == ErrorMode_RMSE) {
-                error = nvtt::rmsError(img, img_out);
-            }
-            else if (errorMode == ErrorMode_CieLab) {
-                error = nvtt::cieLabError(img, img_out);
-            }
-            else if (errorMode == ErrorMode_AngularRMSE) {
-                error = nvtt::angularError(img, img_out);
-            }
+        fflush(stdout);
 
-            totalError += error;
-            printf("  Error: \t%.4f\n", error);
+        totalError /= set.fileCount;
 
-            graphWriter << error;
-            if (i != set.fileCount-1) graphWriter << ",";
+        const float mpixPerSecond = (totalCompressionTime > 0) ? float(totalPixelCount) / (totalCompressionTime * 1e6f) : 0.0f;
 
+        printf("Total Results:\n");
+        printf("  Total Compression Time:\t%.3f sec\n", totalCompressionTime);
+        printf("  Total Load Time:       \t%.3f sec\n", totalLoadTime);
+        printf("  Total Decompress Time: \t%.3f sec\n", totalDecompressionTime);
+        printf("  Total Output Time:     \t%.3f sec\n", totalOutputTime);
+        printf("  Wall Time:             \t%.3f sec\n", wallTime);
+        printf("  Throughput:            \t%.3f MPix/s\n", mpixPerSecond);
+        printf("  Average Error:         \t%.4f\n", totalError);
 
-            // Output diff.
-            for (int j = 0; j < 3; j++) {
-                diff.scaleBias(j, 4.0f, 0.0f); 
-                diff.abs(j);
-                diff.clamp(j);
-            }
+        if (regressPath != NULL)
+        {
+            printf("Regression Results:\n");
+            printf("  Diff: %.4f\n", totalDiff);
+            printf("  %d/%d tests failed.\n", failedTests, set.fileCount);
 
-            outputFileName.format("%s/%s", outputFilePath.str(), set.fileNames[i]);
-            outputFileName.stripExtension();
-            outputFileName.append("_diff.tga");
-            diff.save(outputFileName.str());
+            if (failedTests != 0) failed = true;
+        }
 
+        if (perfPath != NULL)
+        {
+            BaselineEntry entry;
+            baselineKey(entry.key, set.name, test.name, s_modeNames[mode]);
+            entry.mpixPerSecond = mpixPerSecond;
 
-            // Output csv file
-            //csvWriter << "\"" << fileNames[i] << "\"," << rmse << "\n";
+            BaselineEntry * stored = findBaseline(baseline, entry.key);
 
-            /*if (regressPath != NULL)
+            if (perfSave)
             {
-                Path regressFileName;
-                regressFileName.format("%s/%s", regressPath, fileNames[i]);
-                regressFileName.stripExtension();
-                regressFileName.append(".png");
-
-                nvtt::Surface img_reg;
-                if (!img_reg.load(regressFileName.str()))
-                {
-                    printf("Regression image '%s' not found.\n", regressFileName.str());
-                    return EXIT_FAILURE;
-                }
-
-                float rmse_reg = rmsError(img, img_reg);
-
-                float diff = rmse_reg - rmse;
-                totalDiff += diff;
-
-                const char * text = "PASSED";
-                if (equal(diff, 0)) text = "PASSED";
-                else if (diff < 0) {
-                    text = "FAILED";
-                    failedTests++;
-                }
+                if (stored != NULL) *stored = entry;
+                else baseline.pushBack(entry);
+            }
+            else if (stored == NULL)
+            {
+                printf("Throughput Results:\n");
+                printf("  No baseline for '%s'.\n", entry.key);
+            }
+            else
+            {
+                const float change = 100.0f * (mpixPerSecond - stored->mpixPerSecond) / stored->mpixPerSecond;
+                const bool slower = change < -perfTolerance;
 
-                printf("  Diff: \t%.4f (%s)\n", diff, text);
-            }*/
+                printf("Throughput Results:\n");
+                printf("  Baseline: %.3f MPix/s, change: %+.1f%% (%s)\n", stored->mpixPerSecond, change, slower ? "FAILED" : "PASSED");
 
-            fflush(stdout);
+                if (slower) failed = true;
+            }
         }
 
-        totalError /= set.fileCount;
-
-        printf("Total Results:\n");
-        printf("  Total Compression Time:\t%.3f sec\n", totalCompressionTime);
-        printf("  Average Error:         \t%.4f\n", totalError);
-
         if (t != test.count-1) graphWriter << "|";
     }
 
-    /*if (regressPath != NULL)
+    if (perfPath != NULL && perfSave)
     {
-        printf("Regression Results:\n");
-        printf("  Diff: %.4f\n", totalDiff);
-        printf("  %d/%d tests failed.\n", failedTests, fileCount);
-    }*/
+        if (!saveBaseline(perfPath, baseline))
+        {
+            printf("Error saving baseline '%s'.\n", perfPath);
+            return EXIT_FAILURE;
+        }
+    }
 
-    return EXIT_SUCCESS;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
-
@@ -1,5 +1,5 @@
 // Copyright NVIDIA Corporation 2007 -- Ignacio Castano <icastano@nvidia.com>
-// 
+//
 // Permission is hereby granted, free of charge, to any person
 // obtaining a copy of this software and associated documentation
 // files (the "Software"), to deal in the Software without
@@ -8,10 +8,10 @@
 // copies of the Software, and to permit persons to whom the
 // Software is furnished to do so, subject to the following
 // conditions:
-// 
+//
 // The above copyright notice and this permission notice shall be
 // included in all copies or substantial portions of the Software.
-// 
+//
 // THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
 // EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
 // OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
@@ -23,56 +23,270 @@
 
 #include <nvcore/StrLib.h>
 #include <nvcore/StdStream.h>
+#include <nvcore/Array.inl>
+#include <nvcore/Timer.h>
 
-#include <nvimage/Image.h>
-#include <nvimage/DirectDrawSurface.h>
+#include <nvthread/nvthread.h>
+#include <nvthread/ThreadPool.h>
 
 #include <nvtt/nvtt.h>
+#include <nvtt/TaskDispatcher.h> // SequentialTaskDispatcher, ParallelTaskDispatcher
 
 #include "cmdline.h"
 
-#include <time.h> // clock
+#include <math.h> // log10f
+#include <stdio.h> // fopen
 
 
+struct FormatDesc
+{
+	const char * name;
+	nvtt::Format format;
+	nvtt::Format decodeFormat;  // Format_RGB when there's no decoder.
+};
+
+static const FormatDesc s_formats[] = {
+	{ "rgb",  nvtt::Format_RGB,  nvtt::Format_RGB },
+	{ "bc1",  nvtt::Format_BC1,  nvtt::Format_BC1 },
+	{ "bc1a", nvtt::Format_BC1a, nvtt::Format_BC1 },
+	{ "bc2",  nvtt::Format_BC2,  nvtt::Format_BC2 },
+	{ "bc3",  nvtt::Format_BC3,  nvtt::Format_BC3 },
+	{ "bc3n", nvtt::Format_BC3n, nvtt::Format_BC3 },
+	{ "bc4",  nvtt::Format_BC4,  nvtt::Format_BC4 },
+	{ "bc5",  nvtt::Format_BC5,  nvtt::Format_BC5 },
+	{ "bc6",  nvtt::Format_BC6,  nvtt::Format_BC6 },
+	{ "bc7",  nvtt::Format_BC7,  nvtt::Format_BC7 },
+};
+static const int s_formatCount = sizeof(s_formats) / sizeof(s_formats[0]);
+
+struct QualityDesc
+{
+	const char * name;
+	nvtt::Quality quality;
+};
+
+static const QualityDesc s_qualities[] = {
+	{ "fastest",    nvtt::Quality_Fastest },
+	{ "normal",     nvtt::Quality_Normal },
+	{ "production", nvtt::Quality_Production },
+	{ "highest",    nvtt::Quality_Highest },
+};
+static const int s_qualityCount = sizeof(s_qualities) / sizeof(s_qualities[0]);
+
+enum DispatcherType
+{
+	Dispatcher_Default,     // The concurrent dispatcher of the context.
+	Dispatcher_Sequential,
+	Dispatcher_Threads,     // Thread pool with a fixed number of threads, see -threads.
+};
+
+static const char * s_dispatcherNames[] = { "default", "sequential", "threads" };
+
+
+// Counts the compressed bytes and optionally keeps the top level for error measurements.
+struct BenchmarkOutputHandler : public nvtt::OutputHandler
+{
+	BenchmarkOutputHandler() : size(0), capture(false), width(0), height(0), level(-1) {}
+
+	virtual void beginImage(int size, int width, int height, int depth, int face, int miplevel)
+	{
+		level = miplevel;
+		if (capture && miplevel == 0) {
+			this->width = width;
+			this->height = height;
+			data.clear();
+			data.reserve(size);
+		}
+	}
+
+	virtual bool writeData(const void * ptr, int size)
+	{
+		this->size += size;
+		if (capture && level == 0) {
+			data.append((const uint8 *)ptr, size);
+		}
+		return true;
+	}
+
+	virtual void endImage()
+	{
+	}
+
+	uint64 size;
+	bool capture;
+	int width, height, level;
+	nv::Array<uint8> data;
+};
+
 struct MyErrorHandler : public nvtt::ErrorHandler
 {
 	virtual void error(nvtt::Error e)
 	{
-		nvDebugBreak();
+		fprintf(stderr, "Error: '%s'\n", nvtt::errorString(e));
 	}
 };
 
 
-// Set color to normal map conversion options.
-void setColorToNormalMap(nvtt::InputOptions & inputOptions)
+struct Result
 {
-	inputOptions.setNormalMap(false);
-	inputOptions.setConvertToNormalMap(true);
-	inputOptions.setHeightEvaluation(1.0f/3.0f, 1.0f/3.0f, 1.0f/3.0f, 0.0f);
-	//inputOptions.setNormalFilter(1.0f, 0, 0, 0);
-	//inputOptions.setNormalFilter(0.0f, 0, 0, 1);
-	inputOptions.setGamma(1.0f, 1.0f);
-	inputOptions.setNormalizeMipmaps(true);
+	uint file;
+	int format;
+	int quality;
+	DispatcherType dispatcher;
+	uint threadCount;
+
+	uint64 pixelCount;      // Per iteration.
+	uint64 blockCount;
+	uint64 outputSize;
+
+	float minTime;
+	float medianTime;
+	float psnr;             // Top level, negative when it can't be measured.
+	float efficiency;       // Scaling efficiency relative to the smallest thread count, 0 if not applicable.
+};
+
+
+// Parse a comma separated list of names. Returns false if a name is not in the table.
+static bool parseNameList(const char * list, const char * const * names, int nameStride, int nameCount, nv::Array<int> & indices)
+{
+	indices.clear();
+
+	const char * ptr = list;
+	while (*ptr != '\0') {
+		const char * end = strchr(ptr, ',');
+		uint length = end ? uint(end - ptr) : uint(strlen(ptr));
+
+		int index = -1;
+		for (int i = 0; i < nameCount; i++) {
+			const char * name = *(const char * const *)((const char *)names + i * nameStride);
+			if (strlen(name) == length && strncmp(name, ptr, length) == 0) {
+				index = i;
+				break;
+			}
+		}
+		if (index < 0) {
+			fprintf(stderr, "Unknown value '%.*s' in '%s'.\n", int(length), ptr, list);
+			return false;
+		}
+		indices.pushBack(index);
+
+		ptr += length;
+		if (*ptr == ',') ptr++;
+	}
+
+	return indices.count() != 0;
 }
 
-// Set options for normal maps.
-void setNormalMap(nvtt::InputOptions & inputOptions)
+static bool parseNumberList(const char * list, nv::Array<uint> & numbers)
 {
-	inputOptions.setNormalMap(true);
-	inputOptions.setConvertToNormalMap(false);
-	inputOptions.setGamma(1.0f, 1.0f);
-	inputOptions.setNormalizeMipmaps(true);
+	numbers.clear();
+
+	const char * ptr = list;
+	while (*ptr != '\0') {
+		char * end;
+		long n = strtol(ptr, &end, 10);
+		if (end == ptr || n <= 0) {
+			fprintf(stderr, "Invalid number list '%s'.\n", list);
+			return false;
+		}
+		numbers.pushBack(uint(n));
+
+		ptr = end;
+		if (*ptr == ',') ptr++;
+	}
+
+	return numbers.count() != 0;
 }
 
-// Set options for color maps.
-void setColorMap(nvtt::InputOptions & inputOptions)
+// Read one file name per line. Empty lines and lines starting with '#' are ignored.
+static bool readFileList(const char * fileName, nv::Array<nv::Path> & files)
 {
-	inputOptions.setNormalMap(false);
-	inputOptions.setConvertToNormalMap(false);
-	inputOptions.setGamma(2.2f, 2.2f);
-	inputOptions.setNormalizeMipmaps(false);
+	FILE * fp = fopen(fileName, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "Cannot open '%s'.\n", fileName);
+		return false;
+	}
+
+	char line[1024];
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		uint length = uint(strlen(line));
+		while (length > 0 && (line[length-1] == '\n' || line[length-1] == '\r' || line[length-1] == ' ')) {
+			line[--length] = '\0';
+		}
+		if (length == 0 || line[0] == '#') continue;
+
+		files.pushBack(nv::Path(line));
+	}
+
+	fclose(fp);
+	return true;
 }
 
+static void sortTimes(nv::Array<float> & times)
+{
+	for (uint i = 1; i < times.count(); i++) {
+		for (uint j = i; j > 0 && times[j] < times[j-1]; j--) {
+			nv::swap(times[j], times[j-1]);
+		}
+	}
+}
+
+static void writeJsonString(FILE * fp, const char * str)
+{
+	fputc('"', fp);
+	for (const char * ptr = str; *ptr != '\0'; ptr++) {
+		if (*ptr == '"' || *ptr == '\\') fputc('\\', fp);
+		fputc(*ptr, fp);
+	}
+	fputc('"', fp);
+}
+
+static bool writeJson(const char * fileName, const nv::Array<nv::Path> & files, const nv::Array<Result> & results, int warmupCount, int repeatCount, bool mipmaps)
+{
+	FILE * fp = fopen(fileName, "w");
+	if (fp == NULL) {
+		fprintf(stderr, "Cannot open '%s' for writing.\n", fileName);
+		return false;
+	}
+
+	const uint version = nvtt::version();
+
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"version\": \"%u.%u.%u\",\n", version / 10000, (version / 100) % 100, version % 100);
+	fprintf(fp, "  \"platform\": \"%s/%s/%s\",\n", NV_OS_STRING, NV_CC_STRING, NV_CPU_STRING);
+	fprintf(fp, "  \"hardwareThreads\": %u,\n", nv::hardwareThreadCount());
+	fprintf(fp, "  \"warmup\": %d,\n", warmupCount);
+	fprintf(fp, "  \"repeat\": %d,\n", repeatCount);
+	fprintf(fp, "  \"mipmaps\": %s,\n", mipmaps ? "true" : "false");
+	fprintf(fp, "  \"results\": [\n");
+
+	for (uint i = 0; i < results.count(); i++)
+	{
+		const Result & r = results[i];
+
+		fprintf(fp, "    { \"file\": ");
+		writeJsonString(fp, files[r.file].str());
+		fprintf(fp, ", \"format\": \"%s\", \"quality\": \"%s\", \"dispatcher\": \"%s\", \"threads\": %u, ",
+			s_formats[r.format].name, s_qualities[r.quality].name, s_dispatcherNames[r.dispatcher], r.threadCount);
+		fprintf(fp, "\"pixels\": %llu, \"blocks\": %llu, \"bytes\": %llu, ", (unsigned long long)r.pixelCount, (unsigned long long)r.blockCount, (unsigned long long)r.outputSize);
+		fprintf(fp, "\"minTime\": %.6f, \"medianTime\": %.6f, ", r.minTime, r.medianTime);
+		fprintf(fp, "\"mpixPerSecond\": %.3f, \"blocksPerSecond\": %.0f, ", r.pixelCount / (r.medianTime * 1e6), r.blockCount / r.medianTime);
+
+		if (r.psnr >= 0) fprintf(fp, "\"psnr\": %.4f, ", r.psnr);
+		else fprintf(fp, "\"psnr\": null, ");
+
+		if (r.efficiency > 0) fprintf(fp, "\"efficiency\": %.3f }", r.efficiency);
+		else fprintf(fp, "\"efficiency\": null }");
+
+		fprintf(fp, "%s\n", i + 1 < results.count() ? "," : "");
+	}
+
+	fprintf(fp, "  ]\n");
+	fprintf(fp, "}\n");
+
+	fclose(fp);
+	return true;
+}
 
 
 int main(int argc, char *argv[])
@@ -80,295 +294,300 @@ int main(int argc, char *argv[])
 	MyAssertHandler assertHandler;
 	MyMessageHandler messageHandler;
 
-	bool normal = false;
-	bool color2normal = false;
-	bool wrapRepeat = false;
-	bool noMipmaps = false;
-	bool fast = false;
-	bool nocuda = false;
+	const char * formatList = "bc1,bc1a,bc2,bc3,bc3n,bc4,bc5,bc6,bc7";
+	const char * qualityList = "fastest,normal";
+	const char * dispatcherList = "threads";
+	const char * threadList = NULL;
+	const char * jsonFileName = NULL;
+	int warmupCount = 1;
+	int repeatCount = 5;
+	bool mipmaps = false;
 	bool silent = false;
-	nvtt::Format format = nvtt::Format_BC1;
-
-	const char * externalCompressor = NULL;
-
-	nv::Path input;
-	nv::Path output;
 
+	nv::Array<nv::Path> files;
 
 	// Parse arguments.
 	for (int i = 1; i < argc; i++)
 	{
-		// Input options.
-		if (strcmp("-color", argv[i]) == 0)
-		{
-		}
-		else if (strcmp("-normal", argv[i]) == 0)
-		{
-			normal = true;
-		}
-		else if (strcmp("-tonormal", argv[i]) == 0)
+		if (strcmp("-formats", argv[i]) == 0 && i+1 < argc)
 		{
-			color2normal = true;
+			formatList = argv[++i];
 		}
-		else if (strcmp("-clamp", argv[i]) == 0)
+		else if (strcmp("-qualities", argv[i]) == 0 && i+1 < argc)
 		{
+			qualityList = argv[++i];
 		}
-		else if (strcmp("-repeat", argv[i]) == 0)
+		else if (strcmp("-dispatchers", argv[i]) == 0 && i+1 < argc)
 		{
-			wrapRepeat = true;
+			dispatcherList = argv[++i];
 		}
-		else if (strcmp("-nomips", argv[i]) == 0)
+		else if (strcmp("-threads", argv[i]) == 0 && i+1 < argc)
 		{
-			noMipmaps = true;
+			threadList = argv[++i];
 		}
-
-		// Compression options.
-		else if (strcmp("-fast", argv[i]) == 0)
+		else if (strcmp("-warmup", argv[i]) == 0 && i+1 < argc)
 		{
-			fast = true;
+			warmupCount = nv::max(0, atoi(argv[++i]));
 		}
-		else if (strcmp("-nocuda", argv[i]) == 0)
+		else if (strcmp("-repeat", argv[i]) == 0 && i+1 < argc)
 		{
-			nocuda = true;
+			repeatCount = nv::max(1, atoi(argv[++i]));
 		}
-		else if (strcmp("-rgb", argv[i]) == 0)
+		else if (strcmp("-mips", argv[i]) == 0)
 		{
-			format = nvtt::Format_RGB;
+			mipmaps = true;
 		}
-		else if (strcmp("-bc1", argv[i]) == 0)
+		else if (strcmp("-list", argv[i]) == 0 && i+1 < argc)
 		{
-			format = nvtt::Format_BC1;
+			if (!readFileList(argv[++i], files)) return 1;
 		}
-		else if (strcmp("-bc1a", argv[i]) == 0)
+		else if (strcmp("-json", argv[i]) == 0 && i+1 < argc)
 		{
-			format = nvtt::Format_BC1a;
+			jsonFileName = argv[++i];
 		}
-		else if (strcmp("-bc2", argv[i]) == 0)
-		{
-			format = nvtt::Format_BC2;
-		}
-		else if (strcmp("-bc3", argv[i]) == 0)
-		{
-			format = nvtt::Format_BC3;
-		}
-		else if (strcmp("-bc3n", argv[i]) == 0)
+		else if (strcmp("-silent", argv[i]) == 0)
 		{
-			format = nvtt::Format_BC3n;
+			silent = true;
 		}
-		else if (strcmp("-bc4", argv[i]) == 0)
+		else if (argv[i][0] != '-')
 		{
-			format = nvtt::Format_BC4;
+			files.pushBack(nv::Path(argv[i]));
 		}
-		else if (strcmp("-bc5", argv[i]) == 0)
+		else
 		{
-			format = nvtt::Format_BC5;
+			printf("Warning: unrecognized option \"%s\"\n", argv[i]);
 		}
+	}
 
-		// Undocumented option. Mainly used for testing.
-		else if (strcmp("-ext", argv[i]) == 0)
-		{
-			if (i+1 < argc && argv[i+1][0] != '-') {
-				externalCompressor = argv[i+1];
-				i++;
-			}
-		}
+	if (!silent)
+	{
+		printf("NVIDIA Texture Tools - Copyright NVIDIA Corporation 2007\n\n");
+	}
 
-		// Misc options
-		else if (strcmp("-silent", argv[i]) == 0)
-		{
-			silent = true;
-		}
+	if (files.isEmpty())
+	{
+		printf("usage: nvtt-benchmark [options] infile [infile ...]\n\n");
 
-		else if (argv[i][0] != '-')
-		{
-			input = argv[i];
+		printf("Input options:\n");
+		printf("  -list <file>        \tRead input file names from a file, one per line.\n");
+		printf("  -mips               \tCompress the whole mipmap chain, not only the top level.\n\n");
 
-			if (i+1 < argc && argv[i+1][0] != '-') {
-				output = argv[i+1];
-			}
-			else
-			{
-				output.copy(input.str());
-				output.stripExtension();
-				output.append(".dds");
-			}
+		printf("Sweep options:\n");
+		printf("  -formats <list>     \tFormats: rgb, bc1, bc1a, bc2, bc3, bc3n, bc4, bc5, bc6, bc7 (default: all bc formats).\n");
+		printf("  -qualities <list>   \tQualities: fastest, normal, production, highest (default: fastest,normal).\n");
+		printf("  -dispatchers <list> \tDispatchers: default, sequential, threads (default: threads).\n");
+		printf("  -threads <list>     \tThread counts of the threads dispatcher (default: 1 and all hardware threads).\n\n");
 
-			break;
-		}
+		printf("Measurement options:\n");
+		printf("  -warmup <n>         \tUntimed iterations (default: 1).\n");
+		printf("  -repeat <n>         \tTimed iterations, the median is reported (default: 5).\n\n");
+
+		printf("Output options:\n");
+		printf("  -json <file>        \tWrite the results in JSON format.\n");
+		printf("  -silent             \tOnly print the results.\n\n");
+
+		return 1;
 	}
 
-	printf("NVIDIA Texture Tools - Copyright NVIDIA Corporation 2007\n\n");
+	nv::Array<int> formats, qualities, dispatchers;
+	if (!parseNameList(formatList, &s_formats[0].name, sizeof(FormatDesc), s_formatCount, formats)) return 1;
+	if (!parseNameList(qualityList, &s_qualities[0].name, sizeof(QualityDesc), s_qualityCount, qualities)) return 1;
+	if (!parseNameList(dispatcherList, s_dispatcherNames, sizeof(const char *), 3, dispatchers)) return 1;
 
-	if (input.isNull())
+	nv::Array<uint> threadCounts;
+	if (threadList != NULL)
 	{
-		printf("usage: nvttbenchmark [options] infile [outfile]\n\n");
-		
-		printf("Input options:\n");
-		printf("  -color   \tThe input image is a color map (default).\n");
-		printf("  -normal  \tThe input image is a normal map.\n");
-		printf("  -tonormal\tConvert input to normal map.\n");
-		printf("  -clamp   \tClamp wrapping mode (default).\n");
-		printf("  -repeat  \tRepeat wrapping mode.\n");
-		printf("  -nomips  \tDisable mipmap generation.\n\n");
-
-		printf("Compression options:\n");
-		printf("  -fast    \tFast compression.\n");
-		printf("  -nocuda  \tDo not use cuda compressor.\n");
-		printf("  -rgb     \tRGBA format\n");
-		printf("  -bc1     \tBC1 format (DXT1)\n");
-		printf("  -bc1a    \tBC1 format with binary alpha (DXT1a)\n");
-		printf("  -bc2     \tBC2 format (DXT3)\n");
-		printf("  -bc3     \tBC3 format (DXT5)\n");
-		printf("  -bc3n    \tBC3 normal map format (DXT5nm)\n");
-		printf("  -bc4     \tBC4 format (ATI1)\n");
-		printf("  -bc5     \tBC5 format (3Dc/ATI2)\n\n");
-		
-		return 1;
+		if (!parseNumberList(threadList, threadCounts)) return 1;
 	}
+	else
+	{
+		threadCounts.pushBack(1);
+		if (nv::hardwareThreadCount() > 1) threadCounts.pushBack(nv::hardwareThreadCount());
+	}
+
+	nvtt::Context context;
+	context.enableCudaAcceleration(false);
 
-	// @@ Make sure input file exists.
-	
-	// Set input options.
-	nvtt::InputOptions inputOptions;
-	
-	if (nv::strCaseCmp(input.extension(), ".dds") == 0)
+	MyErrorHandler errorHandler;
+	BenchmarkOutputHandler outputHandler;
+
+	nvtt::OutputOptions outputOptions;
+	outputOptions.setOutputHandler(&outputHandler);
+	outputOptions.setErrorHandler(&errorHandler);
+
+	nvtt::SequentialTaskDispatcher sequentialDispatcher;
+
+	// The pools are created up front, so that thread creation is not timed.
+	nv::Array<nv::ThreadPool *> threadPools;
+	if (dispatchers.contains(Dispatcher_Threads))
 	{
-		// Load surface.
-		nv::DirectDrawSurface dds(input);
-		if (!dds.isValid())
+		for (uint i = 0; i < threadCounts.count(); i++)
 		{
-			fprintf(stderr, "The file '%s' is not a valid DDS file.\n", input.str());
-			return 1;
+			threadPools.pushBack(new nv::ThreadPool(threadCounts[i]));
 		}
-		
-		if (!dds.isSupported() || dds.isTexture3D())
+	}
+
+	nv::Array<Result> results;
+	nv::Array<float> times;
+
+	if (!silent)
+	{
+		printf("%-32s %-5s %-10s %-10s %7s %10s %10s %12s %8s %6s\n", "File", "Fmt", "Quality", "Dispatcher", "Threads", "Time (ms)", "MPix/s", "Blocks/s", "PSNR", "Eff.");
+	}
+
+	for (uint f = 0; f < files.count(); f++)
+	{
+		bool hasAlpha = false;
+		nvtt::Surface image;
+		if (!image.load(files[f].str(), &hasAlpha))
 		{
-			fprintf(stderr, "The file '%s' is not a supported DDS file.\n", input.str());
+			fprintf(stderr, "The file '%s' is not a supported image type.\n", files[f].str());
+			nv::deleteAll(threadPools);
 			return 1;
 		}
-		
-		uint faceCount;
-		if (dds.isTexture2D())
+		image.setAlphaMode(hasAlpha ? nvtt::AlphaMode_Transparency : nvtt::AlphaMode_None);
+
+		// Build the mipmap chain up front, only compression is timed.
+		const int levelCount = mipmaps ? image.countMipmaps() : 1;
+		nvtt::Surface * levels = new nvtt::Surface[levelCount];
+		levels[0] = image;
+		for (int m = 1; m < levelCount; m++)
 		{
-			inputOptions.setTextureLayout(nvtt::TextureType_2D, dds.width(), dds.height());
-			faceCount = 1;
+			levels[m] = levels[m-1];
+			levels[m].buildNextMipmap(nvtt::MipmapFilter_Box);
 		}
-		else 
+
+		uint64 pixelCount = 0, blockCount = 0;
+		for (int m = 0; m < levelCount; m++)
 		{
-			nvDebugCheck(dds.isTextureCube());
-			inputOptions.setTextureLayout(nvtt::TextureType_Cube, dds.width(), dds.height());
-			faceCount = 6;
+			pixelCount += uint64(levels[m].width()) * levels[m].height();
+			blockCount += uint64((levels[m].width() + 3) / 4) * ((levels[m].height() + 3) / 4);
 		}
-		
-		uint mipmapCount = dds.mipmapCount();
-		
-		nv::Image mipmap;
-		
-		for (uint f = 0; f < faceCount; f++)
+
+		for (uint fi = 0; fi < formats.count(); fi++)
 		{
-			for (uint m = 0; m <= mipmapCount; m++)
+			const FormatDesc & format = s_formats[formats[fi]];
+
+			for (uint qi = 0; qi < qualities.count(); qi++)
 			{
-				dds.mipmap(&mipmap, f, m);
-				
-				inputOptions.setMipmapData(mipmap.pixels(), mipmap.width(), mipmap.height(), 1, f, m);
+				nvtt::CompressionOptions compressionOptions;
+				compressionOptions.setFormat(format.format);
+				compressionOptions.setQuality(s_qualities[qualities[qi]].quality);
+
+				float psnr = -1.0f;
+				bool measuredError = false;
+
+				for (uint di = 0; di < dispatchers.count(); di++)
+				{
+					const DispatcherType dispatcherType = DispatcherType(dispatchers[di]);
+					const uint configCount = (dispatcherType == Dispatcher_Threads) ? threadCounts.count() : 1;
+
+					float baseThroughput = 0.0f;
+					uint baseThreadCount = 0;
+
+					for (uint ti = 0; ti < configCount; ti++)
+					{
+						nvtt::ParallelTaskDispatcher threadDispatcher(dispatcherType == Dispatcher_Threads ? threadPools[ti] : NULL);
+
+						uint threadCount = 1;
+						if (dispatcherType == Dispatcher_Default)
+						{
+							context.setTaskDispatcher(NULL);
+							threadCount = nv::hardwareThreadCount();
+						}
+						else if (dispatcherType == Dispatcher_Sequential)
+						{
+							context.setTaskDispatcher(&sequentialDispatcher);
+						}
+						else
+						{
+							context.setTaskDispatcher(&threadDispatcher);
+							threadCount = threadCounts[ti];
+						}
+
+						times.clear();
+						for (int i = 0; i < warmupCount + repeatCount; i++)
+						{
+							outputHandler.size = 0;
+							outputHandler.capture = !measuredError && i == 0;
+
+							nv::Timer timer;
+							timer.start();
+
+							for (int m = 0; m < levelCount; m++)
+							{
+								context.compress(levels[m], 0, m, compressionOptions, outputOptions);
+							}
+
+							timer.stop();
+
+							if (i >= warmupCount) times.pushBack(timer.elapsed());
+
+							if (outputHandler.capture)
+							{
+								measuredError = true;
+
+								if (format.decodeFormat != nvtt::Format_RGB)
+								{
+									nvtt::Surface decoded;
+									if (decoded.setImage2D(format.decodeFormat, nvtt::Decoder_D3D10, outputHandler.width, outputHandler.height, outputHandler.data.buffer()))
+									{
+										float rmse = nvtt::rmsError(image, decoded);
+										psnr = (rmse > 0) ? 20.0f * log10f(1.0f / rmse) : 99.0f;
+									}
+								}
+							}
+						}
+
+						sortTimes(times);
+
+						Result result;
+						result.file = f;
+						result.format = formats[fi];
+						result.quality = qualities[qi];
+						result.dispatcher = dispatcherType;
+						result.threadCount = threadCount;
+						result.pixelCount = pixelCount;
+						result.blockCount = blockCount;
+						result.outputSize = outputHandler.size;
+						result.minTime = times[0];
+						result.medianTime = times[times.count() / 2];
+						result.psnr = psnr;
+						result.efficiency = 0.0f;
+
+						// Efficiency is the speedup over the first thread count divided by the ratio of thread counts.
+						if (dispatcherType == Dispatcher_Threads)
+						{
+							const float throughput = float(pixelCount) / nv::max(result.medianTime, 1e-9f);
+							if (ti == 0)
+							{
+								baseThroughput = throughput;
+								baseThreadCount = threadCount;
+							}
+							result.efficiency = (throughput / baseThroughput) * float(baseThreadCount) / float(threadCount);
+						}
+
+						results.pushBack(result);
+
+						printf("%-32s %-5s %-10s %-10s %7u %10.2f %10.2f %12.0f ", files[f].fileName(), format.name, s_qualities[result.quality].name,
+							s_dispatcherNames[dispatcherType], threadCount, result.medianTime * 1000.0f, pixelCount / (result.medianTime * 1e6f), blockCount / result.medianTime);
+						if (psnr >= 0) printf("%8.3f ", psnr); else printf("%8s ", "-");
+						if (result.efficiency > 0) printf("%6.2f\n", result.efficiency); else printf("%6s\n", "-");
+						fflush(stdout);
+					}
+				}
 			}
 		}
-	}
-	else
-	{
-		// Regular image.
-		nv::Image image;
-		if (!image.load(input))
-		{
-			fprintf(stderr, "The file '%s' is not a supported image type.\n", input.str());
-			return 1;
-		}
-		
-		inputOptions.setTextureLayout(nvtt::TextureType_2D, image.width(), image.height());
-		inputOptions.setMipmapData(image.pixels(), image.width(), image.height());
-	}
 
-	if (fast)
-	{
-		inputOptions.setMipmapping(true, nvtt::MipmapFilter_Box);
-	}
-	else
-	{
-		inputOptions.setMipmapping(true, nvtt::MipmapFilter_Box);
-		//inputOptions.setMipmapping(true, nvtt::MipmapFilter_Kaiser);
+		delete [] levels;
 	}
 
-	if (wrapRepeat)
-	{
-		inputOptions.setWrapMode(nvtt::WrapMode_Repeat);
-	}
-	else
-	{
-		inputOptions.setWrapMode(nvtt::WrapMode_Clamp);
-	}
-
-	if (normal)
-	{
-		setNormalMap(inputOptions);
-	}
-	else if (color2normal)
-	{
-		setColorToNormalMap(inputOptions);
-	}
-	else
-	{
-		setColorMap(inputOptions);
-	}
-	
-	if (noMipmaps)
-	{
-		inputOptions.setMipmapping(false);
-	}
-	
-
-	nvtt::CompressionOptions compressionOptions;
-	compressionOptions.setFormat(format);
-	if (fast)
-	{
-		compressionOptions.setQuality(nvtt::Quality_Fastest);
-	}
-	else
-	{
-		compressionOptions.setQuality(nvtt::Quality_Normal);
-		//compressionOptions.setQuality(nvtt::Quality_Production, 0.5f);
-		//compressionOptions.setQuality(nvtt::Quality_Highest);
-	}
-	compressionOptions.enableHardwareCompression(!nocuda);
-	compressionOptions.setColorWeights(1, 1, 1);
+	nv::deleteAll(threadPools);
 
-	if (externalCompressor != NULL)
+	if (jsonFileName != NULL)
 	{
-		compressionOptions.setExternalCompressor(externalCompressor);
-	}	
-	
-	
-	MyErrorHandler errorHandler;
-	nvtt::OutputOptions outputOptions(NULL, &errorHandler);
-	
-//	printf("Press ENTER.\n");
-//	fflush(stdout);
-//	getchar();
-
-	clock_t start = clock();
-	
-	const int iterationCount = 20;
-	for (int i = 0; i < iterationCount; i++)
-	{
-		nvtt::compress(inputOptions, outputOptions, compressionOptions);
+		if (!writeJson(jsonFileName, files, results, warmupCount, repeatCount, mipmaps)) return 1;
 	}
 
-	clock_t end = clock();
-	
-	float seconds = float(end-start) / CLOCKS_PER_SEC
-	printf("total time taken: %.3f seconds\n", seconds);
-	printf("time taken per texture: %.3f seconds\n", seconds / iterationCount);
-	printf("textures per second: %.3f T/s\n", iterationCount / seconds);
-	
 	return 0;
 }
-
@@ -22,6 +22,7 @@
 // OTHER DEALINGS IN THE SOFTWARE.
 
 #include "cmdline.h"
+#include "compressoptions.h"
 
 #include <nvtt/nvtt.h>
 
@@ -35,6 +36,16 @@
 #include <nvcore/StdStream.h>
 #include <nvcore/FileSystem.h>
 #include <nvcore/Timer.h>
+#include <nvcore/Profiler.h>
+#include <nvcore/Array.inl>
+
+#include <nvthread/nvthread.h> // parseProcessorList
+#include <nvthread/Thread.h>
+#include <nvthread/ThreadPool.h> // ThreadPoolScope
+#include <nvthread/Event.h>
+#include <nvthread/Atomic.h>
+
+#include <string.h> // strpbrk
 
 
 struct MyOutputHandler : public nvtt::OutputHandler
@@ -102,181 +113,465 @@ struct MyErrorHandler : public nvtt::ErrorHandler
 
 
 
-// Set color to normal map conversion options.
-void setColorToNormalMap(nvtt::InputOptions & inputOptions)
+// Print per stage timings, block throughput and thread utilization.
+void printTimingStats(const nvtt::Context & context)
 {
-    inputOptions.setNormalMap(false);
-    inputOptions.setConvertToNormalMap(true);
-    inputOptions.setHeightEvaluation(1.0f/3.0f, 1.0f/3.0f, 1.0f/3.0f, 0.0f);
-    //inputOptions.setNormalFilter(1.0f, 0, 0, 0);
-    //inputOptions.setNormalFilter(0.0f, 0, 0, 1);
-    inputOptions.setGamma(1.0f, 1.0f);
-    inputOptions.setNormalizeMipmaps(true);
+    const float elapsed = context.timingStatsElapsedTime();
+
+    printf("\n%-20s %8s %10s %10s %12s %14s\n", "Stage", "Calls", "Total (s)", "Self (s)", "Items", "Items/s");
+
+    const int stageCount = context.timingStageCount();
+    for (int i = 0; i < stageCount; i++)
+    {
+        nvtt::StageStats stats;
+        if (!context.getTimingStage(i, &stats) || stats.callCount == 0) continue;
+
+        printf("%-20s %8llu %10.3f %10.3f", stats.name, stats.callCount, stats.totalTime, stats.selfTime);
+        if (stats.itemCount != 0 && stats.totalTime > 0) {
+            printf(" %12llu %14.0f\n", stats.itemCount, double(stats.itemCount) / stats.totalTime);
+        }
+        else {
+            printf("\n");
+        }
+    }
+
+    printf("\n%-20s %10s %8s\n", "Thread", "Busy (s)", "Usage");
+
+    const int threadCount = context.timingThreadCount();
+    for (int i = 0; i < threadCount; i++)
+    {
+        const float busy = context.timingThreadBusyTime(i);
+        printf("%-20d %10.3f %7.1f%%\n", i, busy, elapsed > 0 ? 100.0f * busy / elapsed : 0.0f);
+    }
+
+    printf("\nelapsed: %.3f seconds\n", elapsed);
 }
 
-// Set options for normal maps.
-void setNormalMap(nvtt::InputOptions & inputOptions)
+// Print how many blocks each quality tier of the adaptive mode encoded.
+void printAdaptiveStats(const nvtt::Context & context)
 {
-    inputOptions.setNormalMap(true);
-    inputOptions.setConvertToNormalMap(false);
-    inputOptions.setGamma(1.0f, 1.0f);
-    inputOptions.setNormalizeMipmaps(true);
+    nvtt::AdaptiveQualityStats stats;
+    context.getAdaptiveQualityStats(&stats);
+
+    unsigned long long total = 0;
+    for (int i = 0; i < 4; i++) total += stats.blockCount[i];
+    if (total == 0) return;
+
+    static const char * const tierNames[4] = { "Fastest", "Normal", "Production", "Highest" };
+
+    printf("\n%-20s %12s %8s\n", "Quality", "Blocks", "Share");
+    for (int i = 0; i < 4; i++)
+    {
+        if (stats.blockCount[i] == 0) continue;
+        printf("%-20s %12llu %7.1f%%\n", tierNames[i], stats.blockCount[i], 100.0 * double(stats.blockCount[i]) / double(total));
+    }
 }
 
-// Set options for color maps.
-void setColorMap(nvtt::InputOptions & inputOptions)
+
+// Multi-file mode. Files go through three stages: a loader thread decodes the inputs, the main thread compresses them
+// on the context's thread pool, and a writer thread writes the outputs. Each stage processes the files in order.
+struct BatchJob
 {
-    inputOptions.setNormalMap(false);
-    inputOptions.setConvertToNormalMap(false);
-    inputOptions.setGamma(2.2f, 2.2f);
-    inputOptions.setNormalizeMipmaps(false);
-}
+    nv::Path input;
+    nv::Path output;
+    Options options;
 
+    nvtt::InputOptions * inputOptions;  // Set by the loader, NULL if loading failed.
+    MemoryOutputHandler outputHandler;
+    bool compressed;
 
+    nv::Event loadEvent;
+    nv::Event compressEvent;
+};
 
-int main(int argc, char *argv[])
+struct Batch
 {
-    MyAssertHandler assertHandler;
-    MyMessageHandler messageHandler;
+    Batch() : jobCount(0), silent(false), stats(false), serialLoad(false), failedCount(0) {}
 
-    bool alpha = false;
-    bool normal = false;
-    bool color2normal = false;
-    bool wrapRepeat = false;
-    bool noMipmaps = false;
-    bool fast = false;
-    bool nocuda = false;
-    bool bc1n = false;
-    bool luminance = false;
-    nvtt::Format format = nvtt::Format_BC1;
-    bool premultiplyAlpha = false;
-    nvtt::MipmapFilter mipmapFilter = nvtt::MipmapFilter_Box;
-    bool loadAsFloat = false;
+    BatchJob ** jobs;
+    uint jobCount;
+    bool silent;
+    bool stats;
+    bool serialLoad;
 
-    const char * externalCompressor = NULL;
+    // Files in flight are limited to bound memory use.
+    static const uint maxInFlight = 4;
+    nv::Atomic<uint> writtenCount;
+    nv::Event writtenEvent;
 
-    bool silent = false;
-    bool dds10 = false;
+    uint failedCount;   // Only updated by the writer.
+};
 
-    nv::Path input;
-    nv::Path output;
+static void batchLoader(void * arg)
+{
+    Batch * batch = (Batch *)arg;
 
+    nv::ThreadPoolScope scope(NULL, batch->serialLoad);
 
-    // Parse arguments.
-    for (int i = 1; i < argc; i++)
+    const int loadZone = nv::profilerZone("Load");
+
+    for (uint i = 0; i < batch->jobCount; i++)
     {
-        // Input options.
-        if (strcmp("-color", argv[i]) == 0)
-        {
-        }
-        else if (strcmp("-alpha", argv[i]) == 0)
-        {
-            alpha = true;
+        while (i >= batch->writtenCount.loadAcquire() + Batch::maxInFlight) {
+            batch->writtenEvent.wait();
         }
-        else if (strcmp("-normal", argv[i]) == 0)
-        {
-            normal = true;
-        }
-        else if (strcmp("-tonormal", argv[i]) == 0)
-        {
-            color2normal = true;
-        }
-        else if (strcmp("-clamp", argv[i]) == 0)
-        {
-        }
-        else if (strcmp("-repeat", argv[i]) == 0)
+
+        BatchJob * job = batch->jobs[i];
+
+        const uint64 loadStart = batch->stats ? nv::profilerBegin() : 0;
+
+        job->inputOptions = NULL;
+        if (!nv::FileSystem::exists(job->input.str()))
         {
-            wrapRepeat = true;
+            fprintf(stderr, "The file '%s' does not exist.\n", job->input.str());
         }
-        else if (strcmp("-nomips", argv[i]) == 0)
+        else
         {
-            noMipmaps = true;
+            job->inputOptions = new nvtt::InputOptions;
+            if (!loadInput(job->options, job->input.str(), *job->inputOptions))
+            {
+                delete job->inputOptions;
+                job->inputOptions = NULL;
+            }
         }
-        else if (strcmp("-premula", argv[i]) == 0)
+
+        if (batch->stats)
         {
-            premultiplyAlpha = true;
+            nv::profilerEnd(loadZone, loadStart, 0);
         }
-        else if (strcmp("-mipfilter", argv[i]) == 0)
-        {
-            if (i+1 == argc) break;
-            i++;
 
-            if (strcmp("box", argv[i]) == 0) mipmapFilter = nvtt::MipmapFilter_Box;
-            else if (strcmp("triangle", argv[i]) == 0) mipmapFilter = nvtt::MipmapFilter_Triangle;
-            else if (strcmp("kaiser", argv[i]) == 0) mipmapFilter = nvtt::MipmapFilter_Kaiser;
-        }
-        else if (strcmp("-float", argv[i]) == 0)
+        job->loadEvent.post();
+    }
+}
+
+static void batchWriter(void * arg)
+{
+    Batch * batch = (Batch *)arg;
+
+    for (uint i = 0; i < batch->jobCount; i++)
+    {
+        BatchJob * job = batch->jobs[i];
+        job->compressEvent.wait();
+
+        bool success = job->compressed;
+        if (success)
         {
-            loadAsFloat = true;
+            nv::StdOutputStream stream(job->output.str());
+            if (stream.isError())
+            {
+                fprintf(stderr, "Error opening '%s' for writting\n", job->output.str());
+                success = false;
+            }
+            else
+            {
+                stream.serialize(job->outputHandler.buffer.buffer(), job->outputHandler.buffer.count());
+                success = !stream.isError();
+            }
+
+            if (!success)
+            {
+                // Don't leave partial outputs behind, they would look up to date.
+                nv::FileSystem::removeFile(job->output.str());
+            }
         }
 
-        // Compression options.
-        else if (strcmp("-fast", argv[i]) == 0)
+        if (!success)
         {
-            fast = true;
+            batch->failedCount++;
         }
-        else if (strcmp("-nocuda", argv[i]) == 0)
+
+        if (!batch->silent)
         {
-            nocuda = true;
+            printf("[%u/%u] %s -> %s%s\n", i + 1, batch->jobCount, job->input.str(), job->output.str(), success ? "" : " FAILED");
         }
-        else if (strcmp("-rgb", argv[i]) == 0)
+
+        // Release the compressed data early, jobs are only deleted at the end.
+        job->outputHandler.buffer.clear();
+        job->outputHandler.buffer.shrink();
+
+        batch->writtenCount.increment();
+        batch->writtenEvent.post();
+    }
+}
+
+// Files of a directory that are likely to be images, or the files that match a pattern.
+bool collectFiles(const char * pattern, nv::Array<nv::Path> & files)
+{
+    nv::Path directory;
+    const char * filePattern;
+
+    const bool isDirectory = nv::FileSystem::isDirectory(pattern);
+    if (isDirectory)
+    {
+        directory.copy(pattern);
+        filePattern = "*";
+    }
+    else
+    {
+        directory.copy(pattern);
+        directory.stripFileName();
+        if (directory.length() == 0) directory.copy(".");
+        filePattern = nv::Path::fileName(pattern);
+    }
+
+    nv::Array<nv::Path> names;
+    if (!nv::FileSystem::listDirectory(directory.str(), names))
+    {
+        fprintf(stderr, "Can't read directory '%s'.\n", directory.str());
+        return false;
+    }
+
+    static const char * const imageExtensions[] = { ".png", ".jpg", ".jpeg", ".tga", ".bmp", ".psd", ".tif", ".tiff", ".exr", ".hdr", ".pfm" };
+
+    for (uint i = 0; i < names.count(); i++)
+    {
+        const char * name = names[i].str();
+        if (!nv::strMatch(name, filePattern)) continue;
+
+        if (isDirectory)
         {
-            format = nvtt::Format_RGB;
+            // DDS files are skipped, they are usually the outputs of a previous run.
+            bool isImage = false;
+            for (uint e = 0; e < sizeof(imageExtensions) / sizeof(imageExtensions[0]); e++)
+            {
+                if (nv::strCaseDiff(nv::Path::extension(name), imageExtensions[e]) == 0) isImage = true;
+            }
+            if (!isImage) continue;
         }
-        else if (strcmp("-lumi", argv[i]) == 0)
+
+        nv::Path path(directory.str());
+        path.appendSeparator();
+        path.append(name);
+        files.append(path);
+    }
+
+    return true;
+}
+
+
+// Each line of the manifest has an input file, an optional output file and options that override the command line
+// options for that file. Empty lines and lines starting with '#' are ignored. Strings point into the text buffer.
+bool parseManifest(const char * fileName, nv::Array<char> & text, const Options & defaultOptions, const char * outputDirectory, nv::Array<BatchJob *> & jobs)
+{
+    FILE * fp = fopen(fileName, "rb");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Can't open manifest '%s'.\n", fileName);
+        return false;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    const long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    text.resize(uint(size) + 1);
+    const bool success = fread(text.buffer(), 1, size, fp) == size_t(size);
+    fclose(fp);
+
+    if (!success)
+    {
+        fprintf(stderr, "Can't read manifest '%s'.\n", fileName);
+        return false;
+    }
+    text[uint(size)] = '\0';
+
+    int lineNumber = 0;
+    char * line = text.buffer();
+    while (line != NULL)
+    {
+        lineNumber++;
+
+        char * next = strchr(line, '\n');
+        if (next != NULL) *next++ = '\0';
+
+        char * argv[64];
+        const int argc = splitArguments(line, argv, 64);
+        line = next;
+
+        if (argc == 0 || argv[0][0] == '#') continue;
+
+        BatchJob * job = new BatchJob;
+        job->options = defaultOptions;
+
+        for (int i = 0; i < argc; i++)
         {
-            luminance = true;
-            format = nvtt::Format_RGB;
+            if (argv[i][0] != '-')
+            {
+                if (job->input.isNull()) job->input = argv[i];
+                else if (job->output.isNull()) job->output = argv[i];
+                else fprintf(stderr, "%s:%d: Warning: ignoring \"%s\"\n", fileName, lineNumber, argv[i]);
+            }
+            else if (!parseOption(job->options, argc, argv, i))
+            {
+                fprintf(stderr, "%s:%d: Warning: unrecognized option \"%s\"\n", fileName, lineNumber, argv[i]);
+            }
         }
-        else if (strcmp("-bc1", argv[i]) == 0)
+
+        if (job->input.isNull())
         {
-            format = nvtt::Format_BC1;
+            fprintf(stderr, "%s:%d: Missing input file.\n", fileName, lineNumber);
+            delete job;
+            continue;
         }
-        else if (strcmp("-bc1n", argv[i]) == 0)
+
+        if (job->output.isNull())
         {
-            format = nvtt::Format_BC1;
-            bc1n = true;
+            outputFileName(job->input.str(), outputDirectory, job->output);
         }
-        else if (strcmp("-bc1a", argv[i]) == 0)
+
+        jobs.append(job);
+    }
+
+    return true;
+}
+
+int compressBatch(nv::Array<BatchJob *> & jobs, nvtt::Context & context, bool silent, bool stats, bool serialLoad)
+{
+    // Skip the files that are up to date.
+    uint skippedCount = 0;
+    for (uint i = 0; i < jobs.count(); )
+    {
+        if (jobs[i]->options.update && isUpToDate(jobs[i]->input.str(), jobs[i]->output.str()))
         {
-            format = nvtt::Format_BC1a;
+            delete jobs[i];
+            jobs.removeAt(i);
+            skippedCount++;
         }
-        else if (strcmp("-bc2", argv[i]) == 0)
+        else
         {
-            format = nvtt::Format_BC2;
+            i++;
         }
-        else if (strcmp("-bc3", argv[i]) == 0)
+    }
+
+    if (!silent && skippedCount != 0)
+    {
+        printf("Skipping %u up to date files.\n", skippedCount);
+    }
+
+    Batch batch;
+    batch.jobs = jobs.buffer();
+    batch.jobCount = jobs.count();
+    batch.silent = silent;
+    batch.stats = stats;
+    batch.serialLoad = serialLoad;
+    batch.writtenCount.storeRelaxed(0);
+
+    MyErrorHandler errorHandler;
+
+    nv::Timer timer;
+    timer.start();
+
+    nv::Thread loader;
+    nv::Thread writer;
+    loader.start(batchLoader, &batch);
+    writer.start(batchWriter, &batch);
+
+    for (uint i = 0; i < jobs.count(); i++)
+    {
+        BatchJob * job = jobs[i];
+        job->loadEvent.wait();
+
+        job->compressed = false;
+        if (job->inputOptions != NULL)
         {
-            format = nvtt::Format_BC3;
+            nvtt::CompressionOptions compressionOptions;
+            setCompressionOptions(job->options, compressionOptions);
+
+            nvtt::OutputOptions outputOptions;
+            outputOptions.setOutputHandler(&job->outputHandler);
+            outputOptions.setErrorHandler(&errorHandler);
+            setContainer(job->options, outputOptions);
+
+            job->compressed = context.process(*job->inputOptions, compressionOptions, outputOptions);
+
+            delete job->inputOptions;
+            job->inputOptions = NULL;
         }
-        else if (strcmp("-bc3n", argv[i]) == 0)
+
+        job->compressEvent.post();
+    }
+
+    loader.wait();
+    writer.wait();
+
+    timer.stop();
+
+    if (!silent)
+    {
+        const float elapsed = timer.elapsed();
+        printf("%u files compressed, %u failed, %u up to date in %.3f seconds", jobs.count() - batch.failedCount, batch.failedCount, skippedCount, elapsed);
+        if (elapsed > 0 && jobs.count() != 0) printf(" (%.1f files/s)", float(jobs.count()) / elapsed);
+        printf("\n");
+    }
+
+    for (uint i = 0; i < jobs.count(); i++)
+    {
+        delete jobs[i];
+    }
+
+    return batch.failedCount == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    MyAssertHandler assertHandler;
+    MyMessageHandler messageHandler;
+
+    Options options;
+
+    bool nocuda = false;
+    int threadCount = 0;
+    uint affinity[1024];
+    uint affinityCount = 0;
+    int numaNode = -1;
+
+    const char * manifest = NULL;
+
+    bool silent = false;
+    bool stats = false;
+
+    nv::Path input;
+    nv::Path output;
+
+
+    // Parse arguments.
+    for (int i = 1; i < argc; i++)
+    {
+        if (parseOption(options, argc, argv, i))
         {
-            format = nvtt::Format_BC3n;
         }
-        else if (strcmp("-bc4", argv[i]) == 0)
+
+        // Context options.
+        else if (strcmp("-nocuda", argv[i]) == 0)
         {
-            format = nvtt::Format_BC4;
+            nocuda = true;
         }
-        else if (strcmp("-bc5", argv[i]) == 0)
+        else if (strcmp("-threads", argv[i]) == 0)
         {
-            format = nvtt::Format_BC5;
+            if (i+1 == argc) break;
+            i++;
+
+            threadCount = atoi(argv[i]);
         }
-        else if (strcmp("-bc6", argv[i]) == 0)
+        else if (strcmp("-affinity", argv[i]) == 0)
         {
-            format = nvtt::Format_BC6;
+            if (i+1 == argc) break;
+            i++;
+
+            affinityCount = nv::parseProcessorList(argv[i], affinity, 1024);
+            if (affinityCount == 0) {
+                fprintf(stderr, "Invalid processor list '%s'\n", argv[i]);
+                return EXIT_FAILURE;
+            }
         }
-        else if (strcmp("-bc7", argv[i]) == 0)
+        else if (strcmp("-numa", argv[i]) == 0)
         {
-            format = nvtt::Format_BC7;
-        }
+            if (i+1 == argc) break;
+            i++;
 
-        // Undocumented option. Mainly used for testing.
-        else if (strcmp("-ext", argv[i]) == 0)
-        {
-            if (i+1 < argc && argv[i+1][0] != '-') {
-                externalCompressor = argv[i+1];
-                i++;
-            }
+            numaNode = atoi(argv[i]);
         }
         else if (strcmp("-pause", argv[i]) == 0)
         {
@@ -284,14 +579,23 @@ int main(int argc, char *argv[])
             getchar();
         }
 
+        // Batch options.
+        else if (strcmp("-manifest", argv[i]) == 0)
+        {
+            if (i+1 == argc) break;
+            i++;
+
+            manifest = argv[i];
+        }
+
         // Output options
         else if (strcmp("-silent", argv[i]) == 0)
         {
             silent = true;
         }
-        else if (strcmp("-dds10", argv[i]) == 0)
+        else if (strcmp("-stats", argv[i]) == 0)
         {
-            dds10 = true;
+            stats = true;
         }
 
         else if (argv[i][0] != '-')
@@ -301,12 +605,6 @@ int main(int argc, char *argv[])
             if (i+1 < argc && argv[i+1][0] != '-') {
                 output = argv[i+1];
             }
-            else
-            {
-                output.copy(input.str());
-                output.stripExtension();
-                output.append(".dds");
-            }
 
             break;
         }
@@ -327,9 +625,11 @@ int main(int argc, char *argv[])
         printf("NVIDIA Texture Tools %u.%u.%u - Copyright NVIDIA Corporation 2007\n\n", major, minor, rev);
     }
 
-    if (input.isNull())
+    if (input.isNull() && manifest == NULL)
     {
-        printf("usage: nvcompress [options] infile [outfile.dds]\n\n");
+        printf("usage: nvcompress [options] infile [outfile.dds]\n");
+        printf("       nvcompress [options] directory|\"pattern\" [outdir]\n");
+        printf("       nvcompress [options] -manifest file [outdir]\n\n");
 
         printf("Input options:\n");
         printf("  -color     \tThe input image is a color map (default).\n");
@@ -345,7 +645,11 @@ int main(int argc, char *argv[])
 
         printf("Compression options:\n");
         printf("  -fast    \tFast compression.\n");
+        printf("  -adaptive <rmse> \tFast compression, production quality for blocks with a larger RMS error.\n");
         printf("  -nocuda  \tDo not use cuda compressor.\n");
+        printf("  -threads <n>     \tNumber of compressor threads, 1 disables threading.\n");
+        printf("  -affinity <list> \tPin compressor threads to these processors, for example: 0-7,16-23\n");
+        printf("  -numa <node>     \tKeep threads and their memory on a NUMA node.\n");
         printf("  -rgb     \tRGBA format\n");
         printf("  -lumi    \tLUMINANCE format\n");
         printf("  -bc1     \tBC1 format (DXT1)\n");
@@ -361,219 +665,157 @@ int main(int argc, char *argv[])
 
         printf("Output options:\n");
         printf("  -silent  \tDo not output progress messages\n");
-        printf("  -dds10   \tUse DirectX 10 DDS format (enabled by default for BC6/7)\n\n");
+        printf("  -dds10   \tUse DirectX 10 DDS format (enabled by default for BC6/7)\n");
+        printf("  -stats   \tPrint timing statistics of each processing stage\n");
+        printf("  -update  \tSkip files whose output is newer than the input\n\n");
+
+        printf("Batch mode:\n");
+        printf("  Directories and quoted patterns such as \"textures/*.png\" compress all the matching files in one process.\n");
+        printf("  Each line of a manifest has an input file, an optional output file and options for that file only.\n\n");
 
         return EXIT_FAILURE;
     }
 
-    // Make sure input file exists.
-    if (!nv::FileSystem::exists(input.str()))
-    {
-        fprintf(stderr, "The file '%s' does not exist.\n", input.str());
-        return 1;
-    }
+    // In batch mode the second argument is the output directory.
+    const bool batchMode = manifest != NULL || nv::FileSystem::isDirectory(input.str()) || strpbrk(input.str(), "*?[") != NULL;
 
-    // Set input options.
-    nvtt::InputOptions inputOptions;
+    nv::Array<BatchJob *> jobs;
+    nv::Array<char> manifestText;
 
-    if (nv::strCaseDiff(input.extension(), ".dds") == 0)
+    if (batchMode)
     {
-        // Load surface.
-        nv::DirectDrawSurface dds(input.str());
-        if (!dds.isValid())
+        const char * outputDirectory = NULL;
+        if (manifest != NULL)
         {
-            fprintf(stderr, "The file '%s' is not a valid DDS file.\n", input.str());
-            return EXIT_FAILURE;
+            // The manifest takes no input argument.
+            if (!input.isNull()) outputDirectory = input.str();
+            if (!parseManifest(manifest, manifestText, options, outputDirectory, jobs)) return EXIT_FAILURE;
         }
-
-        if (!dds.isSupported())
+        else
         {
-            fprintf(stderr, "The file '%s' is not a supported DDS file.\n", input.str());
-            return EXIT_FAILURE;
-        }
+            if (!output.isNull()) outputDirectory = output.str();
 
-        uint faceCount;
-        if (dds.isTexture2D())
-        {
-            inputOptions.setTextureLayout(nvtt::TextureType_2D, dds.width(), dds.height());
-            faceCount = 1;
-        }
-        else if (dds.isTexture3D())
-        {
-            inputOptions.setTextureLayout(nvtt::TextureType_3D, dds.width(), dds.height(), dds.depth());
-            faceCount = 1;
+            nv::Array<nv::Path> files;
+            if (!collectFiles(input.str(), files)) return EXIT_FAILURE;
 
-            nvDebugBreak();
-        }
-        else 
-        {
-            nvDebugCheck(dds.isTextureCube());
-            inputOptions.setTextureLayout(nvtt::TextureType_Cube, dds.width(), dds.height());
-            faceCount = 6;
+            for (uint i = 0; i < files.count(); i++)
+            {
+                BatchJob * job = new BatchJob;
+                job->input = files[i];
+                job->options = options;
+                outputFileName(job->input.str(), outputDirectory, job->output);
+                jobs.append(job);
+            }
         }
 
-        uint mipmapCount = dds.mipmapCount();
-
-        nv::Image mipmap;
-
-        for (uint f = 0; f < faceCount; f++)
+        if (outputDirectory != NULL && !nv::FileSystem::isDirectory(outputDirectory) && !nv::FileSystem::createDirectory(outputDirectory))
         {
-            for (uint m = 0; m < mipmapCount; m++)
-            {
-                dds.mipmap(&mipmap, f, m); // @@ Load as float.
-
-                inputOptions.setMipmapData(mipmap.pixels(), mipmap.width(), mipmap.height(), mipmap.depth(), f, m);
-            }
+            fprintf(stderr, "Can't create directory '%s'.\n", outputDirectory);
+            return EXIT_FAILURE;
         }
     }
     else
     {
-        if (nv::strCaseDiff(input.extension(), ".exr") == 0 || nv::strCaseDiff(input.extension(), ".hdr") == 0)
+        if (output.isNull())
         {
-            loadAsFloat = true;
+            outputFileName(input.str(), NULL, output);
         }
 
-        if (loadAsFloat)
+        // Make sure input file exists.
+        if (!nv::FileSystem::exists(input.str()))
         {
-            nv::AutoPtr<nv::FloatImage> image(nv::ImageIO::loadFloat(input.str()));
-
-            if (image == NULL)
-            {
-                fprintf(stderr, "The file '%s' is not a supported image type.\n", input.str());
-                return EXIT_FAILURE;
-            }
-
-            inputOptions.setFormat(nvtt::InputFormat_RGBA_32F);
-            inputOptions.setTextureLayout(nvtt::TextureType_2D, image->width(), image->height());
-
-            /*for (uint i = 0; i < image->componentNum(); i++)
-            {
-                inputOptions.setMipmapChannelData(image->channel(i), i, image->width(), image->height());
-            }*/
+            fprintf(stderr, "The file '%s' does not exist.\n", input.str());
+            return 1;
         }
-        else
-        {
-            // Regular image.
-            nv::Image image;
-            if (!image.load(input.str()))
-            {
-                fprintf(stderr, "The file '%s' is not a supported image type.\n", input.str());
-                return 1;
-            }
 
-            inputOptions.setTextureLayout(nvtt::TextureType_2D, image.width(), image.height());
-            inputOptions.setMipmapData(image.pixels(), image.width(), image.height());
+        if (options.update && isUpToDate(input.str(), output.str()))
+        {
+            if (!silent) printf("'%s' is up to date.\n", output.str());
+            return EXIT_SUCCESS;
         }
     }
 
-    if (wrapRepeat)
+    if (stats)
     {
-        inputOptions.setWrapMode(nvtt::WrapMode_Repeat);
-    }
-    else
-    {
-        inputOptions.setWrapMode(nvtt::WrapMode_Clamp);
+        nv::profilerEnable(true);
     }
 
-    if (alpha)
-    {
-        inputOptions.setAlphaMode(nvtt::AlphaMode_Transparency);
-    }
-    else
+    if (numaNode >= 0)
     {
-        inputOptions.setAlphaMode(nvtt::AlphaMode_None);
+        // Images are loaded and processed by the main thread, keep it and its allocations on the node too.
+        uint processors[1024];
+        uint processorCount = nv::numaNodeProcessors(numaNode, processors, 1024);
+        if (processorCount == 0 || !nv::setThreadAffinity(processors, processorCount) || !nv::setThreadNumaNode(numaNode))
+        {
+            fprintf(stderr, "Warning: could not bind to NUMA node %d\n", numaNode);
+        }
     }
 
-    // Block compressed textures with mipmaps must be powers of two.
-    if (!noMipmaps && format != nvtt::Format_RGB)
-    {
-        inputOptions.setRoundMode(nvtt::RoundMode_ToPreviousPowerOfTwo);
-    }
+    nvtt::Context context;
+    context.enableCudaAcceleration(!nocuda);
 
-    if (normal)
-    {
-        setNormalMap(inputOptions);
-    }
-    else if (color2normal)
+    if (threadCount != 0) context.setThreadCount(threadCount);
+    if (affinityCount != 0)
     {
-        setColorToNormalMap(inputOptions);
-    }
-    else
-    {
-        setColorMap(inputOptions);
+        int processors[1024];
+        for (uint i = 0; i < affinityCount; i++) processors[i] = int(affinity[i]);
+        context.setThreadAffinity(processors, int(affinityCount));
     }
+    if (numaNode >= 0) context.setNumaNode(numaNode);
 
-    if (noMipmaps)
+    // The thread pool of the context isn't visible outside of nvtt. With explicit thread settings images are loaded
+    // by the calling thread alone, so that loading doesn't use the processors the settings exclude.
+    const bool serialLoad = threadCount != 0 || affinityCount != 0 || numaNode >= 0;
+
+    if (!silent)
     {
-        inputOptions.setMipmapGeneration(false);
+        printf("CUDA acceleration ");
+        if (context.isCudaAccelerationEnabled())
+        {
+            printf("ENABLED\n\n");
+        }
+        else
+        {
+            printf("DISABLED\n\n");
+        }
     }
 
-    /*if (premultiplyAlpha)
+    if (batchMode)
     {
-        inputOptions.setPremultiplyAlpha(true);
-        inputOptions.setAlphaMode(nvtt::AlphaMode_Premultiplied);
-    }*/
-
-    inputOptions.setMipmapFilter(mipmapFilter);
+        const int result = compressBatch(jobs, context, silent, stats, serialLoad);
 
-    nvtt::CompressionOptions compressionOptions;
-    compressionOptions.setFormat(format);
-
-    //compressionOptions.setQuantization(/*color dithering*/true, /*alpha dithering*/false, /*binary alpha*/false);
-
-    if (format == nvtt::Format_BC2) {
-        // Dither alpha when using BC2.
-        compressionOptions.setQuantization(/*color dithering*/false, /*alpha dithering*/true, /*binary alpha*/false);
-    }
-    else if (format == nvtt::Format_BC1a) {
-        // Binary alpha when using BC1a.
-        compressionOptions.setQuantization(/*color dithering*/false, /*alpha dithering*/true, /*binary alpha*/true, 127);
-    }
-    else if (format == nvtt::Format_RGBA)
-    {
-        if (luminance)
+        if (stats)
         {
-            compressionOptions.setPixelFormat(8, 0xff, 0, 0, 0);
+            context.enableTimingStats(false);
+            printTimingStats(context);
+            printAdaptiveStats(context);
         }
-        else {
-            // @@ Edit this to choose the desired pixel format:
-            // compressionOptions.setPixelType(nvtt::PixelType_Float);
-            // compressionOptions.setPixelFormat(16, 16, 16, 16);
-            // compressionOptions.setPixelType(nvtt::PixelType_UnsignedNorm);
-            // compressionOptions.setPixelFormat(16, 0, 0, 0);
 
-            //compressionOptions.setQuantization(/*color dithering*/true, /*alpha dithering*/false, /*binary alpha*/false);
-            //compressionOptions.setPixelType(nvtt::PixelType_UnsignedNorm);
-            //compressionOptions.setPixelFormat(5, 6, 5, 0);
-        }
+        return result;
     }
 
-    if (fast)
-    {
-        compressionOptions.setQuality(nvtt::Quality_Fastest);
-    }
-    else
-    {
-        compressionOptions.setQuality(nvtt::Quality_Normal);
-        //compressionOptions.setQuality(nvtt::Quality_Production);
-        //compressionOptions.setQuality(nvtt::Quality_Highest);
-    }
+    // Time image loading together with the compression stages.
+    const int loadZone = nv::profilerZone("Load");
+    const uint64 loadStart = stats ? nv::profilerBegin() : 0;
 
-    if (bc1n)
+    // Set input options.
+    nvtt::InputOptions inputOptions;
     {
-        compressionOptions.setColorWeights(1, 1, 0);
+        nv::ThreadPoolScope scope(NULL, serialLoad);
+        if (!loadInput(options, input.str(), inputOptions))
+        {
+            return EXIT_FAILURE;
+        }
     }
 
-    
-    //compressionOptions.setColorWeights(0.2126, 0.7152, 0.0722);
-    //compressionOptions.setColorWeights(0.299, 0.587, 0.114);
-    //compressionOptions.setColorWeights(3, 4, 2);
-
-    if (externalCompressor != NULL)
+    if (stats)
     {
-        compressionOptions.setExternalCompressor(externalCompressor);
+        nv::profilerEnd(loadZone, loadStart, 0);
     }
 
+    nvtt::CompressionOptions compressionOptions;
+    setCompressionOptions(options, compressionOptions);
+
 
     MyErrorHandler errorHandler;
     MyOutputHandler outputHandler(output.str());
@@ -583,22 +825,6 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    nvtt::Context context;
-    context.enableCudaAcceleration(!nocuda);
-
-    if (!silent) 
-    {
-        printf("CUDA acceleration ");
-        if (context.isCudaAccelerationEnabled())
-        {
-            printf("ENABLED\n\n");
-        }
-        else
-        {
-            printf("DISABLED\n\n");
-        }
-    }
-
     outputHandler.setTotal(context.estimateSize(inputOptions, compressionOptions));
     outputHandler.setDisplayProgress(!silent);
 
@@ -606,17 +832,7 @@ int main(int argc, char *argv[])
     //outputOptions.setFileName(output);
     outputOptions.setOutputHandler(&outputHandler);
     outputOptions.setErrorHandler(&errorHandler);
-
-	// Automatically use dds10 if compressing to BC6 or BC7
-	if (format == nvtt::Format_BC6 || format == nvtt::Format_BC7)
-	{
-		dds10 = true;
-	}
-
-    if (dds10)
-    {
-        outputOptions.setContainer(nvtt::Container_DDS10);
-    }
+    setContainer(options, outputOptions);
 
     // printf("Press ENTER.\n");
     // fflush(stdout);
@@ -635,6 +851,12 @@ int main(int argc, char *argv[])
         printf("\rtime taken: %.3f seconds\n", timer.elapsed());
     }
 
+    if (stats)
+    {
+        context.enableTimingStats(false);
+        printTimingStats(context);
+        printAdaptiveStats(context);
+    }
+
     return EXIT_SUCCESS;
 }
-
@@ -0,0 +1,545 @@
+// Copyright NVIDIA Corporation 2007 -- Ignacio Castano <icastano@nvidia.com>
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+// Compression options shared by nvcompress and nvtt-server.
+
+#ifndef COMPRESSOPTIONS_H
+#define COMPRESSOPTIONS_H
+
+#include <nvtt/nvtt.h>
+
+#include <nvimage/Image.h>
+#include <nvimage/ImageIO.h>
+#include <nvimage/FloatImage.h>
+#include <nvimage/DirectDrawSurface.h>
+
+#include <nvcore/Ptr.h> // AutoPtr
+#include <nvcore/StrLib.h> // Path
+#include <nvcore/FileSystem.h>
+#include <nvcore/Array.inl>
+
+#include <stdio.h> // fprintf
+#include <string.h> // strcmp
+
+
+// In-memory output, used to hand compressed files over to the writer thread.
+struct MemoryOutputHandler : public nvtt::OutputHandler
+{
+    virtual void beginImage(int size, int width, int height, int depth, int face, int miplevel)
+    {
+        // ignore.
+    }
+
+    virtual void endImage()
+    {
+        // Ignore.
+    }
+
+    virtual bool writeData(const void * data, int size)
+    {
+        buffer.append((const uint8 *)data, size);
+        return true;
+    }
+
+    nv::Array<uint8> buffer;
+};
+
+
+// Options that can be overridden per file in a manifest.
+struct Options
+{
+    Options() :
+        alpha(false), normal(false), color2normal(false), wrapRepeat(false), noMipmaps(false), fast(false), bc1n(false), luminance(false),
+        format(nvtt::Format_BC1), premultiplyAlpha(false), mipmapFilter(nvtt::MipmapFilter_Box), loadAsFloat(false),
+        adaptive(-1.0f), externalCompressor(NULL), dds10(false), update(false) {}
+
+    bool alpha;
+    bool normal;
+    bool color2normal;
+    bool wrapRepeat;
+    bool noMipmaps;
+    bool fast;
+    bool bc1n;
+    bool luminance;
+    nvtt::Format format;
+    bool premultiplyAlpha;
+    nvtt::MipmapFilter mipmapFilter;
+    bool loadAsFloat;
+
+    float adaptive;     // Block RMS error threshold of the adaptive quality mode, negative when disabled.
+
+    const char * externalCompressor;
+
+    bool dds10;
+    bool update;
+};
+
+// Parse the option at argv[i], advancing i past its arguments. Returns false if the option is not recognized.
+inline bool parseOption(Options & options, int argc, char * argv[], int & i)
+{
+    // Input options.
+    if (strcmp("-color", argv[i]) == 0)
+    {
+    }
+    else if (strcmp("-alpha", argv[i]) == 0)
+    {
+        options.alpha = true;
+    }
+    else if (strcmp("-normal", argv[i]) == 0)
+    {
+        options.normal = true;
+    }
+    else if (strcmp("-tonormal", argv[i]) == 0)
+    {
+        options.color2normal = true;
+    }
+    else if (strcmp("-clamp", argv[i]) == 0)
+    {
+    }
+    else if (strcmp("-repeat", argv[i]) == 0)
+    {
+        options.wrapRepeat = true;
+    }
+    else if (strcmp("-nomips", argv[i]) == 0)
+    {
+        options.noMipmaps = true;
+    }
+    else if (strcmp("-premula", argv[i]) == 0)
+    {
+        options.premultiplyAlpha = true;
+    }
+    else if (strcmp("-mipfilter", argv[i]) == 0)
+    {
+        if (i+1 == argc) return true;
+        i++;
+
+        if (strcmp("box", argv[i]) == 0) options.mipmapFilter = nvtt::MipmapFilter_Box;
+        else if (strcmp("triangle", argv[i]) == 0) options.mipmapFilter = nvtt::MipmapFilter_Triangle;
+        else if (strcmp("kaiser", argv[i]) == 0) options.mipmapFilter = nvtt::MipmapFilter_Kaiser;
+    }
+    else if (strcmp("-float", argv[i]) == 0)
+    {
+        options.loadAsFloat = true;
+    }
+
+    // Compression options.
+    else if (strcmp("-fast", argv[i]) == 0)
+    {
+        options.fast = true;
+    }
+    else if (strcmp("-adaptive", argv[i]) == 0)
+    {
+        if (i+1 < argc && argv[i+1][0] != '-') {
+            options.adaptive = float(atof(argv[i+1]));
+            i++;
+        }
+    }
+    else if (strcmp("-rgb", argv[i]) == 0)
+    {
+        options.format = nvtt::Format_RGB;
+    }
+    else if (strcmp("-lumi", argv[i]) == 0)
+    {
+        options.luminance = true;
+        options.format = nvtt::Format_RGB;
+    }
+    else if (strcmp("-bc1", argv[i]) == 0)
+    {
+        options.format = nvtt::Format_BC1;
+    }
+    else if (strcmp("-bc1n", argv[i]) == 0)
+    {
+        options.format = nvtt::Format_BC1;
+        options.bc1n = true;
+    }
+    else if (strcmp("-bc1a", argv[i]) == 0)
+    {
+        options.format = nvtt::Format_BC1a;
+    }
+    else if (strcmp("-bc2", argv[i]) == 0)
+    {
+        options.format = nvtt::Format_BC2;
+    }
+    else if (strcmp("-bc3", argv[i]) == 0)
+    {
+        options.format = nvtt::Format_BC3;
+    }
+    else if (strcmp("-bc3n", argv[i]) == 0)
+    {
+        options.format = nvtt::Format_BC3n;
+    }
+    else if (strcmp("-bc4", argv[i]) == 0)
+    {
+        options.format = nvtt::Format_BC4;
+    }
+    else if (strcmp("-bc5", argv[i]) == 0)
+    {
+        options.format = nvtt::Format_BC5;
+    }
+    else if (strcmp("-bc6", argv[i]) == 0)
+    {
+        options.format = nvtt::Format_BC6;
+    }
+    else if (strcmp("-bc7", argv[i]) == 0)
+    {
+        options.format = nvtt::Format_BC7;
+    }
+
+    // Undocumented option. Mainly used for testing.
+    else if (strcmp("-ext", argv[i]) == 0)
+    {
+        if (i+1 < argc && argv[i+1][0] != '-') {
+            options.externalCompressor = argv[i+1];
+            i++;
+        }
+    }
+
+    // Output options
+    else if (strcmp("-dds10", argv[i]) == 0)
+    {
+        options.dds10 = true;
+    }
+    else if (strcmp("-update", argv[i]) == 0)
+    {
+        options.update = true;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+
+// Set color to normal map conversion options.
+inline void setColorToNormalMap(nvtt::InputOptions & inputOptions)
+{
+    inputOptions.setNormalMap(false);
+    inputOptions.setConvertToNormalMap(true);
+    inputOptions.setHeightEvaluation(1.0f/3.0f, 1.0f/3.0f, 1.0f/3.0f, 0.0f);
+    //inputOptions.setNormalFilter(1.0f, 0, 0, 0);
+    //inputOptions.setNormalFilter(0.0f, 0, 0, 1);
+    inputOptions.setGamma(1.0f, 1.0f);
+    inputOptions.setNormalizeMipmaps(true);
+}
+
+// Set options for normal maps.
+inline void setNormalMap(nvtt::InputOptions & inputOptions)
+{
+    inputOptions.setNormalMap(true);
+    inputOptions.setConvertToNormalMap(false);
+    inputOptions.setGamma(1.0f, 1.0f);
+    inputOptions.setNormalizeMipmaps(true);
+}
+
+// Set options for color maps.
+inline void setColorMap(nvtt::InputOptions & inputOptions)
+{
+    inputOptions.setNormalMap(false);
+    inputOptions.setConvertToNormalMap(false);
+    inputOptions.setGamma(2.2f, 2.2f);
+    inputOptions.setNormalizeMipmaps(false);
+}
+
+// Load the input image and set the input options. Errors are reported to stderr.
+inline bool loadInput(const Options & options, const char * fileName, nvtt::InputOptions & inputOptions)
+{
+    const char * extension = nv::Path::extension(fileName);
+
+    if (nv::strCaseDiff(extension, ".dds") == 0)
+    {
+        // Load surface.
+        nv::DirectDrawSurface dds(fileName);
+        if (!dds.isValid())
+        {
+            fprintf(stderr, "The file '%s' is not a valid DDS file.\n", fileName);
+            return false;
+        }
+
+        if (!dds.isSupported())
+        {
+            fprintf(stderr, "The file '%s' is not a supported DDS file.\n", fileName);
+            return false;
+        }
+
+        uint faceCount;
+        if (dds.isTexture2D())
+        {
+            inputOptions.setTextureLayout(nvtt::TextureType_2D, dds.width(), dds.height());
+            faceCount = 1;
+        }
+        else if (dds.isTexture3D())
+        {
+            inputOptions.setTextureLayout(nvtt::TextureType_3D, dds.width(), dds.height(), dds.depth());
+            faceCount = 1;
+
+            nvDebugBreak();
+        }
+        else
+        {
+            nvDebugCheck(dds.isTextureCube());
+            inputOptions.setTextureLayout(nvtt::TextureType_Cube, dds.width(), dds.height());
+            faceCount = 6;
+        }
+
+        uint mipmapCount = dds.mipmapCount();
+
+        nv::Image mipmap;
+
+        for (uint f = 0; f < faceCount; f++)
+        {
+            for (uint m = 0; m < mipmapCount; m++)
+            {
+                dds.mipmap(&mipmap, f, m); // @@ Load as float.
+
+                inputOptions.setMipmapData(mipmap.pixels(), mipmap.width(), mipmap.height(), mipmap.depth(), f, m);
+            }
+        }
+    }
+    else
+    {
+        bool loadAsFloat = options.loadAsFloat;
+        if (nv::strCaseDiff(extension, ".exr") == 0 || nv::strCaseDiff(extension, ".hdr") == 0)
+        {
+            loadAsFloat = true;
+        }
+
+        if (loadAsFloat)
+        {
+            nv::AutoPtr<nv::FloatImage> image(nv::ImageIO::loadFloat(fileName));
+
+            if (image == NULL)
+            {
+                fprintf(stderr, "The file '%s' is not a supported image type.\n", fileName);
+                return false;
+            }
+
+            inputOptions.setFormat(nvtt::InputFormat_RGBA_32F);
+            inputOptions.setTextureLayout(nvtt::TextureType_2D, image->width(), image->height());
+
+            /*for (uint i = 0; i < image->componentNum(); i++)
+            {
+                inputOptions.setMipmapChannelData(image->channel(i), i, image->width(), image->height());
+            }*/
+        }
+        else
+        {
+            // Regular image.
+            nv::Image image;
+            if (!image.load(fileName))
+            {
+                fprintf(stderr, "The file '%s' is not a supported image type.\n", fileName);
+                return false;
+            }
+
+            inputOptions.setTextureLayout(nvtt::TextureType_2D, image.width(), image.height());
+            inputOptions.setMipmapData(image.pixels(), image.width(), image.height());
+        }
+    }
+
+    if (options.wrapRepeat)
+    {
+        inputOptions.setWrapMode(nvtt::WrapMode_Repeat);
+    }
+    else
+    {
+        inputOptions.setWrapMode(nvtt::WrapMode_Clamp);
+    }
+
+    if (options.alpha)
+    {
+        inputOptions.setAlphaMode(nvtt::AlphaMode_Transparency);
+    }
+    else
+    {
+        inputOptions.setAlphaMode(nvtt::AlphaMode_None);
+    }
+
+    // Block compressed textures with mipmaps must be powers of two.
+    if (!options.noMipmaps && options.format != nvtt::Format_RGB)
+    {
+        inputOptions.setRoundMode(nvtt::RoundMode_ToPreviousPowerOfTwo);
+    }
+
+    if (options.normal)
+    {
+        setNormalMap(inputOptions);
+    }
+    else if (options.color2normal)
+    {
+        setColorToNormalMap(inputOptions);
+    }
+    else
+    {
+        setColorMap(inputOptions);
+    }
+
+    if (options.noMipmaps)
+    {
+        inputOptions.setMipmapGeneration(false);
+    }
+
+    /*if (options.premultiplyAlpha)
+    {
+        inputOptions.setPremultiplyAlpha(true);
+        inputOptions.setAlphaMode(nvtt::AlphaMode_Premultiplied);
+    }*/
+
+    inputOptions.setMipmapFilter(options.mipmapFilter);
+
+    return true;
+}
+
+inline void setCompressionOptions(const Options & options, nvtt::CompressionOptions & compressionOptions)
+{
+    compressionOptions.setFormat(options.format);
+
+    //compressionOptions.setQuantization(/*color dithering*/true, /*alpha dithering*/false, /*binary alpha*/false);
+
+    if (options.format == nvtt::Format_BC2) {
+        // Dither alpha when using BC2.
+        compressionOptions.setQuantization(/*color dithering*/false, /*alpha dithering*/true, /*binary alpha*/false);
+    }
+    else if (options.format == nvtt::Format_BC1a) {
+        // Binary alpha when using BC1a.
+        compressionOptions.setQuantization(/*color dithering*/false, /*alpha dithering*/true, /*binary alpha*/true, 127);
+    }
+    else if (options.format == nvtt::Format_RGBA)
+    {
+        if (options.luminance)
+        {
+            compressionOptions.setPixelFormat(8, 0xff, 0, 0, 0);
+        }
+        else {
+            // @@ Edit this to choose the desired pixel format:
+            // compressionOptions.setPixelType(nvtt::PixelType_Float);
+            // compressionOptions.setPixelFormat(16, 16, 16, 16);
+            // compressionOptions.setPixelType(nvtt::PixelType_UnsignedNorm);
+            // compressionOptions.setPixelFormat(16, 0, 0, 0);
+
+            //compressionOptions.setQuantization(/*color dithering*/true, /*alpha dithering*/false, /*binary alpha*/false);
+            //compressionOptions.setPixelType(nvtt::PixelType_UnsignedNorm);
+            //compressionOptions.setPixelFormat(5, 6, 5, 0);
+        }
+    }
+
+    if (options.fast)
+    {
+        compressionOptions.setQuality(nvtt::Quality_Fastest);
+    }
+    else if (options.adaptive >= 0.0f)
+    {
+        // Blocks that the fast encoder handles well enough skip the production encoder.
+        compressionOptions.setQuality(nvtt::Quality_Production);
+        compressionOptions.setAdaptiveQuality(true, options.adaptive);
+    }
+    else
+    {
+        compressionOptions.setQuality(nvtt::Quality_Normal);
+        //compressionOptions.setQuality(nvtt::Quality_Production);
+        //compressionOptions.setQuality(nvtt::Quality_Highest);
+    }
+
+    if (options.bc1n)
+    {
+        compressionOptions.setColorWeights(1, 1, 0);
+    }
+
+
+    //compressionOptions.setColorWeights(0.2126, 0.7152, 0.0722);
+    //compressionOptions.setColorWeights(0.299, 0.587, 0.114);
+    //compressionOptions.setColorWeights(3, 4, 2);
+
+    if (options.externalCompressor != NULL)
+    {
+        compressionOptions.setExternalCompressor(options.externalCompressor);
+    }
+}
+
+inline void setContainer(const Options & options, nvtt::OutputOptions & outputOptions)
+{
+    // Automatically use dds10 if compressing to BC6 or BC7
+    if (options.dds10 || options.format == nvtt::Format_BC6 || options.format == nvtt::Format_BC7)
+    {
+        outputOptions.setContainer(nvtt::Container_DDS10);
+    }
+}
+
+// Outputs are considered up to date when they are newer than their inputs.
+inline bool isUpToDate(const char * input, const char * output)
+{
+    const uint64 outputTime = nv::FileSystem::lastModified(output);
+    return outputTime != 0 && outputTime >= nv::FileSystem::lastModified(input);
+}
+
+// Output name of an input file, in the output directory if given, otherwise next to the input.
+inline void outputFileName(const char * input, const char * outputDirectory, nv::Path & output)
+{
+    if (outputDirectory != NULL)
+    {
+        output.copy(outputDirectory);
+        output.appendSeparator();
+        output.append(nv::Path::fileName(input));
+    }
+    else
+    {
+        output.copy(input);
+    }
+
+    output.stripExtension();
+    output.append(".dds");
+}
+
+// Split a manifest line into arguments in place. Arguments are separated by white space and can be quoted.
+inline int splitArguments(char * line, char * argv[], int maxCount)
+{
+    int argc = 0;
+
+    char * ptr = line;
+    while (argc < maxCount)
+    {
+        while (*ptr == ' ' || *ptr == '\t' || *ptr == '\r' || *ptr == '\n') ptr++;
+        if (*ptr == '\0') break;
+
+        if (*ptr == '"')
+        {
+            ptr++;
+            argv[argc++] = ptr;
+            while (*ptr != '"' && *ptr != '\0') ptr++;
+        }
+        else
+        {
+            argv[argc++] = ptr;
+            while (*ptr != ' ' && *ptr != '\t' && *ptr != '\r' && *ptr != '\n' && *ptr != '\0') ptr++;
+        }
+
+        if (*ptr == '\0') break;
+        *ptr++ = '\0';
+    }
+
+    return argc;
+}
+
+
+#endif // COMPRESSOPTIONS_H
@@ -22,6 +22,7 @@
 // OTHER DEALINGS IN THE SOFTWARE.
 
 #include "cmdline.h"
+#include "compressoptions.h" // splitArguments
 
 #include "nvmath/Color.h"
 #include "nvmath/Vector.inl"
@@ -31,9 +32,19 @@
 
 #include "nvcore/StrLib.h"
 #include "nvcore/StdStream.h"
+#include "nvcore/FileSystem.h"
+#include "nvcore/Array.inl"
+
+#include "nvthread/ParallelFor.h"
+#include "nvthread/Atomic.h"
+#include "nvthread/Mutex.h"
 
 #include <math.h>
 
+#if NV_USE_SSE >= 2
+#include <emmintrin.h>
+#endif
+
 
 static bool loadImage(nv::Image & image, const char * fileName)
 {
@@ -45,7 +56,7 @@ static bool loadImage(nv::Image & image, const char * fileName)
 			printf("The file '%s' is not a valid DDS file.\n", fileName);
 			return false;
 		}
-		
+
 		dds.mipmap(&image, 0, 0); // get first image
 	}
 	else
@@ -69,6 +80,8 @@ struct Error
 		mabse = 0.0f;
 		maxabse = 0.0f;
 		mse = 0.0f;
+		rmse = 0.0f;
+		psnr = 0.0f;
 	}
 
     // @@ This has poor precision...
@@ -80,12 +93,23 @@ struct Error
 		mse += e * e;
 	}
 
+	void merge(const Error & e)
+	{
+		samples += e.samples;
+		mabse += e.mabse;
+		maxabse = nv::max(maxabse, e.maxabse);
+		mse += e.mse;
+	}
+
 	void done()
 	{
-		mabse /= samples;
-		mse /= samples;
-		rmse = sqrt(mse);
-		psnr = (rmse == 0) ? 999.0 : 20.0 * log10(255.0 / rmse);
+		if (samples)
+		{
+			mabse /= samples;
+			mse /= samples;
+			rmse = sqrt(mse);
+			psnr = (rmse == 0) ? 999.0 : 20.0 * log10(255.0 / rmse);
+		}
 	}
 
 	void print()
@@ -97,6 +121,11 @@ struct Error
 		printf("  Peak signal to noise ratio in dB: %f\n", psnr);
 	}
 
+	void writeJson(FILE * fp, const char * name)
+	{
+		fprintf(fp, "\"%s\": { \"mae\": %f, \"max\": %f, \"mse\": %f, \"rmse\": %f, \"psnr\": %f }", name, mabse, maxabse, mse, rmse, psnr);
+	}
+
 	int samples;
 	double mabse;
 	double maxabse;
@@ -112,6 +141,8 @@ struct NormalError
 		samples = 0;
 		ade = 0.0f;
 		mse = 0.0f;
+		rmse = 0.0f;
+		psnr = 0.0f;
 	}
 
 	void addSample(nv::Color32 o, nv::Color32 c)
@@ -125,10 +156,17 @@ struct NormalError
 
 		ade += acosf(nv::clamp(dot(vo, vc), -1.0f, 1.0f));
 		mse += lengthSquared((vo - vc) * (255 / 2.0f));
-		
+
 		samples++;
 	}
 
+	void merge(const NormalError & e)
+	{
+		samples += e.samples;
+		ade += e.ade;
+		mse += e.mse;
+	}
+
 	void done()
 	{
 		if (samples)
@@ -147,6 +185,11 @@ struct NormalError
 		printf("  Peak signal to noise ratio in dB: %f\n", psnr);
 	}
 
+	void writeJson(FILE * fp, const char * name)
+	{
+		fprintf(fp, "\"%s\": { \"ade\": %f, \"rmse\": %f, \"psnr\": %f }", name, ade, rmse, psnr);
+	}
+
 	int samples;
 	float ade;
 	float mse;
@@ -162,13 +205,484 @@ static float luma(const nv::Color32 & c) {
 }
 
 
+// Errors of a pair of images.
+struct ImageError
+{
+	void merge(const ImageError & e)
+	{
+		color.merge(e.color);
+		luma.merge(e.luma);
+		alpha.merge(e.alpha);
+		normal.merge(e.normal);
+	}
+
+	void done()
+	{
+		color.done();
+		luma.done();
+		alpha.done();
+		normal.done();
+	}
+
+	Error color;
+	Error luma;
+	Error alpha;
+	NormalError normal;
+};
+
+static void addPixel(const nv::Color32 c0, const nv::Color32 c1, bool compareAlpha, ImageError & error)
+{
+	double r = float(c0.r - c1.r);
+	double g = float(c0.g - c1.g);
+	double b = float(c0.b - c1.b);
+	double a = float(c0.a - c1.a);
+
+	error.alpha.addSample(a);
+
+	double l0 = luma(c0);
+	double l1 = luma(c1);
+
+	error.luma.addSample(l0 - l1);
+
+	double d = sqrt(r*r + g*g + b*b);
+
+	if (compareAlpha) {
+		d *= c0.a / 255.0;
+	}
+
+	error.color.addSample(d);
+}
+
+#if NV_USE_SSE >= 2
+
+// Two lanes of error sums, flushed into an Error at the end of the row.
+struct ErrorLanes
+{
+	ErrorLanes() : abs(_mm_setzero_pd()), sq(_mm_setzero_pd()), max(_mm_setzero_pd()), samples(0) {}
+
+	void addSamples(__m128d e)
+	{
+		const __m128d a = _mm_andnot_pd(_mm_set1_pd(-0.0), e);
+		abs = _mm_add_pd(abs, a);
+		sq = _mm_add_pd(sq, _mm_mul_pd(e, e));
+		max = _mm_max_pd(max, a);
+		samples += 2;
+	}
+
+	void addSamples(__m128 e)
+	{
+		addSamples(_mm_cvtps_pd(e));
+		addSamples(_mm_cvtps_pd(_mm_movehl_ps(e, e)));
+	}
+
+	void flush(Error & error) const
+	{
+		double a[2], s[2], m[2];
+		_mm_storeu_pd(a, abs);
+		_mm_storeu_pd(s, sq);
+		_mm_storeu_pd(m, max);
+
+		error.samples += samples;
+		error.mabse += a[0] + a[1];
+		error.mse += s[0] + s[1];
+		error.maxabse = nv::max(error.maxabse, nv::max(m[0], m[1]));
+	}
+
+	__m128d abs;
+	__m128d sq;
+	__m128d max;
+	int samples;
+};
+
+static inline __m128 channel(__m128i texels, int shift)
+{
+	return _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(texels, shift), _mm_set1_epi32(0xFF)));
+}
+
+// Same as addPixel for 4 pixels at a time. The per pixel errors are identical, only the order of the sums differs.
+static void addPixels(const nv::Color32 * row0, const nv::Color32 * row1, uint count, bool compareAlpha, ImageError & error)
+{
+	const __m128 lumaR = _mm_set1_ps(0.299f);
+	const __m128 lumaG = _mm_set1_ps(0.587f);
+	const __m128 lumaB = _mm_set1_ps(0.114f);
+	const __m128d alphaScale = _mm_set1_pd(255.0);
+
+	ErrorLanes color, luma, alpha;
+
+	for (uint x = 0; x + 4 <= count; x += 4)
+	{
+		// Color32 is stored as BGRA, blue is in the low byte.
+		const __m128i p0 = _mm_loadu_si128((const __m128i *)(row0 + x));
+		const __m128i p1 = _mm_loadu_si128((const __m128i *)(row1 + x));
+
+		const __m128 b0 = channel(p0, 0), g0 = channel(p0, 8), r0 = channel(p0, 16), a0 = channel(p0, 24);
+		const __m128 b1 = channel(p1, 0), g1 = channel(p1, 8), r1 = channel(p1, 16), a1 = channel(p1, 24);
+
+		const __m128 r = _mm_sub_ps(r0, r1);
+		const __m128 g = _mm_sub_ps(g0, g1);
+		const __m128 b = _mm_sub_ps(b0, b1);
+
+		alpha.addSamples(_mm_sub_ps(a0, a1));
+
+		const __m128 l0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lumaR, r0), _mm_mul_ps(lumaG, g0)), _mm_mul_ps(lumaB, b0));
+		const __m128 l1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lumaR, r1), _mm_mul_ps(lumaG, g1)), _mm_mul_ps(lumaB, b1));
+		luma.addSamples(_mm_sub_pd(_mm_cvtps_pd(l0), _mm_cvtps_pd(l1)));
+		luma.addSamples(_mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(l0, l0)), _mm_cvtps_pd(_mm_movehl_ps(l1, l1))));
+
+		// The squared distance is an exact integer in single precision, the square root is taken in double precision.
+		const __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(g, g)), _mm_mul_ps(b, b));
+		__m128d dlo = _mm_sqrt_pd(_mm_cvtps_pd(d2));
+		__m128d dhi = _mm_sqrt_pd(_mm_cvtps_pd(_mm_movehl_ps(d2, d2)));
+
+		if (compareAlpha) {
+			dlo = _mm_mul_pd(dlo, _mm_div_pd(_mm_cvtps_pd(a0), alphaScale));
+			dhi = _mm_mul_pd(dhi, _mm_div_pd(_mm_cvtps_pd(_mm_movehl_ps(a0, a0)), alphaScale));
+		}
+
+		color.addSamples(dlo);
+		color.addSamples(dhi);
+	}
+
+	color.flush(error.color);
+	luma.flush(error.luma);
+	alpha.flush(error.alpha);
+}
+
+#endif // NV_USE_SSE >= 2
+
+static void compareRow(const nv::Color32 * row0, const nv::Color32 * row1, uint w, bool compareAlpha, bool compareNormal, ImageError & error)
+{
+	uint x = 0;
+
+#if NV_USE_SSE >= 2
+	x = w & ~3U;
+	addPixels(row0, row1, x, compareAlpha, error);
+#endif
+
+	for (; x < w; x++)
+	{
+		addPixel(row0[x], row1[x], compareAlpha, error);
+	}
+
+	if (compareNormal)
+	{
+		for (x = 0; x < w; x++)
+		{
+			error.normal.addSample(row0[x], row1[x]);
+		}
+	}
+}
+
+
+struct DiffOptions
+{
+	DiffOptions() : compareNormal(false), compareAlpha(false), threshold(-1.0f), failFast(false) {}
+
+	bool compareNormal;
+	bool compareAlpha;
+	float threshold;    // Maximum color RMSE, negative when there's no threshold.
+	bool failFast;      // Stop as soon as the threshold is exceeded.
+};
+
+// Bands of rows are compared in parallel, each band accumulates its own errors.
+struct CompareContext
+{
+	const nv::Image * image0;
+	const nv::Image * image1;
+	uint width;
+	uint height;
+	uint bandHeight;
+	const DiffOptions * options;
+	double maxSquaredError;     // Color squared error sum that exceeds the threshold.
+	double squaredError;        // Color squared error sum of the bands done so far.
+	nv::Mutex mutex;
+	nv::Atomic<uint> exceeded;
+	ImageError * bands;
+};
+
+static void CompareTask(void * context, int id)
+{
+	CompareContext * ctx = (CompareContext *)context;
+	if (ctx->exceeded.loadRelaxed()) return;
+
+	ImageError & error = ctx->bands[id];
+
+	const uint y0 = id * ctx->bandHeight;
+	const uint y1 = nv::min(y0 + ctx->bandHeight, ctx->height);
+
+	for (uint y = y0; y < y1; y++)
+	{
+		compareRow(ctx->image0->scanline(y), ctx->image1->scanline(y), ctx->width, ctx->options->compareAlpha, ctx->options->compareNormal, error);
+
+		// The errors of the other bands can only add to the sum.
+		if (ctx->options->failFast && error.color.mse > ctx->maxSquaredError)
+		{
+			ctx->exceeded.storeRelaxed(1);
+			return;
+		}
+	}
+
+	if (ctx->options->failFast)
+	{
+		nv::Lock<nv::Mutex> lock(ctx->mutex);
+		ctx->squaredError += error.color.mse;
+		if (ctx->squaredError > ctx->maxSquaredError) ctx->exceeded.storeRelaxed(1);
+	}
+}
+
+// Compare the overlap of the two images. Returns false when the comparison stopped early because the threshold was exceeded.
+static bool compareImages(const nv::Image & image0, const nv::Image & image1, const DiffOptions & options, ImageError & error)
+{
+	const uint w = nv::min(image0.width(), image1.width());
+	const uint h = nv::min(image0.height(), image1.height());
+
+	CompareContext context;
+	context.image0 = &image0;
+	context.image1 = &image1;
+	context.width = w;
+	context.height = h;
+	context.bandHeight = 16;
+	context.options = &options;
+	context.maxSquaredError = (options.threshold >= 0) ? double(options.threshold) * options.threshold * w * h : 0.0;
+	context.squaredError = 0.0;
+	context.exceeded.storeRelaxed(0);
+
+	const uint bandCount = (h + context.bandHeight - 1) / context.bandHeight;
+
+	nv::Array<ImageError> bands;
+	bands.resize(bandCount);
+	context.bands = bands.buffer();
+
+	nv::ParallelFor parallelFor(CompareTask, &context);
+	parallelFor.run(bandCount);
+
+	if (context.exceeded.loadRelaxed()) return false;
+
+	// Merge in band order, so that the results don't depend on the scheduling.
+	for (uint i = 0; i < bandCount; i++)
+	{
+		error.merge(bands[i]);
+	}
+	error.done();
+
+	return true;
+}
+
+
+struct DiffResult
+{
+	enum Status
+	{
+		Status_Passed,
+		Status_Exceeded,
+		Status_Error,
+		Status_Skipped,
+	};
+
+	DiffResult() : status(Status_Skipped), complete(false), width(0), height(0) {}
+
+	Status status;
+	bool complete;      // False when the comparison stopped early, there are no errors then.
+	uint width;
+	uint height;
+	ImageError error;
+};
+
+static void compareImages(const nv::Image & image0, const nv::Image & image1, const DiffOptions & options, DiffResult & result)
+{
+	result.width = nv::min(image0.width(), image1.width());
+	result.height = nv::min(image0.height(), image1.height());
+	result.complete = compareImages(image0, image1, options, result.error);
+
+	const bool exceeded = !result.complete || (options.threshold >= 0 && result.error.color.rmse > options.threshold);
+	result.status = exceeded ? DiffResult::Status_Exceeded : DiffResult::Status_Passed;
+}
+
+static void diffImages(const char * input0, const char * input1, const DiffOptions & options, DiffResult & result)
+{
+	result.status = DiffResult::Status_Error;
+
+	nv::Image image0, image1;
+	if (!loadImage(image0, input0)) return;
+	if (!loadImage(image1, input1)) return;
+
+	compareImages(image0, image1, options, result);
+}
+
+
+// Batch mode compares each pair of files in a task of its own.
+struct DiffBatch
+{
+	const nv::Path * inputs0;
+	const nv::Path * inputs1;
+	DiffResult * results;
+	const DiffOptions * options;
+	nv::Atomic<uint> stop;
+};
+
+static void DiffTask(void * context, int id)
+{
+	DiffBatch * batch = (DiffBatch *)context;
+	if (batch->stop.loadRelaxed()) return;
+
+	DiffResult & result = batch->results[id];
+	diffImages(batch->inputs0[id].str(), batch->inputs1[id].str(), *batch->options, result);
+
+	if (batch->options->failFast && result.status != DiffResult::Status_Passed)
+	{
+		batch->stop.storeRelaxed(1);
+	}
+}
+
+// Pair the images of the original directory with the files of the same name in the updated directory.
+static bool collectPairs(const char * directory0, const char * directory1, nv::Array<nv::Path> & inputs0, nv::Array<nv::Path> & inputs1)
+{
+	nv::Array<nv::Path> names;
+	if (!nv::FileSystem::listDirectory(directory0, names))
+	{
+		fprintf(stderr, "Can't read directory '%s'.\n", directory0);
+		return false;
+	}
+
+	static const char * const imageExtensions[] = { ".dds", ".png", ".jpg", ".jpeg", ".tga", ".bmp", ".psd", ".tif", ".tiff" };
+
+	for (uint i = 0; i < names.count(); i++)
+	{
+		const char * name = names[i].str();
+
+		bool isImage = false;
+		for (uint e = 0; e < sizeof(imageExtensions) / sizeof(imageExtensions[0]); e++)
+		{
+			if (nv::strCaseDiff(nv::Path::extension(name), imageExtensions[e]) == 0) isImage = true;
+		}
+		if (!isImage) continue;
+
+		nv::Path path0(directory0);
+		path0.appendSeparator();
+		path0.append(name);
+		inputs0.append(path0);
+
+		nv::Path path1(directory1);
+		path1.appendSeparator();
+		path1.append(name);
+		inputs1.append(path1);
+	}
+
+	return true;
+}
+
+// Each line of the list has an original and an updated file. Empty lines and lines starting with '#' are ignored.
+static bool readPairList(const char * fileName, nv::Array<nv::Path> & inputs0, nv::Array<nv::Path> & inputs1)
+{
+	FILE * fp = fopen(fileName, "r");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "Can't open '%s'.\n", fileName);
+		return false;
+	}
+
+	int lineNumber = 0;
+	char line[2048];
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		lineNumber++;
+
+		char * argv[2];
+		const int argc = splitArguments(line, argv, 2);
+		if (argc == 0 || argv[0][0] == '#') continue;
+
+		if (argc != 2)
+		{
+			fprintf(stderr, "%s:%d: Expected an original and an updated file.\n", fileName, lineNumber);
+			continue;
+		}
+
+		inputs0.append(nv::Path(argv[0]));
+		inputs1.append(nv::Path(argv[1]));
+	}
+
+	fclose(fp);
+	return true;
+}
+
+static void writeJsonString(FILE * fp, const char * str)
+{
+	fputc('"', fp);
+	for (const char * ptr = str; *ptr != '\0'; ptr++) {
+		if (*ptr == '"' || *ptr == '\\') fputc('\\', fp);
+		fputc(*ptr, fp);
+	}
+	fputc('"', fp);
+}
+
+static bool writeJson(const char * fileName, const nv::Array<nv::Path> & inputs0, const nv::Array<nv::Path> & inputs1, nv::Array<DiffResult> & results, const DiffOptions & options)
+{
+	FILE * fp = fopen(fileName, "w");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "Can't open '%s' for writing.\n", fileName);
+		return false;
+	}
+
+	static const char * const statusNames[] = { "passed", "exceeded", "error", "skipped" };
+
+	fprintf(fp, "{\n");
+	if (options.threshold >= 0) fprintf(fp, "  \"threshold\": %f,\n", options.threshold);
+	else fprintf(fp, "  \"threshold\": null,\n");
+	fprintf(fp, "  \"results\": [\n");
+
+	for (uint i = 0; i < results.count(); i++)
+	{
+		DiffResult & r = results[i];
+
+		fprintf(fp, "    { \"original\": ");
+		writeJsonString(fp, inputs0[i].str());
+		fprintf(fp, ", \"updated\": ");
+		writeJsonString(fp, inputs1[i].str());
+		fprintf(fp, ", \"status\": \"%s\"", statusNames[r.status]);
+
+		if (r.status == DiffResult::Status_Passed || r.status == DiffResult::Status_Exceeded)
+		{
+			fprintf(fp, ", \"width\": %u, \"height\": %u", r.width, r.height);
+		}
+
+		if (r.complete)
+		{
+			fprintf(fp, ", ");
+			r.error.color.writeJson(fp, "color");
+			fprintf(fp, ", ");
+			r.error.luma.writeJson(fp, "luma");
+			if (options.compareAlpha)
+			{
+				fprintf(fp, ", ");
+				r.error.alpha.writeJson(fp, "alpha");
+			}
+			if (options.compareNormal)
+			{
+				fprintf(fp, ", ");
+				r.error.normal.writeJson(fp, "normal");
+			}
+		}
+
+		fprintf(fp, " }%s\n", i + 1 < results.count() ? "," : "");
+	}
+
+	fprintf(fp, "  ]\n");
+	fprintf(fp, "}\n");
+
+	fclose(fp);
+	return true;
+}
+
+
 int main(int argc, char *argv[])
 {
 	MyAssertHandler assertHandler;
 	MyMessageHandler messageHandler;
 
-	bool compareNormal = false;
-	bool compareAlpha = false;
+	DiffOptions options;
+	const char * listFileName = NULL;
+	const char * jsonFileName = NULL;
 
 	nv::Path input0;
 	nv::Path input1;
@@ -180,11 +694,27 @@ int main(int argc, char *argv[])
 		// Input options.
 		if (strcmp("-normal", argv[i]) == 0)
 		{
-			compareNormal = true;
+			options.compareNormal = true;
 		}
 		else if (strcmp("-alpha", argv[i]) == 0)
 		{
-			compareAlpha = true;
+			options.compareAlpha = true;
+		}
+		else if (strcmp("-threshold", argv[i]) == 0 && i+1 < argc)
+		{
+			options.threshold = float(atof(argv[++i]));
+		}
+		else if (strcmp("-failfast", argv[i]) == 0)
+		{
+			options.failFast = true;
+		}
+		else if (strcmp("-list", argv[i]) == 0 && i+1 < argc)
+		{
+			listFileName = argv[++i];
+		}
+		else if (strcmp("-json", argv[i]) == 0 && i+1 < argc)
+		{
+			jsonFileName = argv[++i];
 		}
 		else if (argv[i][0] != '-')
 		{
@@ -202,110 +732,138 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (input0.isNull() || input1.isNull())
+	// Without a threshold there's nothing to stop at.
+	if (options.threshold < 0) options.failFast = false;
+
+	if (listFileName == NULL && (input0.isNull() || input1.isNull()))
 	{
 		printf("NVIDIA Texture Tools - Copyright NVIDIA Corporation 2007\n\n");
-		
-		printf("usage: nvimgdiff [options] original_file updated_file [output]\n\n");
-		
+
+		printf("usage: nvimgdiff [options] original_file updated_file [output]\n");
+		printf("       nvimgdiff [options] original_dir updated_dir\n");
+		printf("       nvimgdiff [options] -list file\n\n");
+
 		printf("Diff options:\n");
 		printf("  -normal \tCompare images as if they were normal maps.\n");
 		printf("  -alpha  \tCompare alpha weighted images.\n");
+		printf("  -threshold rmse\tFail the images whose color RMSE exceeds the threshold.\n");
+		printf("  -failfast \tStop as soon as an image exceeds the threshold.\n");
+		printf("  -list file\tCompare the pairs of files listed in the file, one pair per line.\n");
+		printf("  -json file\tWrite a summary of the results to a JSON file.\n\n");
+
+		printf("Batch mode:\n");
+		printf("  Directories compare the images of the original directory with the updated files of the same name.\n");
+		printf("  Pairs are compared in parallel, only the failures are printed.\n");
 
 		return 1;
 	}
 
-	nv::Image image0, image1;
-	if (!loadImage(image0, input0.str())) return 0;
-	if (!loadImage(image1, input1.str())) return 0;
-
-	const uint w0 = image0.width();
-	const uint h0 = image0.height();
-	const uint w1 = image1.width();
-	const uint h1 = image1.height();
-	const uint w = nv::min(w0, w1);
-	const uint h = nv::min(h0, h1);
-
-	// Compute errors.
-	Error error_r;
-	Error error_g;
-	Error error_b;
-	Error error_a;
-    Error error_luma;
-	Error error_total;
-	NormalError error_normal;
-
-	for (uint i = 0; i < h; i++)
-	{
-		for (uint e = 0; e < w; e++)
-		{
-			const nv::Color32 c0(image0.pixel(e, i));
-			const nv::Color32 c1(image1.pixel(e, i));
-
-			double r = float(c0.r - c1.r);
-			double g = float(c0.g - c1.g);
-			double b = float(c0.b - c1.b);
-			double a = float(c0.a - c1.a);
-
-			error_r.addSample(r);
-			error_g.addSample(g);
-			error_b.addSample(b);
-			error_a.addSample(a);
+	const bool batchMode = listFileName != NULL || nv::FileSystem::isDirectory(input0.str());
 
-            double l0 = luma(c0);
-            double l1 = luma(c1);
+	if (!batchMode)
+	{
+		nv::Array<nv::Path> inputs0, inputs1;
+		inputs0.append(input0);
+		inputs1.append(input1);
+
+		nv::Array<DiffResult> results;
+		results.resize(1);
+		DiffResult & result = results[0];
+
+		nv::Image image0, image1;
+		if (!loadImage(image0, input0.str())) return 0;
+		if (!loadImage(image1, input1.str())) return 0;
+
+		const uint w0 = image0.width();
+		const uint h0 = image0.height();
+		const uint w1 = image1.width();
+		const uint h1 = image1.height();
+		const uint w = nv::min(w0, w1);
+		const uint h = nv::min(h0, h1);
+
+		// Compute errors.
+		compareImages(image0, image1, options, result);
+		const bool exceeded = result.status == DiffResult::Status_Exceeded;
+
+		printf("Image size compared: %dx%d\n", w, h);
+		if (w != w0 || w != w1 || h != h0 || h != h1) {
+			printf("--- NOTE: only the overlap between the 2 images (%d,%d) and (%d,%d) was compared\n", w0, h0, w1, h1);
+		}
+		printf("Total pixels: %d\n", w*h);
 
-            error_luma.addSample(l0 - l1);
+		if (result.complete)
+		{
+			printf("Color:\n");
+			result.error.color.print();
 
-            double d = sqrt(r*r + g*g + b*b);
+			printf("Luma:\n");
+			result.error.luma.print();
 
-			if (compareAlpha) {
-                d *= c0.a / 255.0;
+			if (options.compareNormal)
+			{
+				printf("Normal:\n");
+				result.error.normal.print();
 			}
 
-            error_total.addSample(d);
-
-			if (compareNormal) {
-				error_normal.addSample(c0, c1);
+			if (options.compareAlpha)
+			{
+				printf("Alpha:\n");
+				result.error.alpha.print();
 			}
 		}
-	}
 
-	error_r.done();
-	error_g.done();
-	error_b.done();
-	error_a.done();
-    error_luma.done();
-	error_total.done();
-	error_normal.done();
-	
+		if (exceeded)
+		{
+			printf("--- FAILED: the color RMSE exceeds the threshold %f\n", options.threshold);
+		}
 
-	printf("Image size compared: %dx%d\n", w, h);
-	if (w != w0 || w != w1 || h != h0 || h != h1) {
-		printf("--- NOTE: only the overlap between the 2 images (%d,%d) and (%d,%d) was compared\n", w0, h0, w1, h1);
-	}
-	printf("Total pixels: %d\n", w*h);
+		// @@ Write image difference.
 
-	printf("Color:\n");
-	error_total.print();
+		if (jsonFileName != NULL && !writeJson(jsonFileName, inputs0, inputs1, results, options)) return 1;
 
-	printf("Luma:\n");
-	error_luma.print();
+		return exceeded ? 1 : 0;
+	}
 
-	if (compareNormal)
+	nv::Array<nv::Path> inputs0, inputs1;
+	if (listFileName != NULL)
+	{
+		if (!readPairList(listFileName, inputs0, inputs1)) return 1;
+	}
+	else
 	{
-		printf("Normal:\n");
-		error_normal.print();
+		if (!collectPairs(input0.str(), input1.str(), inputs0, inputs1)) return 1;
 	}
 
-	if (compareAlpha)
+	nv::Array<DiffResult> results;
+	results.resize(inputs0.count());
+
+	DiffBatch batch;
+	batch.inputs0 = inputs0.buffer();
+	batch.inputs1 = inputs1.buffer();
+	batch.results = results.buffer();
+	batch.options = &options;
+	batch.stop.storeRelaxed(0);
+
+	nv::ParallelFor parallelFor(DiffTask, &batch);
+	parallelFor.run(inputs0.count());
+
+	uint counts[4] = { 0, 0, 0, 0 };
+	for (uint i = 0; i < results.count(); i++)
 	{
-		printf("Alpha:\n");
-		error_a.print();
+		const DiffResult & r = results[i];
+		counts[r.status]++;
+
+		if (r.status == DiffResult::Status_Exceeded)
+		{
+			if (r.complete) printf("FAILED: '%s' color RMSE %f, PSNR %f\n", inputs1[i].str(), r.error.color.rmse, r.error.color.psnr);
+			else printf("FAILED: '%s' color RMSE exceeds %f\n", inputs1[i].str(), options.threshold);
+		}
 	}
 
-	// @@ Write image difference.
-	
-	return 0;
-}
+	printf("%u pairs compared, %u passed, %u exceeded the threshold, %u errors, %u skipped\n", results.count(),
+		counts[DiffResult::Status_Passed], counts[DiffResult::Status_Exceeded], counts[DiffResult::Status_Error], counts[DiffResult::Status_Skipped]);
+
+	if (jsonFileName != NULL && !writeJson(jsonFileName, inputs0, inputs1, results, options)) return 1;
 
+	return (counts[DiffResult::Status_Passed] == results.count()) ? 0 : 1;
+}
@@ -0,0 +1,718 @@
+// Copyright NVIDIA Corporation 2007 -- Ignacio Castano <icastano@nvidia.com>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+// nvtt-server keeps a compression context alive between jobs, so that build systems don't pay for process startup,
+// table initialization and thread pool creation on every texture. Recently compressed outputs are cached in memory.
+//
+// Requests and responses are single lines of text, read from stdin and written to stdout, or exchanged over a unix
+// domain socket. A request has the same arguments as nvcompress:
+//
+//     [options] input [output]
+//
+// Relative paths are relative to the working directory of the server. The output ":shm" returns the compressed data
+// in a POSIX shared memory object instead of writing a file. Responses are:
+//
+//     OK <size> <output>       The output file was written.
+//     OK <size> shm:<name>     The data is in the shared memory object <name>, the client must unlink it.
+//     UPTODATE <output>        The request has -update and the output is newer than the input.
+//     ERROR <message>
+//
+// The "ping", "stats" and "quit" requests are also recognized. Jobs are processed one at a time, each one runs on all
+// the threads of the context.
+
+#include "cmdline.h"
+#include "compressoptions.h"
+
+#include <nvtt/nvtt.h>
+
+#include <nvcore/Ptr.h> // AutoPtr
+#include <nvcore/StrLib.h> // Path
+#include <nvcore/StdStream.h>
+#include <nvcore/FileSystem.h>
+#include <nvcore/Timer.h>
+#include <nvcore/Array.inl>
+
+#include <nvthread/nvthread.h> // parseProcessorList
+
+#include <string.h> // strcmp
+
+#if NV_OS_UNIX
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h> // shm_open
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#endif
+
+
+struct ServerErrorHandler : public nvtt::ErrorHandler
+{
+    ServerErrorHandler() : failed(false), lastError(nvtt::Error_Unknown) {}
+
+    virtual void error(nvtt::Error e)
+    {
+        failed = true;
+        lastError = e;
+    }
+
+    bool failed;
+    nvtt::Error lastError;
+};
+
+// Compressed outputs, keyed by the request options, the input path, its modification time and its size.
+struct CacheEntry
+{
+    nv::String key;
+    nv::Array<uint8> data;
+};
+
+struct Server
+{
+    Server() : context(NULL), cacheSize(0), cacheBudget(0), requestCount(0), hitCount(0), errorCount(0), busyTime(0), shmCount(0), quit(false) {}
+
+    nvtt::Context * context;
+
+    nv::Array<CacheEntry *> cache;  // Least recently used first.
+    uint64 cacheSize;
+    uint64 cacheBudget;
+
+    uint requestCount;
+    uint hitCount;
+    uint errorCount;
+    float busyTime;
+
+    uint shmCount;
+    bool quit;
+};
+
+
+#if NV_OS_UNIX
+
+// Copy data to a new shared memory object. Returns false on failure.
+static bool writeSharedMemory(const char * name, const uint8 * data, uint size)
+{
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) return false;
+
+    bool success = false;
+    if (ftruncate(fd, size) == 0)
+    {
+        if (size == 0)
+        {
+            success = true;
+        }
+        else
+        {
+            void * ptr = mmap(NULL, size, PROT_WRITE, MAP_SHARED, fd, 0);
+            if (ptr != MAP_FAILED)
+            {
+                memcpy(ptr, data, size);
+                munmap(ptr, size);
+                success = true;
+            }
+        }
+    }
+
+    close(fd);
+
+    if (!success) shm_unlink(name);
+    return success;
+}
+
+// Copy a shared memory object to a stream and unlink it.
+static bool readSharedMemory(const char * name, uint size, FILE * out)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return false;
+
+    bool success = (size == 0);
+    if (size != 0)
+    {
+        void * ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (ptr != MAP_FAILED)
+        {
+            success = fwrite(ptr, 1, size, out) == size;
+            munmap(ptr, size);
+        }
+    }
+
+    close(fd);
+    shm_unlink(name);
+    return success;
+}
+
+#endif // NV_OS_UNIX
+
+
+// Hits are moved to the back, so that the least recently used entries are evicted first.
+static const CacheEntry * findCacheEntry(Server & server, const char * key)
+{
+    for (uint i = 0; i < server.cache.count(); i++)
+    {
+        CacheEntry * entry = server.cache[i];
+        if (strcmp(entry->key.str(), key) == 0)
+        {
+            server.cache.removeAt(i);
+            server.cache.append(entry);
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Move data into a new cache entry. Returns NULL if the data doesn't fit in the cache.
+static const CacheEntry * addCacheEntry(Server & server, const char * key, nv::Array<uint8> & data)
+{
+    if (uint64(data.count()) > server.cacheBudget) return NULL;
+
+    // Evict the least recently used entries.
+    while (server.cacheSize + data.count() > server.cacheBudget)
+    {
+        server.cacheSize -= server.cache[0]->data.count();
+        delete server.cache[0];
+        server.cache.removeAt(0);
+    }
+
+    CacheEntry * entry = new CacheEntry;
+    entry->key = key;
+    swap(entry->data, data);
+
+    server.cache.append(entry);
+    server.cacheSize += entry->data.count();
+
+    return entry;
+}
+
+static void handleRequest(Server & server, char * line, nv::StringBuilder & response)
+{
+    char * argv[64];
+    const int argc = splitArguments(line, argv, 64);
+
+    if (argc == 0)
+    {
+        response.format("ERROR empty request");
+        return;
+    }
+
+    if (strcmp(argv[0], "ping") == 0)
+    {
+        response.format("OK");
+        return;
+    }
+    if (strcmp(argv[0], "quit") == 0)
+    {
+        server.quit = true;
+        response.format("OK");
+        return;
+    }
+    if (strcmp(argv[0], "stats") == 0)
+    {
+        response.format("OK requests=%u hits=%u errors=%u busy=%.3f cached=%u cachebytes=%llu",
+            server.requestCount, server.hitCount, server.errorCount, server.busyTime, server.cache.count(), (unsigned long long)server.cacheSize);
+        return;
+    }
+
+    server.requestCount++;
+
+    Options options;
+    nv::Path input;
+    nv::Path output;
+    nv::StringBuilder key;
+
+    for (int i = 0; i < argc; i++)
+    {
+        const int first = i;
+        if (parseOption(options, argc, argv, i))
+        {
+            for (int j = first; j <= i; j++) key.appendFormat("%s ", argv[j]);
+        }
+        else if (argv[i][0] != '-')
+        {
+            if (input.isNull()) input = argv[i];
+            else if (output.isNull()) output = argv[i];
+            else
+            {
+                server.errorCount++;
+                response.format("ERROR unexpected argument \"%s\"", argv[i]);
+                return;
+            }
+        }
+        else
+        {
+            server.errorCount++;
+            response.format("ERROR unrecognized option \"%s\"", argv[i]);
+            return;
+        }
+    }
+
+    if (input.isNull())
+    {
+        server.errorCount++;
+        response.format("ERROR missing input file");
+        return;
+    }
+
+    if (output.isNull())
+    {
+        outputFileName(input.str(), NULL, output);
+    }
+
+    const bool toSharedMemory = strcmp(output.str(), ":shm") == 0;
+
+    uint64 inputTime, inputSize;
+    if (!nv::FileSystem::fileStamp(input.str(), &inputTime, &inputSize) || !nv::FileSystem::exists(input.str()))
+    {
+        server.errorCount++;
+        response.format("ERROR the file '%s' does not exist", input.str());
+        return;
+    }
+
+    if (options.update && !toSharedMemory && isUpToDate(input.str(), output.str()))
+    {
+        response.format("UPTODATE %s", output.str());
+        return;
+    }
+
+    key.appendFormat("%s@%llu:%llu", input.str(), (unsigned long long)inputTime, (unsigned long long)inputSize);
+
+    nv::Timer timer;
+    timer.start();
+
+    const nv::Array<uint8> * data = NULL;
+    MemoryOutputHandler outputHandler;
+
+    const CacheEntry * entry = findCacheEntry(server, key.str());
+    if (entry != NULL)
+    {
+        server.hitCount++;
+        data = &entry->data;
+    }
+    else
+    {
+        nvtt::InputOptions inputOptions;
+        if (!loadInput(options, input.str(), inputOptions))
+        {
+            server.errorCount++;
+            response.format("ERROR can't load '%s'", input.str());
+            return;
+        }
+
+        nvtt::CompressionOptions compressionOptions;
+        setCompressionOptions(options, compressionOptions);
+
+        ServerErrorHandler errorHandler;
+
+        nvtt::OutputOptions outputOptions;
+        outputOptions.setOutputHandler(&outputHandler);
+        outputOptions.setErrorHandler(&errorHandler);
+        setContainer(options, outputOptions);
+
+        if (!server.context->process(inputOptions, compressionOptions, outputOptions) || errorHandler.failed)
+        {
+            server.errorCount++;
+            response.format("ERROR %s", nvtt::errorString(errorHandler.lastError));
+            return;
+        }
+
+        data = &outputHandler.buffer;
+
+        if (const CacheEntry * added = addCacheEntry(server, key.str(), outputHandler.buffer))
+        {
+            data = &added->data;
+        }
+    }
+
+    if (toSharedMemory)
+    {
+#if NV_OS_UNIX
+        nv::StringBuilder name;
+        name.format("/nvtt-%d-%u", int(getpid()), server.shmCount++);
+
+        if (!writeSharedMemory(name.str(), data->buffer(), data->count()))
+        {
+            server.errorCount++;
+            response.format("ERROR can't create shared memory object '%s'", name.str());
+            return;
+        }
+
+        response.format("OK %u shm:%s", data->count(), name.str());
+#else
+        server.errorCount++;
+        response.format("ERROR shared memory is not supported on this platform");
+        return;
+#endif
+    }
+    else
+    {
+        nv::StdOutputStream stream(output.str());
+        if (!stream.isError())
+        {
+            stream.serialize(const_cast<uint8 *>(data->buffer()), data->count());
+        }
+
+        if (stream.isError())
+        {
+            server.errorCount++;
+            response.format("ERROR can't write '%s'", output.str());
+            return;
+        }
+
+        response.format("OK %u %s", data->count(), output.str());
+    }
+
+    timer.stop();
+    server.busyTime += timer.elapsed();
+}
+
+// Process requests until the input is closed or a quit request arrives.
+static void serve(Server & server, FILE * in, FILE * out)
+{
+    char line[16 * 1024];
+    nv::StringBuilder response;
+
+    while (!server.quit && fgets(line, sizeof(line), in) != NULL)
+    {
+        if (strchr(line, '\n') == NULL && !feof(in))
+        {
+            // Discard the rest of the line.
+            int c;
+            while ((c = fgetc(in)) != EOF && c != '\n') {}
+            response.format("ERROR request too long");
+        }
+        else
+        {
+            handleRequest(server, line, response);
+        }
+
+        fprintf(out, "%s\n", response.str());
+        fflush(out);
+    }
+}
+
+
+#if NV_OS_UNIX
+
+static int runSocketServer(Server & server, const char * path)
+{
+    // Clients that go away shouldn't take the server down.
+    signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        fprintf(stderr, "Can't create socket.\n");
+        return EXIT_FAILURE;
+    }
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "Socket path '%s' is too long.\n", path);
+        close(listener);
+        return EXIT_FAILURE;
+    }
+    strcpy(address.sun_path, path);
+
+    // Remove the socket of a previous run.
+    unlink(path);
+
+    if (bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 64) != 0)
+    {
+        fprintf(stderr, "Can't listen on '%s'.\n", path);
+        close(listener);
+        return EXIT_FAILURE;
+    }
+
+    while (!server.quit)
+    {
+        int connection = accept(listener, NULL, NULL);
+        if (connection < 0) continue;
+
+        FILE * in = fdopen(connection, "r");
+        FILE * out = fdopen(dup(connection), "w");
+        if (in != NULL && out != NULL)
+        {
+            serve(server, in, out);
+        }
+
+        if (in != NULL) fclose(in); else close(connection);
+        if (out != NULL) fclose(out);
+    }
+
+    close(listener);
+    unlink(path);
+
+    return EXIT_SUCCESS;
+}
+
+// Make a path absolute, since the server may run in a different directory.
+static void absolutePath(const char * path, nv::StringBuilder & result)
+{
+    if (path[0] == '/' || path[0] == ':')
+    {
+        result.copy(path);
+        return;
+    }
+
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+    {
+        result.copy(path);
+        return;
+    }
+
+    result.format("%s/%s", cwd, path);
+}
+
+// Send a single request to a server and wait for the response. Shared memory outputs are written to stdout.
+static int runClient(const char * path, int argc, char * argv[])
+{
+    nv::StringBuilder request;
+    request.reserve(1024);
+
+    Options options;
+    for (int i = 0; i < argc; i++)
+    {
+        const int first = i;
+        nv::StringBuilder argument;
+
+        if (argv[i][0] != '-')
+        {
+            absolutePath(argv[i], argument);
+            request.appendFormat("\"%s\" ", argument.str());
+        }
+        else
+        {
+            parseOption(options, argc, argv, i);
+            for (int j = first; j <= i; j++) request.appendFormat("\"%s\" ", argv[j]);
+        }
+    }
+
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0)
+    {
+        fprintf(stderr, "Can't create socket.\n");
+        return EXIT_FAILURE;
+    }
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    if (connect(connection, (sockaddr *)&address, sizeof(address)) != 0)
+    {
+        fprintf(stderr, "Can't connect to '%s'.\n", path);
+        close(connection);
+        return EXIT_FAILURE;
+    }
+
+    FILE * in = fdopen(connection, "r");
+    FILE * out = fdopen(dup(connection), "w");
+
+    fprintf(out, "%s\n", request.str());
+    fclose(out);
+
+    char response[4096];
+    if (fgets(response, sizeof(response), in) == NULL)
+    {
+        fprintf(stderr, "No response from '%s'.\n", path);
+        fclose(in);
+        return EXIT_FAILURE;
+    }
+    fclose(in);
+
+    uint size;
+    char name[1024];
+    if (sscanf(response, "OK %u shm:%1023s", &size, name) == 2)
+    {
+        return readSharedMemory(name, size, stdout) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    fputs(response, stderr);
+    return (strncmp(response, "OK", 2) == 0 || strncmp(response, "UPTODATE", 8) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif // NV_OS_UNIX
+
+
+int main(int argc, char *argv[])
+{
+    MyAssertHandler assertHandler;
+    MyMessageHandler messageHandler;
+
+    bool nocuda = false;
+    int threadCount = 0;
+    uint affinity[1024];
+    uint affinityCount = 0;
+    int numaNode = -1;
+    int cacheMegabytes = 256;
+
+    const char * socketPath = NULL;
+    bool silent = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp("-nocuda", argv[i]) == 0)
+        {
+            nocuda = true;
+        }
+        else if (strcmp("-threads", argv[i]) == 0)
+        {
+            if (i+1 == argc) break;
+            i++;
+
+            threadCount = atoi(argv[i]);
+        }
+        else if (strcmp("-affinity", argv[i]) == 0)
+        {
+            if (i+1 == argc) break;
+            i++;
+
+            affinityCount = nv::parseProcessorList(argv[i], affinity, 1024);
+            if (affinityCount == 0) {
+                fprintf(stderr, "Invalid processor list '%s'\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp("-numa", argv[i]) == 0)
+        {
+            if (i+1 == argc) break;
+            i++;
+
+            numaNode = atoi(argv[i]);
+        }
+        else if (strcmp("-cache", argv[i]) == 0)
+        {
+            if (i+1 == argc) break;
+            i++;
+
+            cacheMegabytes = atoi(argv[i]);
+        }
+        else if (strcmp("-socket", argv[i]) == 0)
+        {
+            if (i+1 == argc) break;
+            i++;
+
+            socketPath = argv[i];
+        }
+        else if (strcmp("-connect", argv[i]) == 0)
+        {
+            if (i+1 == argc) break;
+
+#if NV_OS_UNIX
+            // The remaining arguments are the request.
+            return runClient(argv[i+1], argc - i - 2, argv + i + 2);
+#else
+            fprintf(stderr, "Sockets are not supported on this platform.\n");
+            return EXIT_FAILURE;
+#endif
+        }
+        else if (strcmp("-silent", argv[i]) == 0)
+        {
+            silent = true;
+        }
+        else
+        {
+            printf("usage: nvtt-server [options]\n");
+            printf("       nvtt-server -connect <socket> [nvcompress options] infile [outfile.dds|:shm]\n\n");
+
+            printf("Server options:\n");
+            printf("  -socket <path>   \tListen on a unix domain socket instead of stdin/stdout.\n");
+            printf("  -cache <MB>      \tMemory used to cache compressed outputs, 0 disables the cache (default 256).\n");
+            printf("  -nocuda          \tDo not use cuda compressor.\n");
+            printf("  -threads <n>     \tNumber of compressor threads, 1 disables threading.\n");
+            printf("  -affinity <list> \tPin compressor threads to these processors, for example: 0-7,16-23\n");
+            printf("  -numa <node>     \tKeep threads and their memory on a NUMA node.\n");
+            printf("  -silent          \tDo not print status messages to stderr.\n\n");
+
+            printf("Requests take the same arguments as nvcompress, one request per line.\n");
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (numaNode >= 0)
+    {
+        uint processors[1024];
+        uint processorCount = nv::numaNodeProcessors(numaNode, processors, 1024);
+        if (processorCount == 0 || !nv::setThreadAffinity(processors, processorCount) || !nv::setThreadNumaNode(numaNode))
+        {
+            fprintf(stderr, "Warning: could not bind to NUMA node %d\n", numaNode);
+        }
+    }
+
+    nvtt::Context context;
+    context.enableCudaAcceleration(!nocuda);
+
+    if (threadCount != 0) context.setThreadCount(threadCount);
+    if (affinityCount != 0)
+    {
+        int processors[1024];
+        for (uint i = 0; i < affinityCount; i++) processors[i] = int(affinity[i]);
+        context.setThreadAffinity(processors, int(affinityCount));
+    }
+    if (numaNode >= 0) context.setNumaNode(numaNode);
+
+    Server server;
+    server.context = &context;
+    server.cacheBudget = uint64(nv::max(0, cacheMegabytes)) * 1024 * 1024;
+
+    if (!silent)
+    {
+        fprintf(stderr, "nvtt-server ready, %d threads, CUDA acceleration %s.\n", context.threadCount(), context.isCudaAccelerationEnabled() ? "enabled" : "disabled");
+    }
+
+    int result = EXIT_SUCCESS;
+
+    if (socketPath != NULL)
+    {
+#if NV_OS_UNIX
+        result = runSocketServer(server, socketPath);
+#else
+        fprintf(stderr, "Sockets are not supported on this platform.\n");
+        result = EXIT_FAILURE;
+#endif
+    }
+    else
+    {
+        serve(server, stdin, stdout);
+    }
+
+    for (uint i = 0; i < server.cache.count(); i++)
+    {
+        delete server.cache[i];
+    }
+
+    if (!silent)
+    {
+        fprintf(stderr, "nvtt-server done, %u requests, %u cache hits, %u errors.\n", server.requestCount, server.hitCount, server.errorCount);
+    }
+
+    return result;
+}
@@ -24,42 +24,110 @@
 #include <nvcore/Ptr.h>
 #include <nvcore/StrLib.h>
 #include <nvcore/StdStream.h>
+#include <nvcore/FileSystem.h>
 #include <nvcore/Array.inl>
 
 #include <nvimage/Image.h>
 #include <nvimage/ImageIO.h>
-#include <nvimage/FloatImage.h>
-#include <nvimage/Filter.h>
-#include <nvimage/DirectDrawSurface.h>
 
-#include <nvmath/Color.h>
-#include <nvmath/Vector.h>
+#include <nvthread/ParallelFor.h>
 
-#include <math.h>
+#include <string.h> // strpbrk
 
 #include "cmdline.h"
 
-static bool loadImage(nv::Image & image, const char * fileName)
+static bool writeThumbnail(const char * input, const char * output, uint size, float gamma)
 {
-    if (nv::strCaseDiff(nv::Path::extension(fileName), ".dds") == 0)
+    uint width, height;
+    nv::AutoPtr<nv::Image> image(nv::ImageIO::loadThumbnail(input, size, gamma, &width, &height));
+    if (image == NULL)
     {
-        nv::DirectDrawSurface dds(fileName);
-        if (!dds.isValid())
-        {
-            fprintf(stderr, "The file '%s' is not a valid DDS file.\n", fileName);
-            return false;
-        }
+        fprintf(stderr, "The file '%s' is not a supported image type.\n", input);
+        return false;
+    }
 
-        dds.mipmap(&image, 0, 0); // get first image
+    nv::StringBuilder widthString;
+    widthString.number(width);
+    nv::StringBuilder heightString;
+    heightString.number(height);
+
+    nv::Array<const char *> metaData;
+    metaData.append("Thumb::Image::Width");
+    metaData.append(widthString.str());
+    metaData.append("Thumb::Image::Height");
+    metaData.append(heightString.str());
+    metaData.append(NULL);
+    metaData.append(NULL);
+
+    nv::StdOutputStream stream(output);
+    if (stream.isError() || !nv::ImageIO::save(output, stream, image.ptr(), metaData.buffer()))
+    {
+        fprintf(stderr, "Error writing '%s'.\n", output);
+        return false;
     }
-    else
+
+    return true;
+}
+
+
+// Batch mode thumbnails each file in a task of its own.
+struct ThumbnailBatch
+{
+    const nv::Path * inputs;
+    const nv::Path * outputs;
+    bool * results;
+    uint size;
+    float gamma;
+};
+
+static void ThumbnailTask(void * context, int id)
+{
+    ThumbnailBatch * batch = (ThumbnailBatch *)context;
+    batch->results[id] = writeThumbnail(batch->inputs[id].str(), batch->outputs[id].str(), batch->size, batch->gamma);
+}
+
+// Files of a directory that are likely to be images, or the files that match a pattern.
+static bool collectFiles(const char * pattern, nv::Array<nv::Path> & files)
+{
+    nv::Path directory(pattern);
+    const char * filePattern = "*";
+
+    const bool isDirectory = nv::FileSystem::isDirectory(pattern);
+    if (!isDirectory)
+    {
+        directory.stripFileName();
+        if (directory.length() == 0) directory.copy(".");
+        filePattern = nv::Path::fileName(pattern);
+    }
+
+    nv::Array<nv::Path> names;
+    if (!nv::FileSystem::listDirectory(directory.str(), names))
+    {
+        fprintf(stderr, "Can't read directory '%s'.\n", directory.str());
+        return false;
+    }
+
+    static const char * const imageExtensions[] = { ".dds", ".png", ".jpg", ".jpeg", ".tga", ".bmp", ".psd", ".tif", ".tiff" };
+
+    for (uint i = 0; i < names.count(); i++)
     {
-        // Regular image.
-        if (!image.load(fileName))
+        const char * name = names[i].str();
+        if (!nv::strMatch(name, filePattern)) continue;
+
+        if (isDirectory)
         {
-                fprintf(stderr, "The file '%s' is not a supported image type.\n", fileName);
-                return false;
+            bool isImage = false;
+            for (uint e = 0; e < sizeof(imageExtensions) / sizeof(imageExtensions[0]); e++)
+            {
+                if (nv::strCaseDiff(nv::Path::extension(name), imageExtensions[e]) == 0) isImage = true;
+            }
+            if (!isImage) continue;
         }
+
+        nv::Path path(directory.str());
+        path.appendSeparator();
+        path.append(name);
+        files.append(path);
     }
 
     return true;
@@ -75,6 +143,7 @@ int main(int argc, char *argv[])
     nv::Path input;
     nv::Path output;
     uint size = 128;
+    const char * extension = "png";
 
     // Parse arguments.
     for (int i = 1; i < argc; i++)
@@ -87,6 +156,13 @@ int main(int argc, char *argv[])
                 i++;
             }
         }
+        else if (strcmp("-ext", argv[i]) == 0)
+        {
+            if (i+1 < argc && argv[i+1][0] != '-') {
+                extension = argv[i+1];
+                i++;
+            }
+        }
         else if (argv[i][0] != '-')
         {
             input = argv[i];
@@ -103,7 +179,7 @@ int main(int argc, char *argv[])
 	}
     }
 
-    if (input.isNull() || output.isNull())
+    if (input.isNull() || output.isNull() || size == 0)
     {
         printf("NVIDIA Texture Tools - Copyright NVIDIA Corporation 2007\n\n");
 
@@ -111,56 +187,62 @@ int main(int argc, char *argv[])
 
         printf("Options:\n");
         printf("  -s size\tThumbnail size (default = 128)\n");
+        printf("  -ext ext\tExtension of the thumbnails in batch mode (default = png)\n\n");
+
+        printf("Batch mode:\n");
+        printf("  Directories and quoted patterns such as \"textures/*.dds\" thumbnail all the matching files\n");
+        printf("  in parallel. The output is the directory of the thumbnails, named after the input files.\n");
 
         return 1;
     }
 
-    nv::Image image;
-    if (!loadImage(image, input.str())) return 1;
+    const bool batchMode = nv::FileSystem::isDirectory(input.str()) || strpbrk(input.str(), "*?[") != NULL;
 
-    nv::StringBuilder widthString;
-    widthString.number(image.width());
-    nv::StringBuilder heightString;
-    heightString.number(image.height());
+    if (!batchMode)
+    {
+        return writeThumbnail(input.str(), output.str(), size, gamma) ? 0 : 1;
+    }
 
-    nv::Array<const char *> metaData;
-    metaData.append("Thumb::Image::Width");
-    metaData.append(widthString.str());
-    metaData.append("Thumb::Image::Height");
-    metaData.append(heightString.str());
-    metaData.append(NULL);
-    metaData.append(NULL);
+    nv::Array<nv::Path> inputs;
+    if (!collectFiles(input.str(), inputs)) return 1;
 
-    if ((image.width() > size) || (image.height() > size))
+    if (!nv::FileSystem::isDirectory(output.str()) && !nv::FileSystem::createDirectory(output.str()))
     {
-        nv::FloatImage fimage(&image);
-        fimage.toLinear(0, 3, gamma);
-
-	uint thumbW, thumbH;
-	if (image.width() > image.height())
-	{
-	    thumbW = size;
-	    thumbH = uint ((float (image.height()) / float (image.width())) * size);
-	}
-	else
-	{
-	    thumbW = uint ((float (image.width()) / float (image.height())) * size);
-	    thumbH = size;
-	}
-	nv::AutoPtr<nv::FloatImage> fresult(fimage.resize(nv::BoxFilter(), thumbW, thumbH, nv::FloatImage::WrapMode_Clamp));
-
-	nv::AutoPtr<nv::Image> result(fresult->createImageGammaCorrect(gamma));
-	result->setFormat(nv::Image::Format_ARGB);
+        fprintf(stderr, "Can't create directory '%s'.\n", output.str());
+        return 1;
+    }
 
-        nv::StdOutputStream stream(output.str());
-        nv::ImageIO::save(output.str(), stream, result.ptr(), metaData.buffer());
+    nv::Array<nv::Path> outputs;
+    for (uint i = 0; i < inputs.count(); i++)
+    {
+        nv::Path path(output.str());
+        path.appendSeparator();
+        path.append(nv::Path::fileName(inputs[i].str()));   // Keep the input extension, names would collide otherwise.
+        path.append(".");
+        path.append(extension);
+        outputs.append(path);
     }
-    else
+
+    nv::Array<bool> results;
+    results.resize(inputs.count(), false);
+
+    ThumbnailBatch batch;
+    batch.inputs = inputs.buffer();
+    batch.outputs = outputs.buffer();
+    batch.results = results.buffer();
+    batch.size = size;
+    batch.gamma = gamma;
+
+    nv::ParallelFor parallelFor(ThumbnailTask, &batch);
+    parallelFor.run(inputs.count());
+
+    uint failedCount = 0;
+    for (uint i = 0; i < results.count(); i++)
     {
-        nv::StdOutputStream stream(output.str());
-        nv::ImageIO::save(output.str(), stream, &image, metaData.buffer());
+        if (!results[i]) failedCount++;
     }
-	
-    return 0;
-}
 
+    printf("%u thumbnails written, %u failed\n", inputs.count() - failedCount, failedCount);
+
+    return failedCount == 0 ? 0 : 1;
+}